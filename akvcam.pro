@@ -27,6 +27,7 @@ lupdate_only {
         src/buffer.h \
         src/buffers.h \
         src/buffers_types.h \
+        src/color_table.h \
         src/controls.h \
         src/controls_types.h \
         src/device.h \
@@ -38,6 +39,9 @@ lupdate_only {
         src/format.h \
         src/format_types.h \
         src/frame.h \
+        src/frame_pool.h \
+        src/frame_simd.h \
+        src/frame_simd_kernels.h \
         src/frame_types.h \
         src/global_deleter.h \
         src/ioctl.h \
@@ -48,14 +52,17 @@ lupdate_only {
         src/node.h \
         src/node_types.h \
         src/rbuffer.h \
+        src/scaler.h \
         src/settings.h \
-        src/utils.h
+        src/utils.h \
+        src/yuv_matrix.h
 
     SOURCES += \
         src/attributes.c \
         src/module.c \
         src/buffer.c \
         src/buffers.c \
+        src/color_table.c \
         src/controls.c \
         src/device.c \
         src/driver.c \
@@ -63,6 +70,10 @@ lupdate_only {
         src/file_read.c \
         src/format.c \
         src/frame.c \
+        src/frame_avx2.c \
+        src/frame_pool.c \
+        src/frame_simd.c \
+        src/frame_sse2.c \
         src/global_deleter.c \
         src/ioctl.c \
         src/list.c \
@@ -70,8 +81,10 @@ lupdate_only {
         src/map.c \
         src/node.c \
         src/rbuffer.c \
+        src/scaler.c \
         src/settings.c \
-        src/utils.c
+        src/utils.c \
+        src/yuv_matrix.c
 }
 
 KERNEL_RELEASE = $$system(uname -r)
@@ -96,8 +109,17 @@ DEFINES += \
     KBUILD_MODNAME=\"\\\"\\\"\"
 
 OTHER_FILES += \
+    src/benchmark/benchmark.c \
+    src/benchmark/Makefile \
+    src/benchmark/shim/shim.h \
+    src/benchmark/shim/stubs.c \
     src/dkms.conf \
     src/Makefile \
+    src/tests/containers_test.c \
+    src/tests/list.c \
+    src/tests/map.c \
+    src/tests/rbuffer.c \
+    src/tests/utils.c \
     share/config_example.ini
 
 DUMMY_FILES = .
@@ -221,9 +221,27 @@ static ssize_t akvcam_attributes_device_modes_show(struct device *dev,
         space_left -= (size_t) bytes_written;
     }
 
+    if (mode & AKVCAM_RW_MODE_DMABUF) {
+        bytes_written = snprintf(buffer, space_left, "dmabuf\n");
+        buffer += bytes_written;
+        space_left -= (size_t) bytes_written;
+    }
+
     return (ssize_t) (PAGE_SIZE - space_left);
 }
 
+static ssize_t akvcam_attributes_frame_allocations_show(struct device *dev,
+                                                        struct device_attribute *attribute,
+                                                        char *buffer)
+{
+    struct video_device *vdev = to_video_device(dev);
+    akvcam_device_t device = video_get_drvdata(vdev);
+
+    UNUSED(attribute);
+    memset(buffer, 0, PAGE_SIZE);
+
+    return sprintf(buffer, "%zu\n", akvcam_device_frame_allocations(device));
+}
 
 static ssize_t akvcam_attributes_int_show(struct device *dev,
                                           struct device_attribute *attribute,
@@ -354,6 +372,10 @@ static DEVICE_ATTR(modes,
                    S_IRUGO,
                    akvcam_attributes_device_modes_show,
                    NULL);
+static DEVICE_ATTR(frame_allocations,
+                   S_IRUGO,
+                   akvcam_attributes_frame_allocations_show,
+                   NULL);
 static DEVICE_ATTR(brightness,
                    S_IRUGO | S_IWUSR,
                    akvcam_attributes_int_show,
@@ -405,6 +427,7 @@ static struct attribute	*akvcam_attributes_capture[] = {
     &dev_attr_connected_devices.attr,
     &dev_attr_broadcasters.attr,
     &dev_attr_modes.attr,
+    &dev_attr_frame_allocations.attr,
     &dev_attr_brightness.attr,
     &dev_attr_contrast.attr,
     &dev_attr_saturation.attr,
@@ -432,6 +455,7 @@ static struct attribute	*akvcam_attributes_output[] = {
     &dev_attr_connected_devices.attr,
     &dev_attr_listeners.attr,
     &dev_attr_modes.attr,
+    &dev_attr_frame_allocations.attr,
     &dev_attr_hflip.attr,
     &dev_attr_vflip.attr,
     &dev_attr_aspect_ratio.attr,
@@ -0,0 +1,515 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Userspace benchmark for the frame conversion, scaling and adjusting code.
+//
+// Every case runs until it has taken at least the minimum time, and the
+// fastest run is reported. ns/pixel and MB/s are relative to the source
+// frame, so the numbers of different output sizes can be compared.
+//
+// Usage: akvcam_benchmark [-t msecs] [-r resolution] [-g group]
+
+#include <getopt.h>
+#include <time.h>
+
+// The convert table and the line conversions are private to frame.c.
+#include "frame.c"
+
+#define AKVCAM_BENCHMARK_MIN_RUNS 3
+
+typedef struct
+{
+    const char *name;
+    size_t width;
+    size_t height;
+
+    // Size of the scaling target, same height but the other aspect ratio.
+    size_t scaled_width;
+} akvcam_benchmark_resolution, *akvcam_benchmark_resolution_t;
+
+typedef struct
+{
+    const char *name;
+    int hue;
+    int saturation;
+    int luminance;
+    int contrast;
+    int gamma;
+    bool gray;
+} akvcam_benchmark_adjust, *akvcam_benchmark_adjust_t;
+
+typedef void (*akvcam_benchmark_run_t)(void *user_data);
+
+typedef struct
+{
+    akvcam_frame_t src;
+    akvcam_frame_t dst;
+    akvcam_line_convert_function_t line_convert;
+    akvcam_planar_convert_function_t planar_convert;
+    akvcam_line_convert_function_t simd_convert;
+    size_t width;
+    size_t height;
+    AKVCAM_SCALING scaling;
+    AKVCAM_ASPECT_RATIO aspect_ratio;
+    akvcam_benchmark_adjust_t adjust;
+    akvcam_frame_adjusts process_adjusts;
+} akvcam_benchmark_case, *akvcam_benchmark_case_t;
+
+static akvcam_benchmark_resolution akvcam_benchmark_resolutions[] = {
+    {"480p" ,  640,  480,  852},
+    {"720p" , 1280,  720,  960},
+    {"1080p", 1920, 1080, 1440},
+    {"4K"   , 3840, 2160, 2880},
+    {NULL   ,    0,    0,    0},
+};
+
+static akvcam_benchmark_adjust akvcam_benchmark_adjusts[] = {
+    {"hsl"     , 45, 25, 10,  0,  0, false},
+    {"contrast",  0,  0,  0, 30,  0, false},
+    {"gamma"   ,  0,  0,  0,  0, 30, false},
+    {"gray"    ,  0,  0,  0,  0,  0, true },
+    {"all"     , 45, 25, 10, 30, 30, true },
+    {NULL      ,  0,  0,  0,  0,  0, false},
+};
+
+static struct
+{
+    double min_time;
+    const char *resolution;
+    const char *group;
+} akvcam_benchmark_options = {0.25, NULL, NULL};
+
+static double akvcam_benchmark_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static double akvcam_benchmark_time(akvcam_benchmark_run_t setup,
+                                    akvcam_benchmark_run_t run,
+                                    void *user_data)
+{
+    double best = -1;
+    double total = 0;
+    double start;
+    double elapsed;
+    size_t runs;
+
+    for (runs = 0;
+         runs < AKVCAM_BENCHMARK_MIN_RUNS
+         || total < akvcam_benchmark_options.min_time;
+         runs++) {
+        if (setup)
+            setup(user_data);
+
+        start = akvcam_benchmark_now();
+        run(user_data);
+        elapsed = akvcam_benchmark_now() - start;
+        total += elapsed;
+
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    return best;
+}
+
+static void akvcam_benchmark_report(const char *group,
+                                    const char *name,
+                                    akvcam_benchmark_resolution_t resolution,
+                                    akvcam_frame_t src,
+                                    double seconds)
+{
+    size_t pixels = resolution->width * resolution->height;
+
+    printf("%-8s %-32s %-6s %10.3f ns/pixel %10.1f MB/s\n",
+           group,
+           name,
+           resolution->name,
+           1e9 * seconds / (double) pixels,
+           (double) akvcam_frame_size(src) / seconds / 1e6);
+    fflush(stdout);
+}
+
+static bool akvcam_benchmark_selected(const char *group,
+                                      akvcam_benchmark_resolution_t resolution)
+{
+    if (akvcam_benchmark_options.group
+        && strcasecmp(akvcam_benchmark_options.group, group) != 0)
+        return false;
+
+    if (akvcam_benchmark_options.resolution
+        && strcasecmp(akvcam_benchmark_options.resolution,
+                      resolution->name) != 0)
+        return false;
+
+    return true;
+}
+
+static akvcam_frame_t akvcam_benchmark_frame(__u32 fourcc,
+                                             size_t width,
+                                             size_t height,
+                                             akvcam_frame_pool_t pool)
+{
+    akvcam_format_t format = akvcam_format_new(fourcc, width, height, NULL);
+    akvcam_frame_t frame = akvcam_frame_new_pooled(pool, format);
+    akvcam_format_delete(format);
+    akvcam_frame_pattern(frame, AKVCAM_PATTERN_GRADIENT);
+
+    return frame;
+}
+
+static void akvcam_benchmark_convert_run(void *user_data)
+{
+    akvcam_benchmark_case_t bcase = user_data;
+
+    if (bcase->line_convert)
+        akvcam_frame_convert_lines(bcase->dst,
+                                   bcase->src,
+                                   bcase->line_convert,
+                                   false);
+    else
+        akvcam_frame_convert_planar_lines(bcase->dst,
+                                          bcase->src,
+                                          bcase->planar_convert);
+}
+
+static void akvcam_benchmark_simd_convert_run(void *user_data)
+{
+    akvcam_benchmark_case_t bcase = user_data;
+    akvcam_frame_convert_lines(bcase->dst,
+                               bcase->src,
+                               bcase->simd_convert,
+                               true);
+}
+
+static void akvcam_benchmark_copy_setup(void *user_data)
+{
+    akvcam_benchmark_case_t bcase = user_data;
+    akvcam_frame_copy(bcase->dst, bcase->src);
+}
+
+static void akvcam_benchmark_scaled_run(void *user_data)
+{
+    akvcam_benchmark_case_t bcase = user_data;
+    akvcam_frame_scaled(bcase->dst,
+                        bcase->width,
+                        bcase->height,
+                        bcase->scaling,
+                        bcase->aspect_ratio);
+}
+
+static void akvcam_benchmark_adjust_run(void *user_data)
+{
+    akvcam_benchmark_case_t bcase = user_data;
+    akvcam_frame_adjust(bcase->dst,
+                        bcase->adjust->hue,
+                        bcase->adjust->saturation,
+                        bcase->adjust->luminance,
+                        bcase->adjust->contrast,
+                        bcase->adjust->gamma,
+                        bcase->adjust->gray);
+}
+
+static void akvcam_benchmark_process_run(void *user_data)
+{
+    akvcam_benchmark_case_t bcase = user_data;
+    akvcam_frame_process(bcase->dst,
+                         bcase->src,
+                         &bcase->process_adjusts,
+                         NULL,
+                         NULL,
+                         1);
+}
+
+static void akvcam_benchmark_run_convert_case(akvcam_benchmark_resolution_t resolution,
+                                              akvcam_frame_pool_t pool,
+                                              __u32 from_fourcc,
+                                              __u32 to_fourcc,
+                                              akvcam_line_convert_function_t line_convert,
+                                              akvcam_planar_convert_function_t planar_convert)
+{
+    char name[64];
+    char from[16];
+    akvcam_format_t format;
+    akvcam_benchmark_case bcase;
+
+    memset(&bcase, 0, sizeof(akvcam_benchmark_case));
+    bcase.src = akvcam_benchmark_frame(from_fourcc,
+                                       resolution->width,
+                                       resolution->height,
+                                       pool);
+    format = akvcam_format_new(to_fourcc,
+                               resolution->width,
+                               resolution->height,
+                               NULL);
+    bcase.dst = akvcam_frame_new_pooled(pool, format);
+    akvcam_format_delete(format);
+    bcase.line_convert = line_convert;
+    bcase.planar_convert = planar_convert;
+    bcase.simd_convert = akvcam_frame_simd_convert_func(from_fourcc,
+                                                        to_fourcc);
+    snprintf(from,
+             16,
+             "%s",
+             akvcam_format_string_from_fourcc(from_fourcc));
+    snprintf(name,
+             64,
+             "%s -> %s",
+             from,
+             akvcam_format_string_from_fourcc(to_fourcc));
+    akvcam_benchmark_report("convert",
+                            name,
+                            resolution,
+                            bcase.src,
+                            akvcam_benchmark_time(NULL,
+                                                  akvcam_benchmark_convert_run,
+                                                  &bcase));
+
+    if (bcase.simd_convert) {
+        snprintf(name + strlen(name),
+                 64 - strlen(name),
+                 " (%s)",
+                 akvcam_frame_simd_to_string(akvcam_frame_simd()));
+        akvcam_benchmark_report("convert",
+                                name,
+                                resolution,
+                                bcase.src,
+                                akvcam_benchmark_time(NULL,
+                                                      akvcam_benchmark_simd_convert_run,
+                                                      &bcase));
+    }
+
+    akvcam_frame_delete(bcase.dst);
+    akvcam_frame_delete(bcase.src);
+}
+
+static void akvcam_benchmark_run_convert(akvcam_benchmark_resolution_t resolution,
+                                         akvcam_frame_pool_t pool)
+{
+    size_t i;
+    akvcam_line_convert_t convert;
+    akvcam_planar_convert_t planar_convert;
+
+    for (i = 0; akvcam_frame_line_convert_table[i].from; i++) {
+        convert = akvcam_frame_line_convert_table + i;
+
+        // Copying the frame is not a conversion.
+        if (convert->from == convert->to)
+            continue;
+
+        akvcam_benchmark_run_convert_case(resolution,
+                                          pool,
+                                          convert->from,
+                                          convert->to,
+                                          convert->convert,
+                                          NULL);
+    }
+
+    for (i = 0; akvcam_frame_planar_convert_table[i].from; i++) {
+        planar_convert = akvcam_frame_planar_convert_table + i;
+        akvcam_benchmark_run_convert_case(resolution,
+                                          pool,
+                                          planar_convert->from,
+                                          planar_convert->to,
+                                          NULL,
+                                          planar_convert->convert);
+    }
+}
+
+static void akvcam_benchmark_run_scaled(akvcam_benchmark_resolution_t resolution,
+                                        akvcam_frame_pool_t pool)
+{
+    int scaling;
+    int aspect_ratio;
+    char name[64];
+    akvcam_benchmark_case bcase;
+
+    memset(&bcase, 0, sizeof(akvcam_benchmark_case));
+    bcase.src = akvcam_benchmark_frame(V4L2_PIX_FMT_RGB24,
+                                       resolution->width,
+                                       resolution->height,
+                                       pool);
+    bcase.dst = akvcam_frame_new_copy(bcase.src);
+    bcase.width = resolution->scaled_width;
+    bcase.height = resolution->height;
+
+    for (scaling = AKVCAM_SCALING_FAST;
+         scaling <= AKVCAM_SCALING_BICUBIC;
+         scaling++)
+        for (aspect_ratio = AKVCAM_ASPECT_RATIO_IGNORE;
+             aspect_ratio <= AKVCAM_ASPECT_RATIO_EXPANDING;
+             aspect_ratio++) {
+            bcase.scaling = (AKVCAM_SCALING) scaling;
+            bcase.aspect_ratio = (AKVCAM_ASPECT_RATIO) aspect_ratio;
+            // The names are short, but the compiler can't know it.
+            snprintf(name,
+                     64,
+                     "%.16s %.16s %zux%zu",
+                     akvcam_frame_scaling_to_string(bcase.scaling),
+                     akvcam_frame_aspect_ratio_to_string(bcase.aspect_ratio),
+                     bcase.width,
+                     bcase.height);
+            akvcam_benchmark_report("scaled",
+                                    name,
+                                    resolution,
+                                    bcase.src,
+                                    akvcam_benchmark_time(akvcam_benchmark_copy_setup,
+                                                          akvcam_benchmark_scaled_run,
+                                                          &bcase));
+        }
+
+    akvcam_frame_delete(bcase.dst);
+    akvcam_frame_delete(bcase.src);
+}
+
+static void akvcam_benchmark_run_adjust(akvcam_benchmark_resolution_t resolution,
+                                        akvcam_frame_pool_t pool)
+{
+    size_t i;
+    akvcam_benchmark_case bcase;
+
+    memset(&bcase, 0, sizeof(akvcam_benchmark_case));
+    bcase.src = akvcam_benchmark_frame(V4L2_PIX_FMT_RGB24,
+                                       resolution->width,
+                                       resolution->height,
+                                       pool);
+    bcase.dst = akvcam_frame_new_copy(bcase.src);
+
+    for (i = 0; akvcam_benchmark_adjusts[i].name; i++) {
+        bcase.adjust = akvcam_benchmark_adjusts + i;
+        akvcam_benchmark_report("adjust",
+                                bcase.adjust->name,
+                                resolution,
+                                bcase.src,
+                                akvcam_benchmark_time(akvcam_benchmark_copy_setup,
+                                                      akvcam_benchmark_adjust_run,
+                                                      &bcase));
+    }
+
+    akvcam_frame_delete(bcase.dst);
+    akvcam_frame_delete(bcase.src);
+}
+
+static void akvcam_benchmark_run_rotate(akvcam_benchmark_resolution_t resolution,
+                                        akvcam_frame_pool_t pool)
+{
+    int rotation;
+    bool transpose;
+    char name[64];
+    akvcam_format_t format;
+    akvcam_benchmark_case bcase;
+
+    memset(&bcase, 0, sizeof(akvcam_benchmark_case));
+    bcase.src = akvcam_benchmark_frame(V4L2_PIX_FMT_RGB24,
+                                       resolution->width,
+                                       resolution->height,
+                                       pool);
+
+    // The capture gets the rotated size, so nothing is scaled.
+    for (rotation = 0; rotation < 360; rotation += 90) {
+        transpose = rotation == 90 || rotation == 270;
+        format = akvcam_format_new(V4L2_PIX_FMT_YUYV,
+                                   transpose?
+                                       resolution->height:
+                                       resolution->width,
+                                   transpose?
+                                       resolution->width:
+                                       resolution->height,
+                                   NULL);
+        bcase.dst = akvcam_frame_new_pooled(pool, format);
+        akvcam_format_delete(format);
+        bcase.process_adjusts.rotation = rotation;
+        snprintf(name, 64, "RGB3 -> YUYV %d", rotation);
+        akvcam_benchmark_report("rotate",
+                                name,
+                                resolution,
+                                bcase.src,
+                                akvcam_benchmark_time(NULL,
+                                                      akvcam_benchmark_process_run,
+                                                      &bcase));
+        akvcam_frame_delete(bcase.dst);
+    }
+
+    akvcam_frame_delete(bcase.src);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    akvcam_benchmark_resolution_t resolution;
+    akvcam_frame_pool_t pool;
+
+    while ((opt = getopt(argc, argv, "t:r:g:h")) != -1)
+        switch (opt) {
+        case 't':
+            akvcam_benchmark_options.min_time = atof(optarg) / 1e3;
+
+            break;
+
+        case 'r':
+            akvcam_benchmark_options.resolution = optarg;
+
+            break;
+
+        case 'g':
+            akvcam_benchmark_options.group = optarg;
+
+            break;
+
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-t msecs] [-r resolution] [-g group]\n"
+                    "\n"
+                    "    -t  Minimum time spent in each case, default 250.\n"
+                    "    -r  Run only 480p, 720p, 1080p or 4K.\n"
+                    "    -g  Run only the convert, scaled, adjust or rotate cases.\n",
+                    argv[0]);
+
+            return opt == 'h'? EXIT_SUCCESS: EXIT_FAILURE;
+        }
+
+    akvcam_log_set_level(LOGLEVEL_ERR);
+    akvcam_yuv_matrix_init();
+    akvcam_frame_simd_init();
+    pool = akvcam_frame_pool_new();
+    printf("SIMD: %s\n\n", akvcam_frame_simd_to_string(akvcam_frame_simd()));
+
+    for (resolution = akvcam_benchmark_resolutions;
+         resolution->name;
+         resolution++) {
+        if (akvcam_benchmark_selected("convert", resolution))
+            akvcam_benchmark_run_convert(resolution, pool);
+
+        if (akvcam_benchmark_selected("scaled", resolution))
+            akvcam_benchmark_run_scaled(resolution, pool);
+
+        if (akvcam_benchmark_selected("adjust", resolution))
+            akvcam_benchmark_run_adjust(resolution, pool);
+
+        if (akvcam_benchmark_selected("rotate", resolution))
+            akvcam_benchmark_run_rotate(resolution, pool);
+    }
+
+    akvcam_frame_pool_delete(pool);
+    akvcam_global_deleter_run();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_SHIM_CPUFEATURE_H
+#define AKVCAM_SHIM_CPUFEATURE_H
+
+#include "../shim.h"
+
+#define X86_FEATURE_XMM2 "sse2"
+#define X86_FEATURE_AVX  "avx"
+#define X86_FEATURE_AVX2 "avx2"
+
+#define boot_cpu_has(feature) __builtin_cpu_supports(feature)
+
+#endif // AKVCAM_SHIM_CPUFEATURE_H
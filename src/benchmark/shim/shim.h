@@ -0,0 +1,257 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Just enough of the kernel API for building the frame processing code in
+// userspace. Everything runs in a single thread, the locks do nothing and the
+// workqueue runs the works synchronously.
+
+#ifndef AKVCAM_SHIM_H
+#define AKVCAM_SHIM_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef unsigned int gfp_t;
+
+#define GFP_KERNEL 0
+
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+// printk
+
+#define LOGLEVEL_ERR     3
+#define LOGLEVEL_WARNING 4
+#define LOGLEVEL_INFO    6
+#define LOGLEVEL_DEBUG   7
+#define KERN_ERR     ""
+#define KERN_WARNING ""
+#define KERN_INFO    ""
+#define KERN_DEBUG   ""
+#define printk(...) fprintf(stderr, __VA_ARGS__)
+
+// kref
+
+struct kref
+{
+    int refcount;
+};
+
+static inline void kref_init(struct kref *kref)
+{
+    kref->refcount = 1;
+}
+
+static inline void kref_get(struct kref *kref)
+{
+    kref->refcount++;
+}
+
+static inline int kref_put(struct kref *kref,
+                           void (*release)(struct kref *kref))
+{
+    if (--kref->refcount > 0)
+        return 0;
+
+    release(kref);
+
+    return 1;
+}
+
+// Memory
+
+static inline void *kzalloc(size_t size, gfp_t flags)
+{
+    (void) flags;
+
+    return calloc(1, size? size: 1);
+}
+
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags)
+{
+    (void) flags;
+
+    return calloc(n? n: 1, size? size: 1);
+}
+
+static inline void *kmemdup(const void *src, size_t size, gfp_t flags)
+{
+    void *data = kzalloc(size, flags);
+
+    if (data)
+        memcpy(data, src, size);
+
+    return data;
+}
+
+static inline void kfree(const void *data)
+{
+    free((void *) data);
+}
+
+static inline void *vmalloc(unsigned long size)
+{
+    return malloc(size? size: 1);
+}
+
+static inline void *vzalloc(unsigned long size)
+{
+    return calloc(1, size? size: 1);
+}
+
+static inline void vfree(const void *data)
+{
+    free((void *) data);
+}
+
+static inline void *kvmalloc(size_t size, gfp_t flags)
+{
+    (void) flags;
+
+    return malloc(size? size: 1);
+}
+
+static inline void *kvzalloc(size_t size, gfp_t flags)
+{
+    (void) flags;
+
+    return calloc(1, size? size: 1);
+}
+
+static inline void kvfree(const void *data)
+{
+    free((void *) data);
+}
+
+static inline void memcpy_flushcache(void *dst, const void *src, size_t size)
+{
+    memcpy(dst, src, size);
+}
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+    return dividend / divisor;
+}
+
+static inline s64 div_s64(s64 dividend, s32 divisor)
+{
+    return dividend / divisor;
+}
+
+static inline s64 div64_s64(s64 dividend, s64 divisor)
+{
+    return dividend / divisor;
+}
+
+// Locking
+
+struct mutex
+{
+    int locked;
+};
+
+#define mutex_init(m) ((m)->locked = 0)
+#define mutex_destroy(m) ((void) (m))
+#define mutex_lock(m) ((m)->locked = 1)
+#define mutex_lock_interruptible(m) ((m)->locked = 1, 0)
+#define mutex_unlock(m) ((m)->locked = 0)
+
+// CPU
+
+#define num_online_cpus() ((unsigned int) sysconf(_SC_NPROCESSORS_ONLN))
+
+static inline void kernel_fpu_begin(void)
+{
+}
+
+static inline void kernel_fpu_end(void)
+{
+}
+
+// Workqueue
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct
+{
+    work_func_t func;
+};
+
+struct workqueue_struct
+{
+    int unused;
+};
+
+#define WQ_UNBOUND (1 << 1)
+#define INIT_WORK(work, function) ((work)->func = (function))
+
+static inline struct workqueue_struct *alloc_workqueue(const char *fmt,
+                                                       unsigned int flags,
+                                                       int max_active,
+                                                       ...)
+{
+    static struct workqueue_struct workqueue;
+    (void) fmt;
+    (void) flags;
+    (void) max_active;
+
+    return &workqueue;
+}
+
+static inline void destroy_workqueue(struct workqueue_struct *workqueue)
+{
+    (void) workqueue;
+}
+
+static inline bool queue_work(struct workqueue_struct *workqueue,
+                              struct work_struct *work)
+{
+    (void) workqueue;
+    work->func(work);
+
+    return true;
+}
+
+static inline bool flush_work(struct work_struct *work)
+{
+    (void) work;
+
+    return false;
+}
+
+#endif // AKVCAM_SHIM_H
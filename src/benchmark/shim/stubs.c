@@ -0,0 +1,81 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Functions from the parts of the driver that the benchmark doesn't build.
+// No file is read, so the file API always fails.
+
+#include "file_read.h"
+#include "utils.h"
+
+static int akvcam_shim_last_error = 0;
+
+int akvcam_get_last_error(void)
+{
+    return akvcam_shim_last_error;
+}
+
+int akvcam_set_last_error(int error)
+{
+    akvcam_shim_last_error = error;
+
+    return error;
+}
+
+akvcam_file_t akvcam_file_new(const char *file_name)
+{
+    (void) file_name;
+
+    return NULL;
+}
+
+void akvcam_file_delete(akvcam_file_t self)
+{
+    (void) self;
+}
+
+bool akvcam_file_open(akvcam_file_t self)
+{
+    (void) self;
+
+    return false;
+}
+
+size_t akvcam_file_size(akvcam_file_t self)
+{
+    (void) self;
+
+    return 0;
+}
+
+bool akvcam_file_seek(akvcam_file_t self, ssize_t offset, AKVCAM_FILE_SEEK pos)
+{
+    (void) self;
+    (void) offset;
+    (void) pos;
+
+    return false;
+}
+
+size_t akvcam_file_read(akvcam_file_t self, void *data, size_t size)
+{
+    (void) self;
+    (void) data;
+    (void) size;
+
+    return 0;
+}
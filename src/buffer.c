@@ -16,9 +16,15 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/atomic.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/fcntl.h>
 #include <linux/kref.h>
 #include <linux/mm.h>
+#include <linux/scatterlist.h>
 #include <linux/slab.h>
+#include <linux/version.h>
 #include <linux/videodev2.h>
 #include <linux/vmalloc.h>
 
@@ -29,19 +35,85 @@
 struct akvcam_buffer
 {
     struct kref ref;
-    struct mutex mtx;
     struct v4l2_buffer buffer;
     void *data;
+    size_t size;
+    atomic_t state;
+
+    // The dma-buf imported by the client, read instead of 'data'.
+    struct dma_buf *dma_buf;
+    void *dma_buf_data;
 };
 
+// Before 4.19 the dma-buf exporters must implement the kmap operations too.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 19, 0)
+#define AKVCAM_BUFFER_DMA_BUF
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+typedef struct iosys_map akvcam_dma_buf_map;
+#define akvcam_dma_buf_vmap dma_buf_vmap_unlocked
+#define akvcam_dma_buf_vunmap dma_buf_vunmap_unlocked
+#define akvcam_dma_buf_map_set_vaddr iosys_map_set_vaddr
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+typedef struct iosys_map akvcam_dma_buf_map;
+#define akvcam_dma_buf_vmap dma_buf_vmap
+#define akvcam_dma_buf_vunmap dma_buf_vunmap
+#define akvcam_dma_buf_map_set_vaddr iosys_map_set_vaddr
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+typedef struct dma_buf_map akvcam_dma_buf_map;
+#define akvcam_dma_buf_vmap dma_buf_vmap
+#define akvcam_dma_buf_vunmap dma_buf_vunmap
+#define akvcam_dma_buf_map_set_vaddr dma_buf_map_set_vaddr
+#endif
+
+// The pages of the buffer, as seen by each device importing it.
+typedef struct
+{
+    struct sg_table sgt;
+    enum dma_data_direction direction;
+} akvcam_buffer_attachment, *akvcam_buffer_attachment_t;
+
+int akvcam_buffer_dma_buf_attach(struct dma_buf *dma_buf,
+                                 struct dma_buf_attachment *attachment);
+void akvcam_buffer_dma_buf_detach(struct dma_buf *dma_buf,
+                                  struct dma_buf_attachment *attachment);
+struct sg_table *akvcam_buffer_dma_buf_map(struct dma_buf_attachment *attachment,
+                                           enum dma_data_direction direction);
+void akvcam_buffer_dma_buf_unmap(struct dma_buf_attachment *attachment,
+                                 struct sg_table *sgt,
+                                 enum dma_data_direction direction);
+int akvcam_buffer_dma_buf_mmap(struct dma_buf *dma_buf,
+                               struct vm_area_struct *vma);
+void akvcam_buffer_dma_buf_release(struct dma_buf *dma_buf);
+
+static const struct dma_buf_ops akvcam_buffer_dma_buf_ops = {
+    .attach        = akvcam_buffer_dma_buf_attach ,
+    .detach        = akvcam_buffer_dma_buf_detach ,
+    .map_dma_buf   = akvcam_buffer_dma_buf_map    ,
+    .unmap_dma_buf = akvcam_buffer_dma_buf_unmap  ,
+    .mmap          = akvcam_buffer_dma_buf_mmap   ,
+    .release       = akvcam_buffer_dma_buf_release,
+};
+
+void *akvcam_buffer_dma_buf_vmap(struct dma_buf *dma_buf);
+void akvcam_buffer_dma_buf_vunmap(struct dma_buf *dma_buf, void *data);
+#endif
+
+void akvcam_buffer_release_dma_buf(akvcam_buffer_t self);
+
+int akvcam_buffer_map_pages(akvcam_buffer_t self,
+                            struct vm_area_struct *vma,
+                            size_t offset);
+
 akvcam_buffer_t akvcam_buffer_new(size_t size)
 {
     akvcam_buffer_t self = kzalloc(sizeof(struct akvcam_buffer), GFP_KERNEL);
     kref_init(&self->ref);
-    mutex_init(&self->mtx);
     memset(&self->buffer, 0, sizeof(struct v4l2_buffer));
     self->buffer.bytesused = (__u32) size;
     self->data = vzalloc(size);
+    self->size = self->data? size: 0;
+    atomic_set(&self->state, AKVCAM_BUFFER_STATE_DEQUEUED);
 
     return self;
 }
@@ -49,6 +121,7 @@ akvcam_buffer_t akvcam_buffer_new(size_t size)
 void akvcam_buffer_free(struct kref *ref)
 {
     akvcam_buffer_t self = container_of(ref, struct akvcam_buffer, ref);
+    akvcam_buffer_release_dma_buf(self);
     vfree(self->data);
     kfree(self);
 }
@@ -72,11 +145,7 @@ bool akvcam_buffer_read(akvcam_buffer_t self, struct v4l2_buffer *v4l2_buff)
     if (!v4l2_buff)
         return false;
 
-    if (mutex_lock_interruptible(&self->mtx))
-        return false;
-
     memcpy(v4l2_buff, &self->buffer, sizeof(struct v4l2_buffer));
-    mutex_unlock(&self->mtx);
 
     return true;
 }
@@ -87,15 +156,17 @@ bool akvcam_buffer_write(akvcam_buffer_t self,
     if (!v4l2_buff)
         return false;
 
-    if (mutex_lock_interruptible(&self->mtx))
-        return false;
-
     memcpy(&self->buffer, v4l2_buff, sizeof(struct v4l2_buffer));
-    mutex_unlock(&self->mtx);
 
     return true;
 }
 
+// Clear some V4L2_BUF_FLAG_* flags without copying the whole v4l2_buffer.
+void akvcam_buffer_clear_flags(akvcam_buffer_t self, __u32 flags)
+{
+    self->buffer.flags &= ~flags;
+}
+
 bool akvcam_buffer_read_data(akvcam_buffer_t self, void *data, size_t size)
 {
     size_t copy_size = akvcam_min(size, self->buffer.bytesused);
@@ -105,11 +176,25 @@ bool akvcam_buffer_read_data(akvcam_buffer_t self, void *data, size_t size)
     if (!data || copy_size < 1)
         return false;
 
-    if (mutex_lock_interruptible(&self->mtx))
+#ifdef AKVCAM_BUFFER_DMA_BUF
+    if (self->dma_buf) {
+        copy_size = akvcam_min(copy_size, self->dma_buf->size);
+
+        if (dma_buf_begin_cpu_access(self->dma_buf, DMA_FROM_DEVICE))
+            return false;
+
+        memcpy(data, self->dma_buf_data, copy_size);
+        dma_buf_end_cpu_access(self->dma_buf, DMA_FROM_DEVICE);
+
+        return true;
+    }
+#endif
+
+    // A dma-buf buffer without a dma-buf imported has nothing to read.
+    if (!self->data)
         return false;
 
     memcpy(data, self->data, copy_size);
-    mutex_unlock(&self->mtx);
 
     return true;
 }
@@ -125,53 +210,331 @@ bool akvcam_buffer_write_data(akvcam_buffer_t self,
     if (!data || copy_size < 1)
         return false;
 
-    if (mutex_lock_interruptible(&self->mtx))
-        return false;
-
     memcpy(self->data, data, copy_size);
-    mutex_unlock(&self->mtx);
 
     return true;
 }
 
-int akvcam_buffer_map_data(akvcam_buffer_t self, struct vm_area_struct *vma)
+void *akvcam_buffer_data(const akvcam_buffer_t self)
+{
+    return self->data;
+}
+
+size_t akvcam_buffer_size(const akvcam_buffer_t self)
+{
+    return self->size;
+}
+
+int akvcam_buffer_map_data(akvcam_buffer_t self,
+                           struct vm_area_struct *vma,
+                           size_t offset)
+{
+    akpr_function();
+
+    return akvcam_buffer_map_pages(self, vma, offset);
+}
+
+// Export the buffer as a dma-buf, and return its file descriptor. The dma-buf
+// keeps a reference to the buffer, so it can outlive the buffers queue.
+int akvcam_buffer_export(akvcam_buffer_t self, __u32 flags)
+{
+#ifdef AKVCAM_BUFFER_DMA_BUF
+    DEFINE_DMA_BUF_EXPORT_INFO(export_info);
+    struct dma_buf *dma_buf;
+    int fd;
+
+    akpr_function();
+
+    if (!self->data)
+        return -EINVAL;
+
+    export_info.ops = &akvcam_buffer_dma_buf_ops;
+    export_info.size = PAGE_ALIGN(self->size);
+    export_info.flags = (int) (flags & O_ACCMODE);
+    export_info.priv = akvcam_buffer_ref(self);
+    dma_buf = dma_buf_export(&export_info);
+
+    if (IS_ERR(dma_buf)) {
+        akvcam_buffer_delete(self);
+
+        return (int) PTR_ERR(dma_buf);
+    }
+
+    fd = dma_buf_fd(dma_buf, (int) (flags & ~O_ACCMODE));
+
+    // Releasing the dma-buf releases the buffer too.
+    if (fd < 0)
+        dma_buf_put(dma_buf);
+
+    return fd;
+#else
+    return -ENOTTY;
+#endif
+}
+
+// Read the frames from the dma-buf 'fd' instead of the buffer memory. The
+// dma-buf stays mapped until another one is imported, or the buffer is freed.
+int akvcam_buffer_import(akvcam_buffer_t self, int fd)
+{
+#ifdef AKVCAM_BUFFER_DMA_BUF
+    struct dma_buf *dma_buf;
+    void *data;
+
+    akpr_function();
+    dma_buf = dma_buf_get(fd);
+
+    if (IS_ERR(dma_buf))
+        return (int) PTR_ERR(dma_buf);
+
+    // The same dma-buf was queued again, it's already mapped.
+    if (dma_buf == self->dma_buf) {
+        dma_buf_put(dma_buf);
+
+        return 0;
+    }
+
+    if (dma_buf->size < self->buffer.bytesused) {
+        akpr_err("The dma-buf is too small for the frame.\n");
+        dma_buf_put(dma_buf);
+
+        return -EINVAL;
+    }
+
+    data = akvcam_buffer_dma_buf_vmap(dma_buf);
+
+    if (!data) {
+        akpr_err("Can't map the dma-buf.\n");
+        dma_buf_put(dma_buf);
+
+        return -EINVAL;
+    }
+
+    akvcam_buffer_release_dma_buf(self);
+    self->dma_buf = dma_buf;
+    self->dma_buf_data = data;
+
+    return 0;
+#else
+    return -ENOTTY;
+#endif
+}
+
+AKVCAM_BUFFER_STATE akvcam_buffer_state(const akvcam_buffer_t self)
+{
+    return (AKVCAM_BUFFER_STATE) atomic_read(&self->state);
+}
+
+void akvcam_buffer_set_state(akvcam_buffer_t self, AKVCAM_BUFFER_STATE state)
+{
+    atomic_set(&self->state, state);
+}
+
+// Hand the buffer over to its next owner, only if it's still owned by the
+// expected one.
+bool akvcam_buffer_change_state(akvcam_buffer_t self,
+                                AKVCAM_BUFFER_STATE from,
+                                AKVCAM_BUFFER_STATE to)
+{
+    return atomic_cmpxchg(&self->state, from, to) == from;
+}
+
+// Map the buffer pages starting from 'offset'.
+int akvcam_buffer_map_pages(akvcam_buffer_t self,
+                            struct vm_area_struct *vma,
+                            size_t offset)
 {
     struct page *page;
-    void *data = self->data;
+    char *data = self->data;
     unsigned long start = vma->vm_start;
     unsigned long size = vma->vm_end - vma->vm_start;
-    int result = 0;
+
+    if (!data || offset + size > PAGE_ALIGN(self->size))
+        return -EINVAL;
+
+    data += offset;
+
+    while (size > 0) {
+        page = vmalloc_to_page(data);
+
+        if (!page)
+            return -EINVAL;
+
+        if (vm_insert_page(vma, start, page))
+            return -EAGAIN;
+
+        start += PAGE_SIZE;
+        data += PAGE_SIZE;
+        size -= PAGE_SIZE;
+    }
+
+    return 0;
+}
+
+#ifdef AKVCAM_BUFFER_DMA_BUF
+int akvcam_buffer_dma_buf_attach(struct dma_buf *dma_buf,
+                                 struct dma_buf_attachment *attachment)
+{
+    akvcam_buffer_t self = dma_buf->priv;
+    akvcam_buffer_attachment_t buffer_attachment;
+    struct page **pages;
+    size_t n_pages = PAGE_ALIGN(self->size) >> PAGE_SHIFT;
+    size_t i;
+    int result;
 
     akpr_function();
+    buffer_attachment = kzalloc(sizeof(akvcam_buffer_attachment), GFP_KERNEL);
+
+    if (!buffer_attachment)
+        return -ENOMEM;
 
-    if (mutex_lock_interruptible(&self->mtx))
-        return -EIO;
+    pages = kmalloc(n_pages * sizeof(struct page *), GFP_KERNEL);
 
-    if (data) {
-        while (size > 0) {
-            page = vmalloc_to_page(data);
+    if (!pages) {
+        kfree(buffer_attachment);
 
-            if (!page) {
-                result = -EINVAL;
+        return -ENOMEM;
+    }
 
-                break;
-            }
+    for (i = 0; i < n_pages; i++)
+        pages[i] = vmalloc_to_page((char *) self->data + (i << PAGE_SHIFT));
 
-            if (vm_insert_page(vma, start, page)) {
-                result = -EAGAIN;
+    result = sg_alloc_table_from_pages(&buffer_attachment->sgt,
+                                       pages,
+                                       (unsigned int) n_pages,
+                                       0,
+                                       n_pages << PAGE_SHIFT,
+                                       GFP_KERNEL);
+    kfree(pages);
 
-                break;
-            }
+    if (result) {
+        kfree(buffer_attachment);
 
-            start += PAGE_SIZE;
-            data += PAGE_SIZE;
-            size -= PAGE_SIZE;
-        }
-    } else {
-        result = -EINVAL;
+        return result;
     }
 
-    mutex_unlock(&self->mtx);
+    buffer_attachment->direction = DMA_NONE;
+    attachment->priv = buffer_attachment;
+
+    return 0;
+}
+
+void akvcam_buffer_dma_buf_detach(struct dma_buf *dma_buf,
+                                  struct dma_buf_attachment *attachment)
+{
+    akvcam_buffer_attachment_t buffer_attachment = attachment->priv;
+
+    akpr_function();
+
+    if (buffer_attachment->direction != DMA_NONE)
+        dma_unmap_sg(attachment->dev,
+                     buffer_attachment->sgt.sgl,
+                     buffer_attachment->sgt.orig_nents,
+                     buffer_attachment->direction);
+
+    sg_free_table(&buffer_attachment->sgt);
+    kfree(buffer_attachment);
+    attachment->priv = NULL;
+}
+
+struct sg_table *akvcam_buffer_dma_buf_map(struct dma_buf_attachment *attachment,
+                                           enum dma_data_direction direction)
+{
+    akvcam_buffer_attachment_t buffer_attachment = attachment->priv;
+    struct sg_table *sgt = &buffer_attachment->sgt;
+    int nents;
+
+    akpr_function();
 
-    return result;
+    // The pages stay mapped until the device is detached.
+    if (buffer_attachment->direction == direction)
+        return sgt;
+
+    if (buffer_attachment->direction != DMA_NONE) {
+        dma_unmap_sg(attachment->dev,
+                     sgt->sgl,
+                     sgt->orig_nents,
+                     buffer_attachment->direction);
+        buffer_attachment->direction = DMA_NONE;
+    }
+
+    nents = dma_map_sg(attachment->dev, sgt->sgl, sgt->orig_nents, direction);
+
+    if (nents < 1)
+        return ERR_PTR(-EIO);
+
+    sgt->nents = (unsigned int) nents;
+    buffer_attachment->direction = direction;
+
+    return sgt;
+}
+
+void akvcam_buffer_dma_buf_unmap(struct dma_buf_attachment *attachment,
+                                 struct sg_table *sgt,
+                                 enum dma_data_direction direction)
+{
+    // Unmapped when detaching.
+}
+
+int akvcam_buffer_dma_buf_mmap(struct dma_buf *dma_buf,
+                               struct vm_area_struct *vma)
+{
+    akpr_function();
+
+    return akvcam_buffer_map_pages(dma_buf->priv,
+                                   vma,
+                                   vma->vm_pgoff << PAGE_SHIFT);
+}
+
+void akvcam_buffer_dma_buf_release(struct dma_buf *dma_buf)
+{
+    akpr_function();
+    akvcam_buffer_delete(dma_buf->priv);
+}
+
+// Map the dma-buf in the kernel address space. The buffers in I/O memory
+// can't be read with memcpy, so they aren't supported.
+void *akvcam_buffer_dma_buf_vmap(struct dma_buf *dma_buf)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+    akvcam_dma_buf_map map;
+
+    if (akvcam_dma_buf_vmap(dma_buf, &map))
+        return NULL;
+
+    if (map.is_iomem) {
+        akvcam_dma_buf_vunmap(dma_buf, &map);
+
+        return NULL;
+    }
+
+    return map.vaddr;
+#else
+    return dma_buf_vmap(dma_buf);
+#endif
+}
+
+void akvcam_buffer_dma_buf_vunmap(struct dma_buf *dma_buf, void *data)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+    akvcam_dma_buf_map map;
+
+    akvcam_dma_buf_map_set_vaddr(&map, data);
+    akvcam_dma_buf_vunmap(dma_buf, &map);
+#else
+    dma_buf_vunmap(dma_buf, data);
+#endif
+}
+#endif
+
+void akvcam_buffer_release_dma_buf(akvcam_buffer_t self)
+{
+#ifdef AKVCAM_BUFFER_DMA_BUF
+    if (!self->dma_buf)
+        return;
+
+    akvcam_buffer_dma_buf_vunmap(self->dma_buf, self->dma_buf_data);
+    dma_buf_put(self->dma_buf);
+    self->dma_buf = NULL;
+    self->dma_buf_data = NULL;
+#endif
 }
@@ -26,6 +26,23 @@ typedef struct akvcam_buffer *akvcam_buffer_t;
 struct v4l2_buffer;
 struct vm_area_struct;
 
+// Who has the buffer. A buffer has just one owner at a time, and only the
+// owner can touch its data, so the frames are copied without holding any
+// lock:
+//
+// - DEQUEUED: the client.
+// - QUEUED: the queue of buffers waiting to be filled or read.
+// - FILLING: whoever took it out of a queue to copy a frame to or from it.
+// - DONE: the queue of filled buffers waiting to be dequeued, or the call
+//   dequeueing it, until the frame reaches the client.
+typedef enum
+{
+    AKVCAM_BUFFER_STATE_DEQUEUED,
+    AKVCAM_BUFFER_STATE_QUEUED,
+    AKVCAM_BUFFER_STATE_FILLING,
+    AKVCAM_BUFFER_STATE_DONE
+} AKVCAM_BUFFER_STATE;
+
 // public
 akvcam_buffer_t akvcam_buffer_new(size_t size);
 void akvcam_buffer_delete(akvcam_buffer_t self);
@@ -34,10 +51,22 @@ akvcam_buffer_t akvcam_buffer_ref(akvcam_buffer_t self);
 bool akvcam_buffer_read(akvcam_buffer_t self, struct v4l2_buffer *v4l2_buff);
 bool akvcam_buffer_write(akvcam_buffer_t self,
                          const struct v4l2_buffer *v4l2_buff);
+void akvcam_buffer_clear_flags(akvcam_buffer_t self, __u32 flags);
 bool akvcam_buffer_read_data(akvcam_buffer_t self, void *data, size_t size);
 bool akvcam_buffer_write_data(akvcam_buffer_t self,
                               const void *data,
                               size_t size);
-int akvcam_buffer_map_data(akvcam_buffer_t self, struct vm_area_struct *vma);
+void *akvcam_buffer_data(const akvcam_buffer_t self);
+size_t akvcam_buffer_size(const akvcam_buffer_t self);
+int akvcam_buffer_map_data(akvcam_buffer_t self,
+                           struct vm_area_struct *vma,
+                           size_t offset);
+int akvcam_buffer_export(akvcam_buffer_t self, __u32 flags);
+int akvcam_buffer_import(akvcam_buffer_t self, int fd);
+AKVCAM_BUFFER_STATE akvcam_buffer_state(const akvcam_buffer_t self);
+void akvcam_buffer_set_state(akvcam_buffer_t self, AKVCAM_BUFFER_STATE state);
+bool akvcam_buffer_change_state(akvcam_buffer_t self,
+                                AKVCAM_BUFFER_STATE from,
+                                AKVCAM_BUFFER_STATE to);
 
 #endif // AKVCAM_BUFFER_H
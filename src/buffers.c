@@ -16,6 +16,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/fcntl.h>
 #include <linux/kref.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
@@ -29,14 +30,42 @@
 #include "device.h"
 #include "format.h"
 #include "frame.h"
-#include "list.h"
 #include "log.h"
 #include "rbuffer.h"
 
+// A buffer, and the range of the device memory it's mapped to.
+typedef struct
+{
+    akvcam_buffer_t buffer;
+    __u32 offset;
+    __u32 size;
+} akvcam_buffers_entry, *akvcam_buffers_entry_t;
+
+// Buffers in the order they will be taken. A buffer is in one queue at most,
+// so the queue never holds more buffers than there are.
+typedef struct
+{
+    akvcam_buffer_t *buffers;
+    size_t capacity;
+    size_t first;
+    size_t size;
+} akvcam_buffers_ring, *akvcam_buffers_ring_t;
+
 struct akvcam_buffers
 {
     struct kref ref;
-    akvcam_list_tt(akvcam_buffer_t) buffers;
+
+    // Indexed by the v4l2_buffer index.
+    akvcam_buffers_entry_t buffers;
+    size_t n_buffers;
+
+    // The memory of all the buffers, set by VIDIOC_REQBUFS.
+    enum v4l2_memory memory;
+
+    // Buffers queued by the client, waiting to be filled or read, and
+    // buffers already filled, waiting to be dequeued.
+    akvcam_buffers_ring queued;
+    akvcam_buffers_ring done;
     akvcam_rbuffer_tt(char) rw_buffers;
     struct mutex buffers_mutex;
     enum v4l2_buf_type type;
@@ -48,10 +77,53 @@ struct akvcam_buffers
     AKVCAM_RW_MODE rw_mode;
     __u32 sequence;
     bool multiplanar;
+    akvcam_frame_pool_t frame_pool;
+
+    // Buffer being filled by the capture, between the claim and the commit.
+    akvcam_buffer_t claimed;
 };
 
 bool akvcam_buffers_is_supported(const akvcam_buffers_t self,
                                  enum v4l2_memory type);
+void akvcam_buffers_clear(akvcam_buffers_t self);
+bool akvcam_buffers_reserve(akvcam_buffers_t self, size_t count);
+__u32 akvcam_buffers_next_offset(const akvcam_buffers_t self);
+void akvcam_buffers_append(akvcam_buffers_t self,
+                           akvcam_buffer_t buffer,
+                           size_t size);
+akvcam_buffer_t akvcam_buffers_at(const akvcam_buffers_t self, __u32 index);
+akvcam_buffers_entry_t akvcam_buffers_entry_at_offset(const akvcam_buffers_t self,
+                                                      __u32 offset);
+void akvcam_buffers_push(akvcam_buffers_t self,
+                         akvcam_buffer_t buffer,
+                         AKVCAM_BUFFER_STATE state);
+akvcam_buffer_t akvcam_buffers_take_write_buffer(akvcam_buffers_t self);
+int akvcam_buffers_finish_write_buffer(akvcam_buffers_t self,
+                                       akvcam_buffer_t buffer,
+                                       bool filled);
+void akvcam_buffers_finish_read_buffer(akvcam_buffers_t self,
+                                       akvcam_buffer_t buffer,
+                                       bool is_read);
+int akvcam_buffers_copy_user_data(akvcam_buffers_t self,
+                                  akvcam_buffer_t buffer,
+                                  const struct v4l2_buffer *v4l2_buff,
+                                  bool to_user);
+int akvcam_buffers_update_planes(akvcam_buffers_t self,
+                                 const struct v4l2_buffer *v4l2_buff,
+                                 __u32 offset);
+int akvcam_buffers_import(akvcam_buffers_t self,
+                          akvcam_buffer_t buffer,
+                          const struct v4l2_buffer *v4l2_buff);
+void akvcam_buffers_unqueue(akvcam_buffers_t self, akvcam_buffer_t buffer);
+akvcam_buffer_t akvcam_buffers_next_write_buffer(akvcam_buffers_t self);
+bool akvcam_buffers_ring_reserve(akvcam_buffers_ring_t ring,
+                                 size_t capacity);
+void akvcam_buffers_ring_clear(akvcam_buffers_ring_t ring);
+void akvcam_buffers_ring_push(akvcam_buffers_ring_t ring,
+                              akvcam_buffer_t buffer);
+void akvcam_buffers_ring_remove(akvcam_buffers_ring_t ring,
+                                akvcam_buffer_t buffer);
+akvcam_buffer_t akvcam_buffers_ring_front(const akvcam_buffers_ring_t ring);
 
 akvcam_buffers_t akvcam_buffers_new(AKVCAM_RW_MODE rw_mode,
                                     enum v4l2_buf_type type,
@@ -60,7 +132,6 @@ akvcam_buffers_t akvcam_buffers_new(AKVCAM_RW_MODE rw_mode,
     akvcam_buffers_t self = kzalloc(sizeof(struct akvcam_buffers), GFP_KERNEL);
 
     kref_init(&self->ref);
-    self->buffers = akvcam_list_new();
     self->rw_buffers = akvcam_rbuffer_new();
     mutex_init(&self->buffers_mutex);
     self->rw_mode = rw_mode;
@@ -77,9 +148,11 @@ akvcam_buffers_t akvcam_buffers_new(AKVCAM_RW_MODE rw_mode,
 void akvcam_buffers_free(struct kref *ref)
 {
     akvcam_buffers_t self = container_of(ref, struct akvcam_buffers, ref);
+    akvcam_buffer_delete(self->claimed);
+    akvcam_frame_pool_delete(self->frame_pool);
     akvcam_format_delete(self->format);
     akvcam_rbuffer_delete(self->rw_buffers);
-    akvcam_list_delete(self->buffers);
+    akvcam_buffers_clear(self);
     kfree(self);
 }
 
@@ -117,6 +190,13 @@ void akvcam_buffers_set_format(akvcam_buffers_t self, akvcam_format_t format)
     akvcam_format_copy(self->format, format);
 }
 
+void akvcam_buffers_set_frame_pool(akvcam_buffers_t self,
+                                   akvcam_frame_pool_t frame_pool)
+{
+    akvcam_frame_pool_delete(self->frame_pool);
+    self->frame_pool = akvcam_frame_pool_ref(frame_pool);
+}
+
 int akvcam_buffers_allocate(akvcam_buffers_t self,
                             struct v4l2_requestbuffers *params)
 {
@@ -124,7 +204,6 @@ int akvcam_buffers_allocate(akvcam_buffers_t self,
     akvcam_buffer_t buffer;
     struct v4l2_buffer v4l2_buff;
     size_t buffer_length;
-    __u32 buffer_size;
     int result = 0;
 
     akpr_function();
@@ -147,7 +226,8 @@ int akvcam_buffers_allocate(akvcam_buffers_t self,
     if (mutex_lock_interruptible(&self->buffers_mutex))
         return -EIO;
 
-    akvcam_list_clear(self->buffers);
+    akvcam_buffers_clear(self);
+    self->memory = params->memory;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
     params->capabilities = 0;
@@ -157,6 +237,9 @@ int akvcam_buffers_allocate(akvcam_buffers_t self,
 
     if (self->rw_mode & AKVCAM_RW_MODE_USERPTR)
         params->capabilities |= V4L2_BUF_CAP_SUPPORTS_USERPTR;
+
+    if (self->rw_mode & AKVCAM_RW_MODE_DMABUF)
+        params->capabilities |= V4L2_BUF_CAP_SUPPORTS_DMABUF;
 #endif
 
     if (params->count < 1) {
@@ -170,14 +253,19 @@ int akvcam_buffers_allocate(akvcam_buffers_t self,
                                   akvcam_format_size(self->format),
                                   AKVCAM_MEMORY_TYPE_VMALLOC);
         }
+    } else if (!akvcam_buffers_reserve(self, params->count)) {
+        result = -ENOMEM;
     } else {
         buffer_length = akvcam_format_size(self->format);
-        buffer_size = (__u32) PAGE_ALIGN(buffer_length);
 
         for (i = 0; i < params->count; i++) {
-            buffer = akvcam_buffer_new(buffer_length);
+            // The frames of the DMABUF buffers are read from the imported
+            // memory.
+            buffer = akvcam_buffer_new(params->memory == V4L2_MEMORY_DMABUF?
+                                           0: buffer_length);
 
             if (!akvcam_buffer_read(buffer, &v4l2_buff)) {
+                akvcam_buffer_delete(buffer);
                 result = -EIO;
 
                 break;
@@ -188,15 +276,16 @@ int akvcam_buffers_allocate(akvcam_buffers_t self,
             v4l2_buff.memory = params->memory;
             v4l2_buff.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
             v4l2_buff.field = V4L2_FIELD_NONE;
+            v4l2_buff.bytesused = (__u32) buffer_length;
 
             if (self->multiplanar)
-                v4l2_buff.length = (__u32) akvcam_format_planes(self->format);
+                v4l2_buff.length = (__u32) akvcam_format_mplanes(self->format);
             else
                 v4l2_buff.length = v4l2_buff.bytesused;
 
             if (params->memory == V4L2_MEMORY_MMAP && !self->multiplanar) {
                 v4l2_buff.flags |= V4L2_BUF_FLAG_MAPPED;
-                v4l2_buff.m.offset = (__u32) i * buffer_size;
+                v4l2_buff.m.offset = akvcam_buffers_next_offset(self);
             }
 
             if (!akvcam_buffer_write(buffer, &v4l2_buff)) {
@@ -206,10 +295,7 @@ int akvcam_buffers_allocate(akvcam_buffers_t self,
                 break;
             }
 
-            akvcam_list_push_back(self->buffers,
-                                  buffer,
-                                  (akvcam_copy_t) akvcam_buffer_ref,
-                                  (akvcam_delete_t) akvcam_buffer_delete);
+            akvcam_buffers_append(self, buffer, buffer_length);
             akvcam_buffer_delete(buffer);
         }
     }
@@ -223,7 +309,7 @@ int akvcam_buffers_allocate(akvcam_buffers_t self,
 void akvcam_buffers_deallocate(akvcam_buffers_t self)
 {
     if (!mutex_lock_interruptible(&self->buffers_mutex)) {
-        akvcam_list_clear(self->buffers);
+        akvcam_buffers_clear(self);
         mutex_unlock(&self->buffers_mutex);
     }
 
@@ -236,11 +322,8 @@ int akvcam_buffers_create(akvcam_buffers_t self,
 {
     size_t i;
     akvcam_buffer_t buffer;
-    akvcam_buffer_t last_buffer;
     struct v4l2_buffer v4l2_buff;
     size_t buffer_length;
-    __u32 buffer_size;
-    __u32 offset = 0;
     int result = 0;
 
     akpr_function();
@@ -268,7 +351,16 @@ int akvcam_buffers_create(akvcam_buffers_t self,
     if (mutex_lock_interruptible(&self->buffers_mutex))
         return -EIO;
 
-    buffers->index = (__u32) akvcam_list_size(self->buffers);
+    // All the buffers share the same memory.
+    if (self->n_buffers > 0 && buffers->memory != self->memory) {
+        mutex_unlock(&self->buffers_mutex);
+        akpr_err("Memory mode differs from the allocated buffers.\n");
+
+        return -EINVAL;
+    }
+
+    self->memory = buffers->memory;
+    buffers->index = (__u32) self->n_buffers;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
     buffers->capabilities = 0;
@@ -278,21 +370,25 @@ int akvcam_buffers_create(akvcam_buffers_t self,
 
     if (self->rw_mode & AKVCAM_RW_MODE_USERPTR)
         buffers->capabilities |= V4L2_BUF_CAP_SUPPORTS_USERPTR;
+
+    if (self->rw_mode & AKVCAM_RW_MODE_DMABUF)
+        buffers->capabilities |= V4L2_BUF_CAP_SUPPORTS_DMABUF;
 #endif
     akvcam_init_reserved(buffers);
 
-    if (buffers->count > 0) {
+    if (buffers->count > 0 && !akvcam_buffers_reserve(self, buffers->count)) {
+        result = -ENOMEM;
+    } else if (buffers->count > 0) {
         buffer_length = akvcam_format_size(format);
-        buffer_size = (__u32) PAGE_ALIGN(buffer_length);
-        last_buffer = akvcam_list_back(self->buffers);
-
-        if (last_buffer && akvcam_buffer_read(last_buffer, &v4l2_buff))
-            offset = v4l2_buff.m.offset + PAGE_ALIGN(v4l2_buff.length);
 
         for (i = 0; i < buffers->count; i++) {
-            buffer = akvcam_buffer_new(buffer_length);
+            // The frames of the DMABUF buffers are read from the imported
+            // memory.
+            buffer = akvcam_buffer_new(buffers->memory == V4L2_MEMORY_DMABUF?
+                                           0: buffer_length);
 
             if (!akvcam_buffer_read(buffer, &v4l2_buff)) {
+                akvcam_buffer_delete(buffer);
                 result = -EIO;
 
                 break;
@@ -303,15 +399,16 @@ int akvcam_buffers_create(akvcam_buffers_t self,
             v4l2_buff.memory = buffers->memory;
             v4l2_buff.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
             v4l2_buff.field = V4L2_FIELD_NONE;
+            v4l2_buff.bytesused = (__u32) buffer_length;
 
             if (self->multiplanar)
-                v4l2_buff.length = (__u32) akvcam_format_planes(format);
+                v4l2_buff.length = (__u32) akvcam_format_mplanes(format);
             else
                 v4l2_buff.length = v4l2_buff.bytesused;
 
             if (buffers->memory == V4L2_MEMORY_MMAP && !self->multiplanar) {
                 v4l2_buff.flags |= V4L2_BUF_FLAG_MAPPED;
-                v4l2_buff.m.offset = offset + (__u32) i * buffer_size;
+                v4l2_buff.m.offset = akvcam_buffers_next_offset(self);
             }
 
             if (!akvcam_buffer_write(buffer, &v4l2_buff)) {
@@ -321,10 +418,7 @@ int akvcam_buffers_create(akvcam_buffers_t self,
                 break;
             }
 
-            akvcam_list_push_back(self->buffers,
-                                  buffer,
-                                  (akvcam_copy_t) akvcam_buffer_ref,
-                                  (akvcam_delete_t) akvcam_buffer_delete);
+            akvcam_buffers_append(self, buffer, buffer_length);
             akvcam_buffer_delete(buffer);
         }
     }
@@ -348,7 +442,7 @@ int akvcam_buffers_query(const akvcam_buffers_t self,
     akpr_function();
     akpr_debug("IN: %s\n", akvcam_string_from_v4l2_buffer(buffer));
 
-    if (akvcam_list_empty(self->buffers))
+    if (self->n_buffers < 1)
         return -EINVAL;
 
     result = mutex_lock_interruptible(&self->buffers_mutex);
@@ -356,7 +450,7 @@ int akvcam_buffers_query(const akvcam_buffers_t self,
     if (result)
         return result;
 
-    akbuffer = akvcam_list_at(self->buffers, buffer->index);
+    akbuffer = akvcam_buffers_at(self, buffer->index);
 
     if (akbuffer
         && akvcam_buffer_read(akbuffer, &v4l2_buff)
@@ -382,24 +476,23 @@ int akvcam_buffers_query(const akvcam_buffers_t self,
             }
 
             n_planes = akvcam_min(buffer->length,
-                                  akvcam_format_planes(self->format));
+                                  akvcam_format_mplanes(self->format));
 
             for (i = 0; i < n_planes; i++) {
                 if (akvcam_device_type_from_v4l2(self->type) == AKVCAM_DEVICE_TYPE_CAPTURE
                     || planes[i].bytesused < 1) {
                     planes[i].bytesused =
-                            (__u32) akvcam_format_plane_size(self->format, i);
+                            (__u32) akvcam_format_mplane_size(self->format, i);
                     planes[i].data_offset = 0;
                 }
 
                 planes[i].length =
-                        (__u32) akvcam_format_plane_size(self->format, i);
+                        (__u32) akvcam_format_mplane_size(self->format, i);
                 memset(&planes[i].m, 0, sizeof(struct v4l2_plane));
 
                 if (buffer->memory == V4L2_MEMORY_MMAP) {
                     planes[i].m.mem_offset =
-                            buffer->index
-                            * (__u32) akvcam_format_size(self->format)
+                            self->buffers[buffer->index].offset
                             + (__u32) akvcam_format_offset(self->format, i);
                 }
 
@@ -427,12 +520,11 @@ int akvcam_buffers_query(const akvcam_buffers_t self,
 
 int akvcam_buffers_queue(akvcam_buffers_t self, struct v4l2_buffer *buffer)
 {
-    akvcam_buffer_t akbuffer;
+    akvcam_buffer_t akbuffer = NULL;
     struct v4l2_buffer v4l2_buff;
-    struct v4l2_plane *planes;
-    size_t n_planes;
-    size_t i;
-    void *data;
+    struct v4l2_buffer user_buff;
+    bool copy_data;
+    bool import_data;
     int result = 0;
 
     akpr_function();
@@ -440,149 +532,141 @@ int akvcam_buffers_queue(akvcam_buffers_t self, struct v4l2_buffer *buffer)
     if (!akvcam_buffers_is_supported(self, buffer->memory))
         return -EINVAL;
 
+    // The frame sent by the client is copied or imported after the buffer
+    // is taken, so remember where it is.
+    memcpy(&user_buff, buffer, sizeof(struct v4l2_buffer));
+    copy_data = buffer->memory == V4L2_MEMORY_USERPTR
+                && buffer->length > 1
+                && buffer->bytesused > 1
+                && akvcam_device_type_from_v4l2(self->type) == AKVCAM_DEVICE_TYPE_OUTPUT;
+    import_data = buffer->memory == V4L2_MEMORY_DMABUF;
     result = mutex_lock_interruptible(&self->buffers_mutex);
 
     if (result)
         return result;
 
-    akbuffer = akvcam_list_at(self->buffers, buffer->index);
+    akbuffer = akvcam_buffers_at(self, buffer->index);
 
-    if (akbuffer) {
-        if (akvcam_buffer_read(akbuffer, &v4l2_buff)) {
-            if (v4l2_buff.type == buffer->type) {
-                if (buffer->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
-                    || buffer->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
-                    v4l2_buff.length = buffer->length;
-                    v4l2_buff.m.planes = buffer->m.planes;
-                }
+    if (!akbuffer) {
+        akpr_err("Buffer is empty.\n");
+        result = -EINVAL;
+    } else if (!akvcam_buffer_read(akbuffer, &v4l2_buff)) {
+        akpr_err("Can't read buffer.\n");
+        result = -EIO;
+    } else if (v4l2_buff.type != buffer->type) {
+        akpr_err("Buffers types differs.\n");
+        result = -EINVAL;
+    } else if (!akvcam_buffer_change_state(akbuffer,
+                                           AKVCAM_BUFFER_STATE_DEQUEUED,
+                                           copy_data || import_data?
+                                               AKVCAM_BUFFER_STATE_FILLING:
+                                               AKVCAM_BUFFER_STATE_QUEUED)) {
+        akpr_err("Buffer is already queued.\n");
+        result = -EINVAL;
+    } else {
+        if (buffer->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+            || buffer->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+            v4l2_buff.length = buffer->length;
+            v4l2_buff.m.planes = buffer->m.planes;
+        }
 
-                switch (buffer->memory) {
-                case V4L2_MEMORY_MMAP:
-                    v4l2_buff.flags = buffer->flags;
-                    v4l2_buff.flags |= V4L2_BUF_FLAG_MAPPED | V4L2_BUF_FLAG_QUEUED;
-                    v4l2_buff.flags &= (__u32) ~V4L2_BUF_FLAG_DONE;
-
-                    break;
-
-                case V4L2_MEMORY_USERPTR:
-                    if (buffer->m.userptr && !self->multiplanar)
-                        v4l2_buff.m.userptr = buffer->m.userptr;
-
-                    v4l2_buff.flags = buffer->flags;
-                    v4l2_buff.flags |= V4L2_BUF_FLAG_QUEUED;
-                    v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_MAPPED
-                                                 | V4L2_BUF_FLAG_DONE);
-
-                    if (buffer->length > 1
-                        && buffer->bytesused > 1
-                        && akvcam_device_type_from_v4l2(self->type) == AKVCAM_DEVICE_TYPE_OUTPUT) {
-                        data = vzalloc(buffer->bytesused);
-
-                        if (data) {
-                            if (self->multiplanar) {
-                                planes = kmalloc(buffer->length * sizeof(struct v4l2_plane), GFP_KERNEL);
-
-                                if (!copy_from_user(planes,
-                                                    (char __user *) buffer->m.planes,
-                                                    buffer->length * sizeof(struct v4l2_plane))) {
-                                    n_planes = akvcam_min(buffer->length,
-                                                          akvcam_format_planes(self->format));
-
-                                    for (i = 0; i < n_planes; i++)
-                                        if (copy_from_user((char *) data + akvcam_format_offset(self->format, i),
-                                                           (char __user *) planes[i].m.userptr,
-                                                           planes[i].length)) {
-                                            akpr_err("Failed copying data from user space.\n");
-                                            result = -EIO;
-
-                                            break;
-                                        }
-
-                                    if (!akvcam_buffer_write_data(akbuffer, data, buffer->bytesused))
-                                        result = -EIO;
-                                } else {
-                                    akpr_err("Failed copying data from user space.\n");
-                                    result = -EIO;
-                                }
-
-                                kfree(planes);
-                            } else {
-                                if (copy_from_user(data,
-                                                   (char __user *) buffer->m.userptr,
-                                                   buffer->length)) {
-                                    akpr_err("Failed copying data from user space.\n");
-                                    result = -EIO;
-                                }
-                            }
-
-                            vfree(data);
-                        }
-                    }
-
-                    break;
-
-                default:
-                    break;
-                }
+        switch (buffer->memory) {
+        case V4L2_MEMORY_MMAP:
+            v4l2_buff.flags = buffer->flags;
+            v4l2_buff.flags |= V4L2_BUF_FLAG_MAPPED | V4L2_BUF_FLAG_QUEUED;
+            v4l2_buff.flags &= (__u32) ~V4L2_BUF_FLAG_DONE;
 
-                memcpy(buffer, &v4l2_buff, sizeof(struct v4l2_buffer));
+            break;
 
-                if (!akvcam_buffer_write(akbuffer, &v4l2_buff)) {
-                    akpr_err("Failed writing buffer.\n");
-                    result = -EIO;
-                }
-            } else {
-                akpr_err("Buffers types differs.\n");
-                result = -EINVAL;
-            }
-        } else {
-            akpr_err("Can't read buffer.\n");
-            result = -EIO;
-        }
-    } else {
-        akpr_err("Buffer is empty.\n");
-        result = -EINVAL;
-    }
+        case V4L2_MEMORY_USERPTR:
+            if (buffer->m.userptr && !self->multiplanar)
+                v4l2_buff.m.userptr = buffer->m.userptr;
 
-    mutex_unlock(&self->buffers_mutex);
-    akpr_debug("%s\n", akvcam_string_from_v4l2_buffer(buffer));
+            v4l2_buff.flags = buffer->flags;
+            v4l2_buff.flags |= V4L2_BUF_FLAG_QUEUED;
+            v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_MAPPED
+                                         | V4L2_BUF_FLAG_DONE);
 
-    return result;
-}
+            break;
 
-static akvcam_buffer_t akvcam_buffers_next_buffer(akvcam_buffers_t self)
-{
-    akvcam_list_element_t it = NULL;
-    akvcam_buffer_t buffer;
-    akvcam_buffer_t next_buffer = NULL;
-    struct v4l2_buffer v4l2_buff;
-    __u32 sequence = UINT_MAX;
+        case V4L2_MEMORY_DMABUF:
+            if (!self->multiplanar)
+                v4l2_buff.m.fd = buffer->m.fd;
 
-    for (;;) {
-        buffer = akvcam_list_next(self->buffers, &it);
+            v4l2_buff.flags = buffer->flags;
+            v4l2_buff.flags |= V4L2_BUF_FLAG_QUEUED;
+            v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_MAPPED
+                                         | V4L2_BUF_FLAG_DONE
+                                         | V4L2_BUF_FLAG_ERROR);
 
-        if (!it)
             break;
 
-        if (akvcam_buffer_read(buffer, &v4l2_buff)
-            && v4l2_buff.flags & V4L2_BUF_FLAG_DONE
-            && v4l2_buff.sequence < sequence) {
-            next_buffer = buffer;
-            sequence = v4l2_buff.sequence;
+        default:
+            break;
+        }
+
+        memcpy(buffer, &v4l2_buff, sizeof(struct v4l2_buffer));
+        akvcam_buffer_write(akbuffer, &v4l2_buff);
+
+        if (copy_data || import_data)
+            akvcam_buffer_ref(akbuffer);
+        else
+            akvcam_buffers_push(self, akbuffer, AKVCAM_BUFFER_STATE_QUEUED);
+    }
+
+    mutex_unlock(&self->buffers_mutex);
+
+    if (!result && (copy_data || import_data)) {
+        // Nobody else touches a filling buffer, copy or import the frame
+        // without holding the mutex.
+        if (copy_data)
+            result = akvcam_buffers_copy_user_data(self,
+                                                   akbuffer,
+                                                   &user_buff,
+                                                   false);
+        else
+            result = akvcam_buffers_import(self, akbuffer, &user_buff);
+
+        mutex_lock(&self->buffers_mutex);
+
+        // The buffers could have been freed while copying.
+        if (akvcam_buffer_state(akbuffer) == AKVCAM_BUFFER_STATE_FILLING) {
+            if (result) {
+                akvcam_buffer_read(akbuffer, &v4l2_buff);
+                v4l2_buff.flags &= (__u32) ~V4L2_BUF_FLAG_QUEUED;
+                akvcam_buffer_write(akbuffer, &v4l2_buff);
+                akvcam_buffer_set_state(akbuffer,
+                                        AKVCAM_BUFFER_STATE_DEQUEUED);
+            } else {
+                akvcam_buffers_push(self,
+                                    akbuffer,
+                                    AKVCAM_BUFFER_STATE_QUEUED);
+            }
         }
+
+        mutex_unlock(&self->buffers_mutex);
+        akvcam_buffer_delete(akbuffer);
     }
 
-    return next_buffer;
+    if (!result) {
+        if (akvcam_device_type_from_v4l2(self->type) == AKVCAM_DEVICE_TYPE_OUTPUT)
+            wake_up_interruptible_all(&self->buffers_not_empty);
+        else
+            wake_up_interruptible_all(&self->buffers_not_full);
+    }
+
+    akpr_debug("%s\n", akvcam_string_from_v4l2_buffer(buffer));
+
+    return result;
 }
 
 int akvcam_buffers_dequeue(akvcam_buffers_t self, struct v4l2_buffer *buffer)
 {
     akvcam_buffer_t akbuffer;
     struct v4l2_buffer v4l2_buff;
-    struct v4l2_plane *planes;
-    size_t n_planes;
-    size_t i;
-    void *data;
+    struct v4l2_buffer user_buff;
+    __u32 offset = 0;
+    bool is_capture;
     int result = 0;
 
     akpr_function();
@@ -590,9 +674,12 @@ int akvcam_buffers_dequeue(akvcam_buffers_t self, struct v4l2_buffer *buffer)
     if (!akvcam_buffers_is_supported(self, buffer->memory))
         return -EINVAL;
 
-    if (akvcam_list_empty(self->buffers))
+    if (self->n_buffers < 1)
         return -EIO;
 
+    memcpy(&user_buff, buffer, sizeof(struct v4l2_buffer));
+    is_capture =
+        akvcam_device_type_from_v4l2(self->type) == AKVCAM_DEVICE_TYPE_CAPTURE;
     result = mutex_lock_interruptible(&self->buffers_mutex);
 
     if (result)
@@ -601,7 +688,7 @@ int akvcam_buffers_dequeue(akvcam_buffers_t self, struct v4l2_buffer *buffer)
     if (self->blocking) {
         result =
                 akvcam_wait_condition(self->buffers_not_empty,
-                                      akvcam_buffers_next_buffer(self) != NULL,
+                                      self->done.size > 0,
                                       &self->buffers_mutex,
                                       AKVCAM_WAIT_TIMEOUT_MSECS);
 
@@ -611,164 +698,168 @@ int akvcam_buffers_dequeue(akvcam_buffers_t self, struct v4l2_buffer *buffer)
 
             return result? result: -EAGAIN;
         }
+
+        result = 0;
     }
 
-    akbuffer = akvcam_buffers_next_buffer(self);
+    akbuffer = akvcam_buffers_ring_front(&self->done);
 
-    if (akbuffer) {
-        if (akvcam_buffer_read(akbuffer, &v4l2_buff)) {
-            if (v4l2_buff.type == buffer->type) {
-                if (buffer->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
-                    || buffer->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
-                    v4l2_buff.length = buffer->length;
-                    v4l2_buff.m.planes = buffer->m.planes;
-                }
+    if (!akbuffer) {
+        akpr_err("Buffer is empty.\n");
+        result = -EAGAIN;
+    } else if (!akvcam_buffer_read(akbuffer, &v4l2_buff)) {
+        akpr_err("Can't read buffer.\n");
+        result = -EIO;
+    } else if (v4l2_buff.type != buffer->type) {
+        akpr_err("Buffers types differs.\n");
+        result = -EINVAL;
+    } else {
+        if (buffer->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
+            || buffer->type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
+            v4l2_buff.length = buffer->length;
+            v4l2_buff.m.planes = buffer->m.planes;
+        }
 
-                switch (buffer->memory) {
-                case V4L2_MEMORY_MMAP:
-                    v4l2_buff.flags |= V4L2_BUF_FLAG_MAPPED;
-                    v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_DONE
-                                                 | V4L2_BUF_FLAG_QUEUED);
-                    if (self->multiplanar) {
-                        n_planes = akvcam_min(buffer->length, akvcam_format_planes(self->format));
-
-                        if (akvcam_device_type_from_v4l2(self->type) == AKVCAM_DEVICE_TYPE_CAPTURE) {
-                            planes = kmalloc(buffer->length * sizeof(struct v4l2_plane), GFP_KERNEL);
-
-                            if (planes) {
-                                if (!copy_from_user(planes,
-                                                    (char __user *) buffer->m.planes,
-                                                    buffer->length * sizeof(struct v4l2_plane))) {
-                                    for (i = 0; i < n_planes; i++)
-                                        planes[i].m.mem_offset =
-                                                buffer->index
-                                                * (__u32) akvcam_format_size(self->format)
-                                                + (__u32) akvcam_format_offset(self->format, i);
-
-                                    if (copy_to_user((char __user *) buffer->m.planes,
-                                                     planes,
-                                                     buffer->length * sizeof(struct v4l2_plane))) {
-                                        akpr_err("Failed copying data to user space.\n");
-                                        result = -EIO;
-                                    }
-                                } else {
-                                    akpr_err("Failed copying data from user space.\n");
-                                    result = -EIO;
-                                }
-
-                                kfree(planes);
-                            } else {
-                                akpr_err("Can't allocate memory for the planes.\n");
-                                result = -EIO;
-                            }
-                        }
-                    }
-
-                    break;
-
-                case V4L2_MEMORY_USERPTR:
-                    if (buffer->m.userptr && !self->multiplanar)
-                        v4l2_buff.m.userptr = buffer->m.userptr;
-
-                    v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_MAPPED
-                                                 | V4L2_BUF_FLAG_DONE
-                                                 | V4L2_BUF_FLAG_QUEUED);
-                    if (buffer->length > 1
-                        && buffer->bytesused > 1
-                        && akvcam_device_type_from_v4l2(self->type) == AKVCAM_DEVICE_TYPE_CAPTURE) {
-                        data = vzalloc(buffer->bytesused);
-
-                        if (data) {
-                            if (akvcam_buffer_read_data(akbuffer, data, buffer->bytesused)) {
-                                if (self->multiplanar) {
-                                    planes = kmalloc(buffer->length * sizeof(struct v4l2_plane), GFP_KERNEL);
-
-                                    if (!copy_from_user(planes,
-                                                        (char __user *) buffer->m.planes,
-                                                        buffer->length * sizeof(struct v4l2_plane))) {
-                                        n_planes = akvcam_min(buffer->length,
-                                                              akvcam_format_planes(self->format));
-
-                                        for (i = 0; i < n_planes; i++)
-                                            if (copy_to_user((char __user *) planes[i].m.userptr,
-                                                             (char *) data + akvcam_format_offset(self->format, i),
-                                                             planes[i].length)) {
-                                                akpr_err("Failed copying data to user space.\n");
-                                                result = -EIO;
-
-                                                break;
-                                            }
-                                    } else {
-                                        akpr_err("Failed copying data from user space.\n");
-                                        result = -EIO;
-                                    }
-
-                                    kfree(planes);
-                                } else if (copy_to_user((char __user *) buffer->m.userptr,
-                                                        data,
-                                                        buffer->length)) {
-                                    akpr_err("Failed copying data to user space.\n");
-                                    result = -EIO;
-                                }
-                            } else {
-                                akpr_err("Can't read buffer data.\n");
-                                result = -EIO;
-                            }
-
-                            vfree(data);
-                        }
-                    }
-
-                    break;
-
-                default:
-                    break;
-                }
+        switch (buffer->memory) {
+        case V4L2_MEMORY_MMAP:
+            v4l2_buff.flags |= V4L2_BUF_FLAG_MAPPED;
+            v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_DONE
+                                         | V4L2_BUF_FLAG_QUEUED);
 
-                memcpy(buffer, &v4l2_buff, sizeof(struct v4l2_buffer));
+            break;
 
-                if (!akvcam_buffer_write(akbuffer, &v4l2_buff)) {
-                    akpr_err("Failed writing buffer.\n");
-                    result = -EIO;
-                }
-            } else {
-                akpr_err("Buffers types differs.\n");
-                result = -EINVAL;
-            }
+        case V4L2_MEMORY_USERPTR:
+            if (buffer->m.userptr && !self->multiplanar)
+                v4l2_buff.m.userptr = buffer->m.userptr;
+
+            v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_MAPPED
+                                         | V4L2_BUF_FLAG_DONE
+                                         | V4L2_BUF_FLAG_QUEUED);
+
+            break;
+
+        case V4L2_MEMORY_DMABUF:
+            v4l2_buff.flags &= (__u32) ~(V4L2_BUF_FLAG_MAPPED
+                                         | V4L2_BUF_FLAG_DONE
+                                         | V4L2_BUF_FLAG_QUEUED);
+
+            break;
+
+        default:
+            break;
+        }
+
+        offset = self->buffers[v4l2_buff.index].offset;
+
+        // The buffer stays done, but out of the queue, until the client
+        // gets it, so nobody else can dequeue it.
+        akvcam_buffer_ref(akbuffer);
+        akvcam_buffers_unqueue(self, akbuffer);
+    }
+
+    mutex_unlock(&self->buffers_mutex);
+
+    if (result) {
+        akpr_debug("%s\n", akvcam_string_from_v4l2_buffer(buffer));
+
+        return result;
+    }
+
+    // The client memory can page fault, so it's accessed without holding the
+    // mutex.
+    if (is_capture
+        && user_buff.memory == V4L2_MEMORY_MMAP
+        && self->multiplanar) {
+        result = akvcam_buffers_update_planes(self, &user_buff, offset);
+    } else if (is_capture
+               && user_buff.memory == V4L2_MEMORY_USERPTR
+               && user_buff.length > 1
+               && user_buff.bytesused > 1) {
+        result = akvcam_buffers_copy_user_data(self,
+                                               akbuffer,
+                                               &user_buff,
+                                               true);
+    }
+
+    mutex_lock(&self->buffers_mutex);
+
+    // The buffers could have been freed while copying.
+    if (akvcam_buffer_state(akbuffer) == AKVCAM_BUFFER_STATE_DONE) {
+        if (result) {
+            // Let the client try again.
+            akvcam_buffers_push(self, akbuffer, AKVCAM_BUFFER_STATE_DONE);
+            wake_up_interruptible_all(&self->buffers_not_empty);
         } else {
-            akpr_err("Can't read buffer.\n");
-            result = -EIO;
+            // From here on the buffer belongs to the client.
+            akvcam_buffer_write(akbuffer, &v4l2_buff);
+            akvcam_buffer_set_state(akbuffer, AKVCAM_BUFFER_STATE_DEQUEUED);
         }
-    } else {
-        akpr_err("Buffer is empty.\n");
-        result = -EAGAIN;
     }
 
     mutex_unlock(&self->buffers_mutex);
+    akvcam_buffer_delete(akbuffer);
+
+    if (!result)
+        memcpy(buffer, &v4l2_buff, sizeof(struct v4l2_buffer));
+
     akpr_debug("%s\n", akvcam_string_from_v4l2_buffer(buffer));
 
     return result;
 }
 
-static bool akvcam_buffers_equals_offset(const akvcam_buffer_t buffer,
-                                         const __u32 *offset)
+int akvcam_buffers_export(const akvcam_buffers_t self,
+                          struct v4l2_exportbuffer *buffer)
 {
+    akvcam_buffer_t akbuffer;
     struct v4l2_buffer v4l2_buff;
+    int result;
 
-    if (!akvcam_buffer_read(buffer, &v4l2_buff))
-        return false;
+    akpr_function();
+
+    // All the planes are stored in a single memory plane.
+    if (buffer->type != self->type
+        || buffer->plane > 0
+        || buffer->flags & ~(O_ACCMODE | O_CLOEXEC))
+        return -EINVAL;
+
+    result = mutex_lock_interruptible(&self->buffers_mutex);
+
+    if (result)
+        return result;
+
+    akbuffer = akvcam_buffers_at(self, buffer->index);
+
+    if (!akbuffer
+        || !akvcam_buffer_read(akbuffer, &v4l2_buff)
+        || v4l2_buff.memory != V4L2_MEMORY_MMAP) {
+        akpr_err("Only MMAP buffers can be exported.\n");
+        result = -EINVAL;
+    } else {
+        akvcam_buffer_ref(akbuffer);
+    }
+
+    mutex_unlock(&self->buffers_mutex);
+
+    if (result)
+        return result;
+
+    result = akvcam_buffer_export(akbuffer, buffer->flags);
+    akvcam_buffer_delete(akbuffer);
 
-    return akvcam_between(v4l2_buff.m.offset,
-                          *offset,
-                          v4l2_buff.m.offset + v4l2_buff.bytesused);
+    if (result < 0)
+        return result;
+
+    buffer->fd = result;
+    akvcam_init_reserved(buffer);
+
+    return 0;
 }
 
 int akvcam_buffers_data_map(const akvcam_buffers_t self,
                             __u32 offset,
                             struct vm_area_struct *vma)
 {
-    akvcam_buffer_t buffer;
-    akvcam_list_element_t it;
+    akvcam_buffers_entry_t entry;
     int result;
 
     akpr_function();
@@ -777,11 +868,18 @@ int akvcam_buffers_data_map(const akvcam_buffers_t self,
     if (result)
         return result;
 
-    it = akvcam_list_find(self->buffers,
-                          &offset,
-                          (akvcam_are_equals_t) akvcam_buffers_equals_offset);
-    buffer = akvcam_list_element_data(it);
-    result = akvcam_buffer_map_data(buffer, vma);
+    entry = akvcam_buffers_entry_at_offset(self, offset);
+
+    if (!entry) {
+        mutex_unlock(&self->buffers_mutex);
+
+        return -EINVAL;
+    }
+
+    // The planes of a buffer are mapped from their own offset inside it.
+    result = akvcam_buffer_map_data(entry->buffer,
+                                    vma,
+                                    offset - entry->offset);
     mutex_unlock(&self->buffers_mutex);
 
     return result;
@@ -789,7 +887,7 @@ int akvcam_buffers_data_map(const akvcam_buffers_t self,
 
 bool akvcam_buffers_allocated(const akvcam_buffers_t self)
 {
-    return !akvcam_list_empty(self->buffers);
+    return self->n_buffers > 0;
 }
 
 size_t akvcam_buffers_size_rw(const akvcam_buffers_t self)
@@ -806,7 +904,7 @@ size_t akvcam_buffers_size_rw(const akvcam_buffers_t self)
 
 bool akvcam_buffers_resize_rw(akvcam_buffers_t self, size_t size)
 {
-    if (!akvcam_list_empty(self->buffers))
+    if (self->n_buffers > 0)
         return false;
 
     if (!(self->rw_mode & AKVCAM_RW_MODE_READWRITE))
@@ -984,48 +1082,21 @@ ssize_t akvcam_buffers_write(akvcam_buffers_t self,
     return data_size;
 }
 
-static akvcam_buffer_t akvcam_buffers_next_read_buffer(akvcam_buffers_t self)
-{
-    akvcam_list_element_t it = NULL;
-    akvcam_buffer_t buffer;
-    akvcam_buffer_t next_buffer = NULL;
-    struct v4l2_buffer v4l2_buff;
-    __u32 sequence = UINT_MAX;
-
-    for (;;) {
-        buffer = akvcam_list_next(self->buffers, &it);
-
-        if (!it)
-            break;
-
-        if (akvcam_buffer_read(buffer, &v4l2_buff)
-            && v4l2_buff.flags & V4L2_BUF_FLAG_QUEUED
-            && !(v4l2_buff.flags & V4L2_BUF_FLAG_DONE)
-            && v4l2_buff.sequence < sequence) {
-            next_buffer = buffer;
-            sequence = v4l2_buff.sequence;
-        }
-    }
-
-    return next_buffer;
-}
-
 akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self)
 {
-    akvcam_buffer_t buffer;
-    struct v4l2_buffer v4l2_buff;
-    size_t length;
+    akvcam_buffer_t buffer = NULL;
     akvcam_frame_t frame = NULL;
     size_t frame_size;
+    bool is_read;
     int condition_result;
 
     akpr_function();
 
     if (mutex_lock_interruptible(&self->buffers_mutex) == 0) {
-        if (!akvcam_list_empty(self->buffers)) {
+        if (self->n_buffers > 0) {
             condition_result =
                     akvcam_wait_condition(self->buffers_not_empty,
-                                          akvcam_buffers_next_read_buffer(self),
+                                          self->queued.size > 0,
                                           &self->buffers_mutex,
                                           AKVCAM_WAIT_TIMEOUT_MSECS);
         } else {
@@ -1043,22 +1114,28 @@ akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self)
             return frame;
         }
 
-        if (!akvcam_list_empty(self->buffers)) {
-            buffer = akvcam_buffers_next_read_buffer(self);
-
-            if (buffer && akvcam_buffer_read(buffer, &v4l2_buff)) {
-                if (v4l2_buff.memory == V4L2_MEMORY_MMAP
-                    || v4l2_buff.memory == V4L2_MEMORY_USERPTR) {
-                    frame = akvcam_frame_new(self->format, NULL, 0);
-                    length = akvcam_min((size_t) v4l2_buff.length,
-                                        akvcam_frame_size(frame));
-                    akvcam_buffer_read_data(buffer,
-                                            akvcam_frame_data(frame),
-                                            length);
-                }
+        if (self->n_buffers > 0) {
+            buffer = akvcam_buffers_ring_front(&self->queued);
+
+            if (buffer
+                && (self->memory == V4L2_MEMORY_MMAP
+                    || self->memory == V4L2_MEMORY_USERPTR
+                    || self->memory == V4L2_MEMORY_DMABUF)) {
+                frame = akvcam_frame_new_pooled(self->frame_pool,
+                                                self->format);
+
+                // The buffer is taken out of the queue, and read after
+                // releasing the mutex. Once read, it's given back to the
+                // client, so it can queue it again with a new frame.
+                akvcam_buffer_ref(buffer);
+                akvcam_buffers_unqueue(self, buffer);
+                akvcam_buffer_set_state(buffer, AKVCAM_BUFFER_STATE_FILLING);
+            } else {
+                buffer = NULL;
             }
         } else if (self->rw_mode & AKVCAM_RW_MODE_READWRITE) {
-            frame = akvcam_frame_new(self->format, NULL, 0);
+            frame = akvcam_frame_new_pooled(self->frame_pool,
+                                            self->format);
             frame_size = akvcam_frame_size(frame);
             akvcam_rbuffer_dequeue_bytes(self->rw_buffers,
                                          akvcam_frame_data(frame),
@@ -1070,41 +1147,29 @@ akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self)
             wake_up_interruptible_all(&self->buffers_not_full);
 
         mutex_unlock(&self->buffers_mutex);
-    }
-
-    return frame;
-}
-
-static akvcam_buffer_t akvcam_buffers_next_write_buffer(akvcam_buffers_t self)
-{
-    akvcam_list_element_t it = NULL;
-    akvcam_buffer_t buffer;
-    akvcam_buffer_t next_buffer = NULL;
-    struct v4l2_buffer v4l2_buff;
-    __u32 sequence = UINT_MAX;
 
-    for (;;) {
-        buffer = akvcam_list_next(self->buffers, &it);
+        if (buffer) {
+            is_read = akvcam_buffer_read_data(buffer,
+                                              akvcam_frame_data(frame),
+                                              akvcam_frame_size(frame));
 
-        if (!it)
-            break;
+            akvcam_buffers_finish_read_buffer(self, buffer, is_read);
+            akvcam_buffer_delete(buffer);
 
-        if (akvcam_buffer_read(buffer, &v4l2_buff)
-            && v4l2_buff.flags & (V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_QUEUED)
-            && v4l2_buff.sequence < sequence) {
-            next_buffer = buffer;
-            sequence = v4l2_buff.sequence;
+            if (!is_read) {
+                akvcam_frame_delete(frame);
+                frame = NULL;
+            }
         }
     }
 
-    return next_buffer;
+    return frame;
 }
 
 int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame)
 {
     akvcam_buffer_t buffer;
-    struct v4l2_buffer v4l2_buff;
-    char *data;
+    bool filled = true;
     size_t length;
     int condition_result = -ENOTTY;
     int result = 0;
@@ -1113,7 +1178,7 @@ int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame)
 
     if (mutex_lock_interruptible(&self->buffers_mutex) == 0) {
         if (self->rw_mode & (AKVCAM_RW_MODE_MMAP | AKVCAM_RW_MODE_USERPTR)
-            && !akvcam_list_empty(self->buffers)) {
+            && self->n_buffers > 0) {
             akpr_debug("Writting streaming buffers\n");
             condition_result =
                     akvcam_wait_condition(self->buffers_not_full,
@@ -1128,45 +1193,32 @@ int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame)
                 return condition_result;
             }
 
-            buffer = akvcam_buffers_next_write_buffer(self);
-
-            if (buffer) {
-                if (akvcam_buffer_read(buffer, &v4l2_buff)) {
-                    if (v4l2_buff.memory == V4L2_MEMORY_MMAP
-                        || v4l2_buff.memory == V4L2_MEMORY_USERPTR) {
-                        if (frame) {
-                            length = akvcam_frame_size(frame);
-                            result = akvcam_buffer_write_data(buffer,
-                                                              akvcam_frame_data(frame),
-                                                              length)? 0: -EIO;
-                        } else {
-                            data = vzalloc(v4l2_buff.length);
-                            result = akvcam_buffer_write_data(buffer,
-                                                              data,
-                                                              v4l2_buff.length)? 0: -EIO;
-                            vfree(data);
-                        }
-
-                        if (result == 0) {
-                            akvcam_get_timestamp(&v4l2_buff.timestamp);
-                            v4l2_buff.sequence = self->sequence;
-                            v4l2_buff.flags |= V4L2_BUF_FLAG_DONE;
-
-                            if (akvcam_buffer_write(buffer, &v4l2_buff))
-                                self->sequence++;
-                            else
-                                result = -EIO;
-                        }
-                    }
-                } else {
-                    result = -EIO;
-                }
-            } else {
-                result = -EAGAIN;
-            }
+            buffer = akvcam_buffers_take_write_buffer(self);
+            mutex_unlock(&self->buffers_mutex);
+
+            if (!buffer)
+                return -EAGAIN;
+
+            // The buffer is ours until it's given back, so the frame is
+            // copied without holding the mutex.
+            if (frame)
+                filled = akvcam_buffer_write_data(buffer,
+                                                  akvcam_frame_data(frame),
+                                                  akvcam_frame_size(frame));
+            else
+                memset(akvcam_buffer_data(buffer),
+                       0,
+                       akvcam_buffer_size(buffer));
+
+            mutex_lock(&self->buffers_mutex);
+            result = akvcam_buffers_finish_write_buffer(self, buffer, filled);
+            mutex_unlock(&self->buffers_mutex);
+            akvcam_buffer_delete(buffer);
+
+            return result;
         } else if (frame
                    && self->rw_mode & AKVCAM_RW_MODE_READWRITE
-                   && akvcam_list_empty(self->buffers)) {
+                   && self->n_buffers < 1) {
             akpr_debug("Writting RW buffers\n");
             condition_result =
                     akvcam_wait_condition(self->buffers_not_full,
@@ -1202,6 +1254,88 @@ int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame)
     return result;
 }
 
+// Give the capture the next buffer to be filled, as a frame that writes
+// directly to the buffer memory, so the frame doesn't need to be copied.
+// The frame must be given back with akvcam_buffers_commit_frame. If the
+// device doesn't use streaming buffers, 'frame' is set to NULL and the
+// frame must be written with akvcam_buffers_write_frame instead. 'frame' is
+// NULL too if the client doesn't queue a buffer in time.
+int akvcam_buffers_claim_frame(akvcam_buffers_t self, akvcam_frame_t *frame)
+{
+    akvcam_buffer_t buffer;
+    size_t size = akvcam_format_size(self->format);
+    int result;
+
+    akpr_function();
+    *frame = NULL;
+    result = mutex_lock_interruptible(&self->buffers_mutex);
+
+    if (result)
+        return result;
+
+    // The frames are written to the rw buffers with
+    // akvcam_buffers_write_frame.
+    if (!(self->rw_mode & (AKVCAM_RW_MODE_MMAP | AKVCAM_RW_MODE_USERPTR))
+        || self->n_buffers < 1) {
+        mutex_unlock(&self->buffers_mutex);
+
+        return 0;
+    }
+
+    result = akvcam_wait_condition(self->buffers_not_full,
+                                   akvcam_buffers_next_write_buffer(self),
+                                   &self->buffers_mutex,
+                                   AKVCAM_WAIT_TIMEOUT_MSECS);
+
+    if (result < 1) {
+        if (result != -EINTR)
+            mutex_unlock(&self->buffers_mutex);
+
+        return result;
+    }
+
+    result = 0;
+    buffer = akvcam_buffers_next_write_buffer(self);
+
+    if (!buffer) {
+        result = -EAGAIN;
+    } else if (size > 0 && akvcam_buffer_size(buffer) >= size) {
+        buffer = akvcam_buffers_take_write_buffer(self);
+
+        if (buffer) {
+            akvcam_buffer_delete(self->claimed);
+            self->claimed = buffer;
+            *frame = akvcam_frame_new_wrapped(self->format,
+                                              akvcam_buffer_data(buffer),
+                                              size);
+            akvcam_frame_set_pool(*frame, self->frame_pool);
+        }
+    }
+
+    mutex_unlock(&self->buffers_mutex);
+
+    return result;
+}
+
+int akvcam_buffers_commit_frame(akvcam_buffers_t self, akvcam_frame_t frame)
+{
+    akvcam_buffer_t buffer;
+    int result;
+
+    akpr_function();
+
+    // The claimed buffer must be released even if we get interrupted.
+    mutex_lock(&self->buffers_mutex);
+    akvcam_frame_delete(frame);
+    buffer = self->claimed;
+    self->claimed = NULL;
+    result = akvcam_buffers_finish_write_buffer(self, buffer, true);
+    mutex_unlock(&self->buffers_mutex);
+    akvcam_buffer_delete(buffer);
+
+    return result;
+}
+
 __u32 akvcam_buffers_sequence(akvcam_buffers_t self)
 {
     return self->sequence;
@@ -1223,5 +1357,453 @@ bool akvcam_buffers_is_supported(const akvcam_buffers_t self,
     return (self->rw_mode & AKVCAM_RW_MODE_MMAP
             && type == V4L2_MEMORY_MMAP)
             || (self->rw_mode & AKVCAM_RW_MODE_USERPTR
-                && type == V4L2_MEMORY_USERPTR);
+                && type == V4L2_MEMORY_USERPTR)
+            || (self->rw_mode & AKVCAM_RW_MODE_DMABUF
+                && type == V4L2_MEMORY_DMABUF);
+}
+
+// Forget all the buffers. A claimed buffer is no longer filling, so it won't
+// be committed.
+void akvcam_buffers_clear(akvcam_buffers_t self)
+{
+    size_t i;
+
+    akvcam_buffers_ring_clear(&self->done);
+    akvcam_buffers_ring_clear(&self->queued);
+
+    for (i = 0; i < self->n_buffers; i++) {
+        akvcam_buffer_set_state(self->buffers[i].buffer,
+                                AKVCAM_BUFFER_STATE_DEQUEUED);
+        akvcam_buffer_delete(self->buffers[i].buffer);
+    }
+
+    kfree(self->buffers);
+    self->buffers = NULL;
+    self->n_buffers = 0;
+}
+
+// Make room for count more buffers.
+bool akvcam_buffers_reserve(akvcam_buffers_t self, size_t count)
+{
+    akvcam_buffers_entry_t buffers =
+            krealloc(self->buffers,
+                     (self->n_buffers + count) * sizeof(akvcam_buffers_entry),
+                     GFP_KERNEL);
+
+    if (!buffers)
+        return false;
+
+    self->buffers = buffers;
+
+    return akvcam_buffers_ring_reserve(&self->queued, self->n_buffers + count)
+           && akvcam_buffers_ring_reserve(&self->done, self->n_buffers + count);
+}
+
+// The buffers are mapped one after the other, each one starting at a page
+// boundary.
+__u32 akvcam_buffers_next_offset(const akvcam_buffers_t self)
+{
+    akvcam_buffers_entry_t last;
+
+    if (self->n_buffers < 1)
+        return 0;
+
+    last = self->buffers + self->n_buffers - 1;
+
+    return last->offset + last->size;
+}
+
+// The room must be already reserved with akvcam_buffers_reserve.
+void akvcam_buffers_append(akvcam_buffers_t self,
+                           akvcam_buffer_t buffer,
+                           size_t size)
+{
+    akvcam_buffers_entry_t entry = self->buffers + self->n_buffers;
+
+    entry->offset = akvcam_buffers_next_offset(self);
+    entry->size = (__u32) PAGE_ALIGN(size);
+    entry->buffer = akvcam_buffer_ref(buffer);
+    self->n_buffers++;
+}
+
+akvcam_buffer_t akvcam_buffers_at(const akvcam_buffers_t self, __u32 index)
+{
+    if (index >= self->n_buffers)
+        return NULL;
+
+    return self->buffers[index].buffer;
+}
+
+// Find the buffer mapped to a range containing the offset.
+akvcam_buffers_entry_t akvcam_buffers_entry_at_offset(const akvcam_buffers_t self,
+                                                      __u32 offset)
+{
+    akvcam_buffers_entry_t entry;
+    size_t low = 0;
+    size_t high = self->n_buffers;
+    size_t i;
+
+    if (self->n_buffers < 1 || self->buffers[0].size < 1)
+        return NULL;
+
+    // All the buffers have the same size unless they were added with
+    // VIDIOC_CREATE_BUFS for another format, then search for it, the offsets
+    // grow with the index.
+    i = offset / self->buffers[0].size;
+
+    while (low < high) {
+        if (i < low || i >= high)
+            i = low + (high - low) / 2;
+
+        entry = self->buffers + i;
+
+        if (offset < entry->offset)
+            high = i;
+        else if (offset >= entry->offset + entry->size)
+            low = i + 1;
+        else
+            return entry;
+    }
+
+    return NULL;
+}
+
+// Add the buffer at the end of the queue of the state.
+void akvcam_buffers_push(akvcam_buffers_t self,
+                         akvcam_buffer_t buffer,
+                         AKVCAM_BUFFER_STATE state)
+{
+    akvcam_buffers_ring_push(state == AKVCAM_BUFFER_STATE_DONE?
+                                 &self->done:
+                                 &self->queued,
+                             buffer);
+    akvcam_buffer_set_state(buffer, state);
+}
+
+// Remove the buffer from the queue of its state.
+void akvcam_buffers_unqueue(akvcam_buffers_t self, akvcam_buffer_t buffer)
+{
+    switch (akvcam_buffer_state(buffer)) {
+    case AKVCAM_BUFFER_STATE_QUEUED:
+        akvcam_buffers_ring_remove(&self->queued, buffer);
+
+        break;
+
+    case AKVCAM_BUFFER_STATE_DONE:
+        akvcam_buffers_ring_remove(&self->done, buffer);
+
+        break;
+
+    default:
+        break;
+    }
+}
+
+// The buffers queued by the client are filled first. If there are none, the
+// oldest frame not dequeued yet is dropped, and its buffer filled again.
+akvcam_buffer_t akvcam_buffers_next_write_buffer(akvcam_buffers_t self)
+{
+    if (self->queued.size > 0)
+        return akvcam_buffers_ring_front(&self->queued);
+
+    return akvcam_buffers_ring_front(&self->done);
+}
+
+// Make room for capacity buffers, keeping the ones in the ring in order.
+bool akvcam_buffers_ring_reserve(akvcam_buffers_ring_t ring, size_t capacity)
+{
+    akvcam_buffer_t *buffers;
+    size_t i;
+
+    if (capacity <= ring->capacity)
+        return true;
+
+    buffers = kmalloc(capacity * sizeof(akvcam_buffer_t), GFP_KERNEL);
+
+    if (!buffers)
+        return false;
+
+    for (i = 0; i < ring->size; i++)
+        buffers[i] = ring->buffers[(ring->first + i) % ring->capacity];
+
+    kfree(ring->buffers);
+    ring->buffers = buffers;
+    ring->capacity = capacity;
+    ring->first = 0;
+
+    return true;
+}
+
+void akvcam_buffers_ring_clear(akvcam_buffers_ring_t ring)
+{
+    kfree(ring->buffers);
+    memset(ring, 0, sizeof(akvcam_buffers_ring));
+}
+
+// The ring doesn't hold a reference to the buffer, the buffers array does.
+void akvcam_buffers_ring_push(akvcam_buffers_ring_t ring,
+                              akvcam_buffer_t buffer)
+{
+    if (ring->size >= ring->capacity)
+        return;
+
+    ring->buffers[(ring->first + ring->size) % ring->capacity] = buffer;
+    ring->size++;
+}
+
+// The buffer is almost always the first one in the ring, otherwise the
+// buffers after it are moved back.
+void akvcam_buffers_ring_remove(akvcam_buffers_ring_t ring,
+                                akvcam_buffer_t buffer)
+{
+    size_t i;
+
+    for (i = 0; i < ring->size; i++)
+        if (ring->buffers[(ring->first + i) % ring->capacity] == buffer)
+            break;
+
+    if (i >= ring->size)
+        return;
+
+    if (i == 0) {
+        ring->first = (ring->first + 1) % ring->capacity;
+    } else {
+        for (; i + 1 < ring->size; i++)
+            ring->buffers[(ring->first + i) % ring->capacity] =
+                    ring->buffers[(ring->first + i + 1) % ring->capacity];
+    }
+
+    ring->size--;
+}
+
+akvcam_buffer_t akvcam_buffers_ring_front(const akvcam_buffers_ring_t ring)
+{
+    if (ring->size < 1)
+        return NULL;
+
+    return ring->buffers[ring->first];
+}
+
+// Take the next buffer to be filled out of its queue. The caller owns it, and
+// can write to it without holding the mutex, until it's given back with
+// akvcam_buffers_finish_write_buffer.
+akvcam_buffer_t akvcam_buffers_take_write_buffer(akvcam_buffers_t self)
+{
+    akvcam_buffer_t buffer = akvcam_buffers_next_write_buffer(self);
+
+    if (!buffer
+        || (self->memory != V4L2_MEMORY_MMAP
+            && self->memory != V4L2_MEMORY_USERPTR))
+        return NULL;
+
+    // Don't let the buffer be dequeued while it's being filled.
+    akvcam_buffer_clear_flags(buffer, V4L2_BUF_FLAG_DONE);
+    akvcam_buffers_unqueue(self, buffer);
+    akvcam_buffer_set_state(buffer, AKVCAM_BUFFER_STATE_FILLING);
+
+    return akvcam_buffer_ref(buffer);
+}
+
+// Give back a buffer taken with akvcam_buffers_take_write_buffer, as done if
+// it was filled, or queued again otherwise.
+int akvcam_buffers_finish_write_buffer(akvcam_buffers_t self,
+                                       akvcam_buffer_t buffer,
+                                       bool filled)
+{
+    struct v4l2_buffer v4l2_buff;
+
+    // The buffers could have been freed while the frame was being written,
+    // in that case just drop the frame.
+    if (!buffer
+        || akvcam_buffer_state(buffer) != AKVCAM_BUFFER_STATE_FILLING)
+        return -EAGAIN;
+
+    if (!filled || !akvcam_buffer_read(buffer, &v4l2_buff)) {
+        akvcam_buffers_push(self, buffer, AKVCAM_BUFFER_STATE_QUEUED);
+
+        return -EIO;
+    }
+
+    // Make sure the frame is in memory before the consumer can see the
+    // buffer, it could have been written with non-temporal stores.
+    wmb();
+    akvcam_get_timestamp(&v4l2_buff.timestamp);
+    v4l2_buff.sequence = self->sequence;
+    v4l2_buff.flags |= V4L2_BUF_FLAG_DONE;
+    akvcam_buffer_write(buffer, &v4l2_buff);
+    akvcam_buffers_push(self, buffer, AKVCAM_BUFFER_STATE_DONE);
+    self->sequence++;
+    wake_up_interruptible_all(&self->buffers_not_empty);
+
+    return 0;
+}
+
+// Give back to the client a buffer consumed by akvcam_buffers_read_frame.
+void akvcam_buffers_finish_read_buffer(akvcam_buffers_t self,
+                                       akvcam_buffer_t buffer,
+                                       bool is_read)
+{
+    struct v4l2_buffer v4l2_buff;
+
+    mutex_lock(&self->buffers_mutex);
+
+    // The buffers could have been freed while the frame was being read.
+    if (akvcam_buffer_state(buffer) == AKVCAM_BUFFER_STATE_FILLING
+        && akvcam_buffer_read(buffer, &v4l2_buff)) {
+        v4l2_buff.sequence = self->sequence;
+        v4l2_buff.flags |= V4L2_BUF_FLAG_DONE;
+
+        if (!is_read)
+            v4l2_buff.flags |= V4L2_BUF_FLAG_ERROR;
+
+        akvcam_buffer_write(buffer, &v4l2_buff);
+        akvcam_buffers_push(self, buffer, AKVCAM_BUFFER_STATE_DONE);
+        self->sequence++;
+        wake_up_interruptible_all(&self->buffers_not_empty);
+    }
+
+    mutex_unlock(&self->buffers_mutex);
+}
+
+// Copy the frame between a USERPTR buffer and the client memory. The client
+// memory can page fault, so this must be called by the owner of the buffer
+// without holding the mutex.
+int akvcam_buffers_copy_user_data(akvcam_buffers_t self,
+                                  akvcam_buffer_t buffer,
+                                  const struct v4l2_buffer *v4l2_buff,
+                                  bool to_user)
+{
+    char *data = akvcam_buffer_data(buffer);
+    size_t size = akvcam_buffer_size(buffer);
+    struct v4l2_plane *planes;
+    size_t n_planes;
+    size_t offset;
+    size_t length;
+    size_t i;
+    unsigned long left = 0;
+
+    if (!self->multiplanar) {
+        length = akvcam_min((size_t) v4l2_buff->length, size);
+
+        if (to_user)
+            left = copy_to_user((char __user *) v4l2_buff->m.userptr,
+                                data,
+                                length);
+        else
+            left = copy_from_user(data,
+                                  (char __user *) v4l2_buff->m.userptr,
+                                  length);
+    } else {
+        planes = kmalloc(v4l2_buff->length * sizeof(struct v4l2_plane),
+                         GFP_KERNEL);
+
+        if (!planes) {
+            akpr_err("Can't allocate memory for the planes.\n");
+
+            return -ENOMEM;
+        }
+
+        left = copy_from_user(planes,
+                              (char __user *) v4l2_buff->m.planes,
+                              v4l2_buff->length * sizeof(struct v4l2_plane));
+        n_planes = akvcam_min((size_t) v4l2_buff->length,
+                              akvcam_format_mplanes(self->format));
+
+        for (i = 0; !left && i < n_planes; i++) {
+            offset = akvcam_format_offset(self->format, i);
+
+            if (offset >= size)
+                break;
+
+            length = akvcam_min((size_t) planes[i].length, size - offset);
+
+            if (to_user)
+                left = copy_to_user((char __user *) planes[i].m.userptr,
+                                    data + offset,
+                                    length);
+            else
+                left = copy_from_user(data + offset,
+                                      (char __user *) planes[i].m.userptr,
+                                      length);
+        }
+
+        kfree(planes);
+    }
+
+    if (left) {
+        akpr_err("Failed copying data %s user space.\n",
+                 to_user? "to": "from");
+
+        return -EIO;
+    }
+
+    return 0;
+}
+
+// Tell the client where each plane of a multiplanar MMAP buffer is mapped.
+int akvcam_buffers_update_planes(akvcam_buffers_t self,
+                                 const struct v4l2_buffer *v4l2_buff,
+                                 __u32 offset)
+{
+    struct v4l2_plane *planes;
+    size_t n_planes;
+    size_t i;
+    int result = 0;
+
+    planes = kmalloc(v4l2_buff->length * sizeof(struct v4l2_plane),
+                     GFP_KERNEL);
+
+    if (!planes) {
+        akpr_err("Can't allocate memory for the planes.\n");
+
+        return -EIO;
+    }
+
+    if (copy_from_user(planes,
+                       (char __user *) v4l2_buff->m.planes,
+                       v4l2_buff->length * sizeof(struct v4l2_plane))) {
+        akpr_err("Failed copying data from user space.\n");
+        result = -EIO;
+    } else {
+        n_planes = akvcam_min((size_t) v4l2_buff->length,
+                              akvcam_format_mplanes(self->format));
+
+        for (i = 0; i < n_planes; i++)
+            planes[i].m.mem_offset =
+                    offset + (__u32) akvcam_format_offset(self->format, i);
+
+        if (copy_to_user((char __user *) v4l2_buff->m.planes,
+                         planes,
+                         v4l2_buff->length * sizeof(struct v4l2_plane))) {
+            akpr_err("Failed copying data to user space.\n");
+            result = -EIO;
+        }
+    }
+
+    kfree(planes);
+
+    return result;
+}
+
+// Map the dma-buf sent by the client, the frames are read straight from it.
+int akvcam_buffers_import(akvcam_buffers_t self,
+                          akvcam_buffer_t buffer,
+                          const struct v4l2_buffer *v4l2_buff)
+{
+    struct v4l2_plane plane;
+
+    if (!self->multiplanar)
+        return akvcam_buffer_import(buffer, v4l2_buff->m.fd);
+
+    // The frame is in a single memory plane.
+    if (v4l2_buff->length < 1
+        || copy_from_user(&plane,
+                          (char __user *) v4l2_buff->m.planes,
+                          sizeof(struct v4l2_plane))) {
+        akpr_err("Failed copying data from user space.\n");
+
+        return -EIO;
+    }
+
+    return akvcam_buffer_import(buffer, plane.m.fd);
 }
@@ -24,6 +24,7 @@
 #include "buffers_types.h"
 #include "device_types.h"
 #include "format_types.h"
+#include "frame_pool.h"
 #include "frame_types.h"
 #include "node_types.h"
 
@@ -34,6 +35,7 @@ struct v4l2_buffer;
 struct v4l2_requestbuffers;
 struct v4l2_create_buffers;
 struct v4l2_event;
+struct v4l2_exportbuffer;
 struct vm_area_struct;
 
 akvcam_buffers_t akvcam_buffers_new(AKVCAM_RW_MODE rw_mode,
@@ -46,6 +48,8 @@ bool akvcam_buffers_blocking(akvcam_buffers_t self);
 void akvcam_buffers_set_blocking(akvcam_buffers_t self, bool blocking);
 akvcam_format_t akvcam_buffers_format(akvcam_buffers_t self);
 void akvcam_buffers_set_format(akvcam_buffers_t self, akvcam_format_t format);
+void akvcam_buffers_set_frame_pool(akvcam_buffers_t self,
+                                   akvcam_frame_pool_t frame_pool);
 int akvcam_buffers_allocate(akvcam_buffers_t self,
                             struct v4l2_requestbuffers *params);
 void akvcam_buffers_deallocate(akvcam_buffers_t self);
@@ -56,6 +60,8 @@ int akvcam_buffers_query(const akvcam_buffers_t self,
                          struct v4l2_buffer *buffer);
 int akvcam_buffers_queue(akvcam_buffers_t self, struct v4l2_buffer *buffer);
 int akvcam_buffers_dequeue(akvcam_buffers_t self, struct v4l2_buffer *buffer);
+int akvcam_buffers_export(const akvcam_buffers_t self,
+                          struct v4l2_exportbuffer *buffer);
 int akvcam_buffers_data_map(const akvcam_buffers_t self,
                             __u32 offset,
                             struct vm_area_struct *vma);
@@ -70,6 +76,8 @@ ssize_t akvcam_buffers_write(akvcam_buffers_t self,
                              size_t size);
 akvcam_frame_t akvcam_buffers_read_frame(akvcam_buffers_t self);
 int akvcam_buffers_write_frame(akvcam_buffers_t self, akvcam_frame_t frame);
+int akvcam_buffers_claim_frame(akvcam_buffers_t self, akvcam_frame_t *frame);
+int akvcam_buffers_commit_frame(akvcam_buffers_t self, akvcam_frame_t frame);
 __u32 akvcam_buffers_sequence(akvcam_buffers_t self);
 void akvcam_buffers_reset_sequence(akvcam_buffers_t self);
 
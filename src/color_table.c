@@ -0,0 +1,359 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/kref.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "color_table.h"
+#include "global_deleter.h"
+#include "utils.h"
+
+struct akvcam_color_table
+{
+    struct kref ref;
+    int hue;
+    int saturation;
+    int luminance;
+    int contrast;
+    int gamma;
+    bool gray;
+
+    // Rotated hue, the high byte is the color wheel sector (0 to 5), and the
+    // low byte is the weight of the second strongest component in that
+    // sector (0 to 60).
+    uint16_t hue_table[360];
+
+    // Saturation and luminance with the controls applied.
+    uint8_t saturation_table[256];
+    uint8_t luminance_table[256];
+
+    // Reciprocals of 0 to 255, so the divisions in the RGB to HSL conversion
+    // can be replaced by multiplications.
+    uint64_t reciprocals[256];
+
+    // Gamma followed by contrast.
+    uint8_t level_table[256];
+
+    // Red, green and blue weights of the gray scale conversion, with the
+    // levels already applied.
+    uint16_t luma_table[3 * 256];
+
+    // Luminance followed by the levels, applied to the Y component of the YUV
+    // frames, in the 16 to 235 range first, and in the 0 to 255 range second.
+    uint8_t y_table[2][256];
+};
+
+const uint8_t *akvcam_contrast_table(void);
+const uint8_t *akvcam_gamma_table(void);
+
+akvcam_color_table_t akvcam_color_table_new(int hue,
+                                            int saturation,
+                                            int luminance,
+                                            int contrast,
+                                            int gamma,
+                                            bool gray)
+{
+    const uint8_t *contrast_table = akvcam_contrast_table();
+    const uint8_t *gamma_table = akvcam_gamma_table();
+    size_t contrast_offset;
+    size_t gamma_offset;
+    int y_offset;
+    int y_levels;
+    int level;
+    int h;
+    int i;
+    int j;
+
+    akvcam_color_table_t self = kzalloc(sizeof(struct akvcam_color_table),
+                                        GFP_KERNEL);
+    kref_init(&self->ref);
+    self->hue = hue;
+    self->saturation = saturation;
+    self->luminance = luminance;
+    self->contrast = contrast;
+    self->gamma = gamma;
+    self->gray = gray;
+
+    for (i = 0; i < 360; i++) {
+        h = akvcam_mod(i + hue, 360);
+        self->hue_table[i] = (uint16_t) (((h / 60) << 8)
+                                         | (60 - akvcam_abs(h % 120 - 60)));
+    }
+
+    for (i = 0; i < 256; i++) {
+        self->saturation_table[i] =
+                (uint8_t) akvcam_bound(0, i + saturation, 255);
+        self->luminance_table[i] =
+                (uint8_t) akvcam_bound(0, i + luminance, 255);
+    }
+
+    // The numerators are always lower than 2^32 / 255, so rounding the
+    // reciprocals up gives the exact quotient.
+    self->reciprocals[0] = 0;
+
+    for (i = 1; i < 256; i++)
+        self->reciprocals[i] = 0xffffffffULL / (uint64_t) i + 1;
+
+    contrast = akvcam_bound(-255, contrast, 255);
+    contrast_offset = (size_t) (contrast + 255) << 8;
+    gamma = akvcam_bound(-255, gamma, 255);
+    gamma_offset = (size_t) (gamma + 255) << 8;
+
+    for (i = 0; i < 256; i++) {
+        level = i;
+
+        if (gamma_table && gamma != 0)
+            level = gamma_table[gamma_offset | (size_t) level];
+
+        if (contrast_table && contrast != 0)
+            level = contrast_table[contrast_offset | (size_t) level];
+
+        self->level_table[i] = (uint8_t) level;
+        self->luma_table[i] = (uint16_t) (11 * level);
+        self->luma_table[256 + i] = (uint16_t) (16 * level);
+        self->luma_table[512 + i] = (uint16_t) (5 * level);
+    }
+
+    for (j = 0; j < 2; j++) {
+        y_offset = j? 0: 16;
+        y_levels = j? 255: 219;
+
+        for (i = 0; i < 256; i++) {
+            level = akvcam_bound(0,
+                                 ((i - y_offset) * 255 + y_levels / 2)
+                                 / y_levels,
+                                 255);
+            level = self->level_table[akvcam_bound(0, level + luminance, 255)];
+            self->y_table[j][i] =
+                    (uint8_t) (y_offset + (level * y_levels + 127) / 255);
+        }
+    }
+
+    return self;
+}
+
+void akvcam_color_table_free(struct kref *ref)
+{
+    akvcam_color_table_t self =
+            container_of(ref, struct akvcam_color_table, ref);
+    kfree(self);
+}
+
+void akvcam_color_table_delete(akvcam_color_table_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_color_table_free);
+}
+
+akvcam_color_table_t akvcam_color_table_ref(akvcam_color_table_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+bool akvcam_color_table_matches(const akvcam_color_table_t self,
+                                int hue,
+                                int saturation,
+                                int luminance,
+                                int contrast,
+                                int gamma,
+                                bool gray)
+{
+    return self
+           && self->hue == hue
+           && self->saturation == saturation
+           && self->luminance == luminance
+           && self->contrast == contrast
+           && self->gamma == gamma
+           && self->gray == gray;
+}
+
+bool akvcam_color_table_hsl(const akvcam_color_table_t self)
+{
+    return self->hue != 0 || self->saturation != 0 || self->luminance != 0;
+}
+
+bool akvcam_color_table_levels(const akvcam_color_table_t self)
+{
+    return self->contrast != 0 || self->gamma != 0 || self->gray;
+}
+
+bool akvcam_color_table_gray(const akvcam_color_table_t self)
+{
+    return self->gray;
+}
+
+const uint16_t *akvcam_color_table_hue(const akvcam_color_table_t self)
+{
+    return self->hue_table;
+}
+
+const uint8_t *akvcam_color_table_saturation(const akvcam_color_table_t self)
+{
+    return self->saturation_table;
+}
+
+const uint8_t *akvcam_color_table_luminance(const akvcam_color_table_t self)
+{
+    return self->luminance_table;
+}
+
+const uint64_t *akvcam_color_table_reciprocals(const akvcam_color_table_t self)
+{
+    return self->reciprocals;
+}
+
+const uint8_t *akvcam_color_table_level(const akvcam_color_table_t self)
+{
+    return self->level_table;
+}
+
+const uint16_t *akvcam_color_table_luma(const akvcam_color_table_t self)
+{
+    return self->luma_table;
+}
+
+const uint8_t *akvcam_color_table_y(const akvcam_color_table_t self,
+                                    bool full_range)
+{
+    return self->y_table[full_range? 1: 0];
+}
+
+const uint8_t *akvcam_contrast_table(void)
+{
+    static uint8_t *contrast_table = NULL;
+    size_t i;
+    size_t j = 0;
+    ssize_t contrast;
+    ssize_t f_num;
+    ssize_t f_den;
+    ssize_t ic;
+
+    if (contrast_table)
+        return contrast_table;
+
+    contrast_table = vmalloc(511 * 256);
+
+    for (contrast = -255; contrast < 256; contrast++) {
+        f_num = 259 * (255 + contrast);
+        f_den = 255 * (259 - contrast);
+
+        for (i = 0; i < 256; i++, j++) {
+            ic = (f_num * ((ssize_t) i - 128) + 128 * f_den) / f_den;
+            contrast_table[j] = (uint8_t) akvcam_bound(0, ic, 255);
+        }
+    }
+
+    akvcam_global_deleter_add(contrast_table, (akvcam_delete_t) vfree);
+
+    return contrast_table;
+}
+
+/* Gamma correction is traditionally computed with the following formula:
+ *
+ * c = N * (c / N) ^ gamma
+ *
+ * Where 'c' is the color component and 'N' is the maximum value of the color
+ * component, 255 in this case. The formula will define a curve between 0 and
+ * N. When 'gamma' is 1 it will draw a rect, returning the identity image at the
+ * output. when 'gamma' is near to 0 it will draw a decreasing curve (mountain),
+ * Giving more light to darker colors. When 'gamma' is higher than 1 it will
+ * draw a increasing curve (valley), making bright colors darker.
+ *
+ * Explained in a simple way, gamma correction will modify image brightness
+ * preserving the contrast.
+ *
+ * The problem with the original formula is that it requires floating point
+ * computing which is not possible in the kernel because not all target
+ * architectures have a FPU.
+ *
+ * So instead, we will use a quadric function, that even if it does not returns
+ * the same values, it will cause the same effect and is good enough for our
+ * purpose. We use the formula:
+ *
+ * y = a * x ^ 2 + b * x
+ *
+ * and because we have the point (0, N) already defined, then we can calculate
+ * b as :
+ *
+ * b = 1 - a * N
+ *
+ * and replacing
+ *
+ * y = a * x ^ 2 + (1 - a * N) * x
+ *
+ * we are missing a third point (x', y') to fully define the value of 'a', so
+ * the value of 'a' will be given by:
+ *
+ * a = (y' - x') / (x' ^ 2 - N * x')
+ *
+ * we will take the point (x', y') from the segment orthogonal to the curve's
+ * segment, that is:
+ *
+ * y' = N - x'
+ *
+ * Here x' will be our fake 'gamma' value.
+ * Then the value of 'a' becomes:
+ *
+ * a = (N - 2 * x') / (x' ^ 2 - N * x')
+ *
+ * finally we clamp/bound the resulting value between 0 and N and that's what
+ * this code does.
+ */
+const uint8_t *akvcam_gamma_table(void)
+{
+    static uint8_t *gamma_table = NULL;
+    ssize_t i;
+    size_t j = 0;
+    ssize_t gamma;
+    ssize_t f_num;
+    ssize_t f_den;
+    ssize_t g;
+    ssize_t ig;
+
+    if (gamma_table)
+        return gamma_table;
+
+    gamma_table = vmalloc(511 * 256);
+
+    for (gamma = -255; gamma < 256; gamma++) {
+        g = (255 + gamma) >> 1;
+        f_num = 2 * g - 255;
+        f_den = g * (g - 255);
+
+        for (i = 0; i < 256; i++, j++) {
+            if (g > 0 && g != 255) {
+                ig = (f_num * i * i + (f_den - f_num * 255) * i) / f_den;
+                ig = akvcam_bound(0, ig, 255);
+            } else if (g != 255) {
+                ig = 0;
+            } else {
+                ig = 255;
+            }
+
+            gamma_table[j] = (uint8_t) ig;
+        }
+    }
+
+    akvcam_global_deleter_add(gamma_table, (akvcam_delete_t) vfree);
+
+    return gamma_table;
+}
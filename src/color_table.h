@@ -0,0 +1,62 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_COLOR_TABLE_H
+#define AKVCAM_COLOR_TABLE_H
+
+#include <linux/types.h>
+
+// Precision of the reciprocals table.
+#define AKVCAM_COLOR_TABLE_SHIFT 32
+
+// Precision of the gray scale weights.
+#define AKVCAM_COLOR_TABLE_LUMA_SHIFT 5
+
+struct akvcam_color_table;
+typedef struct akvcam_color_table *akvcam_color_table_t;
+
+// public
+akvcam_color_table_t akvcam_color_table_new(int hue,
+                                            int saturation,
+                                            int luminance,
+                                            int contrast,
+                                            int gamma,
+                                            bool gray);
+void akvcam_color_table_delete(akvcam_color_table_t self);
+akvcam_color_table_t akvcam_color_table_ref(akvcam_color_table_t self);
+
+bool akvcam_color_table_matches(const akvcam_color_table_t self,
+                                int hue,
+                                int saturation,
+                                int luminance,
+                                int contrast,
+                                int gamma,
+                                bool gray);
+bool akvcam_color_table_hsl(const akvcam_color_table_t self);
+bool akvcam_color_table_levels(const akvcam_color_table_t self);
+bool akvcam_color_table_gray(const akvcam_color_table_t self);
+const uint16_t *akvcam_color_table_hue(const akvcam_color_table_t self);
+const uint8_t *akvcam_color_table_saturation(const akvcam_color_table_t self);
+const uint8_t *akvcam_color_table_luminance(const akvcam_color_table_t self);
+const uint64_t *akvcam_color_table_reciprocals(const akvcam_color_table_t self);
+const uint8_t *akvcam_color_table_level(const akvcam_color_table_t self);
+const uint16_t *akvcam_color_table_luma(const akvcam_color_table_t self);
+const uint8_t *akvcam_color_table_y(const akvcam_color_table_t self,
+                                    bool full_range);
+
+#endif // AKVCAM_COLOR_TABLE_H
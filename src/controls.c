@@ -73,17 +73,18 @@ akvcam_menu_item_t akvcam_controls_colorfx_menu(akvcam_controls_t controls,
                                                 bool *int_menu);
 
 static akvcam_control_params akvcam_controls_capture[] = {
-    {V4L2_CID_USER_CLASS, V4L2_CTRL_TYPE_CTRL_CLASS,   "User Controls",    0,   0, 0, 0, V4L2_CTRL_FLAG_READ_ONLY
-                                                                                       | V4L2_CTRL_FLAG_WRITE_ONLY, NULL                        },
-    {V4L2_CID_BRIGHTNESS,    V4L2_CTRL_TYPE_INTEGER,      "Brightness", -255, 255, 1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
-    {V4L2_CID_CONTRAST  ,    V4L2_CTRL_TYPE_INTEGER,        "Contrast", -255, 255, 1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
-    {V4L2_CID_SATURATION,    V4L2_CTRL_TYPE_INTEGER,      "Saturation", -255, 255, 1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
-    {V4L2_CID_HUE       ,    V4L2_CTRL_TYPE_INTEGER,             "Hue", -359, 359, 1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
-    {V4L2_CID_GAMMA     ,    V4L2_CTRL_TYPE_INTEGER,           "Gamma", -255, 255, 1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
-    {V4L2_CID_HFLIP     ,    V4L2_CTRL_TYPE_BOOLEAN, "Horizontal Flip",    0,   1, 1, 0,                         0, NULL                        },
-    {V4L2_CID_VFLIP     ,    V4L2_CTRL_TYPE_BOOLEAN,   "Vertical Flip",    0,   1, 1, 0,                         0, NULL                        },
-    {V4L2_CID_COLORFX   ,       V4L2_CTRL_TYPE_MENU,   "Color Effects",    0,   0, 1, 0,                         0, akvcam_controls_colorfx_menu},
-    {0                  ,                         0,                "",    0,   0, 0, 0,                         0, NULL                        },
+    {V4L2_CID_USER_CLASS, V4L2_CTRL_TYPE_CTRL_CLASS,   "User Controls",    0,   0,  0, 0, V4L2_CTRL_FLAG_READ_ONLY
+                                                                                        | V4L2_CTRL_FLAG_WRITE_ONLY, NULL                        },
+    {V4L2_CID_BRIGHTNESS,    V4L2_CTRL_TYPE_INTEGER,      "Brightness", -255, 255,  1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
+    {V4L2_CID_CONTRAST  ,    V4L2_CTRL_TYPE_INTEGER,        "Contrast", -255, 255,  1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
+    {V4L2_CID_SATURATION,    V4L2_CTRL_TYPE_INTEGER,      "Saturation", -255, 255,  1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
+    {V4L2_CID_HUE       ,    V4L2_CTRL_TYPE_INTEGER,             "Hue", -359, 359,  1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
+    {V4L2_CID_GAMMA     ,    V4L2_CTRL_TYPE_INTEGER,           "Gamma", -255, 255,  1, 0,     V4L2_CTRL_FLAG_SLIDER, NULL                        },
+    {V4L2_CID_HFLIP     ,    V4L2_CTRL_TYPE_BOOLEAN, "Horizontal Flip",    0,   1,  1, 0,                         0, NULL                        },
+    {V4L2_CID_VFLIP     ,    V4L2_CTRL_TYPE_BOOLEAN,   "Vertical Flip",    0,   1,  1, 0,                         0, NULL                        },
+    {V4L2_CID_ROTATE    ,    V4L2_CTRL_TYPE_INTEGER,          "Rotate",    0, 270, 90, 0,                         0, NULL                        },
+    {V4L2_CID_COLORFX   ,       V4L2_CTRL_TYPE_MENU,   "Color Effects",    0,   0,  1, 0,                         0, akvcam_controls_colorfx_menu},
+    {0                  ,                         0,                "",    0,   0,  0, 0,                         0, NULL                        },
 };
 
 akvcam_menu_item_t akvcam_controls_scaling_menu(akvcam_controls_t controls,
@@ -705,14 +706,16 @@ akvcam_menu_item_t akvcam_controls_scaling_menu(akvcam_controls_t controls,
                                                 bool *int_menu)
 {
     static akvcam_menu_item scaling[] = {
-        {.name = "Fast"  },
-        {.name = "Linear"},
+        {.name = "Fast"   },
+        {.name = "Linear" },
+        {.name = "Area"   },
+        {.name = "Bicubic"},
     };
 
     UNUSED(controls);
 
     if (size)
-        *size = 2;
+        *size = 4;
 
     if (int_menu)
         *int_menu = false;
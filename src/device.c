@@ -17,8 +17,8 @@
  */
 
 #include <linux/delay.h>
+#include <linux/cpumask.h>
 #include <linux/kthread.h>
-#include <linux/random.h>
 #include <linux/slab.h>
 #include <linux/mutex.h>
 #include <media/v4l2-device.h>
@@ -26,6 +26,7 @@
 #include "device.h"
 #include "attributes.h"
 #include "buffers.h"
+#include "color_table.h"
 #include "controls.h"
 #include "driver.h"
 #include "events.h"
@@ -45,6 +46,10 @@
 #define VFL_TYPE_VIDEO VFL_TYPE_GRABBER
 #endif
 
+// Lines the gradient pattern moves in each frame, even so the 4:2:0 chroma
+// moves whole lines too.
+#define AKVCAM_DEVICE_PATTERN_SCROLL 2
+
 struct akvcam_device
 {
     struct kref ref;
@@ -59,7 +64,11 @@ struct akvcam_device
     akvcam_node_t priority_node;
     akvcam_node_t controlling_node;
     akvcam_buffers_t buffers;
+    akvcam_frame_pool_t frame_pool;
     akvcam_frame_t current_frame;
+    akvcam_frame_t pattern_frame;
+    akvcam_scaler_t scaler;
+    akvcam_color_table_t color_table;
     struct mutex mtx;
     struct mutex clock_mtx;
     struct v4l2_device v4l2_dev;
@@ -70,6 +79,10 @@ struct akvcam_device
     AKVCAM_RW_MODE rw_mode;
     enum v4l2_priority priority;
     int32_t videonr;
+    size_t stripes;
+    bool process_yuv;
+    AKVCAM_PATTERN pattern;
+    size_t pattern_offset;
     int64_t broadcasting_node;
     bool streaming;
     bool streaming_rw;
@@ -84,6 +97,7 @@ struct akvcam_device
     bool horizontal_mirror;
     bool vertical_mirror;
     bool swap_rgb;
+    int rotation;
 
     // Output controls
     bool horizontal_flip;
@@ -100,10 +114,13 @@ void akvcam_device_event_received(akvcam_device_t self,
                                   struct v4l2_event *event);
 void akvcam_device_controls_changed(akvcam_device_t self,
                                     struct v4l2_event *event);
+void akvcam_device_update_color_table(akvcam_device_t self);
 int akvcam_device_clock_timeout(akvcam_device_t self);
-akvcam_frame_t akvcam_device_frame_apply_adjusts(const akvcam_device_t self,
-                                                 akvcam_frame_t frame);
+void akvcam_device_frame_apply_adjusts(const akvcam_device_t self,
+                                       akvcam_frame_t dst,
+                                       akvcam_frame_t frame);
 void akvcam_device_notify_frame(akvcam_device_t self);
+akvcam_frame_t akvcam_device_pattern_frame(akvcam_device_t self);
 akvcam_frame_t akvcam_default_frame(void);
 
 akvcam_device_t akvcam_device_new(const char *name,
@@ -129,14 +146,26 @@ akvcam_device_t akvcam_device_new(const char *name,
     multiplanar = akvcam_format_have_multiplanar(formats);
     self->buffer_type = akvcam_device_v4l2_from_device_type(type, multiplanar);
     self->buffers = akvcam_buffers_new(rw_mode, self->buffer_type, multiplanar);
+    self->frame_pool = akvcam_frame_pool_new();
+
+    // Build the color table for the default controls, so the frames don't
+    // need a new one until a control changes.
+    self->color_table = akvcam_color_table_new(self->hue,
+                                               self->saturation,
+                                               self->brightness,
+                                               self->contrast,
+                                               self->gamma,
+                                               self->gray);
     self->rw_mode = rw_mode;
     self->videonr = -1;
+    self->stripes = 1;
     self->broadcasting_node = -1;
     self->priority = V4L2_PRIORITY_DEFAULT;
     mutex_init(&self->mtx);
     mutex_init(&self->clock_mtx);
 
     akvcam_buffers_set_format(self->buffers, self->format);
+    akvcam_buffers_set_frame_pool(self->buffers, self->frame_pool);
     memset(&self->v4l2_dev, 0, sizeof(struct v4l2_device));
     snprintf(self->v4l2_dev.name,
              V4L2_DEVICE_NAME_SIZE,
@@ -156,8 +185,12 @@ void akvcam_device_free(struct kref *ref)
 {
     akvcam_device_t self = container_of(ref, struct akvcam_device, ref);
 
+    akvcam_color_table_delete(self->color_table);
+    akvcam_scaler_delete(self->scaler);
     akvcam_frame_delete(self->current_frame);
+    akvcam_frame_delete(self->pattern_frame);
     akvcam_buffers_delete(self->buffers);
+    akvcam_frame_pool_delete(self->frame_pool);
     akvcam_device_unregister(self);
     akvcam_list_delete(self->nodes);
     akvcam_list_delete(self->connected_devices);
@@ -252,6 +285,43 @@ void akvcam_device_set_num(const akvcam_device_t self, int32_t num)
     self->videonr = num;
 }
 
+size_t akvcam_device_stripes(const akvcam_device_t self)
+{
+    return self->stripes;
+}
+
+void akvcam_device_set_stripes(const akvcam_device_t self, size_t stripes)
+{
+    self->stripes = stripes;
+}
+
+AKVCAM_PATTERN akvcam_device_pattern(const akvcam_device_t self)
+{
+    return self->pattern;
+}
+
+void akvcam_device_set_pattern(const akvcam_device_t self,
+                               AKVCAM_PATTERN pattern)
+{
+    self->pattern = pattern;
+}
+
+size_t akvcam_device_frame_allocations(const akvcam_device_t self)
+{
+    return akvcam_frame_pool_allocations(self->frame_pool);
+}
+
+bool akvcam_device_process_yuv(const akvcam_device_t self)
+{
+    return self->process_yuv;
+}
+
+void akvcam_device_set_process_yuv(const akvcam_device_t self,
+                                   bool process_yuv)
+{
+    self->process_yuv = process_yuv;
+}
+
 int64_t akvcam_device_broadcasting_node(const akvcam_device_t self)
 {
     return self->broadcasting_node;
@@ -303,6 +373,9 @@ void akvcam_device_set_format(const akvcam_device_t self,
 {
     akvcam_format_copy(self->format, format);
     akvcam_buffers_set_format(self->buffers, format);
+
+    // The frames of the old format won't be needed anymore.
+    akvcam_frame_pool_clear(self->frame_pool);
 }
 
 akvcam_controls_t akvcam_device_controls_nr(const akvcam_device_t self)
@@ -534,22 +607,27 @@ void akvcam_device_controls_changed(akvcam_device_t self,
     switch (event->id) {
     case V4L2_CID_BRIGHTNESS:
         self->brightness = event->u.ctrl.value;
+        akvcam_device_update_color_table(self);
         break;
 
     case V4L2_CID_CONTRAST:
         self->contrast = event->u.ctrl.value;
+        akvcam_device_update_color_table(self);
         break;
 
     case V4L2_CID_SATURATION:
         self->saturation = event->u.ctrl.value;
+        akvcam_device_update_color_table(self);
         break;
 
     case V4L2_CID_HUE:
         self->hue = event->u.ctrl.value;
+        akvcam_device_update_color_table(self);
         break;
 
     case V4L2_CID_GAMMA:
         self->gamma = event->u.ctrl.value;
+        akvcam_device_update_color_table(self);
         break;
 
     case V4L2_CID_HFLIP:
@@ -560,8 +638,13 @@ void akvcam_device_controls_changed(akvcam_device_t self,
         self->vertical_flip = event->u.ctrl.value;
         break;
 
+    case V4L2_CID_ROTATE:
+        self->rotation = event->u.ctrl.value / 90 * 90;
+        break;
+
     case V4L2_CID_COLORFX:
         self->gray = event->u.ctrl.value == V4L2_COLORFX_BW;
+        akvcam_device_update_color_table(self);
         break;
 
     case AKVCAM_CID_SCALING:
@@ -598,6 +681,26 @@ void akvcam_device_controls_changed(akvcam_device_t self,
     }
 }
 
+void akvcam_device_update_color_table(akvcam_device_t self)
+{
+    akvcam_color_table_t color_table =
+            akvcam_color_table_new(self->hue,
+                                   self->saturation,
+                                   self->brightness,
+                                   self->contrast,
+                                   self->gamma,
+                                   self->gray);
+
+    // The color table is used from the clock thread. Don't give up on
+    // signals, otherwise the frames would keep the old adjusts until the next
+    // control change.
+    mutex_lock(&self->mtx);
+    swap(self->color_table, color_table);
+    mutex_unlock(&self->mtx);
+
+    akvcam_color_table_delete(color_table);
+}
+
 akvcam_devices_list_t akvcam_device_connected_devices_nr(const akvcam_device_t self)
 {
     return self->connected_devices;
@@ -634,7 +737,8 @@ __u32 akvcam_device_caps(const akvcam_device_t self)
         caps |= V4L2_CAP_READWRITE;
 
     if (self->rw_mode & AKVCAM_RW_MODE_MMAP
-        || self->rw_mode & AKVCAM_RW_MODE_USERPTR)
+        || self->rw_mode & AKVCAM_RW_MODE_USERPTR
+        || self->rw_mode & AKVCAM_RW_MODE_DMABUF)
         caps |= V4L2_CAP_STREAMING;
 
     caps |= V4L2_CAP_EXT_PIX_FORMAT;
@@ -648,7 +752,7 @@ void akvcam_device_clock_run_once(akvcam_device_t self)
     akvcam_device_t capture_device;
     akvcam_device_t output_device;
     akvcam_frame_t frame = NULL;
-    akvcam_frame_t adjusted_frame;
+    akvcam_frame_t adjusted_frame = NULL;
     akvcam_frame_t default_frame = akvcam_default_frame();
     int result;
 
@@ -662,7 +766,10 @@ void akvcam_device_clock_run_once(akvcam_device_t self)
                 && (output_device->streaming || output_device->streaming_rw)
                 && self->current_frame) {
                 akpr_debug("Reading current frame.\n");
-                frame = akvcam_frame_new_copy(self->current_frame);
+
+                // The current frame is replaced, never modified, so there is
+                // no need to copy it.
+                frame = akvcam_frame_ref(self->current_frame);
             }
 
             mutex_unlock(&self->mtx);
@@ -671,23 +778,33 @@ void akvcam_device_clock_run_once(akvcam_device_t self)
         if (!frame) {
             if (default_frame && akvcam_frame_size(default_frame) > 0) {
                 akpr_debug("Reading default frame.\n");
-                frame = akvcam_frame_new_copy(default_frame);
+                frame = akvcam_frame_ref(default_frame);
             } else {
-                akpr_debug("Generating random frame.\n");
-                frame = akvcam_frame_new(self->format, NULL, 0);
-                get_random_bytes(akvcam_frame_data(frame),
-                                 (int) akvcam_frame_size(frame));
+                akpr_debug("Generating pattern frame.\n");
+                frame = akvcam_device_pattern_frame(self);
             }
         }
 
-        adjusted_frame = akvcam_device_frame_apply_adjusts(self, frame);
+        // Write the frame straight into the next buffer if possible,
+        // otherwise write it in a new frame and copy it.
+        result = akvcam_buffers_claim_frame(self->buffers, &adjusted_frame);
+
+        if (result == 0 && adjusted_frame) {
+            akvcam_device_frame_apply_adjusts(self, adjusted_frame, frame);
+            result = akvcam_buffers_commit_frame(self->buffers, adjusted_frame);
+        } else if (result == 0) {
+            adjusted_frame = akvcam_frame_new_pooled(self->frame_pool,
+                                                     self->format);
+            akvcam_device_frame_apply_adjusts(self, adjusted_frame, frame);
+            result = akvcam_buffers_write_frame(self->buffers, adjusted_frame);
+            akvcam_frame_delete(adjusted_frame);
+        }
+
         akvcam_frame_delete(frame);
-        result = akvcam_buffers_write_frame(self->buffers, adjusted_frame);
 
         if (result < 0)
             akpr_err("Failed writing frame: %s.\n", akvcam_string_from_error(result));
 
-        akvcam_frame_delete(adjusted_frame);
         akvcam_device_notify_frame(self);
     } else {
         for (;;) {
@@ -715,6 +832,11 @@ bool akvcam_device_clock_start(akvcam_device_t self)
     if (mutex_lock_interruptible(&self->clock_mtx))
         return false;
 
+    // The format can change between streams, draw the pattern again.
+    akvcam_frame_delete(self->pattern_frame);
+    self->pattern_frame = NULL;
+    self->pattern_offset = 0;
+
     self->thread = kthread_run((akvcam_thread_t)
                                akvcam_device_clock_timeout,
                                self,
@@ -755,18 +877,25 @@ int akvcam_device_clock_timeout(akvcam_device_t self)
     return 0;
 }
 
-akvcam_frame_t akvcam_device_frame_apply_adjusts(const akvcam_device_t self,
-                                                 akvcam_frame_t frame)
+// Write the frame to 'dst' with all the adjusts applied and in the device
+// format. 'dst' can be a claimed buffer, so it's only written, never resized.
+void akvcam_device_frame_apply_adjusts(const akvcam_device_t self,
+                                       akvcam_frame_t dst,
+                                       akvcam_frame_t frame)
 {
     bool horizontal_flip = self->horizontal_flip != self->horizontal_mirror;
     bool vertical_flip = self->vertical_flip != self->vertical_mirror;
-    akvcam_frame_t new_frame = akvcam_frame_new_copy(frame);
+    akvcam_frame_t new_frame;
+    akvcam_frame_adjusts adjusts;
+    akvcam_color_table_t color_table = NULL;
+    bool processed;
     akvcam_format_t frame_format = akvcam_frame_format(frame);
-    __u32 fourcc = akvcam_format_fourcc(self->format);
     size_t iwidth = akvcam_format_width(frame_format);
     size_t iheight = akvcam_format_height(frame_format);
     size_t owidth = akvcam_format_width(self->format);
     size_t oheight = akvcam_format_height(self->format);
+    size_t swidth = iwidth;
+    size_t sheight = iheight;
 
     akpr_function();
     akvcam_format_delete(frame_format);
@@ -780,11 +909,77 @@ akvcam_frame_t akvcam_device_frame_apply_adjusts(const akvcam_device_t self,
     akpr_debug("horizontal_mirror: %s\n", self->horizontal_mirror? "true": "false");
     akpr_debug("vertical_mirror: %s\n", self->vertical_mirror? "true": "false");
     akpr_debug("swap_rgb: %s\n", self->swap_rgb? "true": "false");
+    akpr_debug("rotation: %d\n", self->rotation);
     akpr_debug("horizontal_flip: %s\n", self->horizontal_flip? "true": "false");
     akpr_debug("vertical_flip: %s\n", self->vertical_flip? "true": "false");
     akpr_debug("scaling: %s\n", akvcam_frame_scaling_to_string(self->scaling));
     akpr_debug("aspect_ratio: %s\n", akvcam_frame_aspect_ratio_to_string(self->aspect_ratio));
 
+    adjusts.hue = self->hue;
+    adjusts.saturation = self->saturation;
+    adjusts.luminance = self->brightness;
+    adjusts.contrast = self->contrast;
+    adjusts.gamma = self->gamma;
+    adjusts.gray = self->gray;
+    adjusts.horizontal_mirror = horizontal_flip;
+    adjusts.vertical_mirror = vertical_flip;
+    adjusts.rotation = self->rotation;
+    adjusts.swap_rgb = self->swap_rgb;
+    adjusts.process_yuv = self->process_yuv;
+    adjusts.scaling = self->scaling;
+    adjusts.aspect_ratio = self->aspect_ratio;
+
+    // The frame is rotated before scaling it.
+    if (self->rotation == 90 || self->rotation == 270) {
+        swidth = iheight;
+        sheight = iwidth;
+    }
+
+    // The scaling maps only depends on the frame sizes and the scaling
+    // controls, rebuild them only when those change.
+    if (!akvcam_scaler_matches(self->scaler,
+                               swidth,
+                               sheight,
+                               owidth,
+                               oheight,
+                               self->scaling,
+                               self->aspect_ratio)) {
+        akvcam_scaler_delete(self->scaler);
+        self->scaler = akvcam_scaler_new(swidth,
+                                         sheight,
+                                         owidth,
+                                         oheight,
+                                         self->scaling,
+                                         self->aspect_ratio);
+    }
+
+    if (!mutex_lock_interruptible(&self->mtx)) {
+        color_table = akvcam_color_table_ref(self->color_table);
+        mutex_unlock(&self->mtx);
+    }
+
+    // Scale, mirror, adjust and convert the frame in a single pass.
+    processed = akvcam_frame_process(dst,
+                                     frame,
+                                     &adjusts,
+                                     self->scaler,
+                                     color_table,
+                                     self->stripes > 0?
+                                         self->stripes:
+                                         num_online_cpus());
+    akvcam_color_table_delete(color_table);
+
+    if (processed)
+        return;
+
+    // The frame format is not supported by the single pass pipeline, so
+    // process the frame step by step.
+    frame_format = akvcam_frame_format(frame);
+    new_frame = akvcam_frame_new_pooled(self->frame_pool, frame_format);
+    akvcam_format_delete(frame_format);
+    akvcam_frame_copy(new_frame, frame);
+    akvcam_frame_rotate(new_frame, self->rotation);
+
     if (owidth * oheight > iwidth * iheight) {
         akvcam_frame_mirror(new_frame,
                             horizontal_flip,
@@ -805,7 +1000,7 @@ akvcam_frame_t akvcam_device_frame_apply_adjusts(const akvcam_device_t self,
                             oheight,
                             self->scaling,
                             self->aspect_ratio);
-        akvcam_frame_convert(new_frame, fourcc);
+        akvcam_frame_convert(new_frame, self->format);
     } else {
         akvcam_frame_scaled(new_frame,
                             owidth,
@@ -826,10 +1021,15 @@ akvcam_frame_t akvcam_device_frame_apply_adjusts(const akvcam_device_t self,
                             self->contrast,
                             self->gamma,
                             self->gray);
-        akvcam_frame_convert(new_frame, fourcc);
+        akvcam_frame_convert(new_frame, self->format);
     }
 
-    return new_frame;
+    if (akvcam_frame_data(dst) && akvcam_frame_data(new_frame))
+        memcpy(akvcam_frame_data(dst),
+               akvcam_frame_data(new_frame),
+               akvcam_min(akvcam_frame_size(dst),
+                          akvcam_frame_size(new_frame)));
+    akvcam_frame_delete(new_frame);
 }
 
 void akvcam_device_notify_frame(akvcam_device_t self)
@@ -844,11 +1044,41 @@ void akvcam_device_notify_frame(akvcam_device_t self)
     akvcam_device_event_received(self, &event);
 }
 
+akvcam_frame_t akvcam_device_pattern_frame(akvcam_device_t self)
+{
+    akvcam_frame_t frame;
+    size_t height;
+
+    // The pattern is drawn once in the capture format, after that each frame
+    // is just a copy of it.
+    if (!self->pattern_frame) {
+        self->pattern_frame = akvcam_frame_new(self->format, NULL, 0);
+        akvcam_frame_pattern(self->pattern_frame, self->pattern);
+    }
+
+    if (self->pattern != AKVCAM_PATTERN_GRADIENT)
+        return akvcam_frame_ref(self->pattern_frame);
+
+    height = akvcam_format_height(self->format);
+    frame = akvcam_frame_new_pooled(self->frame_pool, self->format);
+    akvcam_frame_scroll(frame, self->pattern_frame, self->pattern_offset);
+    self->pattern_offset += AKVCAM_DEVICE_PATTERN_SCROLL;
+
+    if (height > 0)
+        self->pattern_offset %= height;
+
+    return frame;
+}
+
 akvcam_frame_t akvcam_default_frame(void)
 {
     static akvcam_frame_t frame = NULL;
     akvcam_settings_t settings;
+    akvcam_format_t format;
     char *file_name;
+    __u32 fourcc;
+    uint32_t width;
+    uint32_t height;
     bool loaded = false;
 
     if (frame)
@@ -860,7 +1090,20 @@ akvcam_frame_t akvcam_default_frame(void)
         akvcam_settings_begin_group(settings, "General");
         file_name = akvcam_settings_value(settings, "default_frame");
         frame = akvcam_frame_new(NULL, NULL, 0);
-        loaded = akvcam_frame_load(frame, file_name);
+
+        // A raw frame has no header, its format comes from the settings.
+        if (akvcam_settings_contains(settings, "default_frame_format")) {
+            fourcc = akvcam_format_fourcc_from_string(akvcam_settings_value(settings,
+                                                                            "default_frame_format"));
+            width = akvcam_settings_value_uint32(settings, "default_frame_width");
+            height = akvcam_settings_value_uint32(settings, "default_frame_height");
+            format = akvcam_format_new(fourcc, width, height, NULL);
+            loaded = akvcam_frame_load_raw(frame, file_name, format);
+            akvcam_format_delete(format);
+        } else {
+            loaded = akvcam_frame_load(frame, file_name);
+        }
+
         akvcam_settings_end_group(settings);
     }
 
@@ -25,6 +25,7 @@
 #include "buffers_types.h"
 #include "controls_types.h"
 #include "format_types.h"
+#include "frame_types.h"
 #include "node_types.h"
 
 struct file;
@@ -42,6 +43,15 @@ bool akvcam_device_register(akvcam_device_t self);
 void akvcam_device_unregister(akvcam_device_t self);
 int32_t akvcam_device_num(const akvcam_device_t self);
 void akvcam_device_set_num(const akvcam_device_t self, int32_t num);
+size_t akvcam_device_stripes(const akvcam_device_t self);
+void akvcam_device_set_stripes(const akvcam_device_t self, size_t stripes);
+AKVCAM_PATTERN akvcam_device_pattern(const akvcam_device_t self);
+void akvcam_device_set_pattern(const akvcam_device_t self,
+                               AKVCAM_PATTERN pattern);
+size_t akvcam_device_frame_allocations(const akvcam_device_t self);
+bool akvcam_device_process_yuv(const akvcam_device_t self);
+void akvcam_device_set_process_yuv(const akvcam_device_t self,
+                                   bool process_yuv);
 int64_t akvcam_device_broadcasting_node(const akvcam_device_t self);
 void akvcam_device_set_broadcasting_node(const akvcam_device_t self,
                                          int64_t broadcasting_node);
@@ -26,6 +26,7 @@
 #define AKVCAM_RW_MODE_READWRITE 0x1U
 #define AKVCAM_RW_MODE_MMAP      0x2U
 #define AKVCAM_RW_MODE_USERPTR   0x4U
+#define AKVCAM_RW_MODE_DMABUF    0x8U
 
 struct akvcam_device;
 typedef struct akvcam_device *akvcam_device_t;
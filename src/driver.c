@@ -24,6 +24,7 @@
 #include "buffers.h"
 #include "device.h"
 #include "format.h"
+#include "frame.h"
 #include "list.h"
 #include "log.h"
 #include "settings.h"
@@ -406,6 +407,15 @@ akvcam_device_t akvcam_driver_read_device(akvcam_settings_t settings,
         mode |= AKVCAM_RW_MODE_READWRITE;
     }
 
+    // Only the output devices can import dma-bufs, the capture devices
+    // export them from their MMAP buffers instead.
+    if (akvcam_list_contains(modes,
+                             "dmabuf",
+                             (akvcam_are_equals_t) akvcam_driver_strings_are_equals)
+        && type == AKVCAM_DEVICE_TYPE_OUTPUT) {
+        mode |= AKVCAM_RW_MODE_DMABUF;
+    }
+
     akvcam_list_delete(modes);
 
     if (!mode)
@@ -432,6 +442,18 @@ akvcam_device_t akvcam_driver_read_device(akvcam_settings_t settings,
         akvcam_device_set_num(device,
                               akvcam_settings_value_int32(settings, "videonr"));
 
+    if (akvcam_settings_contains(settings, "stripes"))
+        akvcam_device_set_stripes(device,
+                                  akvcam_settings_value_uint32(settings, "stripes"));
+
+    if (akvcam_settings_contains(settings, "process_yuv"))
+        akvcam_device_set_process_yuv(device,
+                                      akvcam_settings_value_bool(settings, "process_yuv"));
+
+    if (akvcam_settings_contains(settings, "pattern"))
+        akvcam_device_set_pattern(device,
+                                  akvcam_frame_pattern_from_string(akvcam_settings_value(settings, "pattern")));
+
     buffers = akvcam_device_buffers_nr(device);
     akvcam_buffers_resize_rw(buffers, AKVCAM_BUFFERS_MIN);
 
@@ -651,6 +673,9 @@ void akvcam_driver_print_devices(void)
         if (mode & AKVCAM_RW_MODE_USERPTR)
             akpr_info("\t\tUserPtr\n");
 
+        if (mode & AKVCAM_RW_MODE_DMABUF)
+            akpr_info("\t\tDmaBuf\n");
+
         if (mode & AKVCAM_RW_MODE_READWRITE) {
             akpr_info("\tUser Controls: No\n");
         } else {
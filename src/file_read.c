@@ -215,15 +215,64 @@ bool akvcam_file_seek(akvcam_file_t self, ssize_t offset, AKVCAM_FILE_SEEK pos)
     return true;
 }
 
+static size_t akvcam_file_read_bulk(akvcam_file_t self,
+                                    char *data,
+                                    size_t size,
+                                    size_t buffered)
+{
+    loff_t offset;
+    ssize_t bytes_read;
+    size_t total = buffered;
+
+    if (buffered > 0) {
+        akvcam_rbuffer_dequeue_bytes(self->buffer, data, &buffered, false);
+        total = buffered;
+    }
+
+    while (total < size && self->file_bytes_read < self->size) {
+        offset = (loff_t) self->file_bytes_read;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0)
+        bytes_read = kernel_read(self->filp,
+                                 offset,
+                                 data + total,
+                                 size - total);
+#else
+        bytes_read = kernel_read(self->filp,
+                                 data + total,
+                                 size - total,
+                                 &offset);
+#endif
+
+        if (bytes_read < 1)
+            break;
+
+        self->file_bytes_read += (size_t) bytes_read;
+        total += (size_t) bytes_read;
+    }
+
+    self->bytes_read += total;
+
+    return total;
+}
+
 size_t akvcam_file_read(akvcam_file_t self, void *data, size_t size)
 {
     loff_t offset;
     ssize_t bytes_read;
     char read_block[AKVCAM_READ_BLOCK];
+    size_t buffered;
 
     if (!self->is_open || size < 1)
         return 0;
 
+    buffered = akvcam_min(akvcam_rbuffer_data_size(self->buffer), size);
+
+    // Big reads go straight from the file to the destination, staging them
+    // in the read buffer block by block would only add copies.
+    if (size - buffered >= AKVCAM_READ_BLOCK)
+        return akvcam_file_read_bulk(self, data, size, buffered);
+
     while (self->file_bytes_read < self->size
            && akvcam_rbuffer_data_size(self->buffer) < size) {
         offset = (loff_t) self->file_bytes_read;
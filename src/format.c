@@ -24,8 +24,6 @@
 #include "format.h"
 #include "list.h"
 
-#define DEFAULT_COLORSPACE V4L2_COLORSPACE_RAW
-
 struct akvcam_format
 {
     struct kref ref;
@@ -33,16 +31,25 @@ struct akvcam_format
     size_t width;
     size_t height;
     struct v4l2_fract frame_rate;
+    __u32 colorspace;
+    __u32 ycbcr_enc;
+    __u32 quantization;
     char str[1024];
 };
 
 typedef size_t (*akvcam_plane_offset_t)(size_t plane, size_t width, size_t height);
 typedef size_t (*akvcam_bypl_t)(size_t plane, size_t width);
 
+// 'planes' is the number of planes in the frame, while 'mplanes' is the number
+// of memory planes, that is, the number of planes exposed through the
+// multiplanar API. Planar formats that store all their planes contiguously in a
+// single buffer only need one memory plane.
 typedef struct {
     __u32 fourcc;
     size_t bpp;
     size_t planes;
+    size_t mplanes;
+    bool yuv;
     akvcam_plane_offset_t plane_offset;
     akvcam_bypl_t bypl;
     char str[32];
@@ -50,20 +57,23 @@ typedef struct {
 
 size_t akvcam_po_nv(size_t plane, size_t width, size_t height);
 size_t akvcam_bypl_nv(size_t plane, size_t width);
+size_t akvcam_po_yuv420(size_t plane, size_t width, size_t height);
+size_t akvcam_bypl_yuv420(size_t plane, size_t width);
 
-// Multiplanar formats are not supported at all yet.
 static akvcam_format_globals akvcam_format_globals_formats[] = {
-    {V4L2_PIX_FMT_RGB32 , 32, 1,         NULL,           NULL, "RGB32"},
-    {V4L2_PIX_FMT_RGB24 , 24, 1,         NULL,           NULL, "RGB24"},
-    {V4L2_PIX_FMT_RGB565, 16, 1,         NULL,           NULL, "RGB16"},
-    {V4L2_PIX_FMT_RGB555, 16, 1,         NULL,           NULL, "RGB15"},
-    {V4L2_PIX_FMT_BGR32 , 32, 1,         NULL,           NULL, "BGR32"},
-    {V4L2_PIX_FMT_BGR24 , 24, 1,         NULL,           NULL, "BGR24"},
-    {V4L2_PIX_FMT_UYVY  , 16, 1,         NULL,           NULL, "UYVY" },
-    {V4L2_PIX_FMT_YUYV  , 16, 1,         NULL,           NULL, "YUY2" },
-//    {V4L2_PIX_FMT_NV12  , 12, 2, akvcam_po_nv, akvcam_bypl_nv, "NV12" },
-//    {V4L2_PIX_FMT_NV21  , 12, 2, akvcam_po_nv, akvcam_bypl_nv, "NV21" },
-    {0                  ,  0, 0,         NULL,           NULL, ""     }
+    {V4L2_PIX_FMT_RGB32 , 32, 1, 1, false,             NULL,               NULL, "RGB32"},
+    {V4L2_PIX_FMT_RGB24 , 24, 1, 1, false,             NULL,               NULL, "RGB24"},
+    {V4L2_PIX_FMT_RGB565, 16, 1, 1, false,             NULL,               NULL, "RGB16"},
+    {V4L2_PIX_FMT_RGB555, 16, 1, 1, false,             NULL,               NULL, "RGB15"},
+    {V4L2_PIX_FMT_BGR32 , 32, 1, 1, false,             NULL,               NULL, "BGR32"},
+    {V4L2_PIX_FMT_BGR24 , 24, 1, 1, false,             NULL,               NULL, "BGR24"},
+    {V4L2_PIX_FMT_UYVY  , 16, 1, 1, true ,             NULL,               NULL, "UYVY" },
+    {V4L2_PIX_FMT_YUYV  , 16, 1, 1, true ,             NULL,               NULL, "YUY2" },
+    {V4L2_PIX_FMT_NV12  , 12, 2, 1, true ,     akvcam_po_nv,     akvcam_bypl_nv, "NV12" },
+    {V4L2_PIX_FMT_NV21  , 12, 2, 1, true ,     akvcam_po_nv,     akvcam_bypl_nv, "NV21" },
+    {V4L2_PIX_FMT_YUV420, 12, 3, 1, true , akvcam_po_yuv420, akvcam_bypl_yuv420, "I420" },
+    {V4L2_PIX_FMT_YVU420, 12, 3, 1, true , akvcam_po_yuv420, akvcam_bypl_yuv420, "YV12" },
+    {0                  ,  0, 0, 0, false,             NULL,               NULL, ""     }
 };
 
 size_t akvcam_formats_count(void);
@@ -97,6 +107,9 @@ akvcam_format_t akvcam_format_new_copy(akvcam_format_t other)
     self->width = other->width;
     self->height = other->height;
     memcpy(&self->frame_rate, &other->frame_rate, sizeof(struct v4l2_fract));
+    self->colorspace = other->colorspace;
+    self->ycbcr_enc = other->ycbcr_enc;
+    self->quantization = other->quantization;
 
     return self;
 }
@@ -131,11 +144,17 @@ void akvcam_format_copy(akvcam_format_t self, const akvcam_format_t other)
         self->width = other->width;
         self->height = other->height;
         memcpy(&self->frame_rate, &other->frame_rate, sizeof(struct v4l2_fract));
+        self->colorspace = other->colorspace;
+        self->ycbcr_enc = other->ycbcr_enc;
+        self->quantization = other->quantization;
     } else {
         self->fourcc = 0;
         self->width = 0;
         self->height = 0;
         memset(&self->frame_rate, 0, sizeof(struct v4l2_fract));
+        self->colorspace = V4L2_COLORSPACE_DEFAULT;
+        self->ycbcr_enc = V4L2_YCBCR_ENC_DEFAULT;
+        self->quantization = V4L2_QUANTIZATION_DEFAULT;
     }
 }
 
@@ -184,6 +203,72 @@ struct v4l2_fract *akvcam_format_frame_rate(const akvcam_format_t self)
     return &self->frame_rate;
 }
 
+// The colorimetry is stored as given, and the getters fill the values left
+// as default with the ones used for converting the frames. The RGB formats
+// are always sRGB in full range, while YUV formats can be either BT.601 or
+// BT.709, in limited or full range. Defaults to BT.601 in limited range.
+__u32 akvcam_format_colorspace(const akvcam_format_t self)
+{
+    if (!akvcam_format_is_yuv(self))
+        return V4L2_COLORSPACE_SRGB;
+
+    if (self->colorspace == V4L2_COLORSPACE_REC709)
+        return V4L2_COLORSPACE_REC709;
+
+    return V4L2_COLORSPACE_SMPTE170M;
+}
+
+void akvcam_format_set_colorspace(akvcam_format_t self, __u32 colorspace)
+{
+    self->colorspace = colorspace;
+}
+
+__u32 akvcam_format_ycbcr_enc(const akvcam_format_t self)
+{
+    if (self->ycbcr_enc == V4L2_YCBCR_ENC_601
+        || self->ycbcr_enc == V4L2_YCBCR_ENC_709)
+        return self->ycbcr_enc;
+
+    if (akvcam_format_colorspace(self) == V4L2_COLORSPACE_REC709)
+        return V4L2_YCBCR_ENC_709;
+
+    return V4L2_YCBCR_ENC_601;
+}
+
+void akvcam_format_set_ycbcr_enc(akvcam_format_t self, __u32 ycbcr_enc)
+{
+    self->ycbcr_enc = ycbcr_enc;
+}
+
+__u32 akvcam_format_quantization(const akvcam_format_t self)
+{
+    if (!akvcam_format_is_yuv(self)
+        || self->quantization == V4L2_QUANTIZATION_FULL_RANGE)
+        return V4L2_QUANTIZATION_FULL_RANGE;
+
+    return V4L2_QUANTIZATION_LIM_RANGE;
+}
+
+void akvcam_format_set_quantization(akvcam_format_t self, __u32 quantization)
+{
+    self->quantization = quantization;
+}
+
+void akvcam_format_copy_colorimetry(akvcam_format_t self,
+                                    const akvcam_format_t other)
+{
+    self->colorspace = other->colorspace;
+    self->ycbcr_enc = other->ycbcr_enc;
+    self->quantization = other->quantization;
+}
+
+bool akvcam_format_is_yuv(const akvcam_format_t self)
+{
+    akvcam_format_globals_t vf = akvcam_format_globals_by_fourcc(self->fourcc);
+
+    return vf? vf->yuv: false;
+}
+
 size_t akvcam_format_bpp(const akvcam_format_t self)
 {
     akvcam_format_globals_t vf = akvcam_format_globals_by_fourcc(self->fourcc);
@@ -245,9 +330,43 @@ size_t akvcam_format_offset(const akvcam_format_t self, size_t plane)
 
 size_t akvcam_format_plane_size(const akvcam_format_t self, size_t plane)
 {
+    akvcam_format_globals_t vf = akvcam_format_globals_by_fourcc(self->fourcc);
+
+    if (!vf)
+        return 0;
+
+    // The planes are stored one after the other, and the offset of the plane
+    // next to the last one is the size of the frame.
+    if (vf->plane_offset)
+        return vf->plane_offset(plane + 1, self->width, self->height)
+               - vf->plane_offset(plane, self->width, self->height);
+
     return self->height * akvcam_format_bypl(self, plane);
 }
 
+size_t akvcam_format_mplanes(const akvcam_format_t self)
+{
+    akvcam_format_globals_t vf = akvcam_format_globals_by_fourcc(self->fourcc);
+
+    return vf? vf->mplanes: 0;
+}
+
+// Each memory plane starts at the color plane with the same index, and the last
+// one also holds all the remaining color planes.
+size_t akvcam_format_mplane_size(const akvcam_format_t self, size_t mplane)
+{
+    akvcam_format_globals_t vf = akvcam_format_globals_by_fourcc(self->fourcc);
+
+    if (!vf || mplane >= vf->mplanes)
+        return 0;
+
+    if (mplane + 1 < vf->mplanes)
+        return akvcam_format_offset(self, mplane + 1)
+               - akvcam_format_offset(self, mplane);
+
+    return akvcam_format_size(self) - akvcam_format_offset(self, mplane);
+}
+
 bool akvcam_format_is_valid(const akvcam_format_t self)
 {
     return akvcam_format_size(self) > 0
@@ -263,6 +382,9 @@ void akvcam_format_clear(akvcam_format_t self)
     self->height = 0;
     self->frame_rate.numerator = 0;
     self->frame_rate.denominator = 0;
+    self->colorspace = V4L2_COLORSPACE_DEFAULT;
+    self->ycbcr_enc = V4L2_YCBCR_ENC_DEFAULT;
+    self->quantization = V4L2_QUANTIZATION_DEFAULT;
 }
 
 const char *akvcam_format_to_string(const akvcam_format_t self)
@@ -513,8 +635,7 @@ akvcam_format_t akvcam_format_from_v4l2_nr(akvcam_formats_list_t formats,
                 && format->fmt.pix.height == akvcam_format_height(akformat)
                 && format->fmt.pix.pixelformat == akvcam_format_fourcc(akformat)
                 && format->fmt.pix.field == V4L2_FIELD_NONE
-                && format->fmt.pix.bytesperline == (__u32) akvcam_format_bypl(akformat, 0)
-                && format->fmt.pix.colorspace == DEFAULT_COLORSPACE) {
+                && format->fmt.pix.bytesperline == (__u32) akvcam_format_bypl(akformat, 0)) {
                 return akformat;
             }
         } else if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE
@@ -523,8 +644,7 @@ akvcam_format_t akvcam_format_from_v4l2_nr(akvcam_formats_list_t formats,
                 && format->fmt.pix_mp.height == akvcam_format_height(akformat)
                 && format->fmt.pix_mp.pixelformat == akvcam_format_fourcc(akformat)
                 && format->fmt.pix_mp.field == V4L2_FIELD_NONE
-                && format->fmt.pix_mp.colorspace == DEFAULT_COLORSPACE
-                && format->fmt.pix_mp.num_planes == akvcam_format_planes(akformat)) {
+                && format->fmt.pix_mp.num_planes == akvcam_format_mplanes(akformat)) {
                 is_valid = true;
 
                 for (i = 0; i < format->fmt.pix_mp.num_planes; i++) {
@@ -569,7 +689,7 @@ bool akvcam_format_have_multiplanar(const akvcam_formats_list_t formats)
         if (!vf)
             continue;
 
-        if (vf->planes > 1)
+        if (vf->mplanes > 1)
             return true;
     }
 
@@ -612,10 +732,11 @@ akvcam_format_globals_t akvcam_format_globals_by_str(const char *str)
 
 size_t akvcam_po_nv(size_t plane, size_t width, size_t height)
 {
+    size_t bypl = (size_t) akvcam_align32((ssize_t) width);
     size_t offset[] = {
         0,
-        (size_t) akvcam_align32((ssize_t) width) * height,
-        5 * (size_t) akvcam_align32((ssize_t) width) * height / 4
+        bypl * height,
+        bypl * height + bypl * ((height + 1) / 2)
     };
 
     return offset[plane];
@@ -627,3 +748,25 @@ size_t akvcam_bypl_nv(size_t plane, size_t width)
 
     return (size_t) akvcam_align32((ssize_t) width);
 }
+
+size_t akvcam_po_yuv420(size_t plane, size_t width, size_t height)
+{
+    size_t bypl = (size_t) akvcam_align32((ssize_t) width);
+    size_t chroma_size = bypl / 2 * ((height + 1) / 2);
+    size_t offset[] = {
+        0,
+        bypl * height,
+        bypl * height + chroma_size,
+        bypl * height + 2 * chroma_size
+    };
+
+    return offset[plane];
+}
+
+size_t akvcam_bypl_yuv420(size_t plane, size_t width)
+{
+    size_t bypl = (size_t) akvcam_align32((ssize_t) width);
+
+    // The chroma planes have half the width of the luma plane.
+    return plane < 1? bypl: bypl / 2;
+}
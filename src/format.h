@@ -45,12 +45,23 @@ void akvcam_format_set_width(akvcam_format_t self, size_t width);
 size_t akvcam_format_height(const akvcam_format_t self);
 void akvcam_format_set_height(akvcam_format_t self, size_t height);
 struct v4l2_fract *akvcam_format_frame_rate(const akvcam_format_t self);
+__u32 akvcam_format_colorspace(const akvcam_format_t self);
+void akvcam_format_set_colorspace(akvcam_format_t self, __u32 colorspace);
+__u32 akvcam_format_ycbcr_enc(const akvcam_format_t self);
+void akvcam_format_set_ycbcr_enc(akvcam_format_t self, __u32 ycbcr_enc);
+__u32 akvcam_format_quantization(const akvcam_format_t self);
+void akvcam_format_set_quantization(akvcam_format_t self, __u32 quantization);
+void akvcam_format_copy_colorimetry(akvcam_format_t self,
+                                    const akvcam_format_t other);
+bool akvcam_format_is_yuv(const akvcam_format_t self);
 size_t akvcam_format_bpp(const akvcam_format_t self);
 size_t akvcam_format_bypl(const akvcam_format_t self, size_t plane);
 size_t akvcam_format_size(const akvcam_format_t self);
 size_t akvcam_format_planes(const akvcam_format_t self);
 size_t akvcam_format_offset(const akvcam_format_t self, size_t plane);
 size_t akvcam_format_plane_size(const akvcam_format_t self, size_t plane);
+size_t akvcam_format_mplanes(const akvcam_format_t self);
+size_t akvcam_format_mplane_size(const akvcam_format_t self, size_t mplane);
 bool akvcam_format_is_valid(const akvcam_format_t self);
 void akvcam_format_clear(akvcam_format_t self);
 const char *akvcam_format_to_string(const akvcam_format_t self);
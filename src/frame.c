@@ -16,17 +16,45 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/cpumask.h>
 #include <linux/kref.h>
+#include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/videodev2.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "frame.h"
+#include "color_table.h"
 #include "file_read.h"
+#include "frame_pool.h"
+#include "frame_simd.h"
 #include "format.h"
 #include "global_deleter.h"
 #include "log.h"
+#include "scaler.h"
 #include "utils.h"
+#include "yuv_matrix.h"
+
+// Extra precision bits kept in the horizontally filtered lines.
+#define AKVCAM_FRAME_FILTER_EXTRA_BITS 6
+
+// Frames written to memory owned by someone else, bigger than this, are
+// copied with non-temporal stores. Nothing reads them back here, so there is
+// no point in filling the caches with them.
+#define AKVCAM_FRAME_NT_COPY_SIZE (256 * 1024)
+
+// Size of the square tiles in which the frames are rotated. A tile of the
+// source and a tile of the destination fit in the L1 cache together.
+#define AKVCAM_FRAME_ROTATE_TILE 16
+
+// Number of rotated lines read together when scaling a rotated frame. Each
+// band takes 192 bytes from every source line, whole cache lines.
+#define AKVCAM_FRAME_ROTATE_BAND 64
+
+// The scratch memory of each stripe starts in it's own cache line, so the
+// stripes don't write the same lines from different CPUs.
+#define AKVCAM_FRAME_SCRATCH_ALIGN 64
 
 // FIXME: This is endianness dependent.
 
@@ -145,112 +173,277 @@ typedef struct
     char  str[32];
 } akvcam_frame_aspect_ratio_strings, *akvcam_frame_aspect_ratio_strings_t;
 
-typedef void (*akvcam_extrapolate_t)(size_t dstCoord,
-                                     size_t num, size_t den, size_t s,
-                                     size_t *srcCoordMin, size_t *srcCoordMax,
-                                     size_t *kNum, size_t *kDen);
-int akvcam_grayval(int r, int g, int b);
-
-// YUV utility functions
-uint8_t akvcam_rgb_y(int r, int g, int b);
-uint8_t akvcam_rgb_u(int r, int g, int b);
-uint8_t akvcam_rgb_v(int r, int g, int b);
-uint8_t akvcam_yuv_r(int y, int u, int v);
-uint8_t akvcam_yuv_g(int y, int u, int v);
-uint8_t akvcam_yuv_b(int y, int u, int v);
-
-// BGR to RGB formats
-void akvcam_bgr24_to_rgb32(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_bgr24_to_rgb24(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_bgr24_to_rgb16(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_bgr24_to_rgb15(akvcam_frame_t dst, akvcam_frame_t src);
-
-// BGR to BGR formats
-void akvcam_bgr24_to_bgr32(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_bgr24_to_bgr16(akvcam_frame_t dst, akvcam_frame_t src);
-
-// BGR to Luminance+Chrominance formats
-void akvcam_bgr24_to_uyvy(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_bgr24_to_yuy2(akvcam_frame_t dst, akvcam_frame_t src);
-
-// BGR to two planes -- one Y, one Cr + Cb interleaved
-void akvcam_bgr24_to_nv12(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_bgr24_to_nv21(akvcam_frame_t dst, akvcam_frame_t src);
-
-// RGB to RGB formats
-void akvcam_rgb24_to_rgb32(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_rgb24_to_rgb16(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_rgb24_to_rgb15(akvcam_frame_t dst, akvcam_frame_t src);
-
-// RGB to BGR formats
-void akvcam_rgb24_to_bgr32(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_rgb24_to_bgr24(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_rgb24_to_bgr16(akvcam_frame_t dst, akvcam_frame_t src);
-
-// RGB to Luminance+Chrominance formats
-void akvcam_rgb24_to_uyvy(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_rgb24_to_yuy2(akvcam_frame_t dst, akvcam_frame_t src);
-
-// RGB to two planes -- one Y, one Cr + Cb interleaved
-void akvcam_rgb24_to_nv12(akvcam_frame_t dst, akvcam_frame_t src);
-void akvcam_rgb24_to_nv21(akvcam_frame_t dst, akvcam_frame_t src);
-
-void akvcam_extrapolate_up(size_t dstCoord,
-                           size_t num, size_t den, size_t s,
-                           size_t *src_coord_min, size_t *src_coord_max,
-                           size_t *k_num, size_t *k_den);
-void akvcam_extrapolate_down(size_t dst_coord,
-                             size_t num, size_t den, size_t s,
-                             size_t *src_coord_min, size_t *src_coord_max,
-                             size_t *k_num, size_t *k_den);
-uint8_t akvcam_extrapolate_component(uint8_t min, uint8_t max,
-                                     size_t k_num, size_t k_Den);
-akvcam_RGB24 akvcam_extrapolate_color(const akvcam_RGB24_t color_min,
-                                      const akvcam_RGB24_t color_max,
-                                      size_t k_num,
-                                      size_t k_den);
-akvcam_RGB24 akvcam_extrapolated_color(akvcam_frame_t self,
-                                       size_t x_min, size_t x_max,
-                                       size_t k_num_x, size_t k_den_x,
-                                       size_t y_min, size_t y_max,
-                                       size_t k_num_y, size_t k_den_y);
-void akvcam_rgb_to_hsl(int r, int g, int b, int *h, int *s, int *l);
-void akvcam_hsl_to_rgb(int h, int s, int l, int *r, int *g, int *b);
-
-typedef void (*akvcam_video_convert_funtion_t)(akvcam_frame_t dst,
-                                               akvcam_frame_t src);
+typedef struct
+{
+    AKVCAM_PATTERN pattern;
+    char  str[32];
+} akvcam_frame_pattern_strings, *akvcam_frame_pattern_strings_t;
+
+typedef void (*akvcam_line_adjust_funtion_t)(void *line, size_t width);
+
+// Line conversions, used for converting the frames line by line.
+void akvcam_line_copy24(void *dst,
+                        const void *src,
+                        size_t width,
+                        const akvcam_yuv_matrix *matrix);
+void akvcam_line_bgr24_to_rgb32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_bgr24_to_rgb24(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_bgr24_to_rgb16(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_bgr24_to_rgb15(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_bgr24_to_bgr32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_bgr24_to_uyvy(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix);
+void akvcam_line_bgr24_to_yuy2(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix);
+void akvcam_line_rgb24_to_rgb32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_rgb24_to_rgb16(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_rgb24_to_rgb15(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_rgb24_to_bgr32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_rgb24_to_bgr24(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix);
+void akvcam_line_rgb24_to_uyvy(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix);
+void akvcam_line_rgb24_to_yuy2(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix);
+
+// Planar line conversions, the lines are written to each plane of the frame.
+void akvcam_line_bgr24_to_yuv420(akvcam_frame_t dst,
+                                 size_t y,
+                                 const void *src,
+                                 size_t width);
+void akvcam_line_rgb24_to_yuv420(akvcam_frame_t dst,
+                                 size_t y,
+                                 const void *src,
+                                 size_t width);
+
+// Unpack the lines of the formats not supported by the processing pipeline to
+// RGB24.
+void akvcam_unpack_rgb32(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y);
+void akvcam_unpack_bgr32(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y);
+void akvcam_unpack_uyvy(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y);
+void akvcam_unpack_yuy2(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y);
+void akvcam_unpack_yuv420(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y);
+
+// Scaling and mirroring of a single component of the packed 4:2:2 formats.
+void akvcam_frame_scale_component(uint8_t *dst_line,
+                                  size_t owidth,
+                                  const akvcam_frame_t src,
+                                  size_t offset,
+                                  size_t step,
+                                  size_t iwidth,
+                                  size_t y,
+                                  const akvcam_scaler_t scaler,
+                                  uint8_t black,
+                                  int32_t *tmp);
+void akvcam_frame_mirror_component(uint8_t *line, size_t width);
+
+uint8_t akvcam_extrapolate_component(uint8_t min, uint8_t max, uint32_t k);
+akvcam_RGB24 akvcam_extrapolate_color(const akvcam_RGB24 *color_min,
+                                      const akvcam_RGB24 *color_max,
+                                      uint32_t k);
+void akvcam_frame_scale_line(akvcam_RGB24_t dst_line,
+                             const akvcam_RGB24 *src_line_min,
+                             const akvcam_RGB24 *src_line_max,
+                             uint32_t k,
+                             const akvcam_scaler_t scaler);
+void akvcam_frame_area_line(akvcam_RGB24_t dst_line,
+                            const akvcam_frame_t src,
+                            const akvcam_scaler_point *y_point,
+                            const akvcam_scaler_t scaler,
+                            uint32_t *sums);
+void akvcam_frame_filter_hline(int16_t *dst_line,
+                               const akvcam_RGB24 *src_line,
+                               const akvcam_scaler_filter *filter,
+                               size_t x_min,
+                               size_t x_max);
+void akvcam_frame_filter_line(akvcam_RGB24_t dst_line,
+                              const akvcam_frame_t src,
+                              size_t y,
+                              bool mirror,
+                              const akvcam_scaler_t scaler,
+                              const akvcam_frame_adjusts_t adjusts,
+                              const akvcam_color_table_t color_table,
+                              akvcam_RGB24 **cache,
+                              size_t *cached,
+                              int16_t **rows,
+                              size_t *rows_cached);
+void akvcam_frame_mirror_line(akvcam_RGB24_t line, size_t width);
+void akvcam_frame_adjust_hsl_line(akvcam_RGB24_t line,
+                                  size_t width,
+                                  const akvcam_color_table_t color_table);
+void akvcam_frame_adjust_levels_line(akvcam_RGB24_t line,
+                                     size_t width,
+                                     const akvcam_color_table_t color_table);
+void akvcam_frame_adjust_line(void *line,
+                              size_t width,
+                              const akvcam_color_table_t color_table);
+void akvcam_frame_swap_rgb_line(void *line, size_t width);
+const akvcam_RGB24 *akvcam_frame_process_src_line(const akvcam_RGB24 *src_line,
+                                                  size_t width,
+                                                  size_t y,
+                                                  size_t keep,
+                                                  const akvcam_frame_adjusts_t adjusts,
+                                                  const akvcam_color_table_t color_table,
+                                                  akvcam_RGB24 **cache,
+                                                  size_t *cached);
+void akvcam_frame_rotate_band(akvcam_RGB24_t band,
+                              const akvcam_frame_t src,
+                              int rotation,
+                              size_t first,
+                              size_t count);
+
+static akvcam_line_convert akvcam_frame_line_convert_table[] = {
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB32 , akvcam_line_bgr24_to_rgb32},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB24 , akvcam_line_bgr24_to_rgb24},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB565, akvcam_line_bgr24_to_rgb16},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB555, akvcam_line_bgr24_to_rgb15},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_BGR32 , akvcam_line_bgr24_to_bgr32},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_BGR24 , akvcam_line_copy24        },
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_UYVY  , akvcam_line_bgr24_to_uyvy },
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_YUYV  , akvcam_line_bgr24_to_yuy2 },
+
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB32 , akvcam_line_rgb24_to_rgb32},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB24 , akvcam_line_copy24        },
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB565, akvcam_line_rgb24_to_rgb16},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB555, akvcam_line_rgb24_to_rgb15},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_BGR32 , akvcam_line_rgb24_to_bgr32},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_BGR24 , akvcam_line_rgb24_to_bgr24},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_UYVY  , akvcam_line_rgb24_to_uyvy },
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUYV  , akvcam_line_rgb24_to_yuy2 },
+    {0                 , 0                  , NULL                      }
+};
+
+typedef void (*akvcam_planar_convert_function_t)(akvcam_frame_t dst,
+                                                 size_t y,
+                                                 const void *src,
+                                                 size_t width);
 
 typedef struct
 {
     __u32 from;
     __u32 to;
-    akvcam_video_convert_funtion_t convert;
-} akvcam_video_convert, *akvcam_video_convert_t;
-
-static akvcam_video_convert akvcam_frame_convert_table[] = {
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB32 , akvcam_bgr24_to_rgb32},
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB24 , akvcam_bgr24_to_rgb24},
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB565, akvcam_bgr24_to_rgb16},
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB555, akvcam_bgr24_to_rgb15},
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_BGR32 , akvcam_bgr24_to_bgr32},
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_UYVY  , akvcam_bgr24_to_uyvy },
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_YUYV  , akvcam_bgr24_to_yuy2 },
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_NV12  , akvcam_bgr24_to_nv12 },
-    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_NV21  , akvcam_bgr24_to_nv21 },
-
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB32 , akvcam_rgb24_to_rgb32},
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB565, akvcam_rgb24_to_rgb16},
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_BGR32 , akvcam_rgb24_to_bgr32},
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_BGR24 , akvcam_rgb24_to_bgr24},
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_UYVY  , akvcam_rgb24_to_uyvy },
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUYV  , akvcam_rgb24_to_yuy2 },
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_NV12  , akvcam_rgb24_to_nv12 },
-    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_NV21  , akvcam_rgb24_to_nv21 },
-    {0                 , 0                  , NULL                 }
+    akvcam_planar_convert_function_t convert;
+} akvcam_planar_convert, *akvcam_planar_convert_t;
+
+static akvcam_planar_convert akvcam_frame_planar_convert_table[] = {
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_NV12  , akvcam_line_bgr24_to_yuv420},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_NV21  , akvcam_line_bgr24_to_yuv420},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_YUV420, akvcam_line_bgr24_to_yuv420},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_YVU420, akvcam_line_bgr24_to_yuv420},
+
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_NV12  , akvcam_line_rgb24_to_yuv420},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_NV21  , akvcam_line_rgb24_to_yuv420},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUV420, akvcam_line_rgb24_to_yuv420},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YVU420, akvcam_line_rgb24_to_yuv420},
+    {0                 , 0                  , NULL                       }
+};
+
+// Where the chroma samples are stored in the 4:2:0 formats. The U and V
+// samples are either interleaved in a single plane or stored in its own
+// plane, 'step' is the distance between two consecutive samples.
+// The pixel structs name the components in the reverse order of the bytes in
+// memory, so akvcam_rgb_u() and akvcam_rgb_v() swap places here, same as in
+// the packed YUV formats.
+typedef struct
+{
+    __u32 fourcc;
+    size_t u_plane;
+    size_t u_offset;
+    size_t v_plane;
+    size_t v_offset;
+    size_t step;
+} akvcam_yuv420_layout, *akvcam_yuv420_layout_t;
+
+static akvcam_yuv420_layout akvcam_frame_yuv420_layouts[] = {
+    {V4L2_PIX_FMT_NV12  , 1, 1, 1, 0, 2},
+    {V4L2_PIX_FMT_NV21  , 1, 0, 1, 1, 2},
+    {V4L2_PIX_FMT_YUV420, 2, 0, 1, 0, 1},
+    {V4L2_PIX_FMT_YVU420, 1, 0, 2, 0, 1},
+    {0                  , 0, 0, 0, 0, 0}
+};
+
+// Where the samples are stored in the packed 4:2:2 formats. The luma samples
+// are 2 bytes apart, and the two chroma samples of each pair of pixels are at
+// 'chroma_offset' and 'chroma_offset + 2', 4 bytes apart.
+typedef struct
+{
+    __u32 fourcc;
+    size_t luma_offset;
+    size_t chroma_offset;
+} akvcam_yuv422_layout, *akvcam_yuv422_layout_t;
+
+static akvcam_yuv422_layout akvcam_frame_yuv422_layouts[] = {
+    {V4L2_PIX_FMT_YUYV, 0, 1},
+    {V4L2_PIX_FMT_UYVY, 1, 0},
+    {0                , 0, 0}
+};
+
+typedef void (*akvcam_unpack_function_t)(akvcam_RGB24_t dst,
+                                         const akvcam_frame_t src,
+                                         size_t y);
+
+typedef struct
+{
+    __u32 fourcc;
+    akvcam_unpack_function_t unpack;
+} akvcam_unpack, *akvcam_unpack_t;
+
+static akvcam_unpack akvcam_frame_unpack_table[] = {
+    {V4L2_PIX_FMT_RGB32 , akvcam_unpack_rgb32 },
+    {V4L2_PIX_FMT_BGR32 , akvcam_unpack_bgr32 },
+    {V4L2_PIX_FMT_UYVY  , akvcam_unpack_uyvy  },
+    {V4L2_PIX_FMT_YUYV  , akvcam_unpack_yuy2  },
+    {V4L2_PIX_FMT_NV12  , akvcam_unpack_yuv420},
+    {V4L2_PIX_FMT_NV21  , akvcam_unpack_yuv420},
+    {V4L2_PIX_FMT_YUV420, akvcam_unpack_yuv420},
+    {V4L2_PIX_FMT_YVU420, akvcam_unpack_yuv420},
+    {0                  , NULL                }
 };
 
-size_t akvcam_convert_funcs_count(void);
-akvcam_video_convert_funtion_t akvcam_convert_func(__u32 from, __u32 to);
+size_t akvcam_line_convert_funcs_count(void);
+akvcam_line_convert_function_t akvcam_line_convert_func(__u32 from, __u32 to);
+akvcam_planar_convert_function_t akvcam_planar_convert_func(__u32 from,
+                                                            __u32 to);
+const akvcam_yuv420_layout *akvcam_yuv420_layout_by_fourcc(__u32 fourcc);
+const akvcam_yuv422_layout *akvcam_yuv422_layout_by_fourcc(__u32 fourcc);
+akvcam_unpack_function_t akvcam_unpack_func(__u32 fourcc);
 
 struct akvcam_frame
 {
@@ -258,11 +451,98 @@ struct akvcam_frame
     akvcam_format_t format;
     void *data;
     size_t size;
+
+    // The data belongs to someone else, like a device buffer, so it must not
+    // be freed with the frame.
+    bool borrowed;
+
+    // The data is taken from and returned to this pool, if any. Intermediate
+    // frames are taken from it too.
+    akvcam_frame_pool_t pool;
 };
 
+// A range of output lines processed by akvcam_frame_process.
+typedef struct
+{
+    struct work_struct work;
+    akvcam_frame_t dst;
+    akvcam_frame_t src;
+    akvcam_frame_adjusts_t adjusts;
+    akvcam_scaler_t scaler;
+    akvcam_scaler_t chroma_scaler;
+    akvcam_color_table_t color_table;
+    akvcam_line_convert_function_t convert;
+    akvcam_planar_convert_function_t planar_convert;
+    akvcam_unpack_function_t unpack;
+    bool simd;
+
+    // The source lines are rotated into the destination, instead of scaled.
+    int rotation;
+
+    // The source lines are read rotated by this angle while scaling them.
+    int src_rotation;
+
+    // Intermediate lines of the stripe, taken from the pool once per frame.
+    void *scratch;
+    size_t y_start;
+    size_t y_end;
+} akvcam_frame_stripe, *akvcam_frame_stripe_t;
+
+// The intermediate lines of akvcam_frame_process_stripe, in it's scratch.
+typedef struct
+{
+    akvcam_RGB24_t line;
+    akvcam_RGB24 *cache[2];
+    uint32_t *sums;
+    int16_t *rows[AKVCAM_SCALER_FILTER_MAX_TAPS];
+    akvcam_RGB24_t band;
+} akvcam_frame_scratch, *akvcam_frame_scratch_t;
+
+static struct workqueue_struct *akvcam_frame_workqueue = NULL;
+
+akvcam_frame_stripe_t akvcam_frame_stripes_new(size_t *stripes,
+                                               size_t height,
+                                               akvcam_frame_stripe_t single_stripe);
+void akvcam_frame_stripes_delete(akvcam_frame_stripe_t stripe, size_t stripes);
+void akvcam_frame_run_stripes(akvcam_frame_stripe_t stripe, size_t stripes);
+size_t akvcam_frame_process_scratch(akvcam_frame_scratch_t lines,
+                                    char *scratch,
+                                    const akvcam_frame_adjusts_t adjusts,
+                                    const akvcam_scaler_t scaler,
+                                    size_t iwidth,
+                                    size_t iheight,
+                                    size_t owidth,
+                                    size_t oheight,
+                                    bool rotated);
+void akvcam_frame_process_stripe(akvcam_frame_stripe_t stripe);
+void akvcam_frame_unpack_stripe(akvcam_frame_stripe_t stripe);
+void akvcam_frame_rotate_stripe(akvcam_frame_stripe_t stripe);
+void akvcam_frame_process_yuv_stripe(akvcam_frame_stripe_t stripe);
+void akvcam_frame_run_stripe(akvcam_frame_stripe_t stripe);
+void akvcam_frame_process_work(struct work_struct *work);
+
 bool akvcam_frame_adjust_format_supported(__u32 fourcc);
-const uint8_t *akvcam_contrast_table(void);
-const uint8_t *akvcam_gamma_table(void);
+bool akvcam_frame_adjusts_colors(const akvcam_frame_adjusts_t adjusts);
+bool akvcam_frame_can_process_yuv(const akvcam_frame_t self,
+                                  const akvcam_frame_t src,
+                                  const akvcam_frame_adjusts_t adjusts);
+bool akvcam_frame_process_yuv(akvcam_frame_t self,
+                              const akvcam_frame_t src,
+                              const akvcam_frame_adjusts_t adjusts,
+                              akvcam_scaler_t scaler,
+                              akvcam_color_table_t color_table,
+                              size_t stripes);
+bool akvcam_frame_unpack(akvcam_frame_t self);
+void akvcam_frame_draw_bars(akvcam_frame_t self);
+void akvcam_frame_draw_gradient(akvcam_frame_t self);
+void akvcam_frame_free_data(akvcam_frame_t self);
+void akvcam_frame_convert_lines(akvcam_frame_t dst,
+                                akvcam_frame_t src,
+                                akvcam_line_convert_function_t convert,
+                                bool simd);
+void akvcam_frame_convert_planar_lines(akvcam_frame_t dst,
+                                       akvcam_frame_t src,
+                                       akvcam_planar_convert_function_t convert);
 
 akvcam_frame_t akvcam_frame_new(akvcam_format_t format,
                                 const void *data,
@@ -288,15 +568,45 @@ akvcam_frame_t akvcam_frame_new(akvcam_format_t format,
     return self;
 }
 
+akvcam_frame_t akvcam_frame_new_wrapped(akvcam_format_t format,
+                                        void *data,
+                                        size_t size)
+{
+    akvcam_frame_t self = kzalloc(sizeof(struct akvcam_frame), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->format = akvcam_format_new_copy(format);
+    self->data = data;
+    self->size = size;
+    self->borrowed = true;
+
+    return self;
+}
+
+akvcam_frame_t akvcam_frame_new_pooled(akvcam_frame_pool_t pool,
+                                       akvcam_format_t format)
+{
+    akvcam_frame_t self = kzalloc(sizeof(struct akvcam_frame), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->format = akvcam_format_new_copy(format);
+    self->size = akvcam_format_size(format);
+    self->pool = akvcam_frame_pool_ref(pool);
+
+    if (self->size > 0)
+        self->data = akvcam_frame_pool_get(self->pool, self->size);
+
+    return self;
+}
+
 akvcam_frame_t akvcam_frame_new_copy(akvcam_frame_t other)
 {
     akvcam_frame_t self = kzalloc(sizeof(struct akvcam_frame), GFP_KERNEL);
     kref_init(&self->ref);
     self->format = akvcam_format_new_copy(other->format);
     self->size = other->size;
+    self->pool = akvcam_frame_pool_ref(other->pool);
 
     if (self->size > 0) {
-        self->data = vzalloc(self->size);
+        self->data = akvcam_frame_pool_get(self->pool, self->size);
 
         if (self->data)
             memcpy(self->data, other->data, self->size);
@@ -309,9 +619,8 @@ void akvcam_frame_free(struct kref *ref)
 {
     akvcam_frame_t self = container_of(ref, struct akvcam_frame, ref);
 
-    if (self->data)
-        vfree(self->data);
-
+    akvcam_frame_free_data(self);
+    akvcam_frame_pool_delete(self->pool);
     akvcam_format_delete(self->format);
     kfree(self);
 }
@@ -333,19 +642,83 @@ akvcam_frame_t akvcam_frame_ref(akvcam_frame_t self)
 void akvcam_frame_copy(akvcam_frame_t self, const akvcam_frame_t other)
 {
     akvcam_format_copy(self->format, other->format);
-    self->size = other->size;
 
-    if (self->data) {
-        vfree(self->data);
-        self->data = NULL;
+    // Keep the current buffer if it has the right size.
+    if (self->borrowed || !self->data || self->size != other->size) {
+        akvcam_frame_free_data(self);
+        self->size = other->size;
+
+        if (self->size > 0)
+            self->data = akvcam_frame_pool_get(self->pool, self->size);
     }
 
-    if (self->size > 0) {
-        self->data = vzalloc(self->size);
+    if (!self->data)
+        return;
+
+    if (other->data)
+        memcpy(self->data, other->data, self->size);
+    else
+        memset(self->data, 0, self->size);
+}
+
+void akvcam_frame_swap(akvcam_frame_t self, akvcam_frame_t other)
+{
+    akvcam_format_t format = self->format;
+    void *data = self->data;
+    size_t size = self->size;
+    bool borrowed = self->borrowed;
+    akvcam_frame_pool_t pool = self->pool;
+
+    // The pool goes with the data, that's where it must be returned to.
+    self->format = other->format;
+    self->data = other->data;
+    self->size = other->size;
+    self->borrowed = other->borrowed;
+    self->pool = other->pool;
+    other->format = format;
+    other->data = data;
+    other->size = size;
+    other->borrowed = borrowed;
+    other->pool = pool;
+}
+
+void akvcam_frame_take(akvcam_frame_t self, akvcam_frame_t other)
+{
+    // Borrowed memory is where the caller expects the result, so keep
+    // writing there while it fits.
+    if (self->borrowed && self->data && other->data
+        && other->size <= self->size) {
+        akvcam_format_copy(self->format, other->format);
+        memcpy(self->data, other->data, other->size);
+        self->size = other->size;
+    } else {
+        akvcam_frame_swap(self, other);
+    }
 
-        if (other->data)
-            memcpy(self->data, other->data, other->size);
+    akvcam_frame_clear(other);
+}
+
+void akvcam_frame_set_pool(akvcam_frame_t self, akvcam_frame_pool_t pool)
+{
+    akvcam_frame_pool_t old_pool = self->pool;
+    void *data = self->data;
+
+    if (pool == old_pool)
+        return;
+
+    self->pool = akvcam_frame_pool_ref(pool);
+
+    // The data already allocated must go back to the pool it came from.
+    if (data && !self->borrowed) {
+        self->data = akvcam_frame_pool_get(self->pool, self->size);
+
+        if (self->data)
+            memcpy(self->data, data, self->size);
+
+        akvcam_frame_pool_put(old_pool, data, self->size);
     }
+
+    akvcam_frame_pool_delete(old_pool);
 }
 
 akvcam_format_t akvcam_frame_format(const akvcam_frame_t self)
@@ -380,26 +753,21 @@ void akvcam_frame_resize(akvcam_frame_t self, size_t size)
     if (size < 1)
         size = akvcam_format_size(self->format);
 
+    akvcam_frame_free_data(self);
     self->size = size;
 
-    if (self->data) {
-        vfree(self->data);
-        self->data = NULL;
-    }
+    if (size > 0) {
+        self->data = akvcam_frame_pool_get(self->pool, size);
 
-    if (size > 0)
-        self->data = vzalloc(size);
+        if (self->data)
+            memset(self->data, 0, size);
+    }
 }
 
 void akvcam_frame_clear(akvcam_frame_t self)
 {
     akvcam_format_clear(self->format);
-
-    if (self->data) {
-        vfree(self->data);
-        self->data = NULL;
-    }
-
+    akvcam_frame_free_data(self);
     self->size = 0;
 }
 
@@ -410,8 +778,10 @@ bool akvcam_frame_load(akvcam_frame_t self, const char *file_name)
     akvcam_bmp_header header;
     akvcam_bmp_image_header image_header;
     akvcam_RGB24_t line;
-    akvcam_BGR24 pixel24;
-    akvcam_BGR32 pixel32;
+    akvcam_BGR24_t pixel24;
+    akvcam_BGR32_t pixel32;
+    uint8_t *row = NULL;
+    size_t row_size;
     uint32_t x;
     uint32_t y;
 
@@ -445,6 +815,14 @@ bool akvcam_frame_load(akvcam_frame_t self, const char *file_name)
     akvcam_file_read(bmp_file,
                      (char *) &image_header,
                      sizeof(akvcam_bmp_image_header));
+
+    if (image_header.bitCount != 24 && image_header.bitCount != 32) {
+        akpr_err("Bit count not supported in bitmap: %u\n",
+                 image_header.bitCount);
+
+        goto akvcam_frame_load_failed;
+    }
+
     akvcam_file_seek(bmp_file, header.offBits, AKVCAM_FILE_SEEK_BEG);
     akvcam_format_set_fourcc(self->format, V4L2_PIX_FMT_RGB24);
     akvcam_format_set_width(self->format, image_header.width);
@@ -457,59 +835,119 @@ bool akvcam_frame_load(akvcam_frame_t self, const char *file_name)
         goto akvcam_frame_load_failed;
     }
 
-    self->data = vmalloc(self->size);
+    self->data = akvcam_frame_pool_get(self->pool, self->size);
 
-    switch (image_header.bitCount) {
-        case 24:
-            for (y = 0; y < image_header.height; y++) {
-                line = akvcam_frame_line(self, 0, image_header.height - y - 1);
+    // Read whole rows at once, the rows are padded to 4 bytes.
+    row_size = ((size_t) image_header.width * image_header.bitCount + 31)
+               / 32 * 4;
+    row = kvmalloc(row_size, GFP_KERNEL);
 
-                for (x = 0; x < image_header.width; x++) {
-                    akvcam_file_read(bmp_file,
-                                     (char *) &pixel24,
-                                     sizeof(akvcam_BGR24));
-                    line[x].r = pixel24.r;
-                    line[x].g = pixel24.g;
-                    line[x].b = pixel24.b;
-                }
-            }
+    if (!self->data || !row) {
+        akpr_err("Can't allocate the bitmap\n");
 
-            break;
+        goto akvcam_frame_load_failed;
+    }
 
-        case 32:
-            for (y = 0; y < image_header.height; y++) {
-                line = akvcam_frame_line(self, 0, image_header.height - y - 1);
+    pixel24 = (akvcam_BGR24_t) row;
+    pixel32 = (akvcam_BGR32_t) row;
 
-                for (x = 0; x < image_header.width; x++) {
-                    akvcam_file_read(bmp_file,
-                                     (char *) &pixel32,
-                                     sizeof(akvcam_BGR32));
-                    line[x].r = pixel32.r;
-                    line[x].g = pixel32.g;
-                    line[x].b = pixel32.b;
-                }
-            }
+    for (y = 0; y < image_header.height; y++) {
+        if (akvcam_file_read(bmp_file, row, row_size)
+            < (size_t) image_header.width * image_header.bitCount / 8) {
+            akpr_err("Bitmap file is truncated: %s\n", file_name);
 
-            break;
+            goto akvcam_frame_load_failed;
+        }
 
-        default:
-            akpr_err("Bit count not supported in bitmap: %u\n",
-                     image_header.bitCount);
+        line = akvcam_frame_line(self, 0, image_header.height - y - 1);
 
-            goto akvcam_frame_load_failed;
+        if (image_header.bitCount == 24)
+            for (x = 0; x < image_header.width; x++) {
+                line[x].r = pixel24[x].r;
+                line[x].g = pixel24[x].g;
+                line[x].b = pixel24[x].b;
+            }
+        else
+            for (x = 0; x < image_header.width; x++) {
+                line[x].r = pixel32[x].r;
+                line[x].g = pixel32[x].g;
+                line[x].b = pixel32[x].b;
+            }
     }
 
+    kvfree(row);
     akvcam_file_delete(bmp_file);
 
     return true;
 
 akvcam_frame_load_failed:
+    kvfree(row);
     akvcam_frame_clear(self);
     akvcam_file_delete(bmp_file);
 
     return false;
 }
 
+bool akvcam_frame_load_raw(akvcam_frame_t self,
+                           const char *file_name,
+                           akvcam_format_t format)
+{
+    akvcam_file_t raw_file;
+    size_t size;
+
+    akvcam_frame_clear(self);
+
+    if (!file_name || strlen(file_name) < 1) {
+        akpr_err("Raw frame file name not valid\n");
+
+        return false;
+    }
+
+    size = akvcam_format_size(format);
+
+    if (size < 1) {
+        akpr_err("Raw frame format is invalid\n");
+
+        return false;
+    }
+
+    raw_file = akvcam_file_new(file_name);
+
+    if (!akvcam_file_open(raw_file)) {
+        akpr_err("Can't open raw frame file: %s\n", file_name);
+
+        goto akvcam_frame_load_raw_failed;
+    }
+
+    if (akvcam_file_size(raw_file) < size) {
+        akpr_err("Raw frame file is too small: %s\n", file_name);
+
+        goto akvcam_frame_load_raw_failed;
+    }
+
+    // The file is already in the frame format, read it as is.
+    akvcam_format_copy(self->format, format);
+    self->size = size;
+    self->data = akvcam_frame_pool_get(self->pool, self->size);
+
+    if (!self->data
+        || akvcam_file_read(raw_file, self->data, self->size) < self->size) {
+        akpr_err("Can't read raw frame file: %s\n", file_name);
+
+        goto akvcam_frame_load_raw_failed;
+    }
+
+    akvcam_file_delete(raw_file);
+
+    return true;
+
+akvcam_frame_load_raw_failed:
+    akvcam_frame_clear(self);
+    akvcam_file_delete(raw_file);
+
+    return false;
+}
+
 void akvcam_frame_mirror(akvcam_frame_t self,
                          bool horizontalMirror,
                          bool verticalMirror)
@@ -518,10 +956,8 @@ void akvcam_frame_mirror(akvcam_frame_t self,
     akvcam_RGB24_t src_line;
     akvcam_RGB24_t dst_line;
     akvcam_RGB24_t tmp_line;
-    akvcam_RGB24 tmp_pixel;
     size_t width;
     size_t height;
-    size_t x;
     size_t y;
     size_t line_size;
 
@@ -537,19 +973,12 @@ void akvcam_frame_mirror(akvcam_frame_t self,
     height = akvcam_format_height(self->format);
 
     if (horizontalMirror)
-        for (y = 0; y < height; y++) {
-            src_line = akvcam_frame_line(self, 0, y);
-
-            for (x = 0; x < width / 2; x++) {
-                tmp_pixel = src_line[x];
-                src_line[x] = src_line[width - x - 1];
-                src_line[width - x - 1] = tmp_pixel;
-            }
-        }
+        for (y = 0; y < height; y++)
+            akvcam_frame_mirror_line(akvcam_frame_line(self, 0, y), width);
 
     if (verticalMirror) {
         line_size = akvcam_format_bypl(self->format, 0);
-        tmp_line = vmalloc(line_size);
+        tmp_line = kvmalloc(line_size, GFP_KERNEL);
 
         for (y = 0; y < height / 2; y++) {
             src_line = akvcam_frame_line(self, 0, height - y - 1);
@@ -559,8 +988,49 @@ void akvcam_frame_mirror(akvcam_frame_t self,
             memcpy(src_line, tmp_line, line_size);
         }
 
-        vfree(tmp_line);
+        kvfree(tmp_line);
+    }
+}
+
+void akvcam_frame_rotate(akvcam_frame_t self, int rotation)
+{
+    __u32 fourcc;
+    akvcam_format_t format;
+    akvcam_frame_t frame;
+    akvcam_frame_stripe stripe;
+
+    if (rotation == 180) {
+        akvcam_frame_mirror(self, true, true);
+
+        return;
+    }
+
+    if (rotation != 90 && rotation != 270)
+        return;
+
+    fourcc = akvcam_format_fourcc(self->format);
+
+    if (!akvcam_frame_adjust_format_supported(fourcc))
+        return;
+
+    format = akvcam_format_new_copy(self->format);
+    akvcam_format_set_width(format, akvcam_format_height(self->format));
+    akvcam_format_set_height(format, akvcam_format_width(self->format));
+    frame = akvcam_frame_new_pooled(self->pool, format);
+    akvcam_format_delete(format);
+
+    if (frame->data) {
+        memset(&stripe, 0, sizeof(akvcam_frame_stripe));
+        stripe.dst = frame;
+        stripe.src = self;
+        stripe.rotation = rotation;
+        stripe.y_start = 0;
+        stripe.y_end = akvcam_format_height(self->format);
+        akvcam_frame_rotate_stripe(&stripe);
+        akvcam_frame_take(self, frame);
     }
+
+    akvcam_frame_delete(frame);
 }
 
 bool akvcam_frame_scaled(akvcam_frame_t self,
@@ -571,35 +1041,9 @@ bool akvcam_frame_scaled(akvcam_frame_t self,
 {
     __u32 fourcc;
     akvcam_format_t format;
-    akvcam_extrapolate_t extrapolate_x;
-    akvcam_extrapolate_t extrapolate_y;
-    akvcam_RGB24_t src_line;
-    akvcam_RGB24_t dst_line;
-    size_t x_dst_min;
-    size_t y_dst_min;
-    size_t x_dst_max;
-    size_t y_dst_max;
-    size_t i_width;
-    size_t i_height;
-    size_t o_width;
-    size_t o_height;
-    size_t x_num;
-    size_t x_den;
-    size_t xs;
-    size_t y_num;
-    size_t y_den;
-    size_t ys;
-    size_t x;
-    size_t y;
-    size_t x_min;
-    size_t x_max;
-    size_t k_num_x;
-    size_t k_den_x;
-    size_t y_min;
-    size_t y_max;
-    size_t k_num_y;
-    size_t k_den_y;
-    void *data;
+    akvcam_frame_t frame;
+    akvcam_frame_adjusts adjusts;
+    bool ok;
 
     if (akvcam_format_width(self->format) == width
         && akvcam_format_height(self->format) == height)
@@ -610,131 +1054,20 @@ bool akvcam_frame_scaled(akvcam_frame_t self,
     if (!akvcam_frame_adjust_format_supported(fourcc))
         return false;
 
-    x_dst_min = 0;
-    y_dst_min = 0;
-    x_dst_max = width;
-    y_dst_max = height;
-
-    if (aspectRatio == AKVCAM_ASPECT_RATIO_KEEP) {
-        if (width * akvcam_format_height(self->format)
-            > akvcam_format_width(self->format) * height) {
-            // Right and left black bars
-            x_dst_min = (width * akvcam_format_height(self->format)
-                         - akvcam_format_width(self->format) * height)
-                         / (2 * akvcam_format_height(self->format));
-            x_dst_max = (width * akvcam_format_height(self->format)
-                         + akvcam_format_width(self->format) * height)
-                         / (2 * akvcam_format_height(self->format));
-        } else if (width * akvcam_format_height(self->format)
-                   < akvcam_format_width(self->format) * height) {
-            // Top and bottom black bars
-            y_dst_min = (akvcam_format_width(self->format) * height
-                         - width * akvcam_format_height(self->format))
-                         / (2 * akvcam_format_width(self->format));
-            y_dst_max = (akvcam_format_width(self->format) * height
-                         + width * akvcam_format_height(self->format))
-                         / (2 * akvcam_format_width(self->format));
-        }
-    }
-
-    i_width = akvcam_format_width(self->format) - 1;
-    i_height = akvcam_format_height(self->format) - 1;
-    o_width = x_dst_max - x_dst_min - 1;
-    o_height = y_dst_max - y_dst_min - 1;
-    x_num = i_width;
-    x_den = o_width;
-    xs = 0;
-    y_num = i_height;
-    y_den = o_height;
-    ys = 0;
-
-    if (aspectRatio == AKVCAM_ASPECT_RATIO_EXPANDING) {
-        if (mode == AKVCAM_SCALING_LINEAR) {
-            i_width--;
-            i_height--;
-            o_width--;
-            o_height--;
-        }
-
-        if (width * akvcam_format_height(self->format)
-            < akvcam_format_width(self->format) * height) {
-            // Right and left cut
-            x_num = 2 * i_height;
-            x_den = 2 * o_height;
-            xs = i_width * o_height - o_width * i_height;
-        } else if (width * akvcam_format_height(self->format)
-                   > akvcam_format_width(self->format) * height) {
-            // Top and bottom cut
-            y_num = 2 * i_width;
-            y_den = 2 * o_width;
-            ys = o_width * i_height - i_width * o_height;
-        }
-    }
-
+    memset(&adjusts, 0, sizeof(akvcam_frame_adjusts));
+    adjusts.scaling = mode;
+    adjusts.aspect_ratio = aspectRatio;
     format = akvcam_format_new(fourcc, width, height, NULL);
-    data = vzalloc(akvcam_format_size(format));
-
-    switch (mode) {
-        case AKVCAM_SCALING_FAST:
-            for (y = y_dst_min; y < y_dst_max; y++) {
-                size_t srcY = (y_num * (y - y_dst_min) + ys) / y_den;
-                src_line = akvcam_frame_line(self, 0, srcY);
-                dst_line = (akvcam_RGB24_t)
-                           ((char *) data + y * akvcam_format_bypl(format, 0));
-
-                for (x = x_dst_min; x < x_dst_max; x++) {
-                    size_t srcX = (x_num * (x - x_dst_min) + xs) / x_den;
-                    dst_line[x] = src_line[srcX];
-                }
-            }
-
-            break;
-
-        case AKVCAM_SCALING_LINEAR: {
-            extrapolate_x = akvcam_format_width(self->format) < width?
-                                &akvcam_extrapolate_up:
-                                &akvcam_extrapolate_down;
-            extrapolate_y = akvcam_format_height(self->format) < height?
-                                &akvcam_extrapolate_up:
-                                &akvcam_extrapolate_down;
-
-            for (y = y_dst_min; y < y_dst_max; y++) {
-                dst_line = (akvcam_RGB24_t)
-                           ((char *) data + y * akvcam_format_bypl(format, 0));
-                extrapolate_y(y - y_dst_min,
-                              y_num, y_den, ys,
-                              &y_min, &y_max,
-                              &k_num_y, &k_den_y);
-
-                for (x = x_dst_min; x < x_dst_max; x++) {
-                    extrapolate_x(x - x_dst_min,
-                                  x_num, x_den, xs,
-                                  &x_min, &x_max,
-                                  &k_num_x, &k_den_x);
-
-                    dst_line[x] =
-                            akvcam_extrapolated_color(self,
-                                                      x_min, x_max,
-                                                      k_num_x, k_den_x,
-                                                      y_min, y_max,
-                                                      k_num_y, k_den_y);
-                }
-            }
-
-            break;
-        }
-    }
-
-    akvcam_format_copy(self->format, format);
+    frame = akvcam_frame_new_pooled(self->pool, format);
     akvcam_format_delete(format);
+    ok = akvcam_frame_process(frame, self, &adjusts, NULL, NULL, 1);
 
-    if (self->data)
-        vfree(self->data);
+    if (ok)
+        akvcam_frame_take(self, frame);
 
-    self->data = data;
-    self->size = akvcam_format_size(self->format);
+    akvcam_frame_delete(frame);
 
-    return true;
+    return ok;
 }
 
 void akvcam_frame_swap_rgb(akvcam_frame_t self)
@@ -742,10 +1075,7 @@ void akvcam_frame_swap_rgb(akvcam_frame_t self)
     __u32 fourcc;
     size_t width;
     size_t height;
-    size_t x;
     size_t y;
-    akvcam_RGB24_t line;
-    uint8_t tmp;
 
     fourcc = akvcam_format_fourcc(self->format);
 
@@ -755,194 +1085,164 @@ void akvcam_frame_swap_rgb(akvcam_frame_t self)
     width = akvcam_format_width(self->format);
     height = akvcam_format_height(self->format);
 
-    for (y = 0; y < height; y++) {
-        line = akvcam_frame_line(self, 0, y);
-
-        for (x = 0; x < width; x++) {
-            tmp = line[x].r;
-            line[x].r = line[x].b;
-            line[x].b = tmp;
-        }
-    }
+    for (y = 0; y < height; y++)
+        akvcam_frame_swap_rgb_line(akvcam_frame_line(self, 0, y), width);
 }
 
-bool akvcam_frame_convert(akvcam_frame_t self, __u32 fourcc)
+bool akvcam_frame_convert(akvcam_frame_t self, const akvcam_format_t format)
 {
-    akvcam_format_t format;
+    akvcam_format_t converted_format;
     akvcam_frame_t frame;
-    akvcam_video_convert_funtion_t convert = NULL;
-
-    if (akvcam_format_fourcc(self->format) == fourcc)
+    akvcam_line_convert_function_t line_convert;
+    akvcam_planar_convert_function_t planar_convert = NULL;
+    bool simd;
+    __u32 from = akvcam_format_fourcc(self->format);
+    __u32 fourcc = akvcam_format_fourcc(format);
+
+    if (from == fourcc
+        && akvcam_yuv_matrix_from_format(self->format)
+           == akvcam_yuv_matrix_from_format(format))
         return true;
 
-    convert = akvcam_convert_func(akvcam_format_fourcc(self->format), fourcc);
+    if (!akvcam_frame_adjust_format_supported(from)) {
+        if (!akvcam_frame_unpack(self))
+            return false;
 
-    if (!convert)
-        return false;
+        return akvcam_frame_convert(self, format);
+    }
+
+    line_convert = akvcam_frame_simd_convert_func(from, fourcc);
+    simd = line_convert != NULL;
+
+    if (!line_convert)
+        line_convert = akvcam_line_convert_func(from, fourcc);
+
+    if (!line_convert) {
+        planar_convert = akvcam_planar_convert_func(from, fourcc);
 
-    format = akvcam_format_new(0, 0, 0, NULL);
-    akvcam_format_copy(format, self->format);
-    akvcam_format_set_fourcc(format, fourcc);
-    frame = akvcam_frame_new(format, NULL, 0);
+        if (!planar_convert)
+            return false;
+    }
+
+    converted_format = akvcam_format_new(0, 0, 0, NULL);
+    akvcam_format_copy(converted_format, self->format);
+    akvcam_format_set_fourcc(converted_format, fourcc);
+    akvcam_format_copy_colorimetry(converted_format, format);
+    frame = akvcam_frame_new_pooled(self->pool, converted_format);
 
-    convert(frame, self);
-    akvcam_frame_copy(self, frame);
+    if (line_convert)
+        akvcam_frame_convert_lines(frame, self, line_convert, simd);
+    else
+        akvcam_frame_convert_planar_lines(frame, self, planar_convert);
+
+    akvcam_frame_take(self, frame);
 
     akvcam_frame_delete(frame);
-    akvcam_format_delete(format);
+    akvcam_format_delete(converted_format);
 
     return true;
 }
 
-void akvcam_frame_adjust_hsl(akvcam_frame_t self,
-                             int hue,
-                             int saturation,
-                             int luminance)
+bool akvcam_frame_pattern(akvcam_frame_t self, AKVCAM_PATTERN pattern)
 {
-    __u32 fourcc;
-    size_t width;
-    size_t height;
-    size_t x;
-    size_t y;
-    akvcam_RGB24_t line;
-    int h;
-    int s;
-    int l;
-    int r;
-    int g;
-    int b;
-
-    if (hue == 0 && saturation == 0 && luminance == 0)
-        return;
+    size_t width = akvcam_format_width(self->format);
+    size_t height = akvcam_format_height(self->format);
+    akvcam_frame_adjusts adjusts;
+    akvcam_format_t format;
+    akvcam_frame_t frame;
+    bool ok;
 
-    fourcc = akvcam_format_fourcc(self->format);
+    if (!self->data)
+        return false;
 
-    if (!akvcam_frame_adjust_format_supported(fourcc))
-        return;
+    // Draw the pattern in RGB and convert it to the frame format.
+    format = akvcam_format_new(V4L2_PIX_FMT_RGB24, width, height, NULL);
+    frame = akvcam_frame_new_pooled(self->pool, format);
+    akvcam_format_delete(format);
 
-    width = akvcam_format_width(self->format);
-    height = akvcam_format_height(self->format);
+    if (!frame->data) {
+        akvcam_frame_delete(frame);
 
-    for (y = 0; y < height; y++) {
-        line = akvcam_frame_line(self, 0, y);
+        return false;
+    }
 
-        for (x = 0; x < width; x++) {
-            akvcam_rgb_to_hsl(line[x].r, line[x].g, line[x].b, &h, &s, &l);
+    switch (pattern) {
+    case AKVCAM_PATTERN_GRADIENT:
+        akvcam_frame_draw_gradient(frame);
 
-            h = akvcam_mod(h + hue, 360);
-            s = akvcam_bound(0, s + saturation, 255);
-            l = akvcam_bound(0, l + luminance, 255);
+        break;
 
-            akvcam_hsl_to_rgb(h, s, l, &r, &g, &b);
+    default:
+        akvcam_frame_draw_bars(frame);
 
-            line[x].r = (uint8_t) r;
-            line[x].g = (uint8_t) g;
-            line[x].b = (uint8_t) b;
-        }
+        break;
     }
+
+    memset(&adjusts, 0, sizeof(akvcam_frame_adjusts));
+    ok = akvcam_frame_process(self, frame, &adjusts, NULL, NULL, 1);
+    akvcam_frame_delete(frame);
+
+    return ok;
 }
 
-void akvcam_frame_adjust_contrast(akvcam_frame_t self, int contrast)
+void akvcam_frame_scroll(akvcam_frame_t self,
+                         const akvcam_frame_t src,
+                         size_t lines)
 {
-    __u32 fourcc;
-    size_t width;
-    size_t height;
-    size_t x;
-    size_t y;
-    akvcam_RGB24_t line;
-    const uint8_t *contrast_table = akvcam_contrast_table();
-    size_t contrast_offset;
-
-    if (!contrast_table || contrast == 0)
-        return;
-
-    fourcc = akvcam_format_fourcc(self->format);
-
-    if (!akvcam_frame_adjust_format_supported(fourcc))
+    size_t height = akvcam_format_height(src->format);
+    size_t planes = akvcam_format_planes(src->format);
+    size_t bypl;
+    size_t plane_height;
+    size_t shift;
+    char *src_plane;
+    char *dst_plane;
+    size_t plane;
+
+    if (!self->data || !src->data || height < 1)
         return;
 
-    width = akvcam_format_width(self->format);
-    height = akvcam_format_height(self->format);
-
-    contrast = akvcam_bound(-255, contrast, 255);
-    contrast_offset = (size_t) (contrast + 255) << 8;
-
-    for (y = 0; y < height; y++) {
-        line = akvcam_frame_line(self, 0, y);
-
-        for (x = 0; x < width; x++) {
-            line[x].r = contrast_table[contrast_offset | line[x].r];
-            line[x].g = contrast_table[contrast_offset | line[x].g];
-            line[x].b = contrast_table[contrast_offset | line[x].b];
-        }
+    // Every plane is moved the same fraction of its height, so the
+    // subsampled planes stay aligned with the luma.
+    for (plane = 0; plane < planes; plane++) {
+        bypl = akvcam_format_bypl(src->format, plane);
+
+        if (bypl < 1)
+            continue;
+
+        plane_height = akvcam_format_plane_size(src->format, plane) / bypl;
+        shift = (lines % height) * plane_height / height;
+        src_plane = (char *) src->data + akvcam_format_offset(src->format, plane);
+        dst_plane = (char *) self->data + akvcam_format_offset(self->format, plane);
+        memcpy(dst_plane,
+               src_plane + shift * bypl,
+               (plane_height - shift) * bypl);
+        memcpy(dst_plane + (plane_height - shift) * bypl,
+               src_plane,
+               shift * bypl);
     }
 }
 
-void akvcam_frame_adjust_gamma(akvcam_frame_t self, int gamma)
+void akvcam_frame_adjust_hsl(akvcam_frame_t self,
+                             int hue,
+                             int saturation,
+                             int luminance)
 {
-    __u32 fourcc;
-    size_t width;
-    size_t height;
-    size_t x;
-    size_t y;
-    akvcam_RGB24_t line;
-    const uint8_t *gamma_table = akvcam_gamma_table();
-    size_t gamma_offset;
-
-    if (!gamma_table || gamma == 0)
-        return;
-
-    fourcc = akvcam_format_fourcc(self->format);
-
-    if (!akvcam_frame_adjust_format_supported(fourcc))
-        return;
-
-    width = akvcam_format_width(self->format);
-    height = akvcam_format_height(self->format);
-
-    gamma = akvcam_bound(-255, gamma, 255);
-    gamma_offset = (size_t) (gamma + 255) << 8;
+    akvcam_frame_adjust(self, hue, saturation, luminance, 0, 0, false);
+}
 
-    for (y = 0; y < height; y++) {
-        line = akvcam_frame_line(self, 0, y);
+void akvcam_frame_adjust_contrast(akvcam_frame_t self, int contrast)
+{
+    akvcam_frame_adjust(self, 0, 0, 0, contrast, 0, false);
+}
 
-        for (x = 0; x < width; x++) {
-            line[x].r = gamma_table[gamma_offset | line[x].r];
-            line[x].g = gamma_table[gamma_offset | line[x].g];
-            line[x].b = gamma_table[gamma_offset | line[x].b];
-        }
-    }
+void akvcam_frame_adjust_gamma(akvcam_frame_t self, int gamma)
+{
+    akvcam_frame_adjust(self, 0, 0, 0, 0, gamma, false);
 }
 
 void akvcam_frame_to_gray_scale(akvcam_frame_t self)
 {
-    __u32 fourcc;
-    size_t width;
-    size_t height;
-    size_t x;
-    size_t y;
-    akvcam_RGB24_t line;
-    int luma;
-
-    fourcc = akvcam_format_fourcc(self->format);
-
-    if (!akvcam_frame_adjust_format_supported(fourcc))
-        return;
-
-    width = akvcam_format_width(self->format);
-    height = akvcam_format_height(self->format);
-
-    for (y = 0; y < height; y++) {
-        line = akvcam_frame_line(self, 0, y);
-
-        for (x = 0; x < width; x++) {
-            luma = akvcam_grayval(line[x].r, line[x].g, line[x].b);
-
-            line[x].r = (uint8_t) luma;
-            line[x].g = (uint8_t) luma;
-            line[x].b = (uint8_t) luma;
-        }
-    }
+    akvcam_frame_adjust(self, 0, 0, 0, 0, 0, true);
 }
 
 void akvcam_frame_adjust(akvcam_frame_t self,
@@ -956,20 +1256,8 @@ void akvcam_frame_adjust(akvcam_frame_t self,
     __u32 fourcc;
     size_t width;
     size_t height;
-    size_t x;
     size_t y;
-    akvcam_RGB24_t line;
-    int h;
-    int s;
-    int l;
-    int r;
-    int g;
-    int b;
-    int luma;
-    const uint8_t *contrast_table = akvcam_contrast_table();
-    const uint8_t *gamma_table = akvcam_gamma_table();
-    size_t contrast_offset;
-    size_t gamma_offset;
+    akvcam_color_table_t color_table;
 
     if (hue == 0
         && saturation == 0
@@ -986,56 +1274,292 @@ void akvcam_frame_adjust(akvcam_frame_t self,
 
     width = akvcam_format_width(self->format);
     height = akvcam_format_height(self->format);
+    color_table = akvcam_color_table_new(hue,
+                                         saturation,
+                                         luminance,
+                                         contrast,
+                                         gamma,
+                                         gray);
+
+    for (y = 0; y < height; y++)
+        akvcam_frame_adjust_line(akvcam_frame_line(self, 0, y),
+                                 width,
+                                 color_table);
+
+    akvcam_color_table_delete(color_table);
+}
+
+bool akvcam_frame_process(akvcam_frame_t self,
+                          const akvcam_frame_t src,
+                          const akvcam_frame_adjusts_t adjusts,
+                          akvcam_scaler_t scaler,
+                          akvcam_color_table_t color_table,
+                          size_t stripes)
+{
+    __u32 ifourcc = akvcam_format_fourcc(src->format);
+    __u32 ofourcc = akvcam_format_fourcc(self->format);
+    size_t iwidth = akvcam_format_width(src->format);
+    size_t iheight = akvcam_format_height(src->format);
+    size_t owidth = akvcam_format_width(self->format);
+    size_t oheight = akvcam_format_height(self->format);
+    akvcam_line_convert_function_t convert;
+    akvcam_planar_convert_function_t planar_convert = NULL;
+    akvcam_unpack_function_t unpack = NULL;
+    akvcam_format_t format;
+    akvcam_frame_t unpacked = NULL;
+    char *scratch;
+    size_t scratch_size;
+    akvcam_frame_adjusts rotated_adjusts;
+    akvcam_frame_stripe single_stripe;
+    akvcam_frame_stripe_t stripe;
+    bool processed;
+    bool transpose;
+    bool prerotate;
+    bool simd;
+    size_t i;
 
-    contrast = akvcam_bound(-255, contrast, 255);
-    contrast_offset = (size_t) (contrast + 255) << 8;
+    if (iwidth < 1 || iheight < 1 || owidth < 1 || oheight < 1
+        || !self->data
+        || !src->data)
+        return false;
 
-    gamma = akvcam_bound(-255, gamma, 255);
-    gamma_offset = (size_t) (gamma + 255) << 8;
+    // Turning the frame upside down is the same as mirroring it both ways.
+    if (adjusts->rotation == 180) {
+        rotated_adjusts = *adjusts;
+        rotated_adjusts.horizontal_mirror = !adjusts->horizontal_mirror;
+        rotated_adjusts.vertical_mirror = !adjusts->vertical_mirror;
+        rotated_adjusts.rotation = 0;
+
+        return akvcam_frame_process(self,
+                                    src,
+                                    &rotated_adjusts,
+                                    scaler,
+                                    color_table,
+                                    stripes);
+    }
 
-    for (y = 0; y < height; y++) {
-        line = akvcam_frame_line(self, 0, y);
+    transpose = adjusts->rotation == 90 || adjusts->rotation == 270;
+
+    // The producer already gives the frames as the capture wants them.
+    if (ifourcc == ofourcc
+        && akvcam_yuv_matrix_from_format(src->format)
+           == akvcam_yuv_matrix_from_format(self->format)
+        && iwidth == owidth
+        && iheight == oheight
+        && !adjusts->horizontal_mirror
+        && !adjusts->vertical_mirror
+        && !transpose
+        && !akvcam_frame_adjusts_colors(adjusts)) {
+        if (self->borrowed && self->size >= AKVCAM_FRAME_NT_COPY_SIZE)
+            memcpy_flushcache(self->data,
+                              src->data,
+                              akvcam_min(self->size, src->size));
+        else
+            memcpy(self->data, src->data, akvcam_min(self->size, src->size));
 
-        for (x = 0; x < width; x++) {
-            r = line[x].r;
-            g = line[x].g;
-            b = line[x].b;
+        return true;
+    }
 
-            if (hue != 0 || saturation != 0 ||  luminance != 0) {
-                akvcam_rgb_to_hsl(r, g, b, &h, &s, &l);
+    // Other formats are unpacked to RGB24 before processing them.
+    if (!akvcam_frame_adjust_format_supported(ifourcc)) {
+        unpack = akvcam_unpack_func(ifourcc);
 
-                h = akvcam_mod(h + hue, 360);
-                s = akvcam_bound(0, s + saturation, 255);
-                l = akvcam_bound(0, l + luminance, 255);
+        if (!unpack)
+            return false;
 
-                akvcam_hsl_to_rgb(h, s, l, &r, &g, &b);
-            }
+        ifourcc = V4L2_PIX_FMT_RGB24;
+    }
 
-            if (gamma_table && gamma != 0) {
-                r = gamma_table[gamma_offset | (size_t) r];
-                g = gamma_table[gamma_offset | (size_t) g];
-                b = gamma_table[gamma_offset | (size_t) b];
-            }
+    convert = akvcam_frame_simd_convert_func(ifourcc, ofourcc);
+    simd = convert != NULL;
 
-            if (contrast_table && contrast != 0) {
-                r = contrast_table[contrast_offset | (size_t) r];
-                g = contrast_table[contrast_offset | (size_t) g];
-                b = contrast_table[contrast_offset | (size_t) b];
-            }
+    if (!convert)
+        convert = akvcam_line_convert_func(ifourcc, ofourcc);
 
-            if (gray) {
-                luma = akvcam_grayval(r, g, b);
+    if (!convert) {
+        planar_convert = akvcam_planar_convert_func(ifourcc, ofourcc);
 
-                r = luma;
-                g = luma;
-                b = luma;
-            }
+        if (!planar_convert)
+            return false;
+    }
+
+    // The source frame is rotated before scaling it, so the scaling goes
+    // from the rotated size.
+    if (transpose) {
+        iwidth = akvcam_format_height(src->format);
+        iheight = akvcam_format_width(src->format);
+    }
+
+    if (akvcam_scaler_matches(scaler,
+                              iwidth,
+                              iheight,
+                              owidth,
+                              oheight,
+                              adjusts->scaling,
+                              adjusts->aspect_ratio))
+        akvcam_scaler_ref(scaler);
+    else
+        scaler = akvcam_scaler_new(iwidth,
+                                   iheight,
+                                   owidth,
+                                   oheight,
+                                   adjusts->scaling,
+                                   adjusts->aspect_ratio);
+
+    // The color table is only needed for adjusting the colors.
+    if (!akvcam_frame_adjusts_colors(adjusts))
+        color_table = NULL;
+    else if (akvcam_color_table_matches(color_table,
+                                        adjusts->hue,
+                                        adjusts->saturation,
+                                        adjusts->luminance,
+                                        adjusts->contrast,
+                                        adjusts->gamma,
+                                        adjusts->gray))
+        akvcam_color_table_ref(color_table);
+    else
+        color_table = akvcam_color_table_new(adjusts->hue,
+                                             adjusts->saturation,
+                                             adjusts->luminance,
+                                             adjusts->contrast,
+                                             adjusts->gamma,
+                                             adjusts->gray);
+
+    if (akvcam_frame_can_process_yuv(self, src, adjusts)) {
+        processed = akvcam_frame_process_yuv(self,
+                                             src,
+                                             adjusts,
+                                             scaler,
+                                             color_table,
+                                             stripes);
+        akvcam_color_table_delete(color_table);
+        akvcam_scaler_delete(scaler);
+
+        return processed;
+    }
+
+    // The fast and linear scaling needs at most two source lines for each
+    // output line, so the stripes read them straight from the columns of the
+    // source. The area and bicubic scaling takes the source lines in any
+    // order, so the whole source frame is rotated before scaling it.
+    prerotate = transpose
+                && (akvcam_scaler_area(scaler) || akvcam_scaler_bicubic(scaler));
+
+    // The rotated frame is unpacked at the same time.
+    if (unpack || prerotate) {
+        format = akvcam_format_new(ifourcc,
+                                   prerotate?
+                                       iwidth:
+                                       akvcam_format_width(src->format),
+                                   prerotate?
+                                       iheight:
+                                       akvcam_format_height(src->format),
+                                   NULL);
+        unpacked = akvcam_frame_new_pooled(self->pool, format);
+        akvcam_format_delete(format);
+
+        if (!unpacked->data) {
+            akvcam_frame_delete(unpacked);
+            akvcam_color_table_delete(color_table);
+            akvcam_scaler_delete(scaler);
+
+            return false;
+        }
+    }
+
+    stripe = akvcam_frame_stripes_new(&stripes, oheight, &single_stripe);
+
+    // The intermediate lines of all the stripes are taken from the pool in a
+    // single buffer, that is split in equal parts. Rotating the packed frames
+    // needs a block of unpacked source lines in each stripe.
+    scratch_size = akvcam_frame_process_scratch(NULL,
+                                                NULL,
+                                                adjusts,
+                                                scaler,
+                                                iwidth,
+                                                iheight,
+                                                owidth,
+                                                oheight,
+                                                transpose && !prerotate);
+
+    if (unpack && prerotate)
+        scratch_size = akvcam_max(scratch_size,
+                                  AKVCAM_FRAME_ROTATE_TILE
+                                  * akvcam_format_width(src->format)
+                                  * sizeof(akvcam_RGB24));
+
+    scratch_size = akvcam_align_up(scratch_size, AKVCAM_FRAME_SCRATCH_ALIGN);
+    scratch = akvcam_frame_pool_get(self->pool, stripes * scratch_size);
+
+    if (!scratch) {
+        akvcam_frame_stripes_delete(stripe, stripes);
+        akvcam_frame_delete(unpacked);
+        akvcam_color_table_delete(color_table);
+        akvcam_scaler_delete(scaler);
+
+        return false;
+    }
 
-            line[x].r = (uint8_t) r;
-            line[x].g = (uint8_t) g;
-            line[x].b = (uint8_t) b;
+    // The whole source frame must be unpacked or rotated before scaling it.
+    if (unpacked) {
+        for (i = 0; i < stripes; i++) {
+            stripe[i].dst = unpacked;
+            stripe[i].src = src;
+            stripe[i].unpack = unpack;
+            stripe[i].rotation = prerotate? adjusts->rotation: 0;
+            stripe[i].scratch = scratch + i * scratch_size;
+            stripe[i].y_start = i * akvcam_format_height(src->format) / stripes;
+            stripe[i].y_end = (i + 1) * akvcam_format_height(src->format) / stripes;
         }
+
+        akvcam_frame_run_stripes(stripe, stripes);
+    }
+
+    for (i = 0; i < stripes; i++) {
+        stripe[i].dst = self;
+        stripe[i].src = unpacked? unpacked: src;
+        stripe[i].adjusts = adjusts;
+        stripe[i].scaler = scaler;
+        stripe[i].chroma_scaler = NULL;
+        stripe[i].color_table = color_table;
+        stripe[i].convert = convert;
+        stripe[i].planar_convert = planar_convert;
+        stripe[i].unpack = NULL;
+        stripe[i].simd = simd;
+        stripe[i].rotation = 0;
+        stripe[i].src_rotation =
+                transpose && !prerotate? adjusts->rotation: 0;
+        stripe[i].scratch = scratch + i * scratch_size;
+        stripe[i].y_start = i * oheight / stripes;
+        stripe[i].y_end = (i + 1) * oheight / stripes;
+    }
+
+    akvcam_frame_run_stripes(stripe, stripes);
+    akvcam_frame_pool_put(self->pool, scratch, stripes * scratch_size);
+    akvcam_frame_stripes_delete(stripe, stripes);
+    akvcam_frame_delete(unpacked);
+    akvcam_color_table_delete(color_table);
+    akvcam_scaler_delete(scaler);
+
+    return true;
+}
+
+void akvcam_frame_workqueue_init(void)
+{
+    // The workqueue is shared by all devices, so don't run more stripes at
+    // the same time than available CPUs.
+    akvcam_frame_workqueue = alloc_workqueue("akvcam-frame",
+                                             WQ_UNBOUND,
+                                             num_online_cpus());
+
+    if (!akvcam_frame_workqueue) {
+        akpr_err("Can't create the frames workqueue\n");
+
+        return;
     }
+
+    akvcam_global_deleter_add(akvcam_frame_workqueue,
+                              (akvcam_delete_t) destroy_workqueue);
 }
 
 const char *akvcam_frame_scaling_to_string(AKVCAM_SCALING scaling)
@@ -1043,9 +1567,11 @@ const char *akvcam_frame_scaling_to_string(AKVCAM_SCALING scaling)
     size_t i;
     static char scaling_str[AKVCAM_MAX_STRING_SIZE];
     static akvcam_frame_scaling_strings scaling_strings[] = {
-        {AKVCAM_SCALING_FAST  , "Fast"  },
-        {AKVCAM_SCALING_LINEAR, "Linear"},
-        {-1                   , ""      },
+        {AKVCAM_SCALING_FAST   , "Fast"   },
+        {AKVCAM_SCALING_LINEAR , "Linear" },
+        {AKVCAM_SCALING_AREA   , "Area"   },
+        {AKVCAM_SCALING_BICUBIC, "Bicubic"},
+        {-1                    , ""       },
     };
 
     memset(scaling_str, 0, AKVCAM_MAX_STRING_SIZE);
@@ -1093,205 +1619,309 @@ const char *akvcam_frame_aspect_ratio_to_string(AKVCAM_ASPECT_RATIO aspect_ratio
     return aspect_ratio_str;
 }
 
-bool akvcam_frame_can_convert(__u32 in_fourcc, __u32 out_fourcc)
+AKVCAM_PATTERN akvcam_frame_pattern_from_string(const char *pattern)
 {
     size_t i;
+    static akvcam_frame_pattern_strings pattern_strings[] = {
+        {AKVCAM_PATTERN_BARS    , "bars"    },
+        {AKVCAM_PATTERN_GRADIENT, "gradient"},
+        {-1                     , ""        },
+    };
+
+    if (pattern)
+        for (i = 0; pattern_strings[i].pattern >= 0; i++)
+            if (strcmp(pattern_strings[i].str, pattern) == 0)
+                return pattern_strings[i].pattern;
+
+    return AKVCAM_PATTERN_BARS;
+}
 
+bool akvcam_frame_can_convert(__u32 in_fourcc, __u32 out_fourcc)
+{
     if (in_fourcc == out_fourcc)
         return true;
 
-    for (i = 0; i < akvcam_convert_funcs_count(); i++)
-        if (akvcam_frame_convert_table[i].from == in_fourcc
-            && akvcam_frame_convert_table[i].to == out_fourcc) {
+    if (!akvcam_frame_adjust_format_supported(in_fourcc)) {
+        if (!akvcam_unpack_func(in_fourcc))
+            return false;
+
+        in_fourcc = V4L2_PIX_FMT_RGB24;
+
+        if (in_fourcc == out_fourcc)
             return true;
-        }
+    }
 
-    return false;
+    return akvcam_line_convert_func(in_fourcc, out_fourcc)
+           || akvcam_planar_convert_func(in_fourcc, out_fourcc);
 }
 
-int akvcam_grayval(int r, int g, int b)
+void akvcam_line_copy24(void *dst,
+                        const void *src,
+                        size_t width,
+                        const akvcam_yuv_matrix *matrix)
 {
-    return (11 * r + 16 * g + 5 * b) >> 5;
+    UNUSED(matrix);
+    memcpy(dst, src, 3 * width);
 }
 
-uint8_t akvcam_rgb_y(int r, int g, int b)
+void akvcam_line_bgr24_to_rgb32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
-    return (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
-}
+    const akvcam_BGR24 *src_line = src;
+    akvcam_RGB32_t dst_line = dst;
+    size_t x;
+    UNUSED(matrix);
 
-uint8_t akvcam_rgb_u(int r, int g, int b)
-{
-    return (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    for (x = 0; x < width; x++) {
+        dst_line[x].x = 255;
+        dst_line[x].r = src_line[x].r;
+        dst_line[x].g = src_line[x].g;
+        dst_line[x].b = src_line[x].b;
+    }
 }
 
-uint8_t akvcam_rgb_v(int r, int g, int b)
+void akvcam_line_bgr24_to_rgb24(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
-    return (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    const akvcam_BGR24 *src_line = src;
+    akvcam_RGB24_t dst_line = dst;
+    size_t x;
+    UNUSED(matrix);
+
+    for (x = 0; x < width; x++) {
+        dst_line[x].r = src_line[x].r;
+        dst_line[x].g = src_line[x].g;
+        dst_line[x].b = src_line[x].b;
+    }
 }
 
-uint8_t akvcam_yuv_r(int y, int u, int v)
+void akvcam_line_bgr24_to_rgb16(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
-    int r;
-    UNUSED(u);
-    r = (298 * (y - 16) + 409 * (v - 128) + 128) >> 8;
+    const akvcam_BGR24 *src_line = src;
+    akvcam_RGB16_t dst_line = dst;
+    size_t x;
+    UNUSED(matrix);
 
-    return (uint8_t) (akvcam_bound(0, r, 255));
+    for (x = 0; x < width; x++) {
+        dst_line[x].r = src_line[x].r >> 3;
+        dst_line[x].g = src_line[x].g >> 2;
+        dst_line[x].b = src_line[x].b >> 3;
+    }
 }
 
-uint8_t akvcam_yuv_g(int y, int u, int v)
+void akvcam_line_bgr24_to_rgb15(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
-    int g = (298 * (y - 16) - 100 * (u - 128) - 208 * (v - 128) + 128) >> 8;
+    const akvcam_BGR24 *src_line = src;
+    akvcam_RGB15_t dst_line = dst;
+    size_t x;
+    UNUSED(matrix);
 
-    return (uint8_t) (akvcam_bound(0, g, 255));
+    for (x = 0; x < width; x++) {
+        dst_line[x].x = 1;
+        dst_line[x].r = src_line[x].r >> 3;
+        dst_line[x].g = src_line[x].g >> 3;
+        dst_line[x].b = src_line[x].b >> 3;
+    }
 }
 
-uint8_t akvcam_yuv_b(int y, int u, int v)
+void akvcam_line_bgr24_to_bgr32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
-    int b;
-    UNUSED(v);
-    b = (298 * (y - 16) + 516 * (u - 128) + 128) >> 8;
+    const akvcam_BGR24 *src_line = src;
+    akvcam_BGR32_t dst_line = dst;
+    size_t x;
+    UNUSED(matrix);
 
-    return (uint8_t) (akvcam_bound(0, b, 255));
+    for (x = 0; x < width; x++) {
+        dst_line[x].x = 255;
+        dst_line[x].r = src_line[x].r;
+        dst_line[x].g = src_line[x].g;
+        dst_line[x].b = src_line[x].b;
+    }
 }
 
-void akvcam_bgr24_to_rgb32(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_bgr24_to_uyvy(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_BGR24 *src_line = src;
+    akvcam_UYVY_t dst_line = dst;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_RGB32_t dst_line;
+    size_t x_yuv;
+    size_t x1;
+    uint8_t r0;
+    uint8_t g0;
+    uint8_t b0;
+    uint8_t r1;
+    uint8_t g1;
+    uint8_t b1;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (x = 0; x < width; x += 2) {
+        x_yuv = x / 2;
+        x1 = x + 1 < width? x + 1: x;
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].x = 255;
-            dst_line[x].r = src_line[x].r;
-            dst_line[x].g = src_line[x].g;
-            dst_line[x].b = src_line[x].b;
-        }
+        r0 = src_line[x].r;
+        g0 = src_line[x].g;
+        b0 = src_line[x].b;
+
+        r1 = src_line[x1].r;
+        g1 = src_line[x1].g;
+        b1 = src_line[x1].b;
+
+        dst_line[x_yuv].u0 = akvcam_rgb_u(matrix, r0, g0, b0);
+        dst_line[x_yuv].y0 = akvcam_rgb_y(matrix, r0, g0, b0);
+        dst_line[x_yuv].v0 = akvcam_rgb_v(matrix, r0, g0, b0);
+        dst_line[x_yuv].y1 = akvcam_rgb_y(matrix, r1, g1, b1);
     }
 }
 
-void akvcam_bgr24_to_rgb24(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_bgr24_to_yuy2(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_BGR24 *src_line = src;
+    akvcam_YUY2_t dst_line = dst;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_RGB24_t dst_line;
+    size_t x_yuv;
+    size_t x1;
+    uint8_t r0;
+    uint8_t g0;
+    uint8_t b0;
+    uint8_t r1;
+    uint8_t g1;
+    uint8_t b1;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (x = 0; x < width; x += 2) {
+        x_yuv = x / 2;
+        x1 = x + 1 < width? x + 1: x;
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].r = src_line[x].r;
-            dst_line[x].g = src_line[x].g;
-            dst_line[x].b = src_line[x].b;
-        }
+        r0 = src_line[x].r;
+        g0 = src_line[x].g;
+        b0 = src_line[x].b;
+
+        r1 = src_line[x1].r;
+        g1 = src_line[x1].g;
+        b1 = src_line[x1].b;
+
+        dst_line[x_yuv].y0 = akvcam_rgb_y(matrix, r0, g0, b0);
+        dst_line[x_yuv].u0 = akvcam_rgb_u(matrix, r0, g0, b0);
+        dst_line[x_yuv].y1 = akvcam_rgb_y(matrix, r1, g1, b1);
+        dst_line[x_yuv].v0 = akvcam_rgb_v(matrix, r0, g0, b0);
     }
 }
 
-void akvcam_bgr24_to_rgb16(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_rgb24_to_rgb32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_RGB24 *src_line = src;
+    akvcam_RGB32_t dst_line = dst;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_RGB16_t dst_line;
-
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    UNUSED(matrix);
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].r = src_line[x].r >> 3;
-            dst_line[x].g = src_line[x].g >> 2;
-            dst_line[x].b = src_line[x].b >> 3;
-        }
+    for (x = 0; x < width; x++) {
+        dst_line[x].x = 255;
+        dst_line[x].r = src_line[x].r;
+        dst_line[x].g = src_line[x].g;
+        dst_line[x].b = src_line[x].b;
     }
 }
 
-void akvcam_bgr24_to_rgb15(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_rgb24_to_rgb16(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_RGB24 *src_line = src;
+    akvcam_RGB16_t dst_line = dst;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_RGB15_t dst_line;
+    UNUSED(matrix);
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
-
-        for (x = 0; x < width; x++) {
-            dst_line[x].x = 1;
-            dst_line[x].r = src_line[x].r >> 3;
-            dst_line[x].g = src_line[x].g >> 3;
-            dst_line[x].b = src_line[x].b >> 3;
-        }
+    for (x = 0; x < width; x++) {
+        dst_line[x].r = src_line[x].r >> 3;
+        dst_line[x].g = src_line[x].g >> 2;
+        dst_line[x].b = src_line[x].b >> 3;
     }
 }
 
-void akvcam_bgr24_to_bgr32(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_rgb24_to_rgb15(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_RGB24 *src_line = src;
+    akvcam_RGB15_t dst_line = dst;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_BGR32_t dst_line;
-
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    UNUSED(matrix);
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].x = 255;
-            dst_line[x].r = src_line[x].r;
-            dst_line[x].g = src_line[x].g;
-            dst_line[x].b = src_line[x].b;
-        }
+    for (x = 0; x < width; x++) {
+        dst_line[x].x = 1;
+        dst_line[x].r = src_line[x].r >> 3;
+        dst_line[x].g = src_line[x].g >> 3;
+        dst_line[x].b = src_line[x].b >> 3;
     }
 }
 
-void akvcam_bgr24_to_bgr16(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_rgb24_to_bgr32(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_RGB24 *src_line = src;
+    akvcam_BGR32_t dst_line = dst;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_BGR16_t dst_line;
+    UNUSED(matrix);
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (x = 0; x < width; x++) {
+        dst_line[x].x = 255;
+        dst_line[x].r = src_line[x].r;
+        dst_line[x].g = src_line[x].g;
+        dst_line[x].b = src_line[x].b;
+    }
+}
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].r = src_line[x].r >> 3;
-            dst_line[x].g = src_line[x].g >> 2;
-            dst_line[x].b = src_line[x].b >> 3;
-        }
+void akvcam_line_rgb24_to_bgr24(void *dst,
+                                const void *src,
+                                size_t width,
+                                const akvcam_yuv_matrix *matrix)
+{
+    const akvcam_RGB24 *src_line = src;
+    akvcam_BGR24_t dst_line = dst;
+    size_t x;
+    UNUSED(matrix);
+
+    for (x = 0; x < width; x++) {
+        dst_line[x].r = src_line[x].r;
+        dst_line[x].g = src_line[x].g;
+        dst_line[x].b = src_line[x].b;
     }
 }
 
-void akvcam_bgr24_to_uyvy(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_rgb24_to_uyvy(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_RGB24 *src_line = src;
+    akvcam_UYVY_t dst_line = dst;
     size_t x;
-    size_t y;
     size_t x_yuv;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_UYVY_t dst_line;
+    size_t x1;
     uint8_t r0;
     uint8_t g0;
     uint8_t b0;
@@ -1299,40 +1929,35 @@ void akvcam_bgr24_to_uyvy(akvcam_frame_t dst, akvcam_frame_t src)
     uint8_t g1;
     uint8_t b1;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
-
-        for (x = 0; x < width; x++) {
-            x_yuv = x / 2;
-
-            r0 = src_line[x].r;
-            g0 = src_line[x].g;
-            b0 = src_line[x].b;
+    for (x = 0; x < width; x += 2) {
+        x_yuv = x / 2;
+        x1 = x + 1 < width? x + 1: x;
 
-            x++;
+        r0 = src_line[x].r;
+        g0 = src_line[x].g;
+        b0 = src_line[x].b;
 
-            r1 = src_line[x].r;
-            g1 = src_line[x].g;
-            b1 = src_line[x].b;
+        r1 = src_line[x1].r;
+        g1 = src_line[x1].g;
+        b1 = src_line[x1].b;
 
-            dst_line[x_yuv].u0 = akvcam_rgb_u(r0, g0, b0);
-            dst_line[x_yuv].y0 = akvcam_rgb_y(r0, g0, b0);
-            dst_line[x_yuv].v0 = akvcam_rgb_v(r0, g0, b0);
-            dst_line[x_yuv].y1 = akvcam_rgb_y(r1, g1, b1);
-        }
+        dst_line[x_yuv].u0 = akvcam_rgb_u(matrix, r0, g0, b0);
+        dst_line[x_yuv].y0 = akvcam_rgb_y(matrix, r0, g0, b0);
+        dst_line[x_yuv].v0 = akvcam_rgb_v(matrix, r0, g0, b0);
+        dst_line[x_yuv].y1 = akvcam_rgb_y(matrix, r1, g1, b1);
     }
 }
 
-void akvcam_bgr24_to_yuy2(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_rgb24_to_yuy2(void *dst,
+                               const void *src,
+                               size_t width,
+                               const akvcam_yuv_matrix *matrix)
 {
+    const akvcam_RGB24 *src_line = src;
+    akvcam_YUY2_t dst_line = dst;
     size_t x;
-    size_t y;
     size_t x_yuv;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    akvcam_YUY2_t dst_line;
+    size_t x1;
     uint8_t r0;
     uint8_t g0;
     uint8_t b0;
@@ -1340,535 +1965,1545 @@ void akvcam_bgr24_to_yuy2(akvcam_frame_t dst, akvcam_frame_t src)
     uint8_t g1;
     uint8_t b1;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
-
-        for (x = 0; x < width; x++) {
-            x_yuv = x / 2;
-
-            r0 = src_line[x].r;
-            g0 = src_line[x].g;
-            b0 = src_line[x].b;
+    for (x = 0; x < width; x += 2) {
+        x_yuv = x / 2;
+        x1 = x + 1 < width? x + 1: x;
 
-            x++;
+        r0 = src_line[x].r;
+        g0 = src_line[x].g;
+        b0 = src_line[x].b;
 
-            r1 = src_line[x].r;
-            g1 = src_line[x].g;
-            b1 = src_line[x].b;
+        r1 = src_line[x1].r;
+        g1 = src_line[x1].g;
+        b1 = src_line[x1].b;
 
-            dst_line[x_yuv].y0 = akvcam_rgb_y(r0, g0, b0);
-            dst_line[x_yuv].u0 = akvcam_rgb_u(r0, g0, b0);
-            dst_line[x_yuv].y1 = akvcam_rgb_y(r1, g1, b1);
-            dst_line[x_yuv].v0 = akvcam_rgb_v(r0, g0, b0);
-        }
+        dst_line[x_yuv].y0 = akvcam_rgb_y(matrix, r0, g0, b0);
+        dst_line[x_yuv].u0 = akvcam_rgb_u(matrix, r0, g0, b0);
+        dst_line[x_yuv].y1 = akvcam_rgb_y(matrix, r1, g1, b1);
+        dst_line[x_yuv].v0 = akvcam_rgb_v(matrix, r0, g0, b0);
     }
 }
 
-void akvcam_bgr24_to_nv12(akvcam_frame_t dst, akvcam_frame_t src)
+size_t akvcam_line_convert_funcs_count(void)
 {
-    size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    uint8_t *dst_line_y;
-    akvcam_VU_t dst_line_vu;
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
+    size_t i;
+    static size_t count = 0;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line_y = akvcam_frame_line(dst, 0, y);
-        dst_line_vu = akvcam_frame_line(dst, 1, y / 2);
+    if (count < 1)
+        for (i = 0; akvcam_frame_line_convert_table[i].from; i++)
+            count++;
 
-        for (x = 0; x < width; x++) {
-            r = src_line[x].r;
-            g = src_line[x].g;
-            b = src_line[x].b;
+    return count;
+}
 
-            dst_line_y[y] = akvcam_rgb_y(r, g, b);
+akvcam_line_convert_function_t akvcam_line_convert_func(__u32 from, __u32 to)
+{
+    size_t i;
+    akvcam_line_convert_t convert;
 
-            if (!(x & 0x1) && !(y & 0x1)) {
-                dst_line_vu[x / 2].v = akvcam_rgb_v(r, g, b);
-                dst_line_vu[x / 2].u = akvcam_rgb_u(r, g, b);
-            }
-        }
+    for (i = 0; i < akvcam_line_convert_funcs_count(); i++) {
+        convert = akvcam_frame_line_convert_table + i;
+
+        if (convert->from == from && convert->to == to)
+            return convert->convert;
     }
+
+    return NULL;
 }
 
-void akvcam_bgr24_to_nv21(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_bgr24_to_yuv420(akvcam_frame_t dst,
+                                 size_t y,
+                                 const void *src,
+                                 size_t width)
 {
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(dst->format);
+    const akvcam_BGR24 *src_line = src;
+    const akvcam_yuv420_layout *layout =
+            akvcam_yuv420_layout_by_fourcc(akvcam_format_fourcc(dst->format));
+    uint8_t *dst_line_y = akvcam_frame_line(dst, 0, y);
+    uint8_t *dst_line_u;
+    uint8_t *dst_line_v;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_BGR24_t src_line;
-    uint8_t *dst_line_y;
-    akvcam_UV_t dst_line_vu;
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line_y = akvcam_frame_line(dst, 0, y);
-        dst_line_vu = akvcam_frame_line(dst, 1, y / 2);
-
-        for (x = 0; x < width; x++) {
-            r = src_line[x].r;
-            g = src_line[x].g;
-            b = src_line[x].b;
+    for (x = 0; x < width; x++)
+        dst_line_y[x] = akvcam_rgb_y(matrix,
+                                     src_line[x].r,
+                                     src_line[x].g,
+                                     src_line[x].b);
 
-            dst_line_y[y] = akvcam_rgb_y(r, g, b);
+    // The chroma is shared by each 2x2 block, and it's taken from the top
+    // left pixel of the block, same as for the packed formats.
+    if (y & 0x1)
+        return;
 
-            if (!(x & 0x1) && !(y & 0x1)) {
-                dst_line_vu[x / 2].v = akvcam_rgb_v(r, g, b);
-                dst_line_vu[x / 2].u = akvcam_rgb_u(r, g, b);
-            }
-        }
+    dst_line_u = (uint8_t *) akvcam_frame_line(dst, layout->u_plane, y / 2)
+               + layout->u_offset;
+    dst_line_v = (uint8_t *) akvcam_frame_line(dst, layout->v_plane, y / 2)
+               + layout->v_offset;
+
+    for (x = 0; x < width; x += 2) {
+        *dst_line_u = akvcam_rgb_u(matrix,
+                                   src_line[x].r,
+                                   src_line[x].g,
+                                   src_line[x].b);
+        *dst_line_v = akvcam_rgb_v(matrix,
+                                   src_line[x].r,
+                                   src_line[x].g,
+                                   src_line[x].b);
+        dst_line_u += layout->step;
+        dst_line_v += layout->step;
     }
 }
 
-void akvcam_rgb24_to_rgb32(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_line_rgb24_to_yuv420(akvcam_frame_t dst,
+                                 size_t y,
+                                 const void *src,
+                                 size_t width)
 {
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(dst->format);
+    const akvcam_RGB24 *src_line = src;
+    const akvcam_yuv420_layout *layout =
+            akvcam_yuv420_layout_by_fourcc(akvcam_format_fourcc(dst->format));
+    uint8_t *dst_line_y = akvcam_frame_line(dst, 0, y);
+    uint8_t *dst_line_u;
+    uint8_t *dst_line_v;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_RGB32_t dst_line;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (x = 0; x < width; x++)
+        dst_line_y[x] = akvcam_rgb_y(matrix,
+                                     src_line[x].r,
+                                     src_line[x].g,
+                                     src_line[x].b);
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].x = 255;
-            dst_line[x].r = src_line[x].r;
-            dst_line[x].g = src_line[x].g;
-            dst_line[x].b = src_line[x].b;
-        }
+    if (y & 0x1)
+        return;
+
+    dst_line_u = (uint8_t *) akvcam_frame_line(dst, layout->u_plane, y / 2)
+               + layout->u_offset;
+    dst_line_v = (uint8_t *) akvcam_frame_line(dst, layout->v_plane, y / 2)
+               + layout->v_offset;
+
+    for (x = 0; x < width; x += 2) {
+        *dst_line_u = akvcam_rgb_u(matrix,
+                                   src_line[x].r,
+                                   src_line[x].g,
+                                   src_line[x].b);
+        *dst_line_v = akvcam_rgb_v(matrix,
+                                   src_line[x].r,
+                                   src_line[x].g,
+                                   src_line[x].b);
+        dst_line_u += layout->step;
+        dst_line_v += layout->step;
     }
 }
 
-void akvcam_rgb24_to_rgb16(akvcam_frame_t dst, akvcam_frame_t src)
+akvcam_planar_convert_function_t akvcam_planar_convert_func(__u32 from,
+                                                            __u32 to)
 {
-    size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_RGB16_t dst_line;
+    size_t i;
+    akvcam_planar_convert_t convert;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (i = 0; akvcam_frame_planar_convert_table[i].from; i++) {
+        convert = akvcam_frame_planar_convert_table + i;
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].r = src_line[x].r >> 3;
-            dst_line[x].g = src_line[x].g >> 2;
-            dst_line[x].b = src_line[x].b >> 3;
-        }
+        if (convert->from == from && convert->to == to)
+            return convert->convert;
     }
+
+    return NULL;
 }
 
-void akvcam_rgb24_to_rgb15(akvcam_frame_t dst, akvcam_frame_t src)
+const akvcam_yuv420_layout *akvcam_yuv420_layout_by_fourcc(__u32 fourcc)
 {
-    size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_RGB15_t dst_line;
+    size_t i;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (i = 0; akvcam_frame_yuv420_layouts[i].fourcc; i++)
+        if (akvcam_frame_yuv420_layouts[i].fourcc == fourcc)
+            return akvcam_frame_yuv420_layouts + i;
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].x = 1;
-            dst_line[x].r = src_line[x].r >> 3;
-            dst_line[x].g = src_line[x].g >> 3;
-            dst_line[x].b = src_line[x].b >> 3;
-        }
-    }
+    return NULL;
 }
 
-void akvcam_rgb24_to_bgr32(akvcam_frame_t dst, akvcam_frame_t src)
+const akvcam_yuv422_layout *akvcam_yuv422_layout_by_fourcc(__u32 fourcc)
 {
-    size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_BGR32_t dst_line;
+    size_t i;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (i = 0; akvcam_frame_yuv422_layouts[i].fourcc; i++)
+        if (akvcam_frame_yuv422_layouts[i].fourcc == fourcc)
+            return akvcam_frame_yuv422_layouts + i;
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].x = 255;
-            dst_line[x].r = src_line[x].r;
-            dst_line[x].g = src_line[x].g;
-            dst_line[x].b = src_line[x].b;
-        }
+    return NULL;
+}
+
+void akvcam_unpack_rgb32(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y)
+{
+    const akvcam_RGB32 *src_line = akvcam_frame_const_line(src, 0, y);
+    size_t width = akvcam_format_width(src->format);
+    size_t x;
+
+    for (x = 0; x < width; x++) {
+        dst[x].r = src_line[x].r;
+        dst[x].g = src_line[x].g;
+        dst[x].b = src_line[x].b;
     }
 }
 
-void akvcam_rgb24_to_bgr24(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_unpack_bgr32(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y)
 {
+    const akvcam_BGR32 *src_line = akvcam_frame_const_line(src, 0, y);
+    size_t width = akvcam_format_width(src->format);
     size_t x;
-    size_t y;
+
+    for (x = 0; x < width; x++) {
+        dst[x].r = src_line[x].r;
+        dst[x].g = src_line[x].g;
+        dst[x].b = src_line[x].b;
+    }
+}
+
+void akvcam_unpack_uyvy(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y)
+{
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(src->format);
+    const akvcam_UYVY *src_line = akvcam_frame_const_line(src, 0, y);
     size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_BGR24_t dst_line;
+    const akvcam_UYVY *pixel;
+    uint8_t luma;
+    size_t x;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (x = 0; x < width; x++) {
+        pixel = src_line + x / 2;
+        luma = x & 0x1? pixel->y1: pixel->y0;
+        dst[x].r = akvcam_yuv_r(matrix, luma, pixel->u0, pixel->v0);
+        dst[x].g = akvcam_yuv_g(matrix, luma, pixel->u0, pixel->v0);
+        dst[x].b = akvcam_yuv_b(matrix, luma, pixel->u0, pixel->v0);
+    }
+}
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].r = src_line[x].r;
-            dst_line[x].g = src_line[x].g;
-            dst_line[x].b = src_line[x].b;
-        }
+void akvcam_unpack_yuy2(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y)
+{
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(src->format);
+    const akvcam_YUY2 *src_line = akvcam_frame_const_line(src, 0, y);
+    size_t width = akvcam_format_width(src->format);
+    const akvcam_YUY2 *pixel;
+    uint8_t luma;
+    size_t x;
+
+    for (x = 0; x < width; x++) {
+        pixel = src_line + x / 2;
+        luma = x & 0x1? pixel->y1: pixel->y0;
+        dst[x].r = akvcam_yuv_r(matrix, luma, pixel->u0, pixel->v0);
+        dst[x].g = akvcam_yuv_g(matrix, luma, pixel->u0, pixel->v0);
+        dst[x].b = akvcam_yuv_b(matrix, luma, pixel->u0, pixel->v0);
     }
 }
 
-void akvcam_rgb24_to_bgr16(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_unpack_yuv420(akvcam_RGB24_t dst, const akvcam_frame_t src, size_t y)
 {
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(src->format);
+    const akvcam_yuv420_layout *layout =
+            akvcam_yuv420_layout_by_fourcc(akvcam_format_fourcc(src->format));
+    size_t width = akvcam_format_width(src->format);
+    const uint8_t *src_line_y = akvcam_frame_const_line(src, 0, y);
+    const uint8_t *src_line_u;
+    const uint8_t *src_line_v;
+    uint8_t u;
+    uint8_t v;
     size_t x;
+
+    src_line_u = (const uint8_t *) akvcam_frame_const_line(src,
+                                                           layout->u_plane,
+                                                           y / 2)
+               + layout->u_offset;
+    src_line_v = (const uint8_t *) akvcam_frame_const_line(src,
+                                                           layout->v_plane,
+                                                           y / 2)
+               + layout->v_offset;
+
+    for (x = 0; x < width; x++) {
+        u = src_line_u[x / 2 * layout->step];
+        v = src_line_v[x / 2 * layout->step];
+        dst[x].r = akvcam_yuv_r(matrix, src_line_y[x], u, v);
+        dst[x].g = akvcam_yuv_g(matrix, src_line_y[x], u, v);
+        dst[x].b = akvcam_yuv_b(matrix, src_line_y[x], u, v);
+    }
+}
+
+akvcam_unpack_function_t akvcam_unpack_func(__u32 fourcc)
+{
+    size_t i;
+
+    for (i = 0; akvcam_frame_unpack_table[i].fourcc; i++)
+        if (akvcam_frame_unpack_table[i].fourcc == fourcc)
+            return akvcam_frame_unpack_table[i].unpack;
+
+    return NULL;
+}
+
+bool akvcam_frame_unpack(akvcam_frame_t self)
+{
+    akvcam_unpack_function_t unpack =
+            akvcam_unpack_func(akvcam_format_fourcc(self->format));
+    akvcam_format_t format;
+    akvcam_frame_t frame;
+    size_t height;
     size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_BGR16_t dst_line;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    if (!unpack)
+        return false;
 
-        for (x = 0; x < width; x++) {
-            dst_line[x].r = src_line[x].r >> 3;
-            dst_line[x].g = src_line[x].g >> 2;
-            dst_line[x].b = src_line[x].b >> 3;
+    format = akvcam_format_new_copy(self->format);
+    akvcam_format_set_fourcc(format, V4L2_PIX_FMT_RGB24);
+    frame = akvcam_frame_new_pooled(self->pool, format);
+    akvcam_format_delete(format);
+    height = akvcam_format_height(self->format);
+
+    for (y = 0; y < height; y++)
+        unpack(akvcam_frame_line(frame, 0, y), self, y);
+
+    akvcam_frame_take(self, frame);
+    akvcam_frame_delete(frame);
+
+    return true;
+}
+
+uint8_t akvcam_extrapolate_component(uint8_t min, uint8_t max, uint32_t k)
+{
+    return (uint8_t) ((min * ((1U << AKVCAM_SCALER_SHIFT) - k) + max * k)
+                      >> AKVCAM_SCALER_SHIFT);
+}
+
+akvcam_RGB24 akvcam_extrapolate_color(const akvcam_RGB24 *color_min,
+                                      const akvcam_RGB24 *color_max,
+                                      uint32_t k)
+{
+    akvcam_RGB24 color = {
+        .r = akvcam_extrapolate_component(color_min->r, color_max->r, k),
+        .g = akvcam_extrapolate_component(color_min->g, color_max->g, k),
+        .b = akvcam_extrapolate_component(color_min->b, color_max->b, k),
+    };
+
+    return color;
+}
+
+void akvcam_frame_scale_line(akvcam_RGB24_t dst_line,
+                             const akvcam_RGB24 *src_line_min,
+                             const akvcam_RGB24 *src_line_max,
+                             uint32_t k,
+                             const akvcam_scaler_t scaler)
+{
+    const akvcam_scaler_point *x_points = akvcam_scaler_x_points(scaler);
+    size_t x_dst_max = akvcam_scaler_x_dst_max(scaler);
+    akvcam_RGB24 color_min;
+    akvcam_RGB24 color_max;
+    size_t x;
+
+    for (x = akvcam_scaler_x_dst_min(scaler); x < x_dst_max; x++) {
+        const akvcam_scaler_point *point = x_points + x;
+
+        if (point->k == 0 && k == 0) {
+            dst_line[x] = src_line_min[point->min];
+        } else {
+            color_min = akvcam_extrapolate_color(src_line_min + point->min,
+                                                 src_line_min + point->max,
+                                                 point->k);
+            color_max = akvcam_extrapolate_color(src_line_max + point->min,
+                                                 src_line_max + point->max,
+                                                 point->k);
+            dst_line[x] = akvcam_extrapolate_color(&color_min, &color_max, k);
         }
     }
 }
 
-void akvcam_rgb24_to_uyvy(akvcam_frame_t dst, akvcam_frame_t src)
-{
+void akvcam_frame_area_line(akvcam_RGB24_t dst_line,
+                            const akvcam_frame_t src,
+                            const akvcam_scaler_point *y_point,
+                            const akvcam_scaler_t scaler,
+                            uint32_t *sums)
+{
+    const akvcam_scaler_point *x_points = akvcam_scaler_x_points(scaler);
+    size_t x_dst_min = akvcam_scaler_x_dst_min(scaler);
+    size_t x_dst_max = akvcam_scaler_x_dst_max(scaler);
+    const akvcam_RGB24 *src_lines[4];
+    const akvcam_RGB24 *pixel;
+    uint32_t *sum;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+    uint64_t k;
+    size_t count;
+    size_t col_min;
+    size_t col_max;
+    size_t i;
+    size_t j;
     size_t x;
     size_t y;
-    size_t x_yuv;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_UYVY_t dst_line;
-    uint8_t r0;
-    uint8_t g0;
-    uint8_t b0;
-    uint8_t r1;
-    uint8_t g1;
-    uint8_t b1;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    switch (akvcam_scaler_area_ratio(scaler)) {
+    case 2:
+        src_lines[0] = akvcam_frame_const_line(src, 0, y_point->min);
+        src_lines[1] = akvcam_frame_const_line(src, 0, y_point->min + 1);
 
-        for (x = 0; x < width; x++) {
-            x_yuv = x / 2;
+        for (x = x_dst_min; x < x_dst_max; x++) {
+            const akvcam_RGB24 *p0 = src_lines[0] + x_points[x].min;
+            const akvcam_RGB24 *p1 = src_lines[1] + x_points[x].min;
 
-            r0 = src_line[x].r;
-            g0 = src_line[x].g;
-            b0 = src_line[x].b;
+            dst_line[x].r = (uint8_t) ((p0[0].r + p0[1].r + p1[0].r + p1[1].r + 2) >> 2);
+            dst_line[x].g = (uint8_t) ((p0[0].g + p0[1].g + p1[0].g + p1[1].g + 2) >> 2);
+            dst_line[x].b = (uint8_t) ((p0[0].b + p0[1].b + p1[0].b + p1[1].b + 2) >> 2);
+        }
+
+        break;
+
+    case 4:
+        for (i = 0; i < 4; i++)
+            src_lines[i] = akvcam_frame_const_line(src, 0, y_point->min + i);
+
+        for (x = x_dst_min; x < x_dst_max; x++) {
+            r = 0;
+            g = 0;
+            b = 0;
+
+            for (i = 0; i < 4; i++) {
+                pixel = src_lines[i] + x_points[x].min;
+
+                for (j = 0; j < 4; j++) {
+                    r += pixel[j].r;
+                    g += pixel[j].g;
+                    b += pixel[j].b;
+                }
+            }
 
-            x++;
+            dst_line[x].r = (uint8_t) ((r + 8) >> 4);
+            dst_line[x].g = (uint8_t) ((g + 8) >> 4);
+            dst_line[x].b = (uint8_t) ((b + 8) >> 4);
+        }
 
-            r1 = src_line[x].r;
-            g1 = src_line[x].g;
-            b1 = src_line[x].b;
+        break;
+
+    default:
+        // Sum the source lines column by column first, then sum the columns
+        // covered by each output pixel.
+        col_min = x_points[x_dst_min].min;
+        col_max = x_points[x_dst_max - 1].max;
+        memset(sums + 3 * col_min,
+               0,
+               3 * (col_max - col_min + 1) * sizeof(uint32_t));
+
+        for (y = y_point->min; y <= y_point->max; y++) {
+            pixel = akvcam_frame_const_line(src, 0, y);
+            sum = sums + 3 * col_min;
+
+            for (i = col_min; i <= col_max; i++, sum += 3) {
+                sum[0] += pixel[i].r;
+                sum[1] += pixel[i].g;
+                sum[2] += pixel[i].b;
+            }
+        }
+
+        for (x = x_dst_min; x < x_dst_max; x++) {
+            r = 0;
+            g = 0;
+            b = 0;
+            sum = sums + 3 * x_points[x].min;
+
+            for (i = x_points[x].min; i <= x_points[x].max; i++, sum += 3) {
+                r += sum[0];
+                g += sum[1];
+                b += sum[2];
+            }
 
-            dst_line[x_yuv].u0 = akvcam_rgb_u(r0, g0, b0);
-            dst_line[x_yuv].y0 = akvcam_rgb_y(r0, g0, b0);
-            dst_line[x_yuv].v0 = akvcam_rgb_v(r0, g0, b0);
-            dst_line[x_yuv].y1 = akvcam_rgb_y(r1, g1, b1);
+            count = (x_points[x].max - x_points[x].min + 1)
+                    * (y_point->max - y_point->min + 1);
+            // Multiply by the reciprocal instead of dividing each component.
+            k = 0xffffffffU / (uint32_t) count + 1ULL;
+            dst_line[x].r = (uint8_t) akvcam_min((r * k + (1ULL << 31)) >> 32, 255);
+            dst_line[x].g = (uint8_t) akvcam_min((g * k + (1ULL << 31)) >> 32, 255);
+            dst_line[x].b = (uint8_t) akvcam_min((b * k + (1ULL << 31)) >> 32, 255);
         }
+
+        break;
     }
 }
 
-void akvcam_rgb24_to_yuy2(akvcam_frame_t dst, akvcam_frame_t src)
-{
+// Apply the horizontal pass of the polyphase filter, the result keeps
+// AKVCAM_FRAME_FILTER_EXTRA_BITS of extra precision for the vertical pass.
+void akvcam_frame_filter_hline(int16_t *dst_line,
+                               const akvcam_RGB24 *src_line,
+                               const akvcam_scaler_filter *filter,
+                               size_t x_min,
+                               size_t x_max)
+{
+    const int shift = AKVCAM_SCALER_FILTER_SHIFT
+                      - AKVCAM_FRAME_FILTER_EXTRA_BITS;
+    const size_t *indexes;
+    const int32_t *coeffs;
+    const akvcam_RGB24 *pixel;
+    int32_t r;
+    int32_t g;
+    int32_t b;
     size_t x;
-    size_t y;
-    size_t x_yuv;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    akvcam_YUY2_t dst_line;
-    uint8_t r0;
-    uint8_t g0;
-    uint8_t b0;
-    uint8_t r1;
-    uint8_t g1;
-    uint8_t b1;
+    size_t i;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line = akvcam_frame_line(dst, 0, y);
+    for (x = x_min; x < x_max; x++) {
+        indexes = filter->indexes + x * filter->taps;
+        coeffs = filter->coeffs + x * filter->taps;
+        r = 0;
+        g = 0;
+        b = 0;
+
+        for (i = 0; i < filter->taps; i++) {
+            pixel = src_line + indexes[i];
+            r += coeffs[i] * pixel->r;
+            g += coeffs[i] * pixel->g;
+            b += coeffs[i] * pixel->b;
+        }
 
-        for (x = 0; x < width; x++) {
-            x_yuv = x / 2;
+        dst_line[3 * x]     = (int16_t) ((r + (1 << (shift - 1))) >> shift);
+        dst_line[3 * x + 1] = (int16_t) ((g + (1 << (shift - 1))) >> shift);
+        dst_line[3 * x + 2] = (int16_t) ((b + (1 << (shift - 1))) >> shift);
+    }
+}
+
+// Scale a line with the polyphase filter. The horizontally filtered source
+// lines are kept in 'rows', indexed by the source line modulo the number of
+// taps, so each source line is filtered only once per frame.
+void akvcam_frame_filter_line(akvcam_RGB24_t dst_line,
+                              const akvcam_frame_t src,
+                              size_t y,
+                              bool mirror,
+                              const akvcam_scaler_t scaler,
+                              const akvcam_frame_adjusts_t adjusts,
+                              const akvcam_color_table_t color_table,
+                              akvcam_RGB24 **cache,
+                              size_t *cached,
+                              int16_t **rows,
+                              size_t *rows_cached)
+{
+    const int shift = AKVCAM_SCALER_FILTER_SHIFT
+                      + AKVCAM_FRAME_FILTER_EXTRA_BITS;
+    const akvcam_scaler_filter *filter = akvcam_scaler_y_filter(scaler);
+    const size_t *indexes = filter->indexes + y * filter->taps;
+    const int32_t *coeffs = filter->coeffs + y * filter->taps;
+    const int16_t *taps_rows[AKVCAM_SCALER_FILTER_MAX_TAPS];
+    const akvcam_RGB24 *src_line;
+    const int16_t *pixel;
+    size_t iheight = akvcam_format_height(src->format);
+    size_t x_min = akvcam_scaler_x_dst_min(scaler);
+    size_t x_max = akvcam_scaler_x_dst_max(scaler);
+    size_t row;
+    size_t slot;
+    int32_t r;
+    int32_t g;
+    int32_t b;
+    size_t x;
+    size_t i;
 
-            r0 = src_line[x].r;
-            g0 = src_line[x].g;
-            b0 = src_line[x].b;
+    for (i = 0; i < filter->taps; i++) {
+        row = mirror? iheight - indexes[i] - 1: indexes[i];
+        slot = row % filter->taps;
+
+        if (rows_cached[slot] != row) {
+            src_line = akvcam_frame_process_src_line(akvcam_frame_const_line(src,
+                                                                             0,
+                                                                             row),
+                                                     akvcam_format_width(src->format),
+                                                     row,
+                                                     SIZE_MAX,
+                                                     adjusts,
+                                                     color_table,
+                                                     cache,
+                                                     cached);
+            akvcam_frame_filter_hline(rows[slot],
+                                      src_line,
+                                      akvcam_scaler_x_filter(scaler),
+                                      x_min,
+                                      x_max);
+            rows_cached[slot] = row;
+        }
 
-            x++;
+        taps_rows[i] = rows[slot];
+    }
 
-            r1 = src_line[x].r;
-            g1 = src_line[x].g;
-            b1 = src_line[x].b;
+    for (x = x_min; x < x_max; x++) {
+        r = 0;
+        g = 0;
+        b = 0;
 
-            dst_line[x_yuv].y0 = akvcam_rgb_y(r0, g0, b0);
-            dst_line[x_yuv].u0 = akvcam_rgb_u(r0, g0, b0);
-            dst_line[x_yuv].y1 = akvcam_rgb_y(r1, g1, b1);
-            dst_line[x_yuv].v0 = akvcam_rgb_v(r0, g0, b0);
+        for (i = 0; i < filter->taps; i++) {
+            pixel = taps_rows[i] + 3 * x;
+            r += coeffs[i] * pixel[0];
+            g += coeffs[i] * pixel[1];
+            b += coeffs[i] * pixel[2];
         }
+
+        dst_line[x].r = (uint8_t) akvcam_bound(0, (r + (1 << (shift - 1))) >> shift, 255);
+        dst_line[x].g = (uint8_t) akvcam_bound(0, (g + (1 << (shift - 1))) >> shift, 255);
+        dst_line[x].b = (uint8_t) akvcam_bound(0, (b + (1 << (shift - 1))) >> shift, 255);
     }
 }
 
-void akvcam_rgb24_to_nv12(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_frame_mirror_line(akvcam_RGB24_t line, size_t width)
 {
+    akvcam_RGB24 tmp_pixel;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    uint8_t *dst_line_y;
-    akvcam_VU_t dst_line_vu;
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line_y = akvcam_frame_line(dst, 0, y);
-        dst_line_vu = akvcam_frame_line(dst, 1, y / 2);
+    for (x = 0; x < width / 2; x++) {
+        tmp_pixel = line[x];
+        line[x] = line[width - x - 1];
+        line[width - x - 1] = tmp_pixel;
+    }
+}
 
-        for (x = 0; x < width; x++) {
-            r = src_line[x].r;
-            g = src_line[x].g;
-            b = src_line[x].b;
+// Scale the line 'y' of a single component of a packed frame, the source
+// samples are 'step' bytes apart starting at 'offset'. The source lines are
+// first combined into 'tmp', and then the columns.
+void akvcam_frame_scale_component(uint8_t *dst_line,
+                                  size_t owidth,
+                                  const akvcam_frame_t src,
+                                  size_t offset,
+                                  size_t step,
+                                  size_t iwidth,
+                                  size_t y,
+                                  const akvcam_scaler_t scaler,
+                                  uint8_t black,
+                                  int32_t *tmp)
+{
+    const int shift = 2 * AKVCAM_SCALER_FILTER_SHIFT;
+    const akvcam_scaler_point *x_points = akvcam_scaler_x_points(scaler);
+    const akvcam_scaler_point *y_point = akvcam_scaler_y_points(scaler) + y;
+    const akvcam_scaler_filter *filter;
+    size_t x_min = akvcam_scaler_x_dst_min(scaler);
+    size_t x_max = akvcam_scaler_x_dst_max(scaler);
+    const uint8_t *line_min;
+    const uint8_t *line_max;
+    const size_t *indexes;
+    const int32_t *coeffs;
+    int64_t sum;
+    uint64_t k;
+    size_t count;
+    size_t x;
+    size_t i;
 
-            dst_line_y[y] = akvcam_rgb_y(r, g, b);
+    if (y < akvcam_scaler_y_dst_min(scaler)
+        || y >= akvcam_scaler_y_dst_max(scaler)) {
+        memset(dst_line, black, owidth);
 
-            if (!(x & 0x1) && !(y & 0x1)) {
-                dst_line_vu[x / 2].v = akvcam_rgb_v(r, g, b);
-                dst_line_vu[x / 2].u = akvcam_rgb_u(r, g, b);
-            }
+        return;
+    }
+
+    memset(dst_line, black, x_min);
+    memset(dst_line + x_max, black, owidth - x_max);
+
+    if (akvcam_scaler_bicubic(scaler)) {
+        filter = akvcam_scaler_y_filter(scaler);
+        indexes = filter->indexes + y * filter->taps;
+        coeffs = filter->coeffs + y * filter->taps;
+        memset(tmp, 0, iwidth * sizeof(int32_t));
+
+        for (i = 0; i < filter->taps; i++) {
+            line_min = akvcam_frame_const_line(src, 0, indexes[i]);
+            line_min += offset;
+
+            for (x = 0; x < iwidth; x++)
+                tmp[x] += coeffs[i] * line_min[step * x];
+        }
+
+        filter = akvcam_scaler_x_filter(scaler);
+
+        for (x = x_min; x < x_max; x++) {
+            indexes = filter->indexes + x * filter->taps;
+            coeffs = filter->coeffs + x * filter->taps;
+            sum = 0;
+
+            for (i = 0; i < filter->taps; i++)
+                sum += (int64_t) coeffs[i] * tmp[indexes[i]];
+
+            dst_line[x] =
+                    (uint8_t) akvcam_bound(0,
+                                           (sum + (1LL << (shift - 1))) >> shift,
+                                           255);
+        }
+    } else if (akvcam_scaler_area(scaler)) {
+        memset(tmp, 0, iwidth * sizeof(int32_t));
+
+        for (i = y_point->min; i <= y_point->max; i++) {
+            line_min = akvcam_frame_const_line(src, 0, i);
+            line_min += offset;
+
+            for (x = 0; x < iwidth; x++)
+                tmp[x] += line_min[step * x];
+        }
+
+        for (x = x_min; x < x_max; x++) {
+            sum = 0;
+
+            for (i = x_points[x].min; i <= x_points[x].max; i++)
+                sum += tmp[i];
+
+            count = (x_points[x].max - x_points[x].min + 1)
+                    * (y_point->max - y_point->min + 1);
+            k = 0xffffffffU / (uint32_t) count + 1ULL;
+            dst_line[x] =
+                    (uint8_t) akvcam_min(((uint64_t) sum * k + (1ULL << 31)) >> 32,
+                                         255);
+        }
+    } else {
+        line_min = akvcam_frame_const_line(src, 0, y_point->min);
+        line_min += offset;
+        line_max = akvcam_frame_const_line(src, 0, y_point->max);
+        line_max += offset;
+
+        for (x = 0; x < iwidth; x++)
+            tmp[x] = (int32_t) (line_min[step * x]
+                                * ((1U << AKVCAM_SCALER_SHIFT) - y_point->k)
+                                + line_max[step * x] * y_point->k);
+
+        for (x = x_min; x < x_max; x++) {
+            sum = (int64_t) tmp[x_points[x].min]
+                  * ((1U << AKVCAM_SCALER_SHIFT) - x_points[x].k)
+                  + (int64_t) tmp[x_points[x].max] * x_points[x].k;
+            dst_line[x] =
+                    (uint8_t) ((sum + (1LL << (2 * AKVCAM_SCALER_SHIFT - 1)))
+                               >> (2 * AKVCAM_SCALER_SHIFT));
         }
     }
 }
 
-void akvcam_rgb24_to_nv21(akvcam_frame_t dst, akvcam_frame_t src)
+void akvcam_frame_mirror_component(uint8_t *line, size_t width)
 {
+    uint8_t tmp;
     size_t x;
-    size_t y;
-    size_t width = akvcam_format_width(src->format);
-    size_t height = akvcam_format_height(src->format);
-    akvcam_RGB24_t src_line;
-    uint8_t *dst_line_y;
-    akvcam_UV_t dst_line_vu;
-    uint8_t r;
-    uint8_t g;
-    uint8_t b;
 
-    for (y = 0; y < height; y++) {
-        src_line = akvcam_frame_line(src, 0, y);
-        dst_line_y = akvcam_frame_line(dst, 0, y);
-        dst_line_vu = akvcam_frame_line(dst, 1, y / 2);
+    for (x = 0; x < width / 2; x++) {
+        tmp = line[x];
+        line[x] = line[width - x - 1];
+        line[width - x - 1] = tmp;
+    }
+}
 
-        for (x = 0; x < width; x++) {
-            r = src_line[x].r;
-            g = src_line[x].g;
-            b = src_line[x].b;
+// Same as converting each pixel to HSL, applying the hue, saturation and
+// luminance controls, and converting it back to RGB, but the divisions and
+// most of the branches are replaced by the color table lookups.
+void akvcam_frame_adjust_hsl_line(akvcam_RGB24_t line,
+                                  size_t width,
+                                  const akvcam_color_table_t color_table)
+{
+    // Component that receives the chroma, the second strongest value and 0
+    // for each sector of the color wheel.
+    static const uint8_t sectors[6][3] = {
+        {0, 1, 2},
+        {1, 0, 2},
+        {2, 0, 1},
+        {2, 1, 0},
+        {1, 2, 0},
+        {0, 2, 1},
+    };
+    const uint16_t *hue_table = akvcam_color_table_hue(color_table);
+    const uint8_t *saturation_table =
+            akvcam_color_table_saturation(color_table);
+    const uint8_t *luminance_table = akvcam_color_table_luminance(color_table);
+    const uint64_t *reciprocals = akvcam_color_table_reciprocals(color_table);
+    const uint8_t *sector;
+    size_t x;
+    int r;
+    int g;
+    int b;
+    int max;
+    int min;
+    int c;
+    int h;
+    int s;
+    int l;
+    int m;
+    int values[3];
+
+    for (x = 0; x < width; x++) {
+        r = line[x].r;
+        g = line[x].g;
+        b = line[x].b;
+        max = akvcam_max(r, akvcam_max(g, b));
+        min = akvcam_min(r, akvcam_min(g, b));
+        c = max - min;
+        l = (max + min) >> 1;
+        h = 0;
+        s = 0;
+
+        if (c) {
+            if (max == r)
+                h = g >= b? g - b: g - b + 6 * c;
+            else if (max == g)
+                h = b - r + 2 * c;
+            else
+                h = r - g + 4 * c;
+
+            h = (int) (((uint64_t) (60 * h) * reciprocals[c])
+                       >> AKVCAM_COLOR_TABLE_SHIFT);
+            s = (int) (((uint64_t) (255 * c)
+                        * reciprocals[255 - akvcam_abs(max + min - 255)])
+                       >> AKVCAM_COLOR_TABLE_SHIFT);
+        }
 
-            dst_line_y[y] = akvcam_rgb_y(r, g, b);
+        h = hue_table[h];
+        s = saturation_table[s];
+        l = luminance_table[l];
+        c = s * (255 - akvcam_abs(2 * l - 255)) / 255;
+        m = 2 * l - c;
+        values[0] = c;
+        values[1] = c * (h & 0xff) / 60;
+        values[2] = 0;
+        sector = sectors[h >> 8];
+
+        line[x].r = (uint8_t) ((2 * values[sector[0]] + m) >> 1);
+        line[x].g = (uint8_t) ((2 * values[sector[1]] + m) >> 1);
+        line[x].b = (uint8_t) ((2 * values[sector[2]] + m) >> 1);
+    }
+}
 
-            if (!(x & 0x1) && !(y & 0x1)) {
-                dst_line_vu[x / 2].v = akvcam_rgb_v(r, g, b);
-                dst_line_vu[x / 2].u = akvcam_rgb_u(r, g, b);
-            }
+// Apply the gamma, contrast and gray scale adjusts with the composed levels
+// table.
+void akvcam_frame_adjust_levels_line(akvcam_RGB24_t line,
+                                     size_t width,
+                                     const akvcam_color_table_t color_table)
+{
+    const uint8_t *level = akvcam_color_table_level(color_table);
+    const uint16_t *luma = akvcam_color_table_luma(color_table);
+    size_t x;
+    uint8_t y;
+
+    if (akvcam_color_table_gray(color_table)) {
+        for (x = 0; x < width; x++) {
+            y = (uint8_t) ((luma[line[x].r]
+                            + luma[256 + line[x].g]
+                            + luma[512 + line[x].b])
+                           >> AKVCAM_COLOR_TABLE_LUMA_SHIFT);
+            line[x].r = y;
+            line[x].g = y;
+            line[x].b = y;
+        }
+    } else {
+        for (x = 0; x < width; x++) {
+            line[x].r = level[line[x].r];
+            line[x].g = level[line[x].g];
+            line[x].b = level[line[x].b];
         }
     }
 }
 
-void akvcam_extrapolate_up(size_t dst_coord,
-                           size_t num, size_t den, size_t s,
-                           size_t *src_coord_min, size_t *src_coord_max,
-                           size_t *k_num, size_t *k_den)
+void akvcam_frame_adjust_line(void *line,
+                              size_t width,
+                              const akvcam_color_table_t color_table)
 {
-    size_t dst_coord_min;
-    size_t dst_coord_max;
-    *src_coord_min = (num * dst_coord + s) / den;
-    *src_coord_max = *src_coord_min + 1;
-    dst_coord_min = (den * *src_coord_min - s) / num;
-    dst_coord_max = (den * *src_coord_max - s) / num;
-    *k_num = dst_coord - dst_coord_min;
-    *k_den = dst_coord_max - dst_coord_min;
+    if (!color_table)
+        return;
+
+    if (akvcam_color_table_hsl(color_table))
+        akvcam_frame_adjust_hsl_line(line, width, color_table);
+
+    if (akvcam_color_table_levels(color_table))
+        akvcam_frame_adjust_levels_line(line, width, color_table);
 }
 
-void akvcam_extrapolate_down(size_t dst_coord,
-                             size_t num, size_t den, size_t s,
-                             size_t *src_coord_min, size_t *src_coord_max,
-                             size_t *k_num, size_t *k_den)
+void akvcam_frame_swap_rgb_line(void *line, size_t width)
 {
-    *src_coord_min = (num * dst_coord + s) / den;
-    *src_coord_max = *src_coord_min;
-    *k_num = 0;
-    *k_den = 1;
+    akvcam_RGB24_t pixels = line;
+    size_t x;
+    uint8_t tmp;
+
+    for (x = 0; x < width; x++) {
+        tmp = pixels[x].r;
+        pixels[x].r = pixels[x].b;
+        pixels[x].b = tmp;
+    }
 }
 
-uint8_t akvcam_extrapolate_component(uint8_t min, uint8_t max,
-                                     size_t k_num, size_t k_Den)
+const akvcam_RGB24 *akvcam_frame_process_src_line(const akvcam_RGB24 *src_line,
+                                                  size_t width,
+                                                  size_t y,
+                                                  size_t keep,
+                                                  const akvcam_frame_adjusts_t adjusts,
+                                                  const akvcam_color_table_t color_table,
+                                                  akvcam_RGB24 **cache,
+                                                  size_t *cached)
 {
-    return (uint8_t) ((k_num * (max - min) + k_Den * min) / k_Den);
+    size_t slot;
+
+    if (!cache[0])
+        return src_line;
+
+    if (cached[0] == y)
+        return cache[0];
+
+    if (cached[1] == y)
+        return cache[1];
+
+    // Never drop the line that is still in use, otherwise drop the line
+    // farthest from the requested one.
+    if (cached[0] == keep)
+        slot = 1;
+    else if (cached[1] == keep)
+        slot = 0;
+    else
+        slot = akvcam_abs((ssize_t) (cached[0] - y))
+               >= akvcam_abs((ssize_t) (cached[1] - y))? 0: 1;
+
+    memcpy(cache[slot], src_line, width * sizeof(akvcam_RGB24));
+
+    if (adjusts->horizontal_mirror)
+        akvcam_frame_mirror_line(cache[slot], width);
+
+    if (adjusts->swap_rgb)
+        akvcam_frame_swap_rgb_line(cache[slot], width);
+
+    akvcam_frame_adjust_line(cache[slot], width, color_table);
+    cached[slot] = y;
+
+    return cache[slot];
 }
 
-akvcam_RGB24 akvcam_extrapolate_color(const akvcam_RGB24_t color_min,
-                                      const akvcam_RGB24_t color_max,
-                                      size_t k_num,
-                                      size_t k_den)
+// Read the lines 'first' to 'first + count' of the source frame rotated by 90
+// or 270 degrees. Each rotated line is a column of the source, so the columns
+// of the band are read together, a short run of pixels from every source
+// line, and the source frame is read just once for all of them.
+void akvcam_frame_rotate_band(akvcam_RGB24_t band,
+                              const akvcam_frame_t src,
+                              int rotation,
+                              size_t first,
+                              size_t count)
 {
-    akvcam_RGB24 color = {
-        .r = akvcam_extrapolate_component(color_min->r, color_max->r, k_num, k_den),
-        .g = akvcam_extrapolate_component(color_min->g, color_max->g, k_num, k_den),
-        .b = akvcam_extrapolate_component(color_min->b, color_max->b, k_num, k_den),
-    };
+    size_t iwidth = akvcam_format_width(src->format);
+    size_t iheight = akvcam_format_height(src->format);
+    const akvcam_RGB24 *src_line;
+    akvcam_RGB24_t band_line;
+    size_t x;
+    size_t y;
 
-    return color;
+    // Turning clockwise, the first source column becomes the first line read
+    // from bottom to top, and turning counterclockwise, the last source
+    // column becomes the first line read from top to bottom.
+    for (y = 0; y < iheight; y++) {
+        src_line = akvcam_frame_const_line(src, 0, y);
+
+        if (rotation == 90) {
+            band_line = band + iheight - y - 1;
+
+            for (x = 0; x < count; x++)
+                band_line[x * iheight] = src_line[first + x];
+        } else {
+            band_line = band + y;
+
+            for (x = 0; x < count; x++)
+                band_line[x * iheight] = src_line[iwidth - first - x - 1];
+        }
+    }
+}
+
+// Split the scratch memory of a stripe in the intermediate lines of
+// akvcam_frame_process_stripe, and return the size they need. With a NULL
+// 'lines' just the size is calculated. The rotated source lines needs a band
+// of them.
+size_t akvcam_frame_process_scratch(akvcam_frame_scratch_t lines,
+                                    char *scratch,
+                                    const akvcam_frame_adjusts_t adjusts,
+                                    const akvcam_scaler_t scaler,
+                                    size_t iwidth,
+                                    size_t iheight,
+                                    size_t owidth,
+                                    size_t oheight,
+                                    bool rotated)
+{
+    size_t line_size = owidth * sizeof(akvcam_RGB24);
+    size_t row_size = 3 * owidth * sizeof(int16_t);
+    size_t sums_size = 0;
+    size_t cache_size = 0;
+    size_t band_size = 0;
+    size_t taps = 0;
+    size_t i;
+
+    if (rotated)
+        band_size = AKVCAM_FRAME_ROTATE_BAND * iwidth * sizeof(akvcam_RGB24);
+
+    if (akvcam_scaler_area(scaler))
+        sums_size = 3 * iwidth * sizeof(uint32_t);
+
+    // Intermediate lines for the polyphase filter.
+    if (akvcam_scaler_bicubic(scaler))
+        taps = akvcam_scaler_y_filter(scaler)->taps;
+
+    // When upscaling, mirroring and adjusting the source lines is cheaper
+    // than doing it in the output lines. Each output line needs at most two
+    // source lines, and consecutive output lines share them, so keep the
+    // last two.
+    if (owidth * oheight > iwidth * iheight
+        && (akvcam_frame_adjusts_colors(adjusts)
+            || adjusts->horizontal_mirror))
+        cache_size = iwidth * sizeof(akvcam_RGB24);
+
+    if (lines) {
+        memset(lines, 0, sizeof(akvcam_frame_scratch));
+
+        // The wider components goes first, so they are aligned.
+        if (sums_size > 0)
+            lines->sums = (uint32_t *) scratch;
+
+        scratch += sums_size;
+
+        for (i = 0; i < taps; i++) {
+            lines->rows[i] = (int16_t *) scratch;
+            scratch += row_size;
+        }
+
+        lines->line = (akvcam_RGB24_t) scratch;
+        scratch += line_size;
+
+        if (cache_size > 0) {
+            lines->cache[0] = (akvcam_RGB24_t) scratch;
+            lines->cache[1] = (akvcam_RGB24_t) (scratch + cache_size);
+        }
+
+        scratch += 2 * cache_size;
+
+        if (band_size > 0)
+            lines->band = (akvcam_RGB24_t) scratch;
+    }
+
+    return sums_size
+           + taps * row_size
+           + line_size
+           + 2 * cache_size
+           + band_size;
+}
+
+void akvcam_frame_process_stripe(akvcam_frame_stripe_t stripe)
+{
+    akvcam_frame_t src = stripe->src;
+    akvcam_frame_adjusts_t adjusts = stripe->adjusts;
+    akvcam_scaler_t scaler = stripe->scaler;
+    akvcam_color_table_t color_table = stripe->color_table;
+    size_t iwidth = akvcam_format_width(src->format);
+    size_t iheight = akvcam_format_height(src->format);
+    size_t owidth = akvcam_format_width(stripe->dst->format);
+    size_t oheight = akvcam_format_height(stripe->dst->format);
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(stripe->dst->format);
+    const akvcam_scaler_point *y_points;
+    const akvcam_RGB24 *src_line_min;
+    const akvcam_RGB24 *src_line_max;
+    const akvcam_RGB24 *line_min;
+    const akvcam_RGB24 *line_max;
+    akvcam_frame_scratch lines;
+    akvcam_RGB24_t line;
+    size_t cached[2] = {SIZE_MAX, SIZE_MAX};
+    size_t rows_cached[AKVCAM_SCALER_FILTER_MAX_TAPS];
+    size_t band_first = 0;
+    size_t band_count = 0;
+    size_t taps = 0;
+    size_t i;
+    bool upscaling;
+    bool adjust;
+    bool bars;
+    size_t y;
+    size_t ys;
+    size_t y_min;
+    size_t y_max;
+
+    if (!stripe->scratch)
+        return;
+
+    // The rotated source is scaled from the rotated size.
+    if (stripe->src_rotation) {
+        iwidth = akvcam_format_height(src->format);
+        iheight = akvcam_format_width(src->format);
+    }
+
+    y_points = akvcam_scaler_y_points(scaler);
+    bars = akvcam_scaler_x_dst_min(scaler) > 0
+           || akvcam_scaler_x_dst_max(scaler) < owidth;
+    upscaling = owidth * oheight > iwidth * iheight;
+    adjust = akvcam_frame_adjusts_colors(adjusts);
+    akvcam_frame_process_scratch(&lines,
+                                 stripe->scratch,
+                                 adjusts,
+                                 scaler,
+                                 iwidth,
+                                 iheight,
+                                 owidth,
+                                 oheight,
+                                 stripe->src_rotation != 0);
+    line = lines.line;
+
+    if (akvcam_scaler_bicubic(scaler)) {
+        taps = akvcam_scaler_y_filter(scaler)->taps;
+
+        for (i = 0; i < taps; i++)
+            rows_cached[i] = SIZE_MAX;
+    }
+
+    for (y = stripe->y_start; y < stripe->y_end; y++) {
+        // Mirroring is applied to the source lines when upscaling, and to the
+        // output lines otherwise, the same as when processing the whole frame
+        // step by step.
+        ys = !upscaling && adjusts->vertical_mirror? oheight - y - 1: y;
+
+        if (ys < akvcam_scaler_y_dst_min(scaler)
+            || ys >= akvcam_scaler_y_dst_max(scaler)) {
+            memset(line, 0, owidth * sizeof(akvcam_RGB24));
+        } else if (lines.sums) {
+            // Area averaging is only used when downscaling, so the source
+            // lines are never mirrored nor adjusted.
+            if (bars)
+                memset(line, 0, owidth * sizeof(akvcam_RGB24));
+
+            akvcam_frame_area_line(line,
+                                   src,
+                                   y_points + ys,
+                                   scaler,
+                                   lines.sums);
+
+            if (adjusts->horizontal_mirror)
+                akvcam_frame_mirror_line(line, owidth);
+        } else if (taps > 0) {
+            if (bars)
+                memset(line, 0, owidth * sizeof(akvcam_RGB24));
+
+            akvcam_frame_filter_line(line,
+                                     src,
+                                     ys,
+                                     upscaling && adjusts->vertical_mirror,
+                                     scaler,
+                                     adjusts,
+                                     color_table,
+                                     lines.cache,
+                                     cached,
+                                     lines.rows,
+                                     rows_cached);
+
+            if (!upscaling && adjusts->horizontal_mirror)
+                akvcam_frame_mirror_line(line, owidth);
+        } else {
+            y_min = y_points[ys].min;
+            y_max = y_points[ys].max;
+
+            if (upscaling && adjusts->vertical_mirror) {
+                y_min = iheight - y_min - 1;
+                y_max = iheight - y_max - 1;
+            }
+
+            // The rotated lines are read in bands. Each band starts at the
+            // last line of the previous one, so the two lines of an output
+            // line are always in the same band.
+            if (stripe->src_rotation) {
+                if (akvcam_min(y_min, y_max) < band_first
+                    || akvcam_max(y_min, y_max) >= band_first + band_count) {
+                    band_first = akvcam_min(y_min, y_max);
+                    band_first -= band_first % (AKVCAM_FRAME_ROTATE_BAND - 1);
+                    band_count = akvcam_min(AKVCAM_FRAME_ROTATE_BAND,
+                                            iheight - band_first);
+                    akvcam_frame_rotate_band(lines.band,
+                                             src,
+                                             stripe->src_rotation,
+                                             band_first,
+                                             band_count);
+                }
+
+                line_min = lines.band + (y_min - band_first) * iwidth;
+                line_max = lines.band + (y_max - band_first) * iwidth;
+            } else {
+                line_min = akvcam_frame_const_line(src, 0, y_min);
+                line_max = akvcam_frame_const_line(src, 0, y_max);
+            }
+
+            src_line_min = akvcam_frame_process_src_line(line_min,
+                                                         iwidth,
+                                                         y_min,
+                                                         SIZE_MAX,
+                                                         adjusts,
+                                                         color_table,
+                                                         lines.cache,
+                                                         cached);
+            src_line_max = akvcam_frame_process_src_line(line_max,
+                                                         iwidth,
+                                                         y_max,
+                                                         y_min,
+                                                         adjusts,
+                                                         color_table,
+                                                         lines.cache,
+                                                         cached);
+
+            if (bars)
+                memset(line, 0, owidth * sizeof(akvcam_RGB24));
+
+            akvcam_frame_scale_line(line,
+                                    src_line_min,
+                                    src_line_max,
+                                    y_points[ys].k,
+                                    scaler);
+
+            if (!upscaling && adjusts->horizontal_mirror)
+                akvcam_frame_mirror_line(line, owidth);
+        }
+
+        if (!upscaling && adjust) {
+            if (adjusts->swap_rgb)
+                akvcam_frame_swap_rgb_line(line, owidth);
+
+            akvcam_frame_adjust_line(line, owidth, color_table);
+        }
+
+        if (stripe->planar_convert) {
+            stripe->planar_convert(stripe->dst, y, line, owidth);
+
+            continue;
+        }
+
+        if (stripe->simd)
+            akvcam_frame_simd_begin();
+
+        stripe->convert(akvcam_frame_line(stripe->dst, 0, y),
+                        line,
+                        owidth,
+                        matrix);
+
+        if (stripe->simd)
+            akvcam_frame_simd_end();
+    }
 }
 
-akvcam_RGB24 akvcam_extrapolated_color(akvcam_frame_t self,
-                                       size_t x_min, size_t x_max,
-                                       size_t k_num_x, size_t k_den_x,
-                                       size_t y_min, size_t y_max,
-                                       size_t k_num_y, size_t k_den_y)
+void akvcam_frame_unpack_stripe(akvcam_frame_stripe_t stripe)
 {
-    size_t line_size = akvcam_format_bypl(self->format, 0);
-    akvcam_RGB24_t min_line =
-            (akvcam_RGB24_t) ((char *) self->data + y_min * line_size);
-    akvcam_RGB24_t max_line =
-            (akvcam_RGB24_t) ((char *) self->data + y_max * line_size);
-    akvcam_RGB24 color_min = akvcam_extrapolate_color(min_line + x_min,
-                                                      min_line + x_max,
-                                                      k_num_x,
-                                                      k_den_x);
-    akvcam_RGB24 color_max = akvcam_extrapolate_color(max_line + x_min,
-                                                      max_line + x_max,
-                                                      k_num_x,
-                                                      k_den_x);
+    size_t y;
 
-    return akvcam_extrapolate_color(&color_min, &color_max, k_num_y, k_den_y);
+    for (y = stripe->y_start; y < stripe->y_end; y++)
+        stripe->unpack(akvcam_frame_line(stripe->dst, 0, y), stripe->src, y);
 }
 
-void akvcam_rgb_to_hsl(int r, int g, int b, int *h, int *s, int *l)
+// Rotate the source lines of the stripe by 90 or 270 degrees, unpacking them
+// first to the stripe scratch lines if needed. Writing each source line as a
+// column of the destination would touch a different destination line for
+// every pixel, so the lines are taken in blocks, and each block is transposed
+// in square tiles that stay in the cache until they are done.
+void akvcam_frame_rotate_stripe(akvcam_frame_stripe_t stripe)
 {
-    int max = akvcam_max(r, akvcam_max(g, b));
-    int min = akvcam_min(r, akvcam_min(g, b));
-    int c = max - min;
+    akvcam_frame_t src = stripe->src;
+    size_t iwidth = akvcam_format_width(src->format);
+    size_t iheight = akvcam_format_height(src->format);
+    size_t bypl = akvcam_format_bypl(stripe->dst->format, 0);
+    char *dst_data = akvcam_frame_line(stripe->dst, 0, 0);
+    const akvcam_RGB24 *lines[AKVCAM_FRAME_ROTATE_TILE];
+    akvcam_RGB24_t unpacked = stripe->scratch;
+    akvcam_RGB24_t dst_line;
+    size_t rows;
+    size_t columns;
+    size_t x;
+    size_t y;
+    size_t i;
+    size_t j;
 
-    *l = (max + min) / 2;
+    // The packed lines can't be read as RGB24.
+    if (stripe->unpack && !unpacked)
+        return;
 
-    if (!c) {
-        *h = 0;
-        *s = 0;
-    } else {
-        if (max == r)
-            *h = akvcam_mod(g - b, 6 * c);
-        else if (max == g)
-            *h = b - r + 2 * c;
+    for (y = stripe->y_start; y < stripe->y_end; y += rows) {
+        rows = akvcam_min(AKVCAM_FRAME_ROTATE_TILE, stripe->y_end - y);
+
+        for (i = 0; i < rows; i++)
+            if (stripe->unpack) {
+                stripe->unpack(unpacked + i * iwidth, src, y + i);
+                lines[i] = unpacked + i * iwidth;
+            } else {
+                lines[i] = akvcam_frame_const_line(src, 0, y + i);
+            }
+
+        for (x = 0; x < iwidth; x += columns) {
+            columns = akvcam_min(AKVCAM_FRAME_ROTATE_TILE, iwidth - x);
+
+            // Turning clockwise, the first source column becomes the first
+            // line, and the first source line becomes the last column.
+            if (stripe->rotation == 90)
+                for (j = 0; j < columns; j++) {
+                    dst_line = (akvcam_RGB24_t) (dst_data + (x + j) * bypl);
+
+                    for (i = 0; i < rows; i++)
+                        dst_line[iheight - y - i - 1] = lines[i][x + j];
+                }
+            else
+                for (j = 0; j < columns; j++) {
+                    dst_line =
+                            (akvcam_RGB24_t) (dst_data
+                                              + (iwidth - x - j - 1) * bypl);
+
+                    for (i = 0; i < rows; i++)
+                        dst_line[y + i] = lines[i][x + j];
+                }
+        }
+    }
+}
+
+void akvcam_frame_process_yuv_stripe(akvcam_frame_stripe_t stripe)
+{
+    const akvcam_yuv422_layout *layout =
+            akvcam_yuv422_layout_by_fourcc(akvcam_format_fourcc(stripe->dst->format));
+    akvcam_frame_t src = stripe->src;
+    akvcam_frame_adjusts_t adjusts = stripe->adjusts;
+    size_t iwidth = akvcam_format_width(src->format);
+    size_t owidth = akvcam_format_width(stripe->dst->format);
+    size_t oheight = akvcam_format_height(stripe->dst->format);
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(stripe->dst->format);
+    const uint8_t *y_table = NULL;
+    uint8_t *luma;
+    uint8_t *chroma[2];
+    uint8_t *dst_line;
+    int32_t *tmp;
+    size_t y;
+    size_t ys;
+    size_t x;
+    size_t i;
+
+    if (!stripe->scratch)
+        return;
+
+    if (adjusts->luminance != 0
+        || adjusts->contrast != 0
+        || adjusts->gamma != 0)
+        y_table = akvcam_color_table_y(stripe->color_table,
+                                       matrix->full_range);
+
+    tmp = stripe->scratch;
+    luma = (uint8_t *) (tmp + iwidth);
+    chroma[0] = luma + owidth;
+    chroma[1] = chroma[0] + owidth / 2;
+
+    for (y = stripe->y_start; y < stripe->y_end; y++) {
+        ys = adjusts->vertical_mirror? oheight - y - 1: y;
+        akvcam_frame_scale_component(luma,
+                                     owidth,
+                                     src,
+                                     layout->luma_offset,
+                                     2,
+                                     iwidth,
+                                     ys,
+                                     stripe->scaler,
+                                     (uint8_t) matrix->y_offset,
+                                     tmp);
+
+        // The gray scale frames keeps just the luma.
+        if (adjusts->gray)
+            memset(chroma[0], 128, owidth);
         else
-            *h = r - g + 4 * c;
+            for (i = 0; i < 2; i++)
+                akvcam_frame_scale_component(chroma[i],
+                                             owidth / 2,
+                                             src,
+                                             layout->chroma_offset + 2 * i,
+                                             4,
+                                             iwidth / 2,
+                                             ys,
+                                             stripe->chroma_scaler,
+                                             128,
+                                             tmp);
+
+        if (adjusts->horizontal_mirror) {
+            akvcam_frame_mirror_component(luma, owidth);
+            akvcam_frame_mirror_component(chroma[0], owidth / 2);
+            akvcam_frame_mirror_component(chroma[1], owidth / 2);
+        }
+
+        if (y_table)
+            for (x = 0; x < owidth; x++)
+                luma[x] = y_table[luma[x]];
 
-        *h = 60 * (*h) / c;
-        *s = 255 * c / (255 - akvcam_abs(max + min - 255));
+        dst_line = akvcam_frame_line(stripe->dst, 0, y);
+
+        for (x = 0; x < owidth; x++)
+            dst_line[layout->luma_offset + 2 * x] = luma[x];
+
+        for (x = 0; x < owidth / 2; x++) {
+            dst_line[layout->chroma_offset + 4 * x] = chroma[0][x];
+            dst_line[layout->chroma_offset + 4 * x + 2] = chroma[1][x];
+        }
     }
 }
 
-void akvcam_hsl_to_rgb(int h, int s, int l, int *r, int *g, int *b)
+akvcam_frame_stripe_t akvcam_frame_stripes_new(size_t *stripes,
+                                               size_t height,
+                                               akvcam_frame_stripe_t single_stripe)
 {
-    int c = s * (255 - akvcam_abs(2 * l - 255)) / 255;
-    int x = c * (60 - akvcam_abs((h % 120) - 60)) / 60;
-    int m;
+    akvcam_frame_stripe_t stripe = NULL;
 
-    if (h >= 0 && h < 60) {
-        *r = c;
-        *g = x;
-        *b = 0;
-    } else if (h >= 60 && h < 120) {
-        *r = x;
-        *g = c;
-        *b = 0;
-    } else if (h >= 120 && h < 180) {
-        *r = 0;
-        *g = c;
-        *b = x;
-    } else if (h >= 180 && h < 240) {
-        *r = 0;
-        *g = x;
-        *b = c;
-    } else if (h >= 240 && h < 300) {
-        *r = x;
-        *g = 0;
-        *b = c;
-    } else if (h >= 300 && h < 360) {
-        *r = c;
-        *g = 0;
-        *b = x;
-    } else {
-        *r = 0;
-        *g = 0;
-        *b = 0;
+    *stripes = akvcam_bound(1, *stripes, height);
+
+    if (!akvcam_frame_workqueue)
+        *stripes = 1;
+
+    if (*stripes > 1)
+        stripe = kcalloc(*stripes, sizeof(akvcam_frame_stripe), GFP_KERNEL);
+
+    if (!stripe) {
+        memset(single_stripe, 0, sizeof(akvcam_frame_stripe));
+        stripe = single_stripe;
+        *stripes = 1;
     }
 
-    m = 2 * l - c;
+    return stripe;
+}
 
-    *r = (2 * (*r) + m) / 2;
-    *g = (2 * (*g) + m) / 2;
-    *b = (2 * (*b) + m) / 2;
+// Only the stripes lists with more than one stripe are allocated.
+void akvcam_frame_stripes_delete(akvcam_frame_stripe_t stripe, size_t stripes)
+{
+    if (stripes > 1)
+        kfree(stripe);
 }
 
-size_t akvcam_convert_funcs_count(void)
+void akvcam_frame_run_stripes(akvcam_frame_stripe_t stripe, size_t stripes)
 {
     size_t i;
-    static size_t count = 0;
 
-    if (count < 1)
-        for (i = 0; akvcam_frame_convert_table[i].from; i++)
-            count++;
+    // The first stripe is processed in the calling thread, while the workers
+    // process the others.
+    for (i = 1; i < stripes; i++) {
+        INIT_WORK(&stripe[i].work, akvcam_frame_process_work);
+        queue_work(akvcam_frame_workqueue, &stripe[i].work);
+    }
 
-    return count;
+    akvcam_frame_run_stripe(stripe);
+
+    for (i = 1; i < stripes; i++)
+        flush_work(&stripe[i].work);
+}
+
+void akvcam_frame_process_work(struct work_struct *work)
+{
+    akvcam_frame_stripe_t stripe = container_of(work,
+                                                akvcam_frame_stripe,
+                                                work);
+
+    akvcam_frame_run_stripe(stripe);
 }
 
-akvcam_video_convert_funtion_t akvcam_convert_func(__u32 from, __u32 to)
+void akvcam_frame_run_stripe(akvcam_frame_stripe_t stripe)
 {
+    if (stripe->rotation)
+        akvcam_frame_rotate_stripe(stripe);
+    else if (stripe->unpack)
+        akvcam_frame_unpack_stripe(stripe);
+    else if (stripe->chroma_scaler)
+        akvcam_frame_process_yuv_stripe(stripe);
+    else
+        akvcam_frame_process_stripe(stripe);
+}
+
+bool akvcam_frame_adjusts_colors(const akvcam_frame_adjusts_t adjusts)
+{
+    return adjusts->swap_rgb
+           || adjusts->hue != 0
+           || adjusts->saturation != 0
+           || adjusts->luminance != 0
+           || adjusts->contrast != 0
+           || adjusts->gamma != 0
+           || adjusts->gray;
+}
+
+// The hue, the saturation and the swapping of the red and blue components
+// needs the RGB components, everything else can be done in the YUV frame.
+bool akvcam_frame_can_process_yuv(const akvcam_frame_t self,
+                                  const akvcam_frame_t src,
+                                  const akvcam_frame_adjusts_t adjusts)
+{
+    return adjusts->process_yuv
+           && akvcam_yuv422_layout_by_fourcc(akvcam_format_fourcc(self->format))
+           && akvcam_format_width(self->format) % 2 == 0
+           && akvcam_format_width(src->format) % 2 == 0
+           && adjusts->hue == 0
+           && adjusts->saturation == 0
+           && adjusts->rotation == 0
+           && !adjusts->swap_rgb;
+}
+
+// Scale, mirror and adjust the frame in the packed 4:2:2 format of the
+// capture. The source frame is converted to that format first, then each
+// component is processed on its own, the chroma with half the width.
+bool akvcam_frame_process_yuv(akvcam_frame_t self,
+                              const akvcam_frame_t src,
+                              const akvcam_frame_adjusts_t adjusts,
+                              akvcam_scaler_t scaler,
+                              akvcam_color_table_t color_table,
+                              size_t stripes)
+{
+    __u32 fourcc = akvcam_format_fourcc(self->format);
+    size_t iwidth = akvcam_format_width(src->format);
+    size_t iheight = akvcam_format_height(src->format);
+    size_t oheight = akvcam_format_height(self->format);
+    akvcam_frame_adjusts convert_adjusts;
+    akvcam_format_t format;
+    akvcam_frame_t converted = NULL;
+    akvcam_frame_stripe single_stripe;
+    akvcam_frame_stripe_t stripe;
+    char *scratch;
+    size_t scratch_size;
     size_t i;
-    akvcam_video_convert_t convert;
 
-    for (i = 0; i < akvcam_convert_funcs_count(); i++) {
-        convert = akvcam_frame_convert_table + i;
+    if (akvcam_format_fourcc(src->format) != fourcc
+        || akvcam_yuv_matrix_from_format(src->format)
+           != akvcam_yuv_matrix_from_format(self->format)) {
+        memset(&convert_adjusts, 0, sizeof(akvcam_frame_adjusts));
+        format = akvcam_format_new(fourcc, iwidth, iheight, NULL);
+        akvcam_format_copy_colorimetry(format, self->format);
+        converted = akvcam_frame_new_pooled(self->pool, format);
+        akvcam_format_delete(format);
+
+        // The conversion doesn't scale nor adjust the frame, so the
+        // unscaled maps are reused between frames too.
+        if (!akvcam_frame_process(converted,
+                                  src,
+                                  &convert_adjusts,
+                                  akvcam_scaler_identity(scaler),
+                                  NULL,
+                                  stripes)) {
+            akvcam_frame_delete(converted);
+
+            return false;
+        }
+    }
 
-        if (convert->from == from && convert->to == to)
-            return convert->convert;
+    stripe = akvcam_frame_stripes_new(&stripes, oheight, &single_stripe);
+
+    // Each stripe needs a line for the vertically filtered samples of the
+    // source, and the scaled luma and chroma lines.
+    scratch_size = akvcam_align_up(iwidth * sizeof(int32_t)
+                                   + 2 * akvcam_format_width(self->format),
+                                   AKVCAM_FRAME_SCRATCH_ALIGN);
+    scratch = akvcam_frame_pool_get(self->pool, stripes * scratch_size);
+
+    if (!scratch) {
+        akvcam_frame_stripes_delete(stripe, stripes);
+        akvcam_frame_delete(converted);
+
+        return false;
     }
 
-    return NULL;
+    for (i = 0; i < stripes; i++) {
+        stripe[i].dst = self;
+        stripe[i].src = converted? converted: src;
+        stripe[i].adjusts = adjusts;
+        stripe[i].scaler = scaler;
+        stripe[i].chroma_scaler = akvcam_scaler_chroma(scaler);
+        stripe[i].color_table = color_table;
+        stripe[i].scratch = scratch + i * scratch_size;
+        stripe[i].y_start = i * oheight / stripes;
+        stripe[i].y_end = (i + 1) * oheight / stripes;
+    }
+
+    akvcam_frame_run_stripes(stripe, stripes);
+    akvcam_frame_pool_put(self->pool, scratch, stripes * scratch_size);
+    akvcam_frame_stripes_delete(stripe, stripes);
+    akvcam_frame_delete(converted);
+
+    return true;
 }
 
 bool akvcam_frame_adjust_format_supported(__u32 fourcc)
@@ -1887,123 +3522,126 @@ bool akvcam_frame_adjust_format_supported(__u32 fourcc)
     return false;
 }
 
-const uint8_t *akvcam_contrast_table(void)
+// 75% color bars, all the lines are the same.
+void akvcam_frame_draw_bars(akvcam_frame_t self)
 {
-    static uint8_t *contrast_table = NULL;
-    size_t i;
-    size_t j = 0;
-    ssize_t contrast;
-    ssize_t f_num;
-    ssize_t f_den;
-    ssize_t ic;
+    // In memory order: red, green, blue.
+    static const akvcam_RGB24 bars[] = {
+        {0xbf, 0xbf, 0xbf},
+        {0xbf, 0xbf, 0x00},
+        {0x00, 0xbf, 0xbf},
+        {0x00, 0xbf, 0x00},
+        {0xbf, 0x00, 0xbf},
+        {0xbf, 0x00, 0x00},
+        {0x00, 0x00, 0xbf},
+        {0x00, 0x00, 0x00},
+    };
+    size_t nbars = sizeof(bars) / sizeof(akvcam_RGB24);
+    size_t width = akvcam_format_width(self->format);
+    size_t height = akvcam_format_height(self->format);
+    size_t line_size = width * sizeof(akvcam_RGB24);
+    akvcam_RGB24_t line = akvcam_frame_line(self, 0, 0);
+    size_t x;
+    size_t y;
 
-    if (contrast_table)
-        return contrast_table;
+    for (x = 0; x < width; x++)
+        line[x] = bars[x * nbars / width];
 
-    contrast_table = vmalloc(511 * 256);
+    for (y = 1; y < height; y++)
+        memcpy(akvcam_frame_line(self, 0, y), line, line_size);
+}
+
+// The hue goes around the color wheel from top to bottom, so the pattern
+// can be scrolled vertically without seams, and fades to black from right
+// to left.
+void akvcam_frame_draw_gradient(akvcam_frame_t self)
+{
+    // Value of each component in each sixth of the wheel: 0, 255, going up
+    // or going down.
+    static const uint8_t wheel[6][3] = {
+        {1, 2, 0},
+        {3, 1, 0},
+        {0, 1, 2},
+        {0, 3, 1},
+        {2, 0, 1},
+        {1, 0, 3},
+    };
+    size_t width = akvcam_format_width(self->format);
+    size_t height = akvcam_format_height(self->format);
+    akvcam_RGB24_t line;
+    uint32_t values[4];
+    uint32_t hue;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+    uint32_t k;
+    size_t x;
+    size_t y;
 
-    for (contrast = -255; contrast < 256; contrast++) {
-        f_num = 259 * (255 + contrast);
-        f_den = 255 * (259 - contrast);
+    for (y = 0; y < height; y++) {
+        hue = (uint32_t) (6 * 256 * y / height);
+        values[0] = 0;
+        values[1] = 255;
+        values[2] = hue & 0xff;
+        values[3] = 255 - (hue & 0xff);
+        r = values[wheel[hue >> 8][0]];
+        g = values[wheel[hue >> 8][1]];
+        b = values[wheel[hue >> 8][2]];
+        line = akvcam_frame_line(self, 0, y);
 
-        for (i = 0; i < 256; i++, j++) {
-            ic = (f_num * ((ssize_t) i - 128) + 128 * f_den) / f_den;
-            contrast_table[j] = (uint8_t) akvcam_bound(0, ic, 255);
+        for (x = 0; x < width; x++) {
+            k = (uint32_t) (256 * (x + 1) / width);
+            line[x].r = (uint8_t) ((r * k) >> 8);
+            line[x].g = (uint8_t) ((g * k) >> 8);
+            line[x].b = (uint8_t) ((b * k) >> 8);
         }
     }
+}
 
-    akvcam_global_deleter_add(contrast_table, (akvcam_delete_t) vfree);
+void akvcam_frame_free_data(akvcam_frame_t self)
+{
+    if (self->data && !self->borrowed)
+        akvcam_frame_pool_put(self->pool, self->data, self->size);
 
-    return contrast_table;
+    self->data = NULL;
+    self->borrowed = false;
 }
 
-/* Gamma correction is traditionally computed with the following formula:
- *
- * c = N * (c / N) ^ gamma
- *
- * Where 'c' is the color component and 'N' is the maximum value of the color
- * component, 255 in this case. The formula will define a curve between 0 and
- * N. When 'gamma' is 1 it will draw a rect, returning the identity image at the
- * output. when 'gamma' is near to 0 it will draw a decreasing curve (mountain),
- * Giving more light to darker colors. When 'gamma' is higher than 1 it will
- * draw a increasing curve (valley), making bright colors darker.
- *
- * Explained in a simple way, gamma correction will modify image brightness
- * preserving the contrast.
- *
- * The problem with the original formula is that it requires floating point
- * computing which is not possible in the kernel because not all target
- * architectures have a FPU.
- *
- * So instead, we will use a quadric function, that even if it does not returns
- * the same values, it will cause the same effect and is good enough for our
- * purpose. We use the formula:
- *
- * y = a * x ^ 2 + b * x
- *
- * and because we have the point (0, N) already defined, then we can calculate
- * b as :
- *
- * b = 1 - a * N
- *
- * and replacing
- *
- * y = a * x ^ 2 + (1 - a * N) * x
- *
- * we are missing a third point (x', y') to fully define the value of 'a', so
- * the value of 'a' will be given by:
- *
- * a = (y' - x') / (x' ^ 2 - N * x')
- *
- * we will take the point (x', y') from the segment orthogonal to the curve's
- * segment, that is:
- *
- * y' = N - x'
- *
- * Here x' will be our fake 'gamma' value.
- * Then the value of 'a' becomes:
- *
- * a = (N - 2 * x') / (x' ^ 2 - N * x')
- *
- * finally we clamp/bound the resulting value between 0 and N and that's what
- * this code does.
- */
-const uint8_t *akvcam_gamma_table(void)
-{
-    static uint8_t *gamma_table = NULL;
-    ssize_t i;
-    size_t j = 0;
-    ssize_t gamma;
-    ssize_t f_num;
-    ssize_t f_den;
-    ssize_t g;
-    ssize_t ig;
-
-    if (gamma_table)
-        return gamma_table;
-
-    gamma_table = vmalloc(511 * 256);
-
-    for (gamma = -255; gamma < 256; gamma++) {
-        g = (255 + gamma) >> 1;
-        f_num = 2 * g - 255;
-        f_den = g * (g - 255);
-
-        for (i = 0; i < 256; i++, j++) {
-            if (g > 0 && g != 255) {
-                ig = (f_num * i * i + (f_den - f_num * 255) * i) / f_den;
-                ig = akvcam_bound(0, ig, 255);
-            } else if (g != 255) {
-                ig = 0;
-            } else {
-                ig = 255;
-            }
+// The FPU is only taken for the SIMD converters, the others don't use it.
+void akvcam_frame_convert_lines(akvcam_frame_t dst,
+                                akvcam_frame_t src,
+                                akvcam_line_convert_function_t convert,
+                                bool simd)
+{
+    size_t width = akvcam_format_width(src->format);
+    size_t height = akvcam_format_height(src->format);
+    const akvcam_yuv_matrix *matrix =
+            akvcam_yuv_matrix_from_format(dst->format);
+    size_t y;
 
-            gamma_table[j] = (uint8_t) ig;
-        }
+    for (y = 0; y < height; y++) {
+        if (simd && y % AKVCAM_FRAME_SIMD_LINES == 0)
+            akvcam_frame_simd_begin();
+
+        convert(akvcam_frame_line(dst, 0, y),
+                akvcam_frame_const_line(src, 0, y),
+                width,
+                matrix);
+
+        if (simd
+            && ((y + 1) % AKVCAM_FRAME_SIMD_LINES == 0 || y + 1 == height))
+            akvcam_frame_simd_end();
     }
+}
 
-    akvcam_global_deleter_add(gamma_table, (akvcam_delete_t) vfree);
+void akvcam_frame_convert_planar_lines(akvcam_frame_t dst,
+                                       akvcam_frame_t src,
+                                       akvcam_planar_convert_function_t convert)
+{
+    size_t width = akvcam_format_width(src->format);
+    size_t height = akvcam_format_height(src->format);
+    size_t y;
 
-    return gamma_table;
+    for (y = 0; y < height; y++)
+        convert(dst, y, akvcam_frame_const_line(src, 0, y), width);
 }
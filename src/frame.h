@@ -21,18 +21,29 @@
 
 #include <linux/types.h>
 
+#include "color_table.h"
+#include "frame_pool.h"
 #include "frame_types.h"
 #include "format_types.h"
+#include "scaler.h"
 
 // public
 akvcam_frame_t akvcam_frame_new(akvcam_format_t format,
                                 const void *data,
                                 size_t size);
+akvcam_frame_t akvcam_frame_new_wrapped(akvcam_format_t format,
+                                        void *data,
+                                        size_t size);
+akvcam_frame_t akvcam_frame_new_pooled(akvcam_frame_pool_t pool,
+                                       akvcam_format_t format);
 akvcam_frame_t akvcam_frame_new_copy(akvcam_frame_t other);
 void akvcam_frame_delete(akvcam_frame_t self);
 akvcam_frame_t akvcam_frame_ref(akvcam_frame_t self);
 
 void akvcam_frame_copy(akvcam_frame_t self, const akvcam_frame_t other);
+void akvcam_frame_swap(akvcam_frame_t self, akvcam_frame_t other);
+void akvcam_frame_take(akvcam_frame_t self, akvcam_frame_t other);
+void akvcam_frame_set_pool(akvcam_frame_t self, akvcam_frame_pool_t pool);
 akvcam_format_t akvcam_frame_format(const akvcam_frame_t self);
 void *akvcam_frame_data(const akvcam_frame_t self);
 void *akvcam_frame_line(const akvcam_frame_t self, size_t plane, size_t y);
@@ -43,16 +54,24 @@ size_t akvcam_frame_size(const akvcam_frame_t self);
 void akvcam_frame_resize(akvcam_frame_t self, size_t size);
 void akvcam_frame_clear(akvcam_frame_t self);
 bool akvcam_frame_load(akvcam_frame_t self, const char *file_name);
+bool akvcam_frame_load_raw(akvcam_frame_t self,
+                           const char *file_name,
+                           akvcam_format_t format);
 void akvcam_frame_mirror(akvcam_frame_t self,
                          bool horizontalMirror,
                          bool verticalMirror);
+void akvcam_frame_rotate(akvcam_frame_t self, int rotation);
 bool akvcam_frame_scaled(akvcam_frame_t self,
                          size_t width,
                          size_t height,
                          AKVCAM_SCALING mode,
                          AKVCAM_ASPECT_RATIO aspectRatio);
 void akvcam_frame_swap_rgb(akvcam_frame_t self);
-bool akvcam_frame_convert(akvcam_frame_t self, __u32 fourcc);
+bool akvcam_frame_convert(akvcam_frame_t self, const akvcam_format_t format);
+bool akvcam_frame_pattern(akvcam_frame_t self, AKVCAM_PATTERN pattern);
+void akvcam_frame_scroll(akvcam_frame_t self,
+                         const akvcam_frame_t src,
+                         size_t lines);
 void akvcam_frame_adjust_hsl(akvcam_frame_t self,
                              int hue,
                              int saturation,
@@ -67,10 +86,18 @@ void akvcam_frame_adjust(akvcam_frame_t self,
                          int contrast,
                          int gamma,
                          bool gray);
+bool akvcam_frame_process(akvcam_frame_t self,
+                          const akvcam_frame_t src,
+                          const akvcam_frame_adjusts_t adjusts,
+                          akvcam_scaler_t scaler,
+                          akvcam_color_table_t color_table,
+                          size_t stripes);
 
 // public static
+void akvcam_frame_workqueue_init(void);
 const char *akvcam_frame_scaling_to_string(AKVCAM_SCALING scaling);
 const char *akvcam_frame_aspect_ratio_to_string(AKVCAM_ASPECT_RATIO aspect_ratio);
+AKVCAM_PATTERN akvcam_frame_pattern_from_string(const char *pattern);
 bool akvcam_frame_can_convert(__u32 in_fourcc, __u32 out_fourcc);
 
 #endif // AKVCAM_FRAME_H
@@ -0,0 +1,157 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "frame_pool.h"
+
+typedef struct
+{
+    void *data;
+    size_t size;
+} akvcam_frame_pool_buffer, *akvcam_frame_pool_buffer_t;
+
+struct akvcam_frame_pool
+{
+    struct kref ref;
+    struct mutex mutex;
+    akvcam_frame_pool_buffer buffers[AKVCAM_FRAME_POOL_SIZE];
+    size_t count;
+    size_t allocations;
+};
+
+akvcam_frame_pool_t akvcam_frame_pool_new(void)
+{
+    akvcam_frame_pool_t self = kzalloc(sizeof(struct akvcam_frame_pool), GFP_KERNEL);
+    kref_init(&self->ref);
+    mutex_init(&self->mutex);
+
+    return self;
+}
+
+void akvcam_frame_pool_free(struct kref *ref)
+{
+    akvcam_frame_pool_t self = container_of(ref, struct akvcam_frame_pool, ref);
+
+    akvcam_frame_pool_clear(self);
+    kfree(self);
+}
+
+void akvcam_frame_pool_delete(akvcam_frame_pool_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_frame_pool_free);
+}
+
+akvcam_frame_pool_t akvcam_frame_pool_ref(akvcam_frame_pool_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+void *akvcam_frame_pool_get(akvcam_frame_pool_t self, size_t size)
+{
+    void *data = NULL;
+    size_t i;
+
+    if (!self)
+        return vzalloc(size);
+
+    mutex_lock(&self->mutex);
+
+    // Take the most recently released buffer, it's the most likely to still
+    // be in the caches.
+    for (i = self->count; i > 0; i--)
+        if (self->buffers[i - 1].size == size) {
+            data = self->buffers[i - 1].data;
+            memmove(self->buffers + i - 1,
+                    self->buffers + i,
+                    (self->count - i) * sizeof(akvcam_frame_pool_buffer));
+            self->count--;
+
+            break;
+        }
+
+    if (!data)
+        self->allocations++;
+
+    mutex_unlock(&self->mutex);
+
+    // New buffers are cleared so no stale kernel memory reaches the user.
+    if (!data)
+        data = vzalloc(size);
+
+    return data;
+}
+
+void akvcam_frame_pool_put(akvcam_frame_pool_t self, void *data, size_t size)
+{
+    void *evicted = NULL;
+
+    if (!data)
+        return;
+
+    if (!self) {
+        vfree(data);
+
+        return;
+    }
+
+    mutex_lock(&self->mutex);
+
+    // When the pool is full drop the oldest buffer, after a format change
+    // it's the one that won't be requested again.
+    if (self->count >= AKVCAM_FRAME_POOL_SIZE) {
+        evicted = self->buffers[0].data;
+        memmove(self->buffers,
+                self->buffers + 1,
+                (self->count - 1) * sizeof(akvcam_frame_pool_buffer));
+        self->count--;
+    }
+
+    self->buffers[self->count].data = data;
+    self->buffers[self->count].size = size;
+    self->count++;
+    mutex_unlock(&self->mutex);
+
+    if (evicted)
+        vfree(evicted);
+}
+
+void akvcam_frame_pool_clear(akvcam_frame_pool_t self)
+{
+    size_t i;
+
+    mutex_lock(&self->mutex);
+
+    for (i = 0; i < self->count; i++)
+        vfree(self->buffers[i].data);
+
+    self->count = 0;
+    mutex_unlock(&self->mutex);
+}
+
+size_t akvcam_frame_pool_allocations(const akvcam_frame_pool_t self)
+{
+    return self->allocations;
+}
@@ -0,0 +1,42 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_FRAME_POOL_H
+#define AKVCAM_FRAME_POOL_H
+
+#include <linux/types.h>
+
+// Maximum number of released buffers kept for reuse.
+#define AKVCAM_FRAME_POOL_SIZE 8
+
+struct akvcam_frame_pool;
+typedef struct akvcam_frame_pool *akvcam_frame_pool_t;
+
+// public
+akvcam_frame_pool_t akvcam_frame_pool_new(void);
+void akvcam_frame_pool_delete(akvcam_frame_pool_t self);
+akvcam_frame_pool_t akvcam_frame_pool_ref(akvcam_frame_pool_t self);
+
+// Returns a buffer of the given size. Recycled buffers are not cleared, so
+// they must be fully overwritten. A NULL pool just allocates a clear buffer.
+void *akvcam_frame_pool_get(akvcam_frame_pool_t self, size_t size);
+void akvcam_frame_pool_put(akvcam_frame_pool_t self, void *data, size_t size);
+void akvcam_frame_pool_clear(akvcam_frame_pool_t self);
+size_t akvcam_frame_pool_allocations(const akvcam_frame_pool_t self);
+
+#endif // AKVCAM_FRAME_POOL_H
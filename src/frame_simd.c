@@ -0,0 +1,130 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/kernel.h>
+#include <linux/version.h>
+#include <linux/videodev2.h>
+
+#ifdef CONFIG_X86
+#include <asm/cpufeature.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 2, 0)
+#include <asm/fpu/api.h>
+#else
+#include <asm/i387.h>
+#endif
+#endif
+
+#include "frame_simd.h"
+#include "log.h"
+#include "utils.h"
+
+typedef struct
+{
+    AKVCAM_FRAME_SIMD simd;
+    char  str[32];
+} akvcam_frame_simd_strings, *akvcam_frame_simd_strings_t;
+
+#ifdef CONFIG_X86
+extern const akvcam_line_convert akvcam_frame_simd_sse2_table[];
+extern const akvcam_line_convert akvcam_frame_simd_avx2_table[];
+#endif
+
+static AKVCAM_FRAME_SIMD akvcam_frame_simd_selected = AKVCAM_FRAME_SIMD_NONE;
+static const akvcam_line_convert *akvcam_frame_simd_table = NULL;
+
+void akvcam_frame_simd_init(void)
+{
+    akvcam_frame_simd_selected = AKVCAM_FRAME_SIMD_NONE;
+    akvcam_frame_simd_table = NULL;
+
+#ifdef CONFIG_X86
+    if (boot_cpu_has(X86_FEATURE_AVX2) && boot_cpu_has(X86_FEATURE_AVX)) {
+        akvcam_frame_simd_selected = AKVCAM_FRAME_SIMD_AVX2;
+        akvcam_frame_simd_table = akvcam_frame_simd_avx2_table;
+    } else if (boot_cpu_has(X86_FEATURE_XMM2)) {
+        akvcam_frame_simd_selected = AKVCAM_FRAME_SIMD_SSE2;
+        akvcam_frame_simd_table = akvcam_frame_simd_sse2_table;
+    }
+#endif
+
+    akpr_info("Frame conversions SIMD: %s\n",
+              akvcam_frame_simd_to_string(akvcam_frame_simd_selected));
+}
+
+AKVCAM_FRAME_SIMD akvcam_frame_simd(void)
+{
+    return akvcam_frame_simd_selected;
+}
+
+const char *akvcam_frame_simd_to_string(AKVCAM_FRAME_SIMD simd)
+{
+    size_t i;
+    static char simd_str[AKVCAM_MAX_STRING_SIZE];
+    static akvcam_frame_simd_strings simd_strings[] = {
+        {AKVCAM_FRAME_SIMD_NONE, "None"},
+        {AKVCAM_FRAME_SIMD_SSE2, "SSE2"},
+        {AKVCAM_FRAME_SIMD_AVX2, "AVX2"},
+        {-1                    , ""    },
+    };
+
+    memset(simd_str, 0, AKVCAM_MAX_STRING_SIZE);
+
+    for (i = 0; simd_strings[i].simd >= 0; i++)
+        if (simd_strings[i].simd == simd) {
+            snprintf(simd_str,
+                     AKVCAM_MAX_STRING_SIZE,
+                     "%s",
+                     simd_strings[i].str);
+
+            return simd_str;
+        }
+
+    snprintf(simd_str, AKVCAM_MAX_STRING_SIZE, "AKVCAM_FRAME_SIMD(%d)", simd);
+
+    return simd_str;
+}
+
+akvcam_line_convert_function_t akvcam_frame_simd_convert_func(__u32 from, __u32 to)
+{
+    size_t i;
+
+    if (!akvcam_frame_simd_table)
+        return NULL;
+
+    for (i = 0; akvcam_frame_simd_table[i].from; i++)
+        if (akvcam_frame_simd_table[i].from == from
+            && akvcam_frame_simd_table[i].to == to)
+            return akvcam_frame_simd_table[i].convert;
+
+    return NULL;
+}
+
+void akvcam_frame_simd_begin(void)
+{
+#ifdef CONFIG_X86
+    kernel_fpu_begin();
+#endif
+}
+
+void akvcam_frame_simd_end(void)
+{
+#ifdef CONFIG_X86
+    kernel_fpu_end();
+#endif
+}
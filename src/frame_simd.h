@@ -0,0 +1,57 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_FRAME_SIMD_H
+#define AKVCAM_FRAME_SIMD_H
+
+#include <linux/types.h>
+
+#include "yuv_matrix.h"
+
+// Number of lines converted between each kernel_fpu_begin/end pair, we don't
+// want to keep preemption disabled for a whole frame.
+#define AKVCAM_FRAME_SIMD_LINES 16
+
+typedef enum
+{
+    AKVCAM_FRAME_SIMD_NONE,
+    AKVCAM_FRAME_SIMD_SSE2,
+    AKVCAM_FRAME_SIMD_AVX2
+} AKVCAM_FRAME_SIMD;
+
+typedef void (*akvcam_line_convert_function_t)(void *dst,
+                                               const void *src,
+                                               size_t width,
+                                               const akvcam_yuv_matrix *matrix);
+
+typedef struct
+{
+    __u32 from;
+    __u32 to;
+    akvcam_line_convert_function_t convert;
+} akvcam_line_convert, *akvcam_line_convert_t;
+
+// public static
+void akvcam_frame_simd_init(void);
+AKVCAM_FRAME_SIMD akvcam_frame_simd(void);
+const char *akvcam_frame_simd_to_string(AKVCAM_FRAME_SIMD simd);
+akvcam_line_convert_function_t akvcam_frame_simd_convert_func(__u32 from, __u32 to);
+void akvcam_frame_simd_begin(void);
+void akvcam_frame_simd_end(void);
+
+#endif // AKVCAM_FRAME_SIMD_H
@@ -0,0 +1,463 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Line conversion kernels shared by all the SIMD backends.
+ *
+ * This file is included by frame_sse2.c and frame_avx2.c, each one compiled
+ * with it's own instruction set flags, after defining:
+ *
+ * AKVCAM_SIMD_VECTOR_SIZE: vector register size in bytes.
+ * AKVCAM_SIMD_TABLE: name of the exported conversion table.
+ * AKVCAM_SIMD_BYTE_SHUFFLE: the instruction set has a byte shuffle (pshufb).
+ *
+ * Without pshufb the compiler emulates the byte shuffles one byte at a time,
+ * so that backends only get the conversions that don't need them.
+ *
+ * We can't include <immintrin.h> from the kernel, so the kernels are written
+ * with the compiler vector extensions and the compiler emits the instructions
+ * for the target instruction set. The arithmetic is exactly the same used by
+ * the YUV matrix tables, so the output is bit exact.
+ *
+ * None of this functions can be called outside a
+ * akvcam_frame_simd_begin/akvcam_frame_simd_end block.
+ */
+
+#ifndef AKVCAM_FRAME_SIMD_KERNELS_H
+#define AKVCAM_FRAME_SIMD_KERNELS_H
+
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+#include "frame_simd.h"
+#include "utils.h"
+
+#define AKVCAM_SIMD_LANES16 (AKVCAM_SIMD_VECTOR_SIZE / 2)
+
+typedef uint8_t akvcam_simd_u8 __attribute__((vector_size(AKVCAM_SIMD_VECTOR_SIZE)));
+typedef uint16_t akvcam_simd_u16 __attribute__((vector_size(AKVCAM_SIMD_VECTOR_SIZE)));
+typedef int16_t akvcam_simd_s16 __attribute__((vector_size(AKVCAM_SIMD_VECTOR_SIZE)));
+
+// Used for the shuffles that are done 16 bytes at a time.
+typedef uint8_t akvcam_simd_u8x16 __attribute__((vector_size(16)));
+
+typedef union
+{
+    akvcam_simd_u16 v;
+    uint16_t s[AKVCAM_SIMD_LANES16];
+} akvcam_simd_u16_block;
+
+typedef union
+{
+    akvcam_simd_s16 v;
+    int16_t s[AKVCAM_SIMD_LANES16];
+} akvcam_simd_s16_block;
+
+#ifdef AKVCAM_SIMD_BYTE_SHUFFLE
+// pshufb doesn't move bytes across the 128 bits lanes of the AVX2 registers,
+// so the shuffles are done lane by lane. Each lane takes 8 pixels, and the 24
+// bytes of the lane 'l' are picked from the lane 'l' of two vectors, one
+// loaded at the start of the pixels and the other 16 bytes after it.
+// This is the index of the byte 't' of the pixels, counted from the start.
+#define AKVCAM_SIMD_INDEX24(l, t) \
+    ((t) < 16 * (l) + 16? (t): (t) - 16 + AKVCAM_SIMD_VECTOR_SIZE)
+
+// Moves the component 'c' of the 8 pixels of the lane 'l' to the low byte of
+// each 16 bits lane.
+#define AKVCAM_SIMD_DEINTERLEAVE24_LANE(l, c) \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) +  0), 0, \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) +  3), 0, \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) +  6), 0, \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) +  9), 0, \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) + 12), 0, \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) + 15), 0, \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) + 18), 0, \
+    AKVCAM_SIMD_INDEX24(l, 24 * (l) + (c) + 21), 0
+
+// Interleave the Y and the VU samples of the 8 pixels of the lane 'l' as
+// UYVY or YUY2, the Y samples are in the low byte of each 16 bits lane, and
+// the V and U samples in the low and high bytes.
+#define AKVCAM_SIMD_INTERLEAVE_UYVY_LANE(l) \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  0, 16 * (l) +  0, \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  1, 16 * (l) +  2, \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  4, 16 * (l) +  4, \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  5, 16 * (l) +  6, \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  8, 16 * (l) +  8, \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  9, 16 * (l) + 10, \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) + 12, 16 * (l) + 12, \
+    AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) + 13, 16 * (l) + 14
+#define AKVCAM_SIMD_INTERLEAVE_YUY2_LANE(l) \
+    16 * (l) +  0, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  0, \
+    16 * (l) +  2, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  1, \
+    16 * (l) +  4, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  4, \
+    16 * (l) +  6, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  5, \
+    16 * (l) +  8, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  8, \
+    16 * (l) + 10, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) +  9, \
+    16 * (l) + 12, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) + 12, \
+    16 * (l) + 14, AKVCAM_SIMD_VECTOR_SIZE + 16 * (l) + 13
+
+#if AKVCAM_SIMD_VECTOR_SIZE == 32
+#define AKVCAM_SIMD_DEINTERLEAVE24(c) { \
+    AKVCAM_SIMD_DEINTERLEAVE24_LANE(0, c), \
+    AKVCAM_SIMD_DEINTERLEAVE24_LANE(1, c)  \
+}
+#define AKVCAM_SIMD_INTERLEAVE_UYVY { \
+    AKVCAM_SIMD_INTERLEAVE_UYVY_LANE(0), \
+    AKVCAM_SIMD_INTERLEAVE_UYVY_LANE(1)  \
+}
+#define AKVCAM_SIMD_INTERLEAVE_YUY2 { \
+    AKVCAM_SIMD_INTERLEAVE_YUY2_LANE(0), \
+    AKVCAM_SIMD_INTERLEAVE_YUY2_LANE(1)  \
+}
+#else
+#define AKVCAM_SIMD_DEINTERLEAVE24(c) {AKVCAM_SIMD_DEINTERLEAVE24_LANE(0, c)}
+#define AKVCAM_SIMD_INTERLEAVE_UYVY {AKVCAM_SIMD_INTERLEAVE_UYVY_LANE(0)}
+#define AKVCAM_SIMD_INTERLEAVE_YUY2 {AKVCAM_SIMD_INTERLEAVE_YUY2_LANE(0)}
+#endif
+
+// The vector loads of akvcam_simd_load16() read this many bytes.
+#define AKVCAM_SIMD_LOAD16_BYTES (16 + AKVCAM_SIMD_VECTOR_SIZE)
+#else
+#define AKVCAM_SIMD_LOAD16_BYTES (3 * AKVCAM_SIMD_LANES16)
+#endif
+
+// Deinterleave the last 'n' 24 bits pixels of the line into 16 bits lanes.
+static __always_inline void akvcam_simd_load16_tail(const uint8_t *src,
+                                                    size_t n,
+                                                    bool bgr,
+                                                    akvcam_simd_u16 *r,
+                                                    akvcam_simd_u16 *g,
+                                                    akvcam_simd_u16 *b)
+{
+    akvcam_simd_u16_block rb = {};
+    akvcam_simd_u16_block gb = {};
+    akvcam_simd_u16_block bb = {};
+    size_t ri = bgr? 0: 2;
+    size_t bi = bgr? 2: 0;
+    size_t i;
+
+    for (i = 0; i < n; i++, src += 3) {
+        rb.s[i] = src[ri];
+        gb.s[i] = src[1];
+        bb.s[i] = src[bi];
+    }
+
+    *r = rb.v;
+    *g = gb.v;
+    *b = bb.v;
+}
+
+// Deinterleave AKVCAM_SIMD_LANES16 24 bits pixels into 16 bits lanes.
+static __always_inline void akvcam_simd_load16(const uint8_t *src,
+                                               bool bgr,
+                                               akvcam_simd_u16 *r,
+                                               akvcam_simd_u16 *g,
+                                               akvcam_simd_u16 *b)
+{
+#ifdef AKVCAM_SIMD_BYTE_SHUFFLE
+    akvcam_simd_u8 rmask = AKVCAM_SIMD_DEINTERLEAVE24(bgr? 0: 2);
+    akvcam_simd_u8 gmask = AKVCAM_SIMD_DEINTERLEAVE24(1);
+    akvcam_simd_u8 bmask = AKVCAM_SIMD_DEINTERLEAVE24(bgr? 2: 0);
+    akvcam_simd_u8 lo;
+    akvcam_simd_u8 hi;
+
+    memcpy(&lo, src, AKVCAM_SIMD_VECTOR_SIZE);
+    memcpy(&hi, src + 16, AKVCAM_SIMD_VECTOR_SIZE);
+    *r = (akvcam_simd_u16) __builtin_shuffle(lo, hi, rmask) & 0xff;
+    *g = (akvcam_simd_u16) __builtin_shuffle(lo, hi, gmask) & 0xff;
+    *b = (akvcam_simd_u16) __builtin_shuffle(lo, hi, bmask) & 0xff;
+#else
+    akvcam_simd_load16_tail(src, AKVCAM_SIMD_LANES16, bgr, r, g, b);
+#endif
+}
+
+#ifdef AKVCAM_SIMD_BYTE_SHUFFLE
+static __always_inline void akvcam_simd_to_yuv(uint8_t *dst,
+                                               const uint8_t *src,
+                                               size_t width,
+                                               const akvcam_yuv_matrix *matrix,
+                                               bool bgr,
+                                               bool uyvy)
+{
+    uint16_t ky_r = (uint16_t) matrix->coeffs[0][0];
+    uint16_t ky_g = (uint16_t) matrix->coeffs[0][1];
+    uint16_t ky_b = (uint16_t) matrix->coeffs[0][2];
+    int16_t ku_r = matrix->coeffs[1][0];
+    int16_t ku_g = matrix->coeffs[1][1];
+    int16_t ku_b = matrix->coeffs[1][2];
+    int16_t kv_r = matrix->coeffs[2][0];
+    int16_t kv_g = matrix->coeffs[2][1];
+    int16_t kv_b = matrix->coeffs[2][2];
+    uint16_t y_offset = (uint16_t) matrix->y_offset;
+    int16_t uv_round = matrix->uv_round;
+    akvcam_simd_u8 mask = AKVCAM_SIMD_INTERLEAVE_YUY2;
+    akvcam_simd_u8 umask = AKVCAM_SIMD_INTERLEAVE_UYVY;
+    akvcam_simd_u8 packed;
+    akvcam_simd_u16 r;
+    akvcam_simd_u16 g;
+    akvcam_simd_u16 b;
+    akvcam_simd_s16 sr;
+    akvcam_simd_s16 sg;
+    akvcam_simd_s16 sb;
+    akvcam_simd_u16_block y;
+    akvcam_simd_s16_block u;
+    akvcam_simd_s16_block v;
+    akvcam_simd_u16 vu;
+    size_t x;
+    size_t i;
+    size_t n;
+    size_t i1;
+
+    if (uyvy)
+        mask = umask;
+
+    for (x = 0; x < width; x += n, src += 3 * n) {
+        n = akvcam_min(width - x, (size_t) AKVCAM_SIMD_LANES16);
+
+        if (3 * (width - x) < AKVCAM_SIMD_LOAD16_BYTES)
+            akvcam_simd_load16_tail(src, n, bgr, &r, &g, &b);
+        else
+            akvcam_simd_load16(src, bgr, &r, &g, &b);
+
+        sr = (akvcam_simd_s16) r;
+        sg = (akvcam_simd_s16) g;
+        sb = (akvcam_simd_s16) b;
+
+        // The luma sum fits in 16 bits unsigned, and the chroma sums in 16
+        // bits signed, the full range matrices round the chroma down by one
+        // for that.
+        y.v = ((ky_r * r + ky_g * g + ky_b * b + 128) >> 8) + y_offset;
+        u.v = ((ku_r * sr + ku_g * sg + ku_b * sb + uv_round) >> 8) + 128;
+        v.v = ((kv_r * sr + kv_g * sg + kv_b * sb + uv_round) >> 8) + 128;
+
+        if (n < AKVCAM_SIMD_LANES16) {
+            for (i = 0; i < n; i += 2, dst += 4) {
+                i1 = i + 1 < n? i + 1: i;
+
+                if (uyvy) {
+                    dst[0] = (uint8_t) v.s[i];
+                    dst[1] = (uint8_t) y.s[i];
+                    dst[2] = (uint8_t) u.s[i];
+                    dst[3] = (uint8_t) y.s[i1];
+                } else {
+                    dst[0] = (uint8_t) y.s[i];
+                    dst[1] = (uint8_t) v.s[i];
+                    dst[2] = (uint8_t) y.s[i1];
+                    dst[3] = (uint8_t) u.s[i];
+                }
+            }
+
+            continue;
+        }
+
+        vu = ((akvcam_simd_u16) v.v & 0xff) | (akvcam_simd_u16) u.v << 8;
+        packed = __builtin_shuffle((akvcam_simd_u8) y.v,
+                                   (akvcam_simd_u8) vu,
+                                   mask);
+        memcpy(dst, &packed, AKVCAM_SIMD_VECTOR_SIZE);
+        dst += AKVCAM_SIMD_VECTOR_SIZE;
+    }
+}
+#endif
+
+typedef enum
+{
+    AKVCAM_SIMD_PACK_RGB16,
+    AKVCAM_SIMD_PACK_RGB15,
+    AKVCAM_SIMD_PACK_BGR16
+} AKVCAM_SIMD_PACK;
+
+static __always_inline void akvcam_simd_to_16(uint8_t *dst,
+                                              const uint8_t *src,
+                                              size_t width,
+                                              bool bgr,
+                                              AKVCAM_SIMD_PACK pack)
+{
+    akvcam_simd_u16 r;
+    akvcam_simd_u16 g;
+    akvcam_simd_u16 b;
+    akvcam_simd_u16_block pixels;
+    size_t x;
+    size_t n;
+
+    for (x = 0; x < width; x += n, src += 3 * n, dst += 2 * n) {
+        n = akvcam_min(width - x, (size_t) AKVCAM_SIMD_LANES16);
+
+        if (3 * (width - x) < AKVCAM_SIMD_LOAD16_BYTES)
+            akvcam_simd_load16_tail(src, n, bgr, &r, &g, &b);
+        else
+            akvcam_simd_load16(src, bgr, &r, &g, &b);
+
+        switch (pack) {
+        case AKVCAM_SIMD_PACK_RGB16:
+            pixels.v = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+            break;
+
+        case AKVCAM_SIMD_PACK_RGB15:
+            pixels.v = 1 << 15 | (r >> 3) << 10 | (g >> 3) << 5 | b >> 3;
+            break;
+
+        default:
+            pixels.v = (b >> 3) << 11 | (g >> 2) << 5 | r >> 3;
+            break;
+        }
+
+        memcpy(dst, pixels.s, 2 * n);
+    }
+}
+
+#ifdef AKVCAM_SIMD_BYTE_SHUFFLE
+// Index of the component 'c' of the pixel 'p' of the group 'k' of 4 pixels,
+// from the 48 bytes loaded as 3 vectors, the group is shuffled from the
+// vector holding it's first byte and the next one.
+#define AKVCAM_SIMD_INDEX48(k, p, c) \
+    (12 * (k) + 3 * (p) + (c) - 16 * (12 * (k) / 16))
+
+// Expands the group 'k' of 4 24 bits pixels to 32 bits, 'c0' to 'c3' are the
+// source components of each output byte.
+#define AKVCAM_SIMD_EXPAND24(k, c0, c1, c2, c3) { \
+    AKVCAM_SIMD_INDEX48(k, 0, c0), AKVCAM_SIMD_INDEX48(k, 0, c1), \
+    AKVCAM_SIMD_INDEX48(k, 0, c2), AKVCAM_SIMD_INDEX48(k, 0, c3), \
+    AKVCAM_SIMD_INDEX48(k, 1, c0), AKVCAM_SIMD_INDEX48(k, 1, c1), \
+    AKVCAM_SIMD_INDEX48(k, 1, c2), AKVCAM_SIMD_INDEX48(k, 1, c3), \
+    AKVCAM_SIMD_INDEX48(k, 2, c0), AKVCAM_SIMD_INDEX48(k, 2, c1), \
+    AKVCAM_SIMD_INDEX48(k, 2, c2), AKVCAM_SIMD_INDEX48(k, 2, c3), \
+    AKVCAM_SIMD_INDEX48(k, 3, c0), AKVCAM_SIMD_INDEX48(k, 3, c1), \
+    AKVCAM_SIMD_INDEX48(k, 3, c2), AKVCAM_SIMD_INDEX48(k, 3, c3)  \
+}
+
+#define AKVCAM_SIMD_EXPAND24_MASKS(c0, c1, c2, c3) { \
+    AKVCAM_SIMD_EXPAND24(0, c0, c1, c2, c3), \
+    AKVCAM_SIMD_EXPAND24(1, c0, c1, c2, c3), \
+    AKVCAM_SIMD_EXPAND24(2, c0, c1, c2, c3), \
+    AKVCAM_SIMD_EXPAND24(3, c0, c1, c2, c3)  \
+}
+
+static __always_inline void akvcam_simd_to_32(uint8_t *dst,
+                                              const uint8_t *src,
+                                              size_t width,
+                                              bool bgr,
+                                              bool bgr32)
+{
+    size_t ri = bgr? 0: 2;
+    size_t bi = bgr? 2: 0;
+
+    // BGR32 is stored as R, G, B, X and RGB32 as X, B, G, R, the alpha
+    // byte is set after the shuffle.
+    akvcam_simd_u8x16 bgr32_masks[4] = AKVCAM_SIMD_EXPAND24_MASKS(ri, 1, bi, 0);
+    akvcam_simd_u8x16 rgb32_masks[4] = AKVCAM_SIMD_EXPAND24_MASKS(0, bi, 1, ri);
+    akvcam_simd_u8x16 bgr32_alpha = {
+        0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff
+    };
+    akvcam_simd_u8x16 rgb32_alpha = {
+        0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0
+    };
+    const akvcam_simd_u8x16 *masks = bgr32? bgr32_masks: rgb32_masks;
+    akvcam_simd_u8x16 alpha = bgr32? bgr32_alpha: rgb32_alpha;
+    akvcam_simd_u8x16 v[3];
+    akvcam_simd_u8x16 pixels;
+    size_t x;
+    size_t k;
+    size_t a;
+
+    for (x = 0; x + 16 <= width; x += 16, src += 48) {
+        memcpy(v, src, 48);
+
+        for (k = 0; k < 4; k++, dst += 16) {
+            a = 12 * k / 16;
+            pixels = __builtin_shuffle(v[a], v[akvcam_min(a + 1, 2)], masks[k]);
+            pixels |= alpha;
+            memcpy(dst, &pixels, 16);
+        }
+    }
+
+    for (; x < width; x++, src += 3, dst += 4) {
+        if (bgr32) {
+            dst[0] = src[ri];
+            dst[1] = src[1];
+            dst[2] = src[bi];
+            dst[3] = 0xff;
+        } else {
+            dst[0] = 0xff;
+            dst[1] = src[bi];
+            dst[2] = src[1];
+            dst[3] = src[ri];
+        }
+    }
+}
+#endif
+
+#define AKVCAM_SIMD_DEFINE_CONVERT(name, kernel, ...) \
+    static void akvcam_simd_##name(void *dst, \
+                                   const void *src, \
+                                   size_t width, \
+                                   const akvcam_yuv_matrix *matrix) \
+    { \
+        UNUSED(matrix); \
+        kernel(dst, src, width, __VA_ARGS__); \
+    }
+
+#define AKVCAM_SIMD_DEFINE_CONVERT_YUV(name, kernel, ...) \
+    static void akvcam_simd_##name(void *dst, \
+                                   const void *src, \
+                                   size_t width, \
+                                   const akvcam_yuv_matrix *matrix) \
+    { \
+        kernel(dst, src, width, matrix, __VA_ARGS__); \
+    }
+
+AKVCAM_SIMD_DEFINE_CONVERT(bgr24_to_rgb16, akvcam_simd_to_16, true , AKVCAM_SIMD_PACK_RGB16)
+AKVCAM_SIMD_DEFINE_CONVERT(bgr24_to_rgb15, akvcam_simd_to_16, true , AKVCAM_SIMD_PACK_RGB15)
+AKVCAM_SIMD_DEFINE_CONVERT(rgb24_to_rgb16, akvcam_simd_to_16, false, AKVCAM_SIMD_PACK_RGB16)
+AKVCAM_SIMD_DEFINE_CONVERT(rgb24_to_rgb15, akvcam_simd_to_16, false, AKVCAM_SIMD_PACK_RGB15)
+
+#ifdef AKVCAM_SIMD_BYTE_SHUFFLE
+AKVCAM_SIMD_DEFINE_CONVERT(bgr24_to_rgb32, akvcam_simd_to_32, true , false)
+AKVCAM_SIMD_DEFINE_CONVERT(bgr24_to_bgr32, akvcam_simd_to_32, true , true )
+AKVCAM_SIMD_DEFINE_CONVERT(rgb24_to_rgb32, akvcam_simd_to_32, false, false)
+AKVCAM_SIMD_DEFINE_CONVERT(rgb24_to_bgr32, akvcam_simd_to_32, false, true )
+
+AKVCAM_SIMD_DEFINE_CONVERT_YUV(bgr24_to_uyvy, akvcam_simd_to_yuv, true , true )
+AKVCAM_SIMD_DEFINE_CONVERT_YUV(bgr24_to_yuy2, akvcam_simd_to_yuv, true , false)
+AKVCAM_SIMD_DEFINE_CONVERT_YUV(rgb24_to_uyvy, akvcam_simd_to_yuv, false, true )
+AKVCAM_SIMD_DEFINE_CONVERT_YUV(rgb24_to_yuy2, akvcam_simd_to_yuv, false, false)
+#endif
+
+// Only the conversions faster than the plain C ones are listed here, the
+// others are converted with the line converters of frame.c.
+const akvcam_line_convert AKVCAM_SIMD_TABLE[] = {
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB565, akvcam_simd_bgr24_to_rgb16},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB555, akvcam_simd_bgr24_to_rgb15},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB565, akvcam_simd_rgb24_to_rgb16},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB555, akvcam_simd_rgb24_to_rgb15},
+
+#ifdef AKVCAM_SIMD_BYTE_SHUFFLE
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_RGB32 , akvcam_simd_bgr24_to_rgb32},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_BGR32 , akvcam_simd_bgr24_to_bgr32},
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_UYVY  , akvcam_simd_bgr24_to_uyvy },
+    {V4L2_PIX_FMT_BGR24, V4L2_PIX_FMT_YUYV  , akvcam_simd_bgr24_to_yuy2 },
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB32 , akvcam_simd_rgb24_to_rgb32},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_BGR32 , akvcam_simd_rgb24_to_bgr32},
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_UYVY  , akvcam_simd_rgb24_to_uyvy },
+    {V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_YUYV  , akvcam_simd_rgb24_to_yuy2 },
+#endif
+
+    {0                 , 0                  , NULL                      }
+};
+
+#endif // AKVCAM_FRAME_SIMD_KERNELS_H
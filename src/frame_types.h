@@ -19,13 +19,17 @@
 #ifndef AKVCAM_FRAME_TYPES_H
 #define AKVCAM_FRAME_TYPES_H
 
+#include <linux/types.h>
+
 struct akvcam_frame;
 typedef struct akvcam_frame *akvcam_frame_t;
 
 typedef enum
 {
     AKVCAM_SCALING_FAST,
-    AKVCAM_SCALING_LINEAR
+    AKVCAM_SCALING_LINEAR,
+    AKVCAM_SCALING_AREA,
+    AKVCAM_SCALING_BICUBIC
 } AKVCAM_SCALING;
 
 typedef enum
@@ -35,4 +39,29 @@ typedef enum
     AKVCAM_ASPECT_RATIO_EXPANDING
 } AKVCAM_ASPECT_RATIO;
 
+typedef enum
+{
+    AKVCAM_PATTERN_BARS,
+    AKVCAM_PATTERN_GRADIENT
+} AKVCAM_PATTERN;
+
+typedef struct
+{
+    int hue;
+    int saturation;
+    int luminance;
+    int contrast;
+    int gamma;
+    bool gray;
+    bool horizontal_mirror;
+    bool vertical_mirror;
+
+    // Clockwise, in degrees, one of 0, 90, 180 or 270.
+    int rotation;
+    bool swap_rgb;
+    bool process_yuv;
+    AKVCAM_SCALING scaling;
+    AKVCAM_ASPECT_RATIO aspect_ratio;
+} akvcam_frame_adjusts, *akvcam_frame_adjusts_t;
+
 #endif // AKVCAM_FRAME_TYPES_H
@@ -34,8 +34,6 @@
 #include "log.h"
 #include "node.h"
 
-#define DEFAULT_COLORSPACE V4L2_COLORSPACE_RAW
-
 #define AKVCAM_HANDLER(cmd, proc, arg_type) \
     {cmd, (akvcam_proc_t) proc, sizeof(arg_type)}
 
@@ -103,8 +101,13 @@ int akvcam_ioctl_querybuf(akvcam_node_t node, struct v4l2_buffer *buffer);
 int akvcam_ioctl_create_bufs(akvcam_node_t node, struct v4l2_create_buffers *buffers);
 int akvcam_ioctl_qbuf(akvcam_node_t node, struct v4l2_buffer *buffer);
 int akvcam_ioctl_dqbuf(akvcam_node_t node, struct v4l2_buffer *buffer);
+int akvcam_ioctl_expbuf(akvcam_node_t node, struct v4l2_exportbuffer *buffer);
 int akvcam_ioctl_streamon(akvcam_node_t node, const int *type);
 int akvcam_ioctl_streamoff(akvcam_node_t node, const int *type);
+void akvcam_ioctl_read_colorimetry(const struct v4l2_format *format,
+                                   akvcam_format_t akformat);
+void akvcam_ioctl_write_colorimetry(struct v4l2_format *format,
+                                    const akvcam_format_t akformat);
 
 static akvcam_ioctl_handler akvcam_ioctls_private[] = {
     AKVCAM_HANDLER(VIDIOC_QUERYCAP           , akvcam_ioctl_querycap           , struct v4l2_capability        ),
@@ -142,6 +145,7 @@ static akvcam_ioctl_handler akvcam_ioctls_private[] = {
     AKVCAM_HANDLER(VIDIOC_CREATE_BUFS        , akvcam_ioctl_create_bufs        , struct v4l2_create_buffers    ),
     AKVCAM_HANDLER(VIDIOC_QBUF               , akvcam_ioctl_qbuf               , struct v4l2_buffer            ),
     AKVCAM_HANDLER(VIDIOC_DQBUF              , akvcam_ioctl_dqbuf              , struct v4l2_buffer            ),
+    AKVCAM_HANDLER(VIDIOC_EXPBUF             , akvcam_ioctl_expbuf             , struct v4l2_exportbuffer      ),
     AKVCAM_HANDLER(VIDIOC_STREAMON           , akvcam_ioctl_streamon           , const int                     ),
     AKVCAM_HANDLER(VIDIOC_STREAMOFF          , akvcam_ioctl_streamoff          , const int                     ),
     AKVCAM_HANDLER_IGNORE(VIDIOC_CROPCAP),
@@ -154,7 +158,6 @@ static akvcam_ioctl_handler akvcam_ioctls_private[] = {
     AKVCAM_HANDLER_IGNORE(VIDIOC_ENUMOUTPUT),
     AKVCAM_HANDLER_IGNORE(VIDIOC_ENUMSTD),
     AKVCAM_HANDLER_IGNORE(VIDIOC_ENUM_DV_TIMINGS),
-    AKVCAM_HANDLER_IGNORE(VIDIOC_EXPBUF),
     AKVCAM_HANDLER_IGNORE(VIDIOC_G_AUDIO),
     AKVCAM_HANDLER_IGNORE(VIDIOC_G_AUDOUT),
     AKVCAM_HANDLER_IGNORE(VIDIOC_G_CROP),
@@ -688,23 +691,23 @@ int akvcam_ioctl_g_fmt(akvcam_node_t node, struct v4l2_format *format)
         format->fmt.pix.field = V4L2_FIELD_NONE;
         format->fmt.pix.bytesperline = (__u32) akvcam_format_bypl(current_format, 0);
         format->fmt.pix.sizeimage = (__u32) akvcam_format_size(current_format);
-        format->fmt.pix.colorspace = DEFAULT_COLORSPACE;
     } else {
         format->fmt.pix_mp.width = (__u32) akvcam_format_width(current_format);
         format->fmt.pix_mp.height = (__u32) akvcam_format_height(current_format);
         format->fmt.pix_mp.pixelformat = akvcam_format_fourcc(current_format);
         format->fmt.pix_mp.field = V4L2_FIELD_NONE;
-        format->fmt.pix_mp.colorspace = DEFAULT_COLORSPACE;
-        format->fmt.pix_mp.num_planes = (__u8) akvcam_format_planes(current_format);
+        format->fmt.pix_mp.num_planes = (__u8) akvcam_format_mplanes(current_format);
 
         for (i = 0; i < format->fmt.pix_mp.num_planes; i++) {
             bypl = akvcam_format_bypl(current_format, i);
-            plane_size = akvcam_format_plane_size(current_format, i);
+            plane_size = akvcam_format_mplane_size(current_format, i);
             format->fmt.pix_mp.plane_fmt[i].bytesperline = (__u32) bypl;
             format->fmt.pix_mp.plane_fmt[i].sizeimage = (__u32) plane_size;
         }
     }
 
+    akvcam_ioctl_write_colorimetry(format, current_format);
+
     akvcam_format_delete(current_format);
 
     return 0;
@@ -732,6 +735,7 @@ int akvcam_ioctl_s_fmt(akvcam_node_t node, struct v4l2_format *format)
         akvcam_format_set_fourcc(current_format, format->fmt.pix.pixelformat);
         akvcam_format_set_width(current_format, format->fmt.pix.width);
         akvcam_format_set_height(current_format, format->fmt.pix.height);
+        akvcam_ioctl_read_colorimetry(format, current_format);
         akvcam_device_set_format(device, current_format);
         akvcam_format_delete(current_format);
 
@@ -781,6 +785,8 @@ int akvcam_ioctl_try_fmt(akvcam_node_t node, struct v4l2_format *format)
     if (!nearest_format)
         return -EINVAL;
 
+    akvcam_ioctl_read_colorimetry(format, nearest_format);
+
     memset(&format->fmt, 0, 200);
 
     if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
@@ -791,23 +797,23 @@ int akvcam_ioctl_try_fmt(akvcam_node_t node, struct v4l2_format *format)
         format->fmt.pix.field = V4L2_FIELD_NONE;
         format->fmt.pix.bytesperline = (__u32) akvcam_format_bypl(nearest_format, 0);
         format->fmt.pix.sizeimage = (__u32) akvcam_format_size(nearest_format);
-        format->fmt.pix.colorspace = DEFAULT_COLORSPACE;
     } else {
         format->fmt.pix_mp.width = (__u32) akvcam_format_width(nearest_format);
         format->fmt.pix_mp.height = (__u32) akvcam_format_height(nearest_format);
         format->fmt.pix_mp.pixelformat = akvcam_format_fourcc(nearest_format);
         format->fmt.pix_mp.field = V4L2_FIELD_NONE;
-        format->fmt.pix_mp.colorspace = DEFAULT_COLORSPACE;
-        format->fmt.pix_mp.num_planes = (__u8) akvcam_format_planes(nearest_format);
+        format->fmt.pix_mp.num_planes = (__u8) akvcam_format_mplanes(nearest_format);
 
         for (i = 0; i < format->fmt.pix_mp.num_planes; i++) {
             bypl = akvcam_format_bypl(nearest_format, i);
-            plane_size = akvcam_format_plane_size(nearest_format, i);
+            plane_size = akvcam_format_mplane_size(nearest_format, i);
             format->fmt.pix_mp.plane_fmt[i].bytesperline = (__u32) bypl;
             format->fmt.pix_mp.plane_fmt[i].sizeimage = (__u32) plane_size;
         }
     }
 
+    akvcam_ioctl_write_colorimetry(format, nearest_format);
+
     akvcam_format_delete(nearest_format);
 
     return 0;
@@ -1296,6 +1302,25 @@ int akvcam_ioctl_dqbuf(akvcam_node_t node, struct v4l2_buffer *buffer)
     return akvcam_buffers_dequeue(buffers, buffer);
 }
 
+int akvcam_ioctl_expbuf(akvcam_node_t node, struct v4l2_exportbuffer *buffer)
+{
+    akvcam_device_t device;
+    akvcam_buffers_t buffers;
+    int32_t device_num;
+
+    akpr_function();
+    device_num = akvcam_node_device_num(node);
+    akpr_debug("Device: /dev/video%d\n", device_num);
+    device = akvcam_driver_device_from_num_nr(device_num);
+
+    if (!device)
+        return -EIO;
+
+    buffers = akvcam_device_buffers_nr(device);
+
+    return akvcam_buffers_export(buffers, buffer);
+}
+
 int akvcam_ioctl_streamon(akvcam_node_t node, const int *type)
 {
     akvcam_device_t device;
@@ -1340,3 +1365,33 @@ int akvcam_ioctl_streamoff(akvcam_node_t node, const int *type)
 
     return 0;
 }
+
+void akvcam_ioctl_read_colorimetry(const struct v4l2_format *format,
+                                   akvcam_format_t akformat)
+{
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+        || format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        akvcam_format_set_colorspace(akformat, format->fmt.pix.colorspace);
+        akvcam_format_set_ycbcr_enc(akformat, format->fmt.pix.ycbcr_enc);
+        akvcam_format_set_quantization(akformat, format->fmt.pix.quantization);
+    } else {
+        akvcam_format_set_colorspace(akformat, format->fmt.pix_mp.colorspace);
+        akvcam_format_set_ycbcr_enc(akformat, format->fmt.pix_mp.ycbcr_enc);
+        akvcam_format_set_quantization(akformat, format->fmt.pix_mp.quantization);
+    }
+}
+
+void akvcam_ioctl_write_colorimetry(struct v4l2_format *format,
+                                    const akvcam_format_t akformat)
+{
+    if (format->type == V4L2_BUF_TYPE_VIDEO_CAPTURE
+        || format->type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+        format->fmt.pix.colorspace = akvcam_format_colorspace(akformat);
+        format->fmt.pix.ycbcr_enc = akvcam_format_ycbcr_enc(akformat);
+        format->fmt.pix.quantization = akvcam_format_quantization(akformat);
+    } else {
+        format->fmt.pix_mp.colorspace = akvcam_format_colorspace(akformat);
+        format->fmt.pix_mp.ycbcr_enc = (__u8) akvcam_format_ycbcr_enc(akformat);
+        format->fmt.pix_mp.quantization = (__u8) akvcam_format_quantization(akformat);
+    }
+}
@@ -117,12 +117,6 @@ void *akvcam_map_value(const akvcam_map_t self, const char *key)
     return  element->value;
 }
 
-static bool akvcam_map_equals_keys(const akvcam_map_element_t element,
-                                   const char *key)
-{
-    return strcmp(element->key, key) == 0;
-}
-
 akvcam_map_element_t akvcam_map_element_copy(akvcam_map_element_t element)
 {
     return kmemdup(element, sizeof(akvcam_map_element), GFP_KERNEL);
@@ -135,24 +129,39 @@ akvcam_map_element_t akvcam_map_set_value(akvcam_map_t self,
                                           const akvcam_delete_t deleter)
 {
     akvcam_map_element element;
-    akvcam_list_element_t it =
-            akvcam_list_find(self->elements,
-                             key,
-                             (akvcam_are_equals_t) akvcam_map_equals_keys);
-
-    if (it)
-        akvcam_list_erase(self->elements, it);
+    akvcam_map_element_t old_element = akvcam_map_it(self, key);
+    akvcam_map_element_t new_element;
+    akvcam_list_element_t it;
 
     element.key = akvcam_strdup(key, AKVCAM_MEMORY_TYPE_KMALLOC);
     element.value = copier? copier(value): value;
     element.copier = copier;
     element.deleter = deleter;
-    element.it = akvcam_list_push_back(self->elements,
-                                       &element,
-                                       (akvcam_copy_t) akvcam_map_element_copy,
-                                       (akvcam_delete_t) kfree);
+    element.it = NULL;
+
+    // Release the key and the value of the replaced element too.
+    if (old_element)
+        akvcam_map_erase(self, old_element);
+
+    it = akvcam_list_push_back(self->elements,
+                               &element,
+                               (akvcam_copy_t) akvcam_map_element_copy,
+                               (akvcam_delete_t) kfree);
+
+    if (!it) {
+        kfree(element.key);
+
+        if (element.value && deleter)
+            deleter(element.value);
+
+        return NULL;
+    }
+
+    // The list stores a copy of the element, so it must be updated there.
+    new_element = akvcam_list_element_data(it);
+    new_element->it = it;
 
-    return akvcam_list_back(self->elements);
+    return new_element;
 }
 
 bool akvcam_map_contains(const akvcam_map_t self, const char *key)
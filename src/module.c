@@ -19,11 +19,15 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/version.h>
 
 #include "driver.h"
+#include "frame.h"
+#include "frame_simd.h"
 #include "global_deleter.h"
 #include "log.h"
 #include "settings.h"
+#include "yuv_matrix.h"
 
 #define AKVCAM_DRIVER_NAME        "akvcam"
 #define AKVCAM_DRIVER_DESCRIPTION "AkVCam Virtual Camera"
@@ -40,6 +44,9 @@ static int __init akvcam_init(void)
 {
     akvcam_log_set_level(loglevel);
     akvcam_settings_set_file(config_file);
+    akvcam_yuv_matrix_init();
+    akvcam_frame_simd_init();
+    akvcam_frame_workqueue_init();
 
     return akvcam_driver_init(AKVCAM_DRIVER_NAME, AKVCAM_DRIVER_DESCRIPTION);
 }
@@ -57,3 +64,10 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Gonzalo Exequiel Pedone");
 MODULE_DESCRIPTION(AKVCAM_DRIVER_DESCRIPTION);
 MODULE_VERSION("1.1.1");
+
+// The dma-buf functions used for exporting the buffers.
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
@@ -240,9 +240,8 @@ void *akvcam_rbuffer_queue_bytes(akvcam_rbuffer_t self,
                    size - right_size);
     }
 
-    move_read =
-            akvcam_between(self->write, self->read, self->write + size - 1)
-            && self->data_size > 0;
+    // The oldest data was overwritten if there was not enough free space.
+    move_read = self->data_size + size > self->size;
     self->write = (self->write + size) % self->size;
     self->data_size = akvcam_min(self->data_size + size, self->size);
 
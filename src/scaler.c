@@ -0,0 +1,605 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/kref.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "scaler.h"
+#include "utils.h"
+
+typedef void (*akvcam_extrapolate_t)(size_t dst_coord,
+                                     size_t num, size_t den, size_t s,
+                                     size_t *src_coord_min,
+                                     size_t *src_coord_max,
+                                     size_t *k_num, size_t *k_den);
+
+struct akvcam_scaler
+{
+    struct kref ref;
+    size_t iwidth;
+    size_t iheight;
+    size_t owidth;
+    size_t oheight;
+    AKVCAM_SCALING mode;
+    AKVCAM_ASPECT_RATIO aspect_ratio;
+    size_t x_dst_min;
+    size_t y_dst_min;
+    size_t x_dst_max;
+    size_t y_dst_max;
+    size_t area_ratio;
+    bool area;
+    bool bicubic;
+    akvcam_scaler_point_t x_points;
+    akvcam_scaler_point_t y_points;
+    akvcam_scaler_filter x_filter;
+    akvcam_scaler_filter y_filter;
+
+    // Scaler for the chroma of the 4:2:2 frames, with half the width.
+    struct akvcam_scaler *chroma;
+
+    // Scaler from the input size to itself, for converting the source
+    // frames before scaling them.
+    struct akvcam_scaler *identity;
+};
+
+void akvcam_scaler_fill_points(akvcam_scaler_point_t points,
+                               size_t ilength,
+                               size_t dst_min,
+                               size_t dst_max,
+                               size_t num,
+                               size_t den,
+                               size_t s,
+                               AKVCAM_SCALING mode);
+size_t akvcam_scaler_fill_area_points(akvcam_scaler_point_t points,
+                                      size_t ilength,
+                                      size_t dst_min,
+                                      size_t dst_max,
+                                      size_t src_offset,
+                                      size_t src_length);
+void akvcam_scaler_fill_filter(akvcam_scaler_filter_t filter,
+                               size_t ilength,
+                               size_t olength,
+                               size_t dst_min,
+                               size_t dst_max,
+                               size_t src_offset,
+                               size_t src_length);
+int32_t akvcam_scaler_cubic(int64_t x);
+void akvcam_extrapolate_up(size_t dst_coord,
+                           size_t num, size_t den, size_t s,
+                           size_t *src_coord_min, size_t *src_coord_max,
+                           size_t *k_num, size_t *k_den);
+void akvcam_extrapolate_down(size_t dst_coord,
+                             size_t num, size_t den, size_t s,
+                             size_t *src_coord_min, size_t *src_coord_max,
+                             size_t *k_num, size_t *k_den);
+
+akvcam_scaler_t akvcam_scaler_new(size_t iwidth,
+                                  size_t iheight,
+                                  size_t owidth,
+                                  size_t oheight,
+                                  AKVCAM_SCALING mode,
+                                  AKVCAM_ASPECT_RATIO aspect_ratio)
+{
+    size_t i_width;
+    size_t i_height;
+    size_t o_width;
+    size_t o_height;
+    size_t x_num;
+    size_t x_den;
+    size_t xs;
+    size_t y_num;
+    size_t y_den;
+    size_t ys;
+    size_t i;
+
+    akvcam_scaler_t self = kzalloc(sizeof(struct akvcam_scaler), GFP_KERNEL);
+    kref_init(&self->ref);
+    self->iwidth = iwidth;
+    self->iheight = iheight;
+    self->owidth = owidth;
+    self->oheight = oheight;
+    self->mode = mode;
+    self->aspect_ratio = aspect_ratio;
+    self->x_dst_min = 0;
+    self->y_dst_min = 0;
+    self->x_dst_max = owidth;
+    self->y_dst_max = oheight;
+    self->x_points = vzalloc(akvcam_max(owidth, 1) * sizeof(akvcam_scaler_point));
+    self->y_points = vzalloc(akvcam_max(oheight, 1) * sizeof(akvcam_scaler_point));
+
+    if (iwidth < 1 || iheight < 1 || owidth < 1 || oheight < 1)
+        return self;
+
+    // Same size, just copy the pixels.
+    if (iwidth == owidth && iheight == oheight) {
+        for (i = 0; i < owidth; i++) {
+            self->x_points[i].min = i;
+            self->x_points[i].max = i;
+        }
+
+        for (i = 0; i < oheight; i++) {
+            self->y_points[i].min = i;
+            self->y_points[i].max = i;
+        }
+
+        return self;
+    }
+
+    // Area averaging only makes sense when downscaling, otherwise use
+    // linear interpolation.
+    if (mode == AKVCAM_SCALING_AREA && owidth * oheight > iwidth * iheight)
+        mode = AKVCAM_SCALING_LINEAR;
+
+    self->area = mode == AKVCAM_SCALING_AREA;
+    self->bicubic = mode == AKVCAM_SCALING_BICUBIC;
+
+    if (aspect_ratio == AKVCAM_ASPECT_RATIO_KEEP) {
+        if (owidth * iheight > iwidth * oheight) {
+            // Right and left black bars
+            self->x_dst_min = (owidth * iheight - iwidth * oheight)
+                              / (2 * iheight);
+            self->x_dst_max = (owidth * iheight + iwidth * oheight)
+                              / (2 * iheight);
+        } else if (owidth * iheight < iwidth * oheight) {
+            // Top and bottom black bars
+            self->y_dst_min = (iwidth * oheight - owidth * iheight)
+                              / (2 * iwidth);
+            self->y_dst_max = (iwidth * oheight + owidth * iheight)
+                              / (2 * iwidth);
+        }
+    }
+
+    if (self->area || self->bicubic) {
+        size_t x_offset = 0;
+        size_t x_length = iwidth;
+        size_t y_offset = 0;
+        size_t y_length = iheight;
+        size_t x_ratio;
+        size_t y_ratio;
+
+        if (aspect_ratio == AKVCAM_ASPECT_RATIO_EXPANDING) {
+            if (owidth * iheight < iwidth * oheight) {
+                // Right and left cut
+                x_length = owidth * iheight / oheight;
+                x_offset = (iwidth - x_length) / 2;
+            } else if (owidth * iheight > iwidth * oheight) {
+                // Top and bottom cut
+                y_length = oheight * iwidth / owidth;
+                y_offset = (iheight - y_length) / 2;
+            }
+        }
+
+        if (self->bicubic) {
+            akvcam_scaler_fill_filter(&self->x_filter,
+                                      iwidth,
+                                      owidth,
+                                      self->x_dst_min,
+                                      self->x_dst_max,
+                                      x_offset,
+                                      x_length);
+            akvcam_scaler_fill_filter(&self->y_filter,
+                                      iheight,
+                                      oheight,
+                                      self->y_dst_min,
+                                      self->y_dst_max,
+                                      y_offset,
+                                      y_length);
+
+            return self;
+        }
+
+        x_ratio = akvcam_scaler_fill_area_points(self->x_points,
+                                                 iwidth,
+                                                 self->x_dst_min,
+                                                 self->x_dst_max,
+                                                 x_offset,
+                                                 x_length);
+        y_ratio = akvcam_scaler_fill_area_points(self->y_points,
+                                                 iheight,
+                                                 self->y_dst_min,
+                                                 self->y_dst_max,
+                                                 y_offset,
+                                                 y_length);
+
+        if (x_ratio == y_ratio && (x_ratio == 2 || x_ratio == 4))
+            self->area_ratio = x_ratio;
+
+        return self;
+    }
+
+    i_width = iwidth - 1;
+    i_height = iheight - 1;
+    o_width = self->x_dst_max - self->x_dst_min - 1;
+    o_height = self->y_dst_max - self->y_dst_min - 1;
+    x_num = i_width;
+    x_den = o_width;
+    xs = 0;
+    y_num = i_height;
+    y_den = o_height;
+    ys = 0;
+
+    if (aspect_ratio == AKVCAM_ASPECT_RATIO_EXPANDING) {
+        if (mode == AKVCAM_SCALING_LINEAR) {
+            i_width--;
+            i_height--;
+            o_width--;
+            o_height--;
+        }
+
+        if (owidth * iheight < iwidth * oheight) {
+            // Right and left cut
+            x_num = 2 * i_height;
+            x_den = 2 * o_height;
+            xs = i_width * o_height - o_width * i_height;
+        } else if (owidth * iheight > iwidth * oheight) {
+            // Top and bottom cut
+            y_num = 2 * i_width;
+            y_den = 2 * o_width;
+            ys = o_width * i_height - i_width * o_height;
+        }
+    }
+
+    akvcam_scaler_fill_points(self->x_points,
+                              iwidth,
+                              self->x_dst_min,
+                              self->x_dst_max,
+                              x_num,
+                              x_den,
+                              xs,
+                              mode);
+    akvcam_scaler_fill_points(self->y_points,
+                              iheight,
+                              self->y_dst_min,
+                              self->y_dst_max,
+                              y_num,
+                              y_den,
+                              ys,
+                              mode);
+
+    return self;
+}
+
+void akvcam_scaler_free(struct kref *ref)
+{
+    akvcam_scaler_t self = container_of(ref, struct akvcam_scaler, ref);
+
+    akvcam_scaler_delete(self->identity);
+    akvcam_scaler_delete(self->chroma);
+    vfree(self->y_filter.coeffs);
+    vfree(self->y_filter.indexes);
+    vfree(self->x_filter.coeffs);
+    vfree(self->x_filter.indexes);
+    vfree(self->y_points);
+    vfree(self->x_points);
+    kfree(self);
+}
+
+void akvcam_scaler_delete(akvcam_scaler_t self)
+{
+    if (self)
+        kref_put(&self->ref, akvcam_scaler_free);
+}
+
+akvcam_scaler_t akvcam_scaler_ref(akvcam_scaler_t self)
+{
+    if (self)
+        kref_get(&self->ref);
+
+    return self;
+}
+
+bool akvcam_scaler_matches(const akvcam_scaler_t self,
+                           size_t iwidth,
+                           size_t iheight,
+                           size_t owidth,
+                           size_t oheight,
+                           AKVCAM_SCALING mode,
+                           AKVCAM_ASPECT_RATIO aspect_ratio)
+{
+    return self
+           && self->iwidth == iwidth
+           && self->iheight == iheight
+           && self->owidth == owidth
+           && self->oheight == oheight
+           && self->mode == mode
+           && self->aspect_ratio == aspect_ratio;
+}
+
+size_t akvcam_scaler_x_dst_min(const akvcam_scaler_t self)
+{
+    return self->x_dst_min;
+}
+
+size_t akvcam_scaler_x_dst_max(const akvcam_scaler_t self)
+{
+    return self->x_dst_max;
+}
+
+size_t akvcam_scaler_y_dst_min(const akvcam_scaler_t self)
+{
+    return self->y_dst_min;
+}
+
+size_t akvcam_scaler_y_dst_max(const akvcam_scaler_t self)
+{
+    return self->y_dst_max;
+}
+
+bool akvcam_scaler_area(const akvcam_scaler_t self)
+{
+    return self->area;
+}
+
+size_t akvcam_scaler_area_ratio(const akvcam_scaler_t self)
+{
+    return self->area_ratio;
+}
+
+bool akvcam_scaler_bicubic(const akvcam_scaler_t self)
+{
+    return self->bicubic;
+}
+
+const akvcam_scaler_point *akvcam_scaler_x_points(const akvcam_scaler_t self)
+{
+    return self->x_points;
+}
+
+const akvcam_scaler_point *akvcam_scaler_y_points(const akvcam_scaler_t self)
+{
+    return self->y_points;
+}
+
+const akvcam_scaler_filter *akvcam_scaler_x_filter(const akvcam_scaler_t self)
+{
+    return &self->x_filter;
+}
+
+const akvcam_scaler_filter *akvcam_scaler_y_filter(const akvcam_scaler_t self)
+{
+    return &self->y_filter;
+}
+
+// The chroma scaler is created the first time it's requested, and then reused
+// for all the frames.
+akvcam_scaler_t akvcam_scaler_chroma(akvcam_scaler_t self)
+{
+    if (!self->chroma)
+        self->chroma = akvcam_scaler_new(self->iwidth / 2,
+                                         self->iheight,
+                                         self->owidth / 2,
+                                         self->oheight,
+                                         self->mode,
+                                         self->aspect_ratio);
+
+    return self->chroma;
+}
+
+// Same as the chroma scaler, created once and reused for all the frames.
+akvcam_scaler_t akvcam_scaler_identity(akvcam_scaler_t self)
+{
+    if (!self->identity)
+        self->identity = akvcam_scaler_new(self->iwidth,
+                                           self->iheight,
+                                           self->iwidth,
+                                           self->iheight,
+                                           AKVCAM_SCALING_FAST,
+                                           AKVCAM_ASPECT_RATIO_IGNORE);
+
+    return self->identity;
+}
+
+void akvcam_scaler_fill_points(akvcam_scaler_point_t points,
+                               size_t ilength,
+                               size_t dst_min,
+                               size_t dst_max,
+                               size_t num,
+                               size_t den,
+                               size_t s,
+                               AKVCAM_SCALING mode)
+{
+    akvcam_extrapolate_t extrapolate;
+    size_t i;
+    size_t k_num;
+    size_t k_den;
+
+    // Compare the real scaling factor instead of the frame sizes, the black
+    // bars and the cuts can turn an upscale into a downscale and
+    // akvcam_extrapolate_up will divide by zero when downscaling.
+    extrapolate = mode == AKVCAM_SCALING_LINEAR && num > 0 && num < den?
+                      &akvcam_extrapolate_up:
+                      &akvcam_extrapolate_down;
+
+    for (i = dst_min; i < dst_max; i++) {
+        // A single pixel wide output, take the first pixel.
+        if (den < 1) {
+            points[i].min = 0;
+            points[i].max = 0;
+            points[i].k = 0;
+
+            continue;
+        }
+
+        extrapolate(i - dst_min,
+                    num, den, s,
+                    &points[i].min, &points[i].max,
+                    &k_num, &k_den);
+        points[i].min = akvcam_min(points[i].min, ilength - 1);
+        points[i].max = akvcam_min(points[i].max, ilength - 1);
+        points[i].k = (uint32_t) ((k_num << AKVCAM_SCALER_SHIFT) / k_den);
+    }
+}
+
+// Fill the source pixels range covered by each output pixel, and return
+// the scaling ratio if it's the same integer for every pixel, or 0
+// otherwise.
+size_t akvcam_scaler_fill_area_points(akvcam_scaler_point_t points,
+                                      size_t ilength,
+                                      size_t dst_min,
+                                      size_t dst_max,
+                                      size_t src_offset,
+                                      size_t src_length)
+{
+    size_t olength = dst_max - dst_min;
+    size_t ratio = src_length % olength == 0? src_length / olength: 0;
+    size_t i;
+    size_t start;
+    size_t end;
+
+    if (src_offset > 0)
+        ratio = 0;
+
+    for (i = dst_min; i < dst_max; i++) {
+        start = src_offset + (i - dst_min) * src_length / olength;
+        end = src_offset + (i - dst_min + 1) * src_length / olength;
+        start = akvcam_min(start, ilength - 1);
+        end = akvcam_bound(start + 1, end, ilength);
+        points[i].min = start;
+        points[i].max = end - 1;
+        points[i].k = 0;
+    }
+
+    return ratio;
+}
+
+// Fill the polyphase filter table of one axis. Every output pixel is mapped
+// to the center of it's footprint in the source window, and the filter is
+// stretched when downscaling so all the source pixels contributes to the
+// output.
+void akvcam_scaler_fill_filter(akvcam_scaler_filter_t filter,
+                               size_t ilength,
+                               size_t olength,
+                               size_t dst_min,
+                               size_t dst_max,
+                               size_t src_offset,
+                               size_t src_length)
+{
+    const int64_t one = 1 << AKVCAM_SCALER_SHIFT;
+    size_t length = dst_max - dst_min;
+    size_t taps;
+    uint32_t scale;
+    size_t i;
+    size_t j;
+
+    // Kernel scale in 16.16 fixed point.
+    scale = (uint32_t) div_u64((uint64_t) src_length << AKVCAM_SCALER_SHIFT,
+                               (uint32_t) length);
+    scale = akvcam_bound((uint32_t) one,
+                         scale,
+                         (uint32_t) (AKVCAM_SCALER_FILTER_MAX_TAPS / 4) * one);
+    taps = 2 * (size_t) ((2 * scale + one - 1) >> AKVCAM_SCALER_SHIFT);
+    filter->taps = taps;
+    filter->indexes = vzalloc(olength * taps * sizeof(size_t));
+    filter->coeffs = vzalloc(olength * taps * sizeof(int32_t));
+
+    for (i = dst_min; i < dst_max; i++) {
+        size_t *indexes = filter->indexes + i * taps;
+        int32_t *coeffs = filter->coeffs + i * taps;
+        int64_t center;
+        int64_t first;
+        int32_t sum = 0;
+        int32_t total = 0;
+        size_t max_tap = 0;
+
+        center = (int64_t) src_offset * one
+                 + (int64_t) div_u64((2 * (uint64_t) (i - dst_min) + 1)
+                                     * src_length
+                                     * (uint64_t) one,
+                                     2 * (uint32_t) length)
+                 - one / 2;
+        first = (center >> AKVCAM_SCALER_SHIFT) - (int64_t) taps / 2 + 1;
+
+        for (j = 0; j < taps; j++) {
+            int64_t pos = first + (int64_t) j;
+            int64_t x = div_s64((pos * one - center) * one, (int32_t) scale);
+
+            coeffs[j] = akvcam_scaler_cubic(x);
+            indexes[j] = (size_t) akvcam_bound(0, pos, (int64_t) ilength - 1);
+            sum += coeffs[j];
+
+            if (coeffs[j] > coeffs[max_tap])
+                max_tap = j;
+        }
+
+        // Normalize the weights so they add exactly 1.
+        for (j = 0; j < taps; j++) {
+            coeffs[j] = (int32_t) div_s64((int64_t) coeffs[j]
+                                          * (1 << AKVCAM_SCALER_FILTER_SHIFT),
+                                          sum);
+            total += coeffs[j];
+        }
+
+        coeffs[max_tap] += (1 << AKVCAM_SCALER_FILTER_SHIFT) - total;
+    }
+}
+
+// Catmull-Rom spline, x is given in 16.16 fixed point and the returned
+// weight is scaled by AKVCAM_SCALER_FILTER_SHIFT.
+int32_t akvcam_scaler_cubic(int64_t x)
+{
+    const int64_t one = 1 << AKVCAM_SCALER_SHIFT;
+    int64_t x2;
+    int64_t x3;
+    int64_t w;
+
+    x = akvcam_abs(x);
+
+    if (x >= 2 * one)
+        return 0;
+
+    x2 = (x * x) >> AKVCAM_SCALER_SHIFT;
+    x3 = (x2 * x) >> AKVCAM_SCALER_SHIFT;
+
+    if (x < one)
+        // 1.5 x^3 - 2.5 x^2 + 1
+        w = (3 * x3 - 5 * x2 + 2 * one) >> 1;
+    else
+        // -0.5 x^3 + 2.5 x^2 - 4 x + 2
+        w = (-x3 + 5 * x2 - 8 * x + 4 * one) >> 1;
+
+    return (int32_t) (w >> (AKVCAM_SCALER_SHIFT - AKVCAM_SCALER_FILTER_SHIFT));
+}
+
+void akvcam_extrapolate_up(size_t dst_coord,
+                           size_t num, size_t den, size_t s,
+                           size_t *src_coord_min, size_t *src_coord_max,
+                           size_t *k_num, size_t *k_den)
+{
+    size_t dst_coord_min;
+    size_t dst_coord_max;
+    *src_coord_min = (num * dst_coord + s) / den;
+    *src_coord_max = *src_coord_min + 1;
+    dst_coord_min = (den * *src_coord_min - s) / num;
+    dst_coord_max = (den * *src_coord_max - s) / num;
+    *k_num = dst_coord - dst_coord_min;
+    *k_den = dst_coord_max - dst_coord_min;
+}
+
+void akvcam_extrapolate_down(size_t dst_coord,
+                             size_t num, size_t den, size_t s,
+                             size_t *src_coord_min, size_t *src_coord_max,
+                             size_t *k_num, size_t *k_den)
+{
+    *src_coord_min = (num * dst_coord + s) / den;
+    *src_coord_max = *src_coord_min;
+    *k_num = 0;
+    *k_den = 1;
+}
+
@@ -0,0 +1,85 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_SCALER_H
+#define AKVCAM_SCALER_H
+
+#include <linux/types.h>
+
+#include "frame_types.h"
+
+// Precision of the interpolation weights.
+#define AKVCAM_SCALER_SHIFT 16
+
+// Precision of the polyphase filter coefficients.
+#define AKVCAM_SCALER_FILTER_SHIFT 14
+
+// Maximum number of taps of the polyphase filter.
+#define AKVCAM_SCALER_FILTER_MAX_TAPS 16
+
+struct akvcam_scaler;
+typedef struct akvcam_scaler *akvcam_scaler_t;
+
+typedef struct
+{
+    size_t min;
+    size_t max;
+    uint32_t k;
+} akvcam_scaler_point, *akvcam_scaler_point_t;
+
+// For each output pixel, the 'taps' source pixels that contributes to it and
+// it's weights.
+typedef struct
+{
+    size_t taps;
+    size_t *indexes;
+    int32_t *coeffs;
+} akvcam_scaler_filter, *akvcam_scaler_filter_t;
+
+// public
+akvcam_scaler_t akvcam_scaler_new(size_t iwidth,
+                                  size_t iheight,
+                                  size_t owidth,
+                                  size_t oheight,
+                                  AKVCAM_SCALING mode,
+                                  AKVCAM_ASPECT_RATIO aspect_ratio);
+void akvcam_scaler_delete(akvcam_scaler_t self);
+akvcam_scaler_t akvcam_scaler_ref(akvcam_scaler_t self);
+
+bool akvcam_scaler_matches(const akvcam_scaler_t self,
+                           size_t iwidth,
+                           size_t iheight,
+                           size_t owidth,
+                           size_t oheight,
+                           AKVCAM_SCALING mode,
+                           AKVCAM_ASPECT_RATIO aspect_ratio);
+size_t akvcam_scaler_x_dst_min(const akvcam_scaler_t self);
+size_t akvcam_scaler_x_dst_max(const akvcam_scaler_t self);
+size_t akvcam_scaler_y_dst_min(const akvcam_scaler_t self);
+size_t akvcam_scaler_y_dst_max(const akvcam_scaler_t self);
+bool akvcam_scaler_area(const akvcam_scaler_t self);
+size_t akvcam_scaler_area_ratio(const akvcam_scaler_t self);
+bool akvcam_scaler_bicubic(const akvcam_scaler_t self);
+const akvcam_scaler_point *akvcam_scaler_x_points(const akvcam_scaler_t self);
+const akvcam_scaler_point *akvcam_scaler_y_points(const akvcam_scaler_t self);
+const akvcam_scaler_filter *akvcam_scaler_x_filter(const akvcam_scaler_t self);
+const akvcam_scaler_filter *akvcam_scaler_y_filter(const akvcam_scaler_t self);
+akvcam_scaler_t akvcam_scaler_chroma(akvcam_scaler_t self);
+akvcam_scaler_t akvcam_scaler_identity(akvcam_scaler_t self);
+
+#endif // AKVCAM_SCALER_H
@@ -0,0 +1,687 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// KUnit tests for the list, map and ring buffer containers.
+//
+// Build the tests module against a kernel with CONFIG_KUNIT, and load it:
+//
+//     make CONFIG_AKVCAM_KUNIT_TEST=m
+//     insmod akvcam_test.ko
+//
+// The results are written to the kernel log, and to
+// /sys/kernel/debug/kunit/<suite>/results when debugfs is enabled.
+//
+// The *_timings cases always pass, they just report how long the common
+// operations take with sizes similar to the ones used by the driver.
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#include "../list.h"
+#include "../map.h"
+#include "../rbuffer.h"
+
+#define AKVCAM_TEST_LIST_SIZE 1024
+#define AKVCAM_TEST_MAP_SIZE 256
+#define AKVCAM_TEST_EVENT_SIZE 136
+#define AKVCAM_TEST_EVENTS 64
+#define AKVCAM_TEST_FRAME_SIZE (640 * 480 * 2)
+#define AKVCAM_TEST_FRAMES 4
+#define AKVCAM_TEST_ROUNDS 64
+
+static int akvcam_test_deleted;
+
+static bool akvcam_test_int_equals(const int *element_data, const int *data)
+{
+    return *element_data == *data;
+}
+
+static int *akvcam_test_int_copy(const int *data)
+{
+    return kmemdup(data, sizeof(int), GFP_KERNEL);
+}
+
+static void akvcam_test_int_delete(int *data)
+{
+    akvcam_test_deleted++;
+    kfree(data);
+}
+
+static void akvcam_test_report(struct kunit *test,
+                               const char *operation,
+                               u64 ns,
+                               size_t count)
+{
+    kunit_info(test,
+               "%s: %llu ns, %llu ns/op\n",
+               operation,
+               ns,
+               div_u64(ns, count? count: 1));
+}
+
+// List
+
+static void akvcam_test_list_push_back(struct kunit *test)
+{
+    static int values[] = {1, 2, 3, 4, 5};
+    akvcam_list_t list = akvcam_list_new();
+    size_t i;
+
+    KUNIT_EXPECT_TRUE(test, akvcam_list_empty(list));
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_list_front(list), NULL);
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_list_back(list), NULL);
+
+    for (i = 0; i < ARRAY_SIZE(values); i++)
+        KUNIT_EXPECT_NOT_ERR_OR_NULL(test,
+                                     akvcam_list_push_back(list,
+                                                           values + i,
+                                                           NULL,
+                                                           NULL));
+
+    KUNIT_EXPECT_EQ(test, akvcam_list_size(list), ARRAY_SIZE(values));
+    KUNIT_EXPECT_FALSE(test, akvcam_list_empty(list));
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_list_front(list), (void *) values);
+    KUNIT_EXPECT_PTR_EQ(test,
+                        akvcam_list_back(list),
+                        (void *) (values + ARRAY_SIZE(values) - 1));
+    akvcam_list_delete(list);
+}
+
+static void akvcam_test_list_at(struct kunit *test)
+{
+    static int values[] = {10, 20, 30, 40};
+    akvcam_list_t list = akvcam_list_new();
+    akvcam_list_element_t it = NULL;
+    void *data;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(values); i++)
+        akvcam_list_push_back(list, values + i, NULL, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(values); i++) {
+        KUNIT_EXPECT_PTR_EQ(test, akvcam_list_at(list, i), (void *) (values + i));
+        KUNIT_EXPECT_PTR_EQ(test,
+                            akvcam_list_element_data(akvcam_list_it(list, i)),
+                            (void *) (values + i));
+    }
+
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_list_at(list, ARRAY_SIZE(values)), NULL);
+    KUNIT_EXPECT_PTR_EQ(test,
+                        (void *) akvcam_list_it(list, ARRAY_SIZE(values)),
+                        NULL);
+
+    for (i = 0;; i++) {
+        data = akvcam_list_next(list, &it);
+
+        if (!it)
+            break;
+
+        KUNIT_EXPECT_PTR_EQ(test, data, (void *) (values + i));
+    }
+
+    KUNIT_EXPECT_EQ(test, i, ARRAY_SIZE(values));
+    akvcam_list_delete(list);
+}
+
+static void akvcam_test_list_erase(struct kunit *test)
+{
+    static int values[] = {1, 2, 3, 4, 5};
+    static int expected[] = {2, 4};
+    akvcam_list_t list = akvcam_list_new();
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(values); i++)
+        akvcam_list_push_back(list, values + i, NULL, NULL);
+
+    // Remove the head, the tail and an element in the middle.
+    akvcam_list_erase(list, akvcam_list_it(list, 0));
+    akvcam_list_erase(list, akvcam_list_it(list, 3));
+    akvcam_list_erase(list, akvcam_list_it(list, 1));
+    KUNIT_ASSERT_EQ(test, akvcam_list_size(list), ARRAY_SIZE(expected));
+
+    for (i = 0; i < ARRAY_SIZE(expected); i++)
+        KUNIT_EXPECT_EQ(test, *(int *) akvcam_list_at(list, i), expected[i]);
+
+    KUNIT_EXPECT_EQ(test, *(int *) akvcam_list_front(list), expected[0]);
+    KUNIT_EXPECT_EQ(test,
+                    *(int *) akvcam_list_back(list),
+                    expected[ARRAY_SIZE(expected) - 1]);
+
+    akvcam_list_clear(list);
+    KUNIT_EXPECT_TRUE(test, akvcam_list_empty(list));
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_list_front(list), NULL);
+    akvcam_list_delete(list);
+}
+
+static void akvcam_test_list_find(struct kunit *test)
+{
+    static int values[] = {7, 3, 9, 3};
+    int missing = 5;
+    akvcam_list_t list = akvcam_list_new();
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(values); i++)
+        akvcam_list_push_back(list, values + i, NULL, NULL);
+
+    // The first match wins.
+    KUNIT_EXPECT_EQ(test,
+                    akvcam_list_index_of(list,
+                                         values + 1,
+                                         (akvcam_are_equals_t) akvcam_test_int_equals),
+                    (ssize_t) 1);
+    KUNIT_EXPECT_PTR_EQ(test,
+                        akvcam_list_element_data(akvcam_list_find(list,
+                                                                  values + 3,
+                                                                  (akvcam_are_equals_t) akvcam_test_int_equals)),
+                        (void *) (values + 1));
+    KUNIT_EXPECT_TRUE(test,
+                      akvcam_list_contains(list,
+                                           values + 2,
+                                           (akvcam_are_equals_t) akvcam_test_int_equals));
+    KUNIT_EXPECT_EQ(test,
+                    akvcam_list_index_of(list,
+                                         &missing,
+                                         (akvcam_are_equals_t) akvcam_test_int_equals),
+                    (ssize_t) -1);
+    KUNIT_EXPECT_FALSE(test,
+                       akvcam_list_contains(list,
+                                            &missing,
+                                            (akvcam_are_equals_t) akvcam_test_int_equals));
+    akvcam_list_delete(list);
+}
+
+static void akvcam_test_list_copy(struct kunit *test)
+{
+    static int values[] = {1, 2, 3};
+    akvcam_list_t list = akvcam_list_new();
+    akvcam_list_t copy;
+    size_t i;
+
+    akvcam_test_deleted = 0;
+
+    for (i = 0; i < ARRAY_SIZE(values); i++)
+        akvcam_list_push_back(list,
+                              values + i,
+                              (akvcam_copy_t) akvcam_test_int_copy,
+                              (akvcam_delete_t) akvcam_test_int_delete);
+
+    // The elements are copied, not shared.
+    KUNIT_EXPECT_PTR_NE(test, akvcam_list_at(list, 0), (void *) values);
+    KUNIT_EXPECT_EQ(test, *(int *) akvcam_list_at(list, 0), values[0]);
+
+    copy = akvcam_list_new_copy(list);
+    akvcam_list_append(copy, list);
+    KUNIT_ASSERT_EQ(test, akvcam_list_size(copy), 2 * ARRAY_SIZE(values));
+
+    for (i = 0; i < akvcam_list_size(copy); i++) {
+        KUNIT_EXPECT_EQ(test,
+                        *(int *) akvcam_list_at(copy, i),
+                        values[i % ARRAY_SIZE(values)]);
+        KUNIT_EXPECT_PTR_NE(test,
+                            akvcam_list_at(copy, i),
+                            akvcam_list_at(list, i % ARRAY_SIZE(values)));
+    }
+
+    akvcam_list_erase(copy, akvcam_list_it(copy, 0));
+    KUNIT_EXPECT_EQ(test, akvcam_test_deleted, 1);
+    akvcam_list_delete(copy);
+    KUNIT_EXPECT_EQ(test, akvcam_test_deleted, 2 * (int) ARRAY_SIZE(values));
+    akvcam_list_delete(list);
+    KUNIT_EXPECT_EQ(test, akvcam_test_deleted, 3 * (int) ARRAY_SIZE(values));
+}
+
+static void akvcam_test_list_timings(struct kunit *test)
+{
+    int *values = kcalloc(AKVCAM_TEST_LIST_SIZE, sizeof(int), GFP_KERNEL);
+    akvcam_list_t list = akvcam_list_new();
+    akvcam_list_element_t it = NULL;
+    size_t i;
+    u64 start;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, values);
+
+    for (i = 0; i < AKVCAM_TEST_LIST_SIZE; i++)
+        values[i] = (int) i;
+
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_LIST_SIZE; i++)
+        akvcam_list_push_back(list, values + i, NULL, NULL);
+
+    akvcam_test_report(test,
+                       "list push_back",
+                       ktime_get_ns() - start,
+                       AKVCAM_TEST_LIST_SIZE);
+
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_LIST_SIZE; i++)
+        KUNIT_EXPECT_PTR_EQ(test, akvcam_list_at(list, i), (void *) (values + i));
+
+    akvcam_test_report(test,
+                       "list at",
+                       ktime_get_ns() - start,
+                       AKVCAM_TEST_LIST_SIZE);
+
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_LIST_SIZE; i++)
+        akvcam_list_next(list, &it);
+
+    akvcam_test_report(test,
+                       "list next",
+                       ktime_get_ns() - start,
+                       AKVCAM_TEST_LIST_SIZE);
+
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_LIST_SIZE; i += AKVCAM_TEST_LIST_SIZE / 16)
+        KUNIT_EXPECT_EQ(test,
+                        akvcam_list_index_of(list,
+                                             values + i,
+                                             (akvcam_are_equals_t) akvcam_test_int_equals),
+                        (ssize_t) i);
+
+    akvcam_test_report(test, "list index_of", ktime_get_ns() - start, 16);
+    akvcam_list_delete(list);
+    kfree(values);
+}
+
+// Map
+
+static void akvcam_test_map_value(struct kunit *test)
+{
+    static int values[] = {1, 2, 3};
+    akvcam_map_t map = akvcam_map_new();
+
+    KUNIT_EXPECT_TRUE(test, akvcam_map_empty(map));
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_map_value(map, "missing"), NULL);
+
+    akvcam_map_set_value(map, "one", values, NULL, NULL);
+    akvcam_map_set_value(map, "two", values + 1, NULL, NULL);
+    akvcam_map_set_value(map, "three", values + 2, NULL, NULL);
+
+    KUNIT_EXPECT_EQ(test, akvcam_map_size(map), (size_t) 3);
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_map_value(map, "one"), (void *) values);
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_map_value(map, "two"), (void *) (values + 1));
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_map_value(map, "three"), (void *) (values + 2));
+    KUNIT_EXPECT_TRUE(test, akvcam_map_contains(map, "two"));
+    KUNIT_EXPECT_FALSE(test, akvcam_map_contains(map, "four"));
+
+    // Replacing a value keeps the size.
+    akvcam_map_set_value(map, "two", values, NULL, NULL);
+    KUNIT_EXPECT_EQ(test, akvcam_map_size(map), (size_t) 3);
+    KUNIT_EXPECT_PTR_EQ(test, akvcam_map_value(map, "two"), (void *) values);
+
+    akvcam_map_erase(map, akvcam_map_it(map, "one"));
+    KUNIT_EXPECT_EQ(test, akvcam_map_size(map), (size_t) 2);
+    KUNIT_EXPECT_FALSE(test, akvcam_map_contains(map, "one"));
+
+    akvcam_map_clear(map);
+    KUNIT_EXPECT_TRUE(test, akvcam_map_empty(map));
+    akvcam_map_delete(map);
+}
+
+static void akvcam_test_map_replace(struct kunit *test)
+{
+    int value = 1;
+    akvcam_map_t map = akvcam_map_new();
+
+    akvcam_test_deleted = 0;
+    akvcam_map_set_value(map,
+                         "key",
+                         &value,
+                         (akvcam_copy_t) akvcam_test_int_copy,
+                         (akvcam_delete_t) akvcam_test_int_delete);
+    value = 2;
+    akvcam_map_set_value(map,
+                         "key",
+                         &value,
+                         (akvcam_copy_t) akvcam_test_int_copy,
+                         (akvcam_delete_t) akvcam_test_int_delete);
+
+    // The replaced value must be released.
+    KUNIT_EXPECT_EQ(test, akvcam_test_deleted, 1);
+    KUNIT_EXPECT_EQ(test, *(int *) akvcam_map_value(map, "key"), 2);
+    akvcam_map_delete(map);
+    KUNIT_EXPECT_EQ(test, akvcam_test_deleted, 2);
+}
+
+static void akvcam_test_map_next(struct kunit *test)
+{
+    static const char *keys[] = {"a", "b", "c", "d", "e"};
+    akvcam_map_t map = akvcam_map_new();
+    akvcam_map_t copy;
+    akvcam_map_element_t element = NULL;
+    akvcam_list_t key_list;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(keys); i++)
+        akvcam_map_set_value(map, keys[i], (void *) keys[i], NULL, NULL);
+
+    // The elements are visited in insertion order.
+    for (i = 0; akvcam_map_next(map, &element); i++) {
+        KUNIT_ASSERT_LT(test, i, ARRAY_SIZE(keys));
+        KUNIT_EXPECT_STREQ(test, akvcam_map_element_key(element), keys[i]);
+        KUNIT_EXPECT_PTR_EQ(test,
+                            akvcam_map_element_value(element),
+                            (void *) keys[i]);
+    }
+
+    KUNIT_EXPECT_EQ(test, i, ARRAY_SIZE(keys));
+
+    key_list = akvcam_map_keys(map);
+    KUNIT_ASSERT_EQ(test, akvcam_list_size(key_list), ARRAY_SIZE(keys));
+
+    for (i = 0; i < ARRAY_SIZE(keys); i++)
+        KUNIT_EXPECT_STREQ(test,
+                           (char *) akvcam_list_at(key_list, i),
+                           keys[i]);
+
+    akvcam_list_delete(key_list);
+
+    copy = akvcam_map_new_copy(map);
+    KUNIT_EXPECT_EQ(test, akvcam_map_size(copy), ARRAY_SIZE(keys));
+
+    for (i = 0; i < ARRAY_SIZE(keys); i++)
+        KUNIT_EXPECT_PTR_EQ(test,
+                            akvcam_map_value(copy, keys[i]),
+                            (void *) keys[i]);
+
+    akvcam_map_delete(copy);
+    akvcam_map_delete(map);
+}
+
+static void akvcam_test_map_timings(struct kunit *test)
+{
+    char key[32];
+    akvcam_map_t map = akvcam_map_new();
+    size_t i;
+    u64 start;
+
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_MAP_SIZE; i++) {
+        snprintf(key, 32, "cameras/%zu/formats", i);
+        akvcam_map_set_value(map, key, (void *) (i + 1), NULL, NULL);
+    }
+
+    akvcam_test_report(test,
+                       "map set_value",
+                       ktime_get_ns() - start,
+                       AKVCAM_TEST_MAP_SIZE);
+
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_MAP_SIZE; i++) {
+        snprintf(key, 32, "cameras/%zu/formats", i);
+        KUNIT_EXPECT_PTR_EQ(test, akvcam_map_value(map, key), (void *) (i + 1));
+    }
+
+    akvcam_test_report(test,
+                       "map value",
+                       ktime_get_ns() - start,
+                       AKVCAM_TEST_MAP_SIZE);
+    akvcam_map_delete(map);
+}
+
+// Ring buffer
+
+static void akvcam_test_rbuffer_queue_bytes(struct kunit *test)
+{
+    akvcam_rbuffer_t rbuffer = akvcam_rbuffer_new();
+    char data[8];
+    size_t size;
+
+    akvcam_rbuffer_resize(rbuffer, 8, 1, AKVCAM_MEMORY_TYPE_KMALLOC);
+    KUNIT_EXPECT_TRUE(test, akvcam_rbuffer_data_empty(rbuffer));
+    akvcam_rbuffer_queue_bytes(rbuffer, "abc", 3);
+    akvcam_rbuffer_queue_bytes(rbuffer, "de", 2);
+    KUNIT_EXPECT_EQ(test, akvcam_rbuffer_data_size(rbuffer), (size_t) 5);
+    KUNIT_EXPECT_EQ(test,
+                    akvcam_rbuffer_available_data_size(rbuffer),
+                    (ssize_t) 3);
+
+    size = 4;
+    KUNIT_EXPECT_NOT_ERR_OR_NULL(test,
+                                 akvcam_rbuffer_dequeue_bytes(rbuffer,
+                                                              data,
+                                                              &size,
+                                                              false));
+    KUNIT_EXPECT_EQ(test, size, (size_t) 4);
+    KUNIT_EXPECT_EQ(test, memcmp(data, "abcd", 4), 0);
+
+    // Asking for more than available returns what is there.
+    size = 8;
+    akvcam_rbuffer_dequeue_bytes(rbuffer, data, &size, false);
+    KUNIT_EXPECT_EQ(test, size, (size_t) 1);
+    KUNIT_EXPECT_EQ(test, data[0], (char) 'e');
+    KUNIT_EXPECT_TRUE(test, akvcam_rbuffer_data_empty(rbuffer));
+
+    size = 8;
+    KUNIT_EXPECT_PTR_EQ(test,
+                        akvcam_rbuffer_dequeue_bytes(rbuffer,
+                                                     data,
+                                                     &size,
+                                                     false),
+                        NULL);
+    akvcam_rbuffer_delete(rbuffer);
+}
+
+static void akvcam_test_rbuffer_wraparound(struct kunit *test)
+{
+    akvcam_rbuffer_t rbuffer = akvcam_rbuffer_new();
+    char data[8];
+    size_t size;
+
+    akvcam_rbuffer_resize(rbuffer, 8, 1, AKVCAM_MEMORY_TYPE_KMALLOC);
+
+    // Move the read and write positions near the end of the buffer.
+    akvcam_rbuffer_queue_bytes(rbuffer, "abcdef", 6);
+    size = 5;
+    akvcam_rbuffer_dequeue_bytes(rbuffer, data, &size, false);
+
+    // This write wraps around the end of the buffer.
+    akvcam_rbuffer_queue_bytes(rbuffer, "ghijk", 5);
+    KUNIT_EXPECT_EQ(test, akvcam_rbuffer_data_size(rbuffer), (size_t) 6);
+
+    // And so does this read.
+    size = 8;
+    akvcam_rbuffer_dequeue_bytes(rbuffer, data, &size, false);
+    KUNIT_EXPECT_EQ(test, size, (size_t) 6);
+    KUNIT_EXPECT_EQ(test, memcmp(data, "fghijk", 6), 0);
+    KUNIT_EXPECT_TRUE(test, akvcam_rbuffer_data_empty(rbuffer));
+    akvcam_rbuffer_delete(rbuffer);
+}
+
+static void akvcam_test_rbuffer_overflow(struct kunit *test)
+{
+    akvcam_rbuffer_t rbuffer = akvcam_rbuffer_new();
+    char data[8];
+    size_t size;
+
+    akvcam_rbuffer_resize(rbuffer, 8, 1, AKVCAM_MEMORY_TYPE_KMALLOC);
+    akvcam_rbuffer_queue_bytes(rbuffer, "abcdef", 6);
+    size = 1;
+    akvcam_rbuffer_dequeue_bytes(rbuffer, data, &size, false);
+
+    // There is space for 3 bytes, so the 2 oldest ones are overwritten.
+    akvcam_rbuffer_queue_bytes(rbuffer, "WXYZA", 5);
+    KUNIT_EXPECT_TRUE(test, akvcam_rbuffer_data_full(rbuffer));
+    size = 8;
+    akvcam_rbuffer_dequeue_bytes(rbuffer, data, &size, false);
+    KUNIT_EXPECT_EQ(test, size, (size_t) 8);
+    KUNIT_EXPECT_EQ(test, memcmp(data, "defWXYZA", 8), 0);
+
+    // Writing more than the whole buffer keeps its first bytes.
+    akvcam_rbuffer_queue_bytes(rbuffer, "0123456789", 10);
+    size = 8;
+    akvcam_rbuffer_dequeue_bytes(rbuffer, data, &size, false);
+    KUNIT_EXPECT_EQ(test, size, (size_t) 8);
+    KUNIT_EXPECT_EQ(test, memcmp(data, "01234567", 8), 0);
+    akvcam_rbuffer_delete(rbuffer);
+}
+
+static void akvcam_test_rbuffer_elements(struct kunit *test)
+{
+    akvcam_rbuffer_t rbuffer = akvcam_rbuffer_new();
+    ssize_t offset;
+    int value;
+    int i;
+
+    akvcam_rbuffer_resize(rbuffer, 4, sizeof(int), AKVCAM_MEMORY_TYPE_VMALLOC);
+    KUNIT_EXPECT_EQ(test, akvcam_rbuffer_n_elements(rbuffer), (size_t) 4);
+    KUNIT_EXPECT_TRUE(test, akvcam_rbuffer_elements_empty(rbuffer));
+
+    // Only the last 4 elements are kept.
+    for (i = 0; i < 6; i++)
+        akvcam_rbuffer_queue(rbuffer, &i);
+
+    KUNIT_EXPECT_TRUE(test, akvcam_rbuffer_elements_full(rbuffer));
+    KUNIT_EXPECT_EQ(test, akvcam_rbuffer_n_data(rbuffer), (size_t) 4);
+    KUNIT_EXPECT_EQ(test, *(int *) akvcam_rbuffer_ptr_front(rbuffer), 2);
+
+    for (i = 0; i < 4; i++)
+        KUNIT_EXPECT_EQ(test, *(int *) akvcam_rbuffer_ptr_at(rbuffer, i), i + 2);
+
+    value = 4;
+    KUNIT_EXPECT_NOT_ERR_OR_NULL(test,
+                                 akvcam_rbuffer_find(rbuffer,
+                                                     &value,
+                                                     (akvcam_are_equals_t) akvcam_test_int_equals,
+                                                     &offset));
+    KUNIT_EXPECT_EQ(test, offset, (ssize_t) 2);
+
+    // Growing the buffer keeps the queued elements in order.
+    akvcam_rbuffer_resize(rbuffer, 8, sizeof(int), AKVCAM_MEMORY_TYPE_VMALLOC);
+    KUNIT_EXPECT_EQ(test, akvcam_rbuffer_n_data(rbuffer), (size_t) 4);
+
+    for (i = 0; i < 4; i++) {
+        KUNIT_EXPECT_NOT_ERR_OR_NULL(test,
+                                     akvcam_rbuffer_dequeue(rbuffer,
+                                                            &value,
+                                                            false));
+        KUNIT_EXPECT_EQ(test, value, i + 2);
+    }
+
+    KUNIT_EXPECT_TRUE(test, akvcam_rbuffer_elements_empty(rbuffer));
+    akvcam_rbuffer_delete(rbuffer);
+}
+
+static void akvcam_test_rbuffer_timings(struct kunit *test)
+{
+    akvcam_rbuffer_t rbuffer = akvcam_rbuffer_new();
+    char *data = vzalloc(AKVCAM_TEST_FRAME_SIZE);
+    size_t size;
+    size_t i;
+    u64 start;
+
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, data);
+
+    // Events queue.
+    akvcam_rbuffer_resize(rbuffer,
+                          AKVCAM_TEST_EVENTS,
+                          AKVCAM_TEST_EVENT_SIZE,
+                          AKVCAM_MEMORY_TYPE_KMALLOC);
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_ROUNDS * AKVCAM_TEST_EVENTS; i++) {
+        akvcam_rbuffer_queue(rbuffer, data);
+        akvcam_rbuffer_dequeue(rbuffer, data, false);
+    }
+
+    akvcam_test_report(test,
+                       "rbuffer queue+dequeue event",
+                       ktime_get_ns() - start,
+                       AKVCAM_TEST_ROUNDS * AKVCAM_TEST_EVENTS);
+
+    // Read/write frames queue.
+    akvcam_rbuffer_resize(rbuffer, 0, 0, AKVCAM_MEMORY_TYPE_VMALLOC);
+    akvcam_rbuffer_resize(rbuffer,
+                          AKVCAM_TEST_FRAMES,
+                          AKVCAM_TEST_FRAME_SIZE,
+                          AKVCAM_MEMORY_TYPE_VMALLOC);
+    start = ktime_get_ns();
+
+    for (i = 0; i < AKVCAM_TEST_ROUNDS; i++) {
+        akvcam_rbuffer_queue_bytes(rbuffer, data, AKVCAM_TEST_FRAME_SIZE);
+        size = AKVCAM_TEST_FRAME_SIZE;
+        akvcam_rbuffer_dequeue_bytes(rbuffer, data, &size, false);
+    }
+
+    akvcam_test_report(test,
+                       "rbuffer queue+dequeue frame",
+                       ktime_get_ns() - start,
+                       AKVCAM_TEST_ROUNDS);
+
+    vfree(data);
+    akvcam_rbuffer_delete(rbuffer);
+}
+
+static struct kunit_case akvcam_test_list_cases[] = {
+    KUNIT_CASE(akvcam_test_list_push_back),
+    KUNIT_CASE(akvcam_test_list_at),
+    KUNIT_CASE(akvcam_test_list_erase),
+    KUNIT_CASE(akvcam_test_list_find),
+    KUNIT_CASE(akvcam_test_list_copy),
+    KUNIT_CASE(akvcam_test_list_timings),
+    {}
+};
+
+static struct kunit_case akvcam_test_map_cases[] = {
+    KUNIT_CASE(akvcam_test_map_value),
+    KUNIT_CASE(akvcam_test_map_replace),
+    KUNIT_CASE(akvcam_test_map_next),
+    KUNIT_CASE(akvcam_test_map_timings),
+    {}
+};
+
+static struct kunit_case akvcam_test_rbuffer_cases[] = {
+    KUNIT_CASE(akvcam_test_rbuffer_queue_bytes),
+    KUNIT_CASE(akvcam_test_rbuffer_wraparound),
+    KUNIT_CASE(akvcam_test_rbuffer_overflow),
+    KUNIT_CASE(akvcam_test_rbuffer_elements),
+    KUNIT_CASE(akvcam_test_rbuffer_timings),
+    {}
+};
+
+static struct kunit_suite akvcam_test_list_suite = {
+    .name = "akvcam-list",
+    .test_cases = akvcam_test_list_cases,
+};
+
+static struct kunit_suite akvcam_test_map_suite = {
+    .name = "akvcam-map",
+    .test_cases = akvcam_test_map_cases,
+};
+
+static struct kunit_suite akvcam_test_rbuffer_suite = {
+    .name = "akvcam-rbuffer",
+    .test_cases = akvcam_test_rbuffer_cases,
+};
+
+kunit_test_suites(&akvcam_test_list_suite,
+                  &akvcam_test_map_suite,
+                  &akvcam_test_rbuffer_suite);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Gonzalo Exequiel Pedone");
+MODULE_DESCRIPTION("akvcam containers tests");
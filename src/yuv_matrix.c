@@ -0,0 +1,162 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <linux/math64.h>
+#include <linux/videodev2.h>
+
+#include "yuv_matrix.h"
+#include "format.h"
+
+// Luma weights of the red and blue components, multiplied by 10000.
+typedef struct
+{
+    s64 kr;
+    s64 kb;
+} akvcam_yuv_matrix_weights, *akvcam_yuv_matrix_weights_t;
+
+// BT.601 and BT.709.
+static const akvcam_yuv_matrix_weights akvcam_yuv_matrix_weights_list[] = {
+    {2990, 1140},
+    {2126,  722},
+};
+
+// One matrix for each encoding, in limited and full range.
+static akvcam_yuv_matrix akvcam_yuv_matrices[4];
+
+s64 akvcam_yuv_matrix_div(s64 num, s64 den);
+void akvcam_yuv_matrix_build(akvcam_yuv_matrix_t self,
+                             const akvcam_yuv_matrix_weights *weights,
+                             bool full_range);
+
+void akvcam_yuv_matrix_init(void)
+{
+    size_t i;
+
+    for (i = 0; i < 4; i++)
+        akvcam_yuv_matrix_build(akvcam_yuv_matrices + i,
+                                akvcam_yuv_matrix_weights_list + i / 2,
+                                i % 2 != 0);
+}
+
+// BT.601 in limited range, what the driver always used before.
+const akvcam_yuv_matrix *akvcam_yuv_matrix_default(void)
+{
+    return akvcam_yuv_matrices;
+}
+
+const akvcam_yuv_matrix *akvcam_yuv_matrix_from_format(const akvcam_format_t format)
+{
+    size_t i = 0;
+
+    if (akvcam_format_ycbcr_enc(format) == V4L2_YCBCR_ENC_709)
+        i += 2;
+
+    if (akvcam_format_quantization(format) == V4L2_QUANTIZATION_FULL_RANGE)
+        i++;
+
+    return akvcam_yuv_matrices + i;
+}
+
+// Rounds to the nearest integer.
+s64 akvcam_yuv_matrix_div(s64 num, s64 den)
+{
+    if (num < 0)
+        return -div64_s64(den / 2 - num, den);
+
+    return div64_s64(num + den / 2, den);
+}
+
+void akvcam_yuv_matrix_build(akvcam_yuv_matrix_t self,
+                             const akvcam_yuv_matrix_weights *weights,
+                             bool full_range)
+{
+    s64 one = 1 << AKVCAM_YUV_MATRIX_SHIFT;
+    s64 kr = weights->kr;
+    s64 kb = weights->kb;
+    s64 kg = 10000 - kr - kb;
+
+    // Levels used for the luma and the chroma, out of 255.
+    s64 y_levels = full_range? 255: 219;
+    s64 uv_levels = full_range? 255: 224;
+    int32_t y_round = 1 << (AKVCAM_YUV_MATRIX_SHIFT - 1);
+    int32_t uv_offset = 128 << AKVCAM_YUV_MATRIX_SHIFT;
+    int32_t ky;
+    int32_t kr_v;
+    int32_t kg_u;
+    int32_t kg_v;
+    int32_t kb_u;
+    int i;
+    int j;
+
+    // The green coefficients are taken from the other two, so that white
+    // gets the highest luma and the grays have no chroma.
+    self->coeffs[0][0] = (int16_t) akvcam_yuv_matrix_div(kr * y_levels * one,
+                                                         10000 * 255);
+    self->coeffs[0][2] = (int16_t) akvcam_yuv_matrix_div(kb * y_levels * one,
+                                                         10000 * 255);
+    self->coeffs[0][1] =
+            (int16_t) (akvcam_yuv_matrix_div(y_levels * one, 255)
+                       - self->coeffs[0][0]
+                       - self->coeffs[0][2]);
+    self->coeffs[1][0] =
+            (int16_t) -akvcam_yuv_matrix_div(kr * uv_levels * one,
+                                             2 * (10000 - kb) * 255);
+    self->coeffs[1][2] = (int16_t) akvcam_yuv_matrix_div(uv_levels * one,
+                                                         2 * 255);
+    self->coeffs[1][1] = (int16_t) (-self->coeffs[1][0] - self->coeffs[1][2]);
+    self->coeffs[2][0] = self->coeffs[1][2];
+    self->coeffs[2][2] =
+            (int16_t) -akvcam_yuv_matrix_div(kb * uv_levels * one,
+                                             2 * (10000 - kr) * 255);
+    self->coeffs[2][1] = (int16_t) (-self->coeffs[2][0] - self->coeffs[2][2]);
+    self->y_offset = full_range? 0: 16;
+    self->full_range = full_range;
+
+    // In full range pure blue and red would round up to 256, and overflow.
+    self->uv_round = (int16_t) (full_range? y_round - 1: y_round);
+
+    for (i = 0; i < 256; i++) {
+        for (j = 0; j < 3; j++) {
+            self->y[j][i] = self->coeffs[0][j] * i;
+            self->u[j][i] = self->coeffs[1][j] * i;
+            self->v[j][i] = self->coeffs[2][j] * i;
+        }
+
+        self->y[0][i] += (self->y_offset << AKVCAM_YUV_MATRIX_SHIFT) + y_round;
+        self->u[0][i] += uv_offset + self->uv_round;
+        self->v[0][i] += uv_offset + self->uv_round;
+    }
+
+    ky = (int32_t) akvcam_yuv_matrix_div(255 * one, y_levels);
+    kr_v = (int32_t) akvcam_yuv_matrix_div(2 * (10000 - kr) * 255 * one,
+                                           10000 * uv_levels);
+    kg_u = (int32_t) akvcam_yuv_matrix_div(2 * kb * (10000 - kb) * 255 * one,
+                                           10000 * kg * uv_levels);
+    kg_v = (int32_t) akvcam_yuv_matrix_div(2 * kr * (10000 - kr) * 255 * one,
+                                           10000 * kg * uv_levels);
+    kb_u = (int32_t) akvcam_yuv_matrix_div(2 * (10000 - kb) * 255 * one,
+                                           10000 * uv_levels);
+
+    for (i = 0; i < 256; i++) {
+        self->yuv_y[i] = ky * (i - self->y_offset) + y_round;
+        self->r_v[i] = kr_v * (i - 128);
+        self->g_u[i] = -kg_u * (i - 128);
+        self->g_v[i] = -kg_v * (i - 128);
+        self->b_u[i] = kb_u * (i - 128);
+    }
+}
@@ -0,0 +1,110 @@
+/* akvcam, virtual camera for Linux.
+ * Copyright (C) 2018  Gonzalo Exequiel Pedone
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AKVCAM_YUV_MATRIX_H
+#define AKVCAM_YUV_MATRIX_H
+
+#include <linux/types.h>
+
+#include "format_types.h"
+#include "utils.h"
+
+// Precision of the YUV matrix coefficients.
+#define AKVCAM_YUV_MATRIX_SHIFT 8
+
+// The coefficients of a YUV encoding and range, and the products of each
+// coefficient by all the possible values of a component, with the offsets
+// and the rounding already added. Converting a pixel just takes a lookup per
+// component and adding up the results.
+typedef struct
+{
+    // RGB to YUV coefficients, by Y, U and V first, and R, G and B second.
+    int16_t coeffs[3][3];
+
+    // The black level, and whether the luma goes up to 255 or just to 235.
+    int16_t y_offset;
+    bool full_range;
+    int16_t uv_round;
+
+    // RGB to YUV partial products, indexed by R, G and B.
+    int32_t y[3][256];
+    int32_t u[3][256];
+    int32_t v[3][256];
+
+    // YUV to RGB partial products, the luma one is shared by all components.
+    int32_t yuv_y[256];
+    int32_t r_v[256];
+    int32_t g_u[256];
+    int32_t g_v[256];
+    int32_t b_u[256];
+} akvcam_yuv_matrix, *akvcam_yuv_matrix_t;
+
+// public static
+void akvcam_yuv_matrix_init(void);
+const akvcam_yuv_matrix *akvcam_yuv_matrix_default(void);
+const akvcam_yuv_matrix *akvcam_yuv_matrix_from_format(const akvcam_format_t format);
+
+static inline uint8_t akvcam_rgb_y(const akvcam_yuv_matrix *matrix,
+                                   int r, int g, int b)
+{
+    return (uint8_t) ((matrix->y[0][r] + matrix->y[1][g] + matrix->y[2][b])
+                      >> AKVCAM_YUV_MATRIX_SHIFT);
+}
+
+static inline uint8_t akvcam_rgb_u(const akvcam_yuv_matrix *matrix,
+                                   int r, int g, int b)
+{
+    return (uint8_t) ((matrix->u[0][r] + matrix->u[1][g] + matrix->u[2][b])
+                      >> AKVCAM_YUV_MATRIX_SHIFT);
+}
+
+static inline uint8_t akvcam_rgb_v(const akvcam_yuv_matrix *matrix,
+                                   int r, int g, int b)
+{
+    return (uint8_t) ((matrix->v[0][r] + matrix->v[1][g] + matrix->v[2][b])
+                      >> AKVCAM_YUV_MATRIX_SHIFT);
+}
+
+static inline uint8_t akvcam_yuv_r(const akvcam_yuv_matrix *matrix,
+                                   int y, int u, int v)
+{
+    int r = (matrix->yuv_y[y] + matrix->r_v[v]) >> AKVCAM_YUV_MATRIX_SHIFT;
+    UNUSED(u);
+
+    return (uint8_t) (akvcam_bound(0, r, 255));
+}
+
+static inline uint8_t akvcam_yuv_g(const akvcam_yuv_matrix *matrix,
+                                   int y, int u, int v)
+{
+    int g = (matrix->yuv_y[y] + matrix->g_u[u] + matrix->g_v[v])
+            >> AKVCAM_YUV_MATRIX_SHIFT;
+
+    return (uint8_t) (akvcam_bound(0, g, 255));
+}
+
+static inline uint8_t akvcam_yuv_b(const akvcam_yuv_matrix *matrix,
+                                   int y, int u, int v)
+{
+    int b = (matrix->yuv_y[y] + matrix->b_u[u]) >> AKVCAM_YUV_MATRIX_SHIFT;
+    UNUSED(v);
+
+    return (uint8_t) (akvcam_bound(0, b, 255));
+}
+
+#endif // AKVCAM_YUV_MATRIX_H